@@ -0,0 +1,24 @@
+# - Find OpenH264
+# Find the OpenH264 video codec library
+#
+#  This module defines the following variables:
+#     OPENH264_FOUND        - true if OPENH264_INCLUDE_DIR & OPENH264_LIBRARY are found
+#     OPENH264_LIBRARIES    - Set when OPENH264_LIBRARY is found
+#     OPENH264_INCLUDE_DIRS - Set when OPENH264_INCLUDE_DIR is found
+#
+#     OPENH264_INCLUDE_DIR  - where to find wels/codec_api.h
+#     OPENH264_LIBRARY      - the OpenH264 library
+#
+
+find_path(OPENH264_INCLUDE_DIR NAMES wels/codec_api.h)
+
+find_library(OPENH264_LIBRARY NAMES openh264)
+
+find_package_handle_standard_args(OpenH264 DEFAULT_MSG OPENH264_LIBRARY OPENH264_INCLUDE_DIR)
+
+if(OPENH264_FOUND)
+	set(OPENH264_LIBRARIES ${OPENH264_LIBRARY})
+	set(OPENH264_INCLUDE_DIRS ${OPENH264_INCLUDE_DIR})
+endif()
+
+mark_as_advanced(OPENH264_INCLUDE_DIR OPENH264_LIBRARY)
@@ -0,0 +1,24 @@
+# - Find Zstd
+# Find the Zstandard compression library
+#
+#  This module defines the following variables:
+#     ZSTD_FOUND        - true if ZSTD_INCLUDE_DIR & ZSTD_LIBRARY are found
+#     ZSTD_LIBRARIES    - Set when ZSTD_LIBRARY is found
+#     ZSTD_INCLUDE_DIRS - Set when ZSTD_INCLUDE_DIR is found
+#
+#     ZSTD_INCLUDE_DIR  - where to find zstd.h
+#     ZSTD_LIBRARY      - the Zstandard library
+#
+
+find_path(ZSTD_INCLUDE_DIR NAMES zstd.h)
+
+find_library(ZSTD_LIBRARY NAMES zstd)
+
+find_package_handle_standard_args(Zstd DEFAULT_MSG ZSTD_LIBRARY ZSTD_INCLUDE_DIR)
+
+if(ZSTD_FOUND)
+	set(ZSTD_LIBRARIES ${ZSTD_LIBRARY})
+	set(ZSTD_INCLUDE_DIRS ${ZSTD_INCLUDE_DIR})
+endif()
+
+mark_as_advanced(ZSTD_INCLUDE_DIR ZSTD_LIBRARY)
@@ -0,0 +1,260 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <winsock2.h>
+#define errorNumber WSAGetLastError()
+#else
+#define errorNumber errno
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#endif
+
+/* Old systems have select() in sys/time.h */
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <network/EventLoop.h>
+#include <network/Socket.h>
+#include <rfb/Timer.h>
+#include <rfb/util.h>
+
+using namespace network;
+
+// How many events we pick up from the kernel at a time
+static const int MaxEvents = 64;
+
+#ifdef HAVE_SYS_EPOLL_H
+static uint32_t toEpollEvents(int events)
+{
+  uint32_t result;
+
+  result = 0;
+  if (events & EventLoop::EventRead)
+    result |= EPOLLIN;
+  if (events & EventLoop::EventWrite)
+    result |= EPOLLOUT;
+
+  return result;
+}
+#endif
+
+EventLoop::EventLoop()
+  : epollFd(-1)
+{
+#ifdef HAVE_SYS_EPOLL_H
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0)
+    throw SocketException("unable to create epoll instance", errno);
+#endif
+}
+
+EventLoop::~EventLoop()
+{
+#ifdef HAVE_SYS_EPOLL_H
+  close(epollFd);
+#endif
+}
+
+void EventLoop::addFd(int fd, int events, Handler* handler)
+{
+  Entry entry;
+
+  if (entries.find(fd) != entries.end())
+    throw rdr::Exception("EventLoop: fd %d is already registered", fd);
+
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = toEpollEvents(events);
+  ev.data.fd = fd;
+
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    throw SocketException("unable to add fd to epoll", errno);
+#endif
+
+  entry.events = events;
+  entry.handler = handler;
+
+  entries[fd] = entry;
+}
+
+void EventLoop::setEvents(int fd, int events)
+{
+  std::map<int, Entry>::iterator iter;
+
+  iter = entries.find(fd);
+  if (iter == entries.end())
+    throw rdr::Exception("EventLoop: fd %d is not registered", fd);
+
+  if (iter->second.events == events)
+    return;
+
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = toEpollEvents(events);
+  ev.data.fd = fd;
+
+  if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0)
+    throw SocketException("unable to modify fd in epoll", errno);
+#endif
+
+  iter->second.events = events;
+}
+
+void EventLoop::removeFd(int fd)
+{
+  std::map<int, Entry>::iterator iter;
+
+  iter = entries.find(fd);
+  if (iter == entries.end())
+    return;
+
+#ifdef HAVE_SYS_EPOLL_H
+  // Can fail if the fd has already been closed, which is harmless
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+
+  entries.erase(iter);
+}
+
+int EventLoop::wait(int timeout)
+{
+  int n;
+
+  rfb::soonestTimeout(&timeout, rfb::Timer::checkTimeouts());
+
+  ready.clear();
+
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event evs[MaxEvents];
+
+  n = epoll_wait(epollFd, evs, MaxEvents, timeout ? timeout : -1);
+  if (n < 0) {
+    if (errno == EINTR)
+      return 0;
+    throw SocketException("epoll_wait", errno);
+  }
+
+  for (int i = 0; i < n; i++) {
+    int events;
+
+    events = 0;
+    if (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+      events |= EventRead;
+    if (evs[i].events & EPOLLOUT)
+      events |= EventWrite;
+    if (evs[i].events & (EPOLLERR | EPOLLHUP))
+      events |= EventError;
+
+    ready.push_back(std::make_pair((int)evs[i].data.fd, events));
+  }
+#else
+  std::map<int, Entry>::iterator iter;
+  fd_set rfds, wfds;
+  struct timeval tv;
+  int maxFd;
+
+  FD_ZERO(&rfds);
+  FD_ZERO(&wfds);
+
+  maxFd = -1;
+  for (iter = entries.begin(); iter != entries.end(); ++iter) {
+    if (iter->second.events & EventRead)
+      FD_SET(iter->first, &rfds);
+    if (iter->second.events & EventWrite)
+      FD_SET(iter->first, &wfds);
+    if (iter->first > maxFd)
+      maxFd = iter->first;
+  }
+
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = (timeout % 1000) * 1000;
+
+  n = select(maxFd + 1, &rfds, &wfds, 0, timeout ? &tv : NULL);
+  if (n < 0) {
+    if (errorNumber == EINTR)
+      return 0;
+    throw SocketException("select", errorNumber);
+  }
+
+  for (iter = entries.begin(); (n > 0) && (iter != entries.end()); ++iter) {
+    int events;
+
+    events = 0;
+    if (FD_ISSET(iter->first, &rfds))
+      events |= EventRead;
+    if (FD_ISSET(iter->first, &wfds))
+      events |= EventWrite;
+
+    if (events == 0)
+      continue;
+
+    ready.push_back(std::make_pair(iter->first, events));
+    n--;
+  }
+#endif
+
+  return ready.size();
+}
+
+void EventLoop::dispatch()
+{
+  std::vector< std::pair<int, int> >::iterator iter;
+
+  for (iter = ready.begin(); iter != ready.end(); ++iter) {
+    std::map<int, Entry>::iterator entry;
+    int events;
+
+    // Handlers may remove other file descriptors as we go
+    entry = entries.find(iter->first);
+    if (entry == entries.end())
+      continue;
+
+    // epoll reports errors even if we didn't ask for anything, and
+    // will keep doing so until someone deals with them
+    events = iter->second & (entry->second.events | EventError);
+    if (events == 0)
+      continue;
+
+    entry->second.handler->handleEvent(iter->first, events);
+  }
+
+  ready.clear();
+}
+
+void EventLoop::processEvents(int timeout)
+{
+  wait(timeout);
+  dispatch();
+  rfb::Timer::checkTimeouts();
+}
@@ -0,0 +1,96 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+// -=- EventLoop.h - waits for activity on a set of file descriptors
+//     and dispatches it to registered handlers. Also runs any expired
+//     rfb::Timer.
+//
+//     epoll() is used where available, so the cost of waiting does
+//     not depend on the number of registered file descriptors. Other
+//     systems fall back to select().
+
+#ifndef __NETWORK_EVENT_LOOP_H__
+#define __NETWORK_EVENT_LOOP_H__
+
+#include <map>
+#include <vector>
+
+namespace network {
+
+  class EventLoop {
+  public:
+    enum {
+      EventRead = 1 << 0,
+      EventWrite = 1 << 1,
+      EventError = 1 << 2,
+    };
+
+    class Handler {
+    public:
+      virtual ~Handler() {}
+
+      // handleEvent() is called from dispatch() with the events that
+      // are ready on the given file descriptor. Errors and hang ups
+      // are reported as EventRead, and also as EventError whether it
+      // was asked for or not. The handler must deal with the file
+      // descriptor or remove it, as it will otherwise keep being
+      // reported. With select() errors only show up as EventRead or
+      // EventWrite.
+      virtual void handleEvent(int fd, int events) = 0;
+    };
+
+    EventLoop();
+    ~EventLoop();
+
+    // addFd() starts monitoring fd for the given events, setEvents()
+    // changes which ones, and removeFd() stops monitoring it. Remove
+    // a file descriptor before closing it.
+    void addFd(int fd, int events, Handler* handler);
+    void setEvents(int fd, int events);
+    void removeFd(int fd);
+
+    // wait() waits for events for at most timeout milliseconds, or
+    // until the next rfb::Timer is due. A timeout of zero means that
+    // there is no limit other than the timers. It returns the number
+    // of ready file descriptors, which is zero if interrupted by a
+    // signal.
+    int wait(int timeout);
+
+    // dispatch() calls the handlers for the events found by the
+    // last wait()
+    void dispatch();
+
+    // processEvents() does wait() and dispatch(), and then runs any
+    // rfb::Timer that has expired meanwhile
+    void processEvents(int timeout);
+
+  private:
+    struct Entry {
+      int events;
+      Handler* handler;
+    };
+
+    std::map<int, Entry> entries;
+    std::vector< std::pair<int, int> > ready;
+
+    int epollFd;
+  };
+
+}
+
+#endif // __NETWORK_EVENT_LOOP_H__
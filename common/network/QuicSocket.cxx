@@ -0,0 +1,1377 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <netdb.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <quiche/quiche.h>
+
+#include <network/QuicSocket.h>
+#include <os/Mutex.h>
+#include <rdr/sha1.h>
+#include <os/Thread.h>
+#include <rfb/Configuration.h>
+#include <rfb/LogWriter.h>
+#include <rfb/util.h>
+
+using namespace network;
+using namespace rdr;
+
+static rfb::LogWriter vlog("QuicSocket");
+
+static rfb::StringParameter quicCert("QUICCert",
+                                     "Path to the certificate (in PEM "
+                                     "format) used for QUIC connections",
+                                     "", rfb::ConfServer);
+static rfb::StringParameter quicKey("QUICKey",
+                                    "Path to the private key (in PEM "
+                                    "format) of the QUIC certificate",
+                                    "", rfb::ConfServer);
+
+// Largest UDP payload we send, which should fit on most paths
+static const size_t MaxDatagramSize = 1350;
+
+// Length of the connection ids we pick for ourselves
+static const size_t ConnIdLen = 16;
+
+// The single bidirectional stream that carries the RFB data
+static const uint64_t StreamId = 0;
+
+static const char ApplicationProto[] = "\x03" "rfb";
+
+// Per direction flow control limits
+static const uint64_t MaxStreamData = 16 * 1024 * 1024;
+
+// How long we wait for a handshake to complete, and for the peer to
+// finish its side of the stream once we've closed ours (in ms)
+static const int HandshakeTimeout = 10000;
+static const int LingerTimeout = 5000;
+
+// A connection is dropped if nothing is heard from the peer for this
+// long, so both ends send something well before then (in ms)
+static const int IdleTimeout = 30000;
+static const int KeepAliveInterval = 10000;
+
+// Keep-alives each use a new unidirectional stream
+static const uint64_t KeepAliveStreams = 16;
+
+// Limit on connections that have not yet been handed out, so that
+// clients that never finish their handshake cannot use up all memory
+static const size_t MaxHandshakes = 32;
+
+// Address validation tokens, which are sent in Retry packets
+static const uint8_t TokenMagic[8] = { 't', 'i', 'g', 'e', 'r', 'v', 'n', 'c' };
+static const size_t MaxTokenLen = 256;
+
+static void getRandomBytes(uint8_t* buf, size_t len)
+{
+  int fd;
+
+  fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw SocketException("unable to open /dev/urandom", errno);
+
+  while (len > 0) {
+    ssize_t n;
+
+    n = read(fd, buf, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      int e = (n < 0) ? errno : EIO;
+      close(fd);
+      throw SocketException("unable to read random data", e);
+    }
+
+    buf += n;
+    len -= n;
+  }
+
+  close(fd);
+}
+
+static uint64_t getMonotonicSeconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec;
+}
+
+static quiche_config* createConfig(bool server)
+{
+  quiche_config* config;
+
+  config = quiche_config_new(QUICHE_PROTOCOL_VERSION);
+  if (config == NULL)
+    throw Exception("unable to create QUIC configuration");
+
+  if (server) {
+    if (quicCert.getValueStr()[0] == '\0' ||
+        quicKey.getValueStr()[0] == '\0') {
+      quiche_config_free(config);
+      throw Exception("QUIC requires a certificate and a private key");
+    }
+
+    if ((quiche_config_load_cert_chain_from_pem_file(config, quicCert) < 0) ||
+        (quiche_config_load_priv_key_from_pem_file(config, quicKey) < 0)) {
+      quiche_config_free(config);
+      throw Exception("unable to load QUIC certificate or private key");
+    }
+  } else {
+    // Like with TCP, it is the RFB security types that authenticate
+    // the server
+    quiche_config_verify_peer(config, false);
+  }
+
+  quiche_config_set_application_protos(config,
+                                       (const uint8_t*)ApplicationProto,
+                                       sizeof(ApplicationProto) - 1);
+
+  // RFB connections can be idle for very long periods, so we rely on
+  // our own keep-alives, see QuicConnection::sendKeepAlive()
+  quiche_config_set_max_idle_timeout(config, IdleTimeout);
+
+  quiche_config_set_max_packet_size(config, MaxDatagramSize);
+  quiche_config_set_initial_max_data(config, MaxStreamData);
+  quiche_config_set_initial_max_stream_data_bidi_local(config, MaxStreamData);
+  quiche_config_set_initial_max_stream_data_bidi_remote(config, MaxStreamData);
+  quiche_config_set_initial_max_streams_bidi(config, 1);
+  quiche_config_set_initial_max_streams_uni(config, KeepAliveStreams);
+  quiche_config_set_initial_max_stream_data_uni(config, 0);
+  quiche_config_set_disable_active_migration(config, true);
+
+  return config;
+}
+
+namespace network {
+
+  //
+  // QuicConnection relays the data of one QUIC connection between
+  // quiche and the local end of a socket pair
+  //
+
+  class QuicConnection {
+  public:
+    QuicConnection(quiche_conn* conn, const uint8_t* cid,
+                   const struct sockaddr* peer, socklen_t peerlen,
+                   bool server);
+    ~QuicConnection();
+
+    void attach(int fd);
+
+    bool isReady();
+    bool isDone();
+
+    short pollEvents();
+    int timeout();
+
+    void readPackets(int sock);
+    void processPacket(uint8_t* buf, size_t len);
+    void handleTimeouts();
+    void process();
+    void flush(int sock);
+
+    void close();
+
+  private:
+    void sendKeepAlive();
+    void discardStreams();
+
+  public:
+    quiche_conn* conn;
+    uint8_t cid[ConnIdLen];
+    vnc_sockaddr_t peer;
+    socklen_t peerlen;
+    int fd;
+
+  private:
+    bool preambleSeen;
+    bool localEOF, remoteFin, localShut;
+    bool closing;
+    int linger;
+    struct timeval startTime;
+    struct timeval closeTime;
+
+    uint64_t nextKeepAliveStream;
+    struct timeval lastKeepAlive;
+
+    uint8_t toPeer[65536];
+    size_t toPeerPos, toPeerLen;
+    uint8_t toLocal[65536];
+    size_t toLocalPos, toLocalLen;
+  };
+
+  class QuicClientThread : public os::Thread {
+  public:
+    QuicClientThread(int sock, QuicConnection* conn);
+    ~QuicClientThread();
+
+  protected:
+    virtual void worker();
+
+  private:
+    int sock;
+    QuicConnection* conn;
+  };
+
+  class QuicServerThread : public os::Thread {
+  public:
+    QuicServerThread(int sock, int control, quiche_config* config);
+    ~QuicServerThread();
+
+    int getSock() { return sock; }
+
+    bool popPending(int* fd, vnc_sockaddr_t* peer, socklen_t* peerlen);
+
+  protected:
+    virtual void worker();
+
+    void readPackets();
+    void processPacket(uint8_t* buf, size_t len,
+                       const vnc_sockaddr_t& from, socklen_t fromlen);
+    void sendPacket(const uint8_t* buf, size_t len,
+                    const vnc_sockaddr_t& from, socklen_t fromlen);
+    void handOut(QuicConnection* conn);
+    size_t countHandshakes();
+
+  private:
+    int sock;
+    int control;
+    quiche_config* config;
+
+    QuicTokenSigner tokenSigner;
+
+    std::list<QuicConnection*> connections;
+
+    struct Pending {
+      int fd;
+      vnc_sockaddr_t peer;
+      socklen_t peerlen;
+    };
+
+    os::Mutex* mutex;
+    std::list<Pending> pending;
+  };
+
+}
+
+// -=- QuicConnection
+
+QuicConnection::QuicConnection(quiche_conn* conn_, const uint8_t* cid_,
+                               const struct sockaddr* peer_,
+                               socklen_t peerlen_, bool server)
+  : conn(conn_), peerlen(peerlen_), fd(-1),
+    preambleSeen(!server), localEOF(false), remoteFin(false),
+    localShut(false), closing(false),
+    // A viewer that goes away has no use for any further data
+    linger(server ? LingerTimeout : 0),
+    // Server initiated unidirectional streams have the lowest bits set
+    nextKeepAliveStream(server ? 3 : 2),
+    toPeerPos(0), toPeerLen(0), toLocalPos(0), toLocalLen(0)
+{
+  memcpy(cid, cid_, sizeof(cid));
+  memset(&peer, 0, sizeof(peer));
+  memcpy(&peer, peer_, peerlen);
+
+  gettimeofday(&startTime, NULL);
+}
+
+QuicConnection::~QuicConnection()
+{
+  if (fd != -1)
+    ::close(fd);
+  quiche_conn_free(conn);
+}
+
+void QuicConnection::attach(int fd_)
+{
+  fd = fd_;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  gettimeofday(&lastKeepAlive, NULL);
+}
+
+bool QuicConnection::isReady()
+{
+  return quiche_conn_is_established(conn) && preambleSeen;
+}
+
+bool QuicConnection::isDone()
+{
+  return closing || quiche_conn_is_closed(conn);
+}
+
+short QuicConnection::pollEvents()
+{
+  short events;
+
+  if (fd == -1)
+    return 0;
+
+  events = 0;
+  if (!localEOF && (toPeerPos == toPeerLen))
+    events |= POLLIN;
+  if (toLocalPos != toLocalLen)
+    events |= POLLOUT;
+
+  return events;
+}
+
+int QuicConnection::timeout()
+{
+  uint64_t timeout;
+
+  timeout = quiche_conn_timeout_as_millis(conn);
+
+  if (fd == -1) {
+    unsigned elapsed;
+
+    elapsed = rfb::msSince(&startTime);
+    if (elapsed >= (unsigned)HandshakeTimeout)
+      return 0;
+    if (timeout > (uint64_t)(HandshakeTimeout - elapsed))
+      timeout = HandshakeTimeout - elapsed;
+  } else if (!localEOF) {
+    unsigned elapsed;
+
+    elapsed = rfb::msSince(&lastKeepAlive);
+    if (elapsed >= (unsigned)KeepAliveInterval)
+      return 0;
+    if (timeout > (uint64_t)(KeepAliveInterval - elapsed))
+      timeout = KeepAliveInterval - elapsed;
+  }
+
+  if (localEOF) {
+    unsigned elapsed;
+
+    elapsed = rfb::msSince(&closeTime);
+    if (elapsed >= (unsigned)linger)
+      return 0;
+    if (timeout > (uint64_t)(linger - elapsed))
+      timeout = linger - elapsed;
+  }
+
+  if (timeout > INT_MAX)
+    return -1;
+
+  return timeout;
+}
+
+void QuicConnection::readPackets(int sock)
+{
+  uint8_t buf[65536];
+  ssize_t len;
+
+  while (true) {
+    len = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      // ICMP errors end up here for connected sockets, which we can
+      // ignore as QUIC will time out on its own
+      break;
+    }
+
+    processPacket(buf, len);
+  }
+}
+
+void QuicConnection::processPacket(uint8_t* buf, size_t len)
+{
+  ssize_t done;
+
+  done = quiche_conn_recv(conn, buf, len);
+  if ((done < 0) && (done != QUICHE_ERR_DONE))
+    vlog.debug("Failed to process QUIC packet: %d", (int)done);
+}
+
+void QuicConnection::handleTimeouts()
+{
+  if (quiche_conn_timeout_as_millis(conn) == 0)
+    quiche_conn_on_timeout(conn);
+
+  if ((fd == -1) && (rfb::msSince(&startTime) >= (unsigned)HandshakeTimeout)) {
+    vlog.debug("QUIC handshake timed out");
+    close();
+  }
+
+  if ((fd != -1) && !localEOF && !closing &&
+      (rfb::msSince(&lastKeepAlive) >= (unsigned)KeepAliveInterval))
+    sendKeepAlive();
+
+  if (localEOF && (rfb::msSince(&closeTime) >= (unsigned)linger))
+    close();
+}
+
+void QuicConnection::process()
+{
+  ssize_t len;
+
+  if (!quiche_conn_is_established(conn) || closing)
+    return;
+
+  discardStreams();
+
+  // Peer to local
+  while (true) {
+    if (toLocalPos == toLocalLen) {
+      bool fin;
+
+      if (remoteFin)
+        break;
+
+      fin = false;
+      len = quiche_conn_stream_recv(conn, StreamId,
+                                    toLocal, sizeof(toLocal), &fin);
+      if (len < 0)
+        break;
+
+      if (fin)
+        remoteFin = true;
+
+      toLocalPos = 0;
+      toLocalLen = len;
+
+      if (!preambleSeen && (len > 0)) {
+        preambleSeen = true;
+        toLocalPos = 1;
+      }
+
+      continue;
+    }
+
+    if (fd == -1)
+      break;
+
+    len = write(fd, toLocal + toLocalPos, toLocalLen - toLocalPos);
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        break;
+
+      // Nothing is reading the data, so no point in continuing
+      vlog.debug("Failed to write to local socket: %d", errno);
+      close();
+      return;
+    }
+
+    toLocalPos += len;
+  }
+
+  if (remoteFin && (toLocalPos == toLocalLen) && (fd != -1) && !localShut) {
+    ::shutdown(fd, SHUT_WR);
+    localShut = true;
+  }
+
+  // Local to peer
+  while ((fd != -1) && !localEOF) {
+    if (toPeerPos == toPeerLen) {
+      len = read(fd, toPeer, sizeof(toPeer));
+      if (len < 0) {
+        if (errno == EINTR)
+          continue;
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+          break;
+      }
+
+      if (len <= 0) {
+        localEOF = true;
+        gettimeofday(&closeTime, NULL);
+        quiche_conn_stream_send(conn, StreamId, toPeer, 0, true);
+        break;
+      }
+
+      toPeerPos = 0;
+      toPeerLen = len;
+    }
+
+    len = quiche_conn_stream_send(conn, StreamId, toPeer + toPeerPos,
+                                  toPeerLen - toPeerPos, false);
+    if (len == QUICHE_ERR_DONE)
+      break;
+    if (len < 0) {
+      vlog.error("Failed to send QUIC stream data: %d", (int)len);
+      close();
+      return;
+    }
+
+    toPeerPos += len;
+
+    // Flow control will let us know when there is more space
+    if (toPeerPos != toPeerLen)
+      break;
+  }
+
+  if (localEOF && remoteFin)
+    close();
+}
+
+void QuicConnection::flush(int sock)
+{
+  uint8_t out[MaxDatagramSize];
+  ssize_t len;
+
+  while (true) {
+    len = quiche_conn_send(conn, out, sizeof(out));
+    if (len == QUICHE_ERR_DONE)
+      break;
+    if (len < 0) {
+      vlog.error("Failed to create QUIC packet: %d", (int)len);
+      break;
+    }
+
+    // Lost packets are handled by QUIC itself
+    if (sendto(sock, out, len, 0, &peer.u.sa, peerlen) < 0)
+      vlog.debug("Failed to send QUIC packet: %d", errno);
+  }
+}
+
+void QuicConnection::sendKeepAlive()
+{
+  ssize_t len;
+
+  // This version of quiche has no way of sending a PING, so we open a
+  // new stream instead and immediately close it again. The peer just
+  // throws these away.
+  len = quiche_conn_stream_send(conn, nextKeepAliveStream,
+                                (const uint8_t*)"", 0, true);
+  if ((len < 0) && (len != QUICHE_ERR_DONE))
+    vlog.debug("Failed to send QUIC keep-alive: %d", (int)len);
+  else
+    nextKeepAliveStream += 4;
+
+  gettimeofday(&lastKeepAlive, NULL);
+}
+
+void QuicConnection::discardStreams()
+{
+  quiche_stream_iter* iter;
+  uint64_t id;
+
+  iter = quiche_conn_readable(conn);
+  if (iter == NULL)
+    return;
+
+  while (quiche_stream_iter_next(iter, &id)) {
+    uint8_t buf[256];
+    bool fin;
+
+    if (id == StreamId)
+      continue;
+
+    // Reading everything lets quiche free the stream and give the peer
+    // more credit for new ones
+    while (quiche_conn_stream_recv(conn, id, buf, sizeof(buf), &fin) > 0)
+      ;
+  }
+
+  quiche_stream_iter_free(iter);
+}
+
+void QuicConnection::close()
+{
+  if (closing)
+    return;
+
+  quiche_conn_close(conn, true, 0, (const uint8_t*)"", 0);
+  closing = true;
+}
+
+// -=- QuicClientThread
+
+QuicClientThread::QuicClientThread(int sock_, QuicConnection* conn_)
+  : sock(sock_), conn(conn_)
+{
+}
+
+QuicClientThread::~QuicClientThread()
+{
+  delete conn;
+  ::close(sock);
+}
+
+void QuicClientThread::worker()
+{
+  while (!conn->isDone()) {
+    struct pollfd fds[2];
+
+    fds[0].fd = sock;
+    fds[0].events = POLLIN;
+    fds[1].events = conn->pollEvents();
+    fds[1].fd = fds[1].events ? conn->fd : -1;
+
+    if (poll(fds, 2, conn->timeout()) < 0) {
+      if (errno == EINTR)
+        continue;
+      vlog.error("Failed to wait for QUIC events: %d", errno);
+      break;
+    }
+
+    if (fds[0].revents)
+      conn->readPackets(sock);
+
+    conn->handleTimeouts();
+    conn->process();
+    conn->flush(sock);
+  }
+
+  // Make sure the other end gets an EOF
+  if (conn->fd != -1)
+    ::shutdown(conn->fd, SHUT_RDWR);
+}
+
+// -=- QuicServerThread
+
+QuicServerThread::QuicServerThread(int sock_, int control_,
+                                   quiche_config* config_)
+  : sock(sock_), control(control_), config(config_)
+{
+  mutex = new os::Mutex();
+}
+
+QuicServerThread::~QuicServerThread()
+{
+  while (!connections.empty()) {
+    delete connections.front();
+    connections.pop_front();
+  }
+
+  while (!pending.empty()) {
+    ::close(pending.front().fd);
+    pending.pop_front();
+  }
+
+  delete mutex;
+
+  quiche_config_free(config);
+
+  ::close(control);
+  ::close(sock);
+}
+
+bool QuicServerThread::popPending(int* fd, vnc_sockaddr_t* peer,
+                                  socklen_t* peerlen)
+{
+  os::AutoMutex a(mutex);
+
+  if (pending.empty())
+    return false;
+
+  *fd = pending.front().fd;
+  *peer = pending.front().peer;
+  *peerlen = pending.front().peerlen;
+
+  pending.pop_front();
+
+  return true;
+}
+
+void QuicServerThread::worker()
+{
+  std::vector<struct pollfd> fds;
+  std::list<QuicConnection*>::iterator iter;
+
+  while (true) {
+    int timeout;
+
+    fds.resize(2);
+
+    fds[0].fd = control;
+    fds[0].events = POLLIN;
+    fds[1].fd = sock;
+    fds[1].events = POLLIN;
+
+    timeout = -1;
+    for (iter = connections.begin(); iter != connections.end(); ++iter) {
+      struct pollfd pfd;
+      int connTimeout;
+
+      connTimeout = (*iter)->timeout();
+      if ((connTimeout != -1) && ((timeout == -1) || (connTimeout < timeout)))
+        timeout = connTimeout;
+
+      pfd.events = (*iter)->pollEvents();
+      if (pfd.events == 0)
+        continue;
+
+      pfd.fd = (*iter)->fd;
+      fds.push_back(pfd);
+    }
+
+    if (poll(&fds[0], fds.size(), timeout) < 0) {
+      if (errno == EINTR)
+        continue;
+      vlog.error("Failed to wait for QUIC events: %d", errno);
+      break;
+    }
+
+    // The listener goes away by shutting down its end
+    if (fds[0].revents) {
+      char c;
+      if (read(control, &c, 1) <= 0)
+        break;
+    }
+
+    if (fds[1].revents)
+      readPackets();
+
+    iter = connections.begin();
+    while (iter != connections.end()) {
+      QuicConnection* conn;
+
+      conn = *iter;
+
+      conn->handleTimeouts();
+
+      if (conn->isReady() && (conn->fd == -1))
+        handOut(conn);
+
+      conn->process();
+      conn->flush(sock);
+
+      if (conn->isDone()) {
+        vlog.debug("QUIC connection closed");
+        delete conn;
+        iter = connections.erase(iter);
+        continue;
+      }
+
+      ++iter;
+    }
+  }
+
+  for (iter = connections.begin(); iter != connections.end(); ++iter) {
+    (*iter)->close();
+    (*iter)->flush(sock);
+  }
+}
+
+void QuicServerThread::readPackets()
+{
+  uint8_t buf[65536];
+  vnc_sockaddr_t from;
+  socklen_t fromlen;
+  ssize_t len;
+
+  while (true) {
+    memset(&from, 0, sizeof(from));
+    fromlen = sizeof(from);
+
+    len = recvfrom(sock, buf, sizeof(buf), MSG_DONTWAIT,
+                   &from.u.sa, &fromlen);
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    processPacket(buf, len, from, fromlen);
+  }
+}
+
+void QuicServerThread::processPacket(uint8_t* buf, size_t len,
+                                     const vnc_sockaddr_t& from,
+                                     socklen_t fromlen)
+{
+  uint32_t version;
+  uint8_t type;
+  uint8_t scid[QUICHE_MAX_CONN_ID_LEN];
+  size_t scid_len;
+  uint8_t dcid[QUICHE_MAX_CONN_ID_LEN];
+  size_t dcid_len;
+  uint8_t token[MaxTokenLen];
+  size_t token_len;
+
+  std::list<QuicConnection*>::iterator iter;
+  QuicConnection* conn;
+
+  uint8_t out[MaxDatagramSize];
+  ssize_t outlen;
+
+  scid_len = sizeof(scid);
+  dcid_len = sizeof(dcid);
+  token_len = sizeof(token);
+
+  if (quiche_header_info(buf, len, ConnIdLen, &version, &type,
+                         scid, &scid_len, dcid, &dcid_len,
+                         token, &token_len) < 0)
+    return;
+
+  conn = NULL;
+  for (iter = connections.begin(); iter != connections.end(); ++iter) {
+    if ((dcid_len == ConnIdLen) &&
+        (memcmp((*iter)->cid, dcid, ConnIdLen) == 0)) {
+      conn = *iter;
+      break;
+    }
+  }
+
+  if (conn == NULL) {
+    uint8_t odcid[QUICHE_MAX_CONN_ID_LEN];
+    size_t odcid_len;
+    quiche_conn* q;
+
+    if (!quiche_version_is_supported(version)) {
+      outlen = quiche_negotiate_version(scid, scid_len, dcid, dcid_len,
+                                        out, sizeof(out));
+      if (outlen > 0)
+        sendPacket(out, outlen, from, fromlen);
+      return;
+    }
+
+    // Make the client prove that it owns its address before we spend
+    // any resources on it
+    if (token_len == 0) {
+      uint8_t newcid[ConnIdLen];
+
+      token_len = tokenSigner.create(&from.u.sa, fromlen, dcid, dcid_len,
+                                     getMonotonicSeconds(),
+                                     token, sizeof(token));
+      if (token_len == 0)
+        return;
+
+      try {
+        getRandomBytes(newcid, sizeof(newcid));
+      } catch (Exception& e) {
+        vlog.error("%s", e.str());
+        return;
+      }
+
+      outlen = quiche_retry(scid, scid_len, dcid, dcid_len,
+                            newcid, sizeof(newcid), token, token_len,
+                            out, sizeof(out));
+      if (outlen > 0)
+        sendPacket(out, outlen, from, fromlen);
+      return;
+    }
+
+    if (!tokenSigner.validate(token, token_len, &from.u.sa, fromlen,
+                              getMonotonicSeconds(), odcid, &odcid_len)) {
+      vlog.debug("Ignoring QUIC packet with an invalid or expired token");
+      return;
+    }
+
+    // The client should now be using the id we gave it in the retry
+    if (dcid_len != ConnIdLen)
+      return;
+
+    if (countHandshakes() >= MaxHandshakes) {
+      vlog.debug("Too many QUIC handshakes in progress, ignoring new "
+                 "connection");
+      return;
+    }
+
+    q = quiche_accept(dcid, dcid_len, odcid, odcid_len, config);
+    if (q == NULL) {
+      vlog.error("Failed to create QUIC connection");
+      return;
+    }
+
+    conn = new QuicConnection(q, dcid, &from.u.sa, fromlen, true);
+    connections.push_back(conn);
+  }
+
+  conn->processPacket(buf, len);
+}
+
+size_t QuicServerThread::countHandshakes()
+{
+  std::list<QuicConnection*>::iterator iter;
+  size_t count;
+
+  count = 0;
+  for (iter = connections.begin(); iter != connections.end(); ++iter) {
+    if ((*iter)->fd == -1)
+      count++;
+  }
+
+  return count;
+}
+
+void QuicServerThread::sendPacket(const uint8_t* buf, size_t len,
+                                  const vnc_sockaddr_t& to,
+                                  socklen_t tolen)
+{
+  if (sendto(sock, buf, len, 0, &to.u.sa, tolen) < 0)
+    vlog.debug("Failed to send QUIC packet: %d", errno);
+}
+
+void QuicServerThread::handOut(QuicConnection* conn)
+{
+  int sv[2];
+  Pending p;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+    vlog.error("Failed to create socket pair: %d", errno);
+    conn->close();
+    return;
+  }
+
+  conn->attach(sv[0]);
+
+  p.fd = sv[1];
+  p.peer = conn->peer;
+  p.peerlen = conn->peerlen;
+
+  {
+    os::AutoMutex a(mutex);
+    pending.push_back(p);
+  }
+
+  // Wake up the main loop so that it calls accept()
+  if (write(control, "", 1) < 0)
+    vlog.error("Failed to signal new QUIC connection: %d", errno);
+}
+
+// -=- QuicTokenSigner
+
+QuicTokenSigner::QuicTokenSigner()
+{
+  getRandomBytes(key, sizeof(key));
+}
+
+QuicTokenSigner::~QuicTokenSigner()
+{
+  memset(key, 0, sizeof(key));
+}
+
+// The token is the magic, a timestamp, and the original destination
+// connection id, followed by a MAC that also covers the peer address
+size_t QuicTokenSigner::create(const struct sockaddr* peer,
+                               socklen_t peerlen,
+                               const uint8_t* odcid, size_t odcidLen,
+                               uint64_t now,
+                               uint8_t* token, size_t maxLen)
+{
+  size_t len;
+
+  if (odcidLen > QUICHE_MAX_CONN_ID_LEN)
+    return 0;
+
+  len = sizeof(TokenMagic) + 8 + 1 + odcidLen;
+  if (len + rdr::SHA1DigestSize > maxLen)
+    return 0;
+
+  memcpy(token, TokenMagic, sizeof(TokenMagic));
+  for (int i = 0; i < 8; i++)
+    token[sizeof(TokenMagic) + i] = now >> (56 - i * 8);
+  token[sizeof(TokenMagic) + 8] = odcidLen;
+  memcpy(token + sizeof(TokenMagic) + 8 + 1, odcid, odcidLen);
+
+  sign(token, len, peer, peerlen, token + len);
+
+  return len + rdr::SHA1DigestSize;
+}
+
+bool QuicTokenSigner::validate(const uint8_t* token, size_t tokenLen,
+                               const struct sockaddr* peer,
+                               socklen_t peerlen, uint64_t now,
+                               uint8_t* odcid, size_t* odcidLen)
+{
+  uint8_t mac[rdr::SHA1DigestSize];
+  uint8_t diff;
+  uint64_t timestamp;
+  size_t len;
+
+  if (tokenLen < sizeof(TokenMagic) + 8 + 1 + rdr::SHA1DigestSize)
+    return false;
+
+  if (memcmp(token, TokenMagic, sizeof(TokenMagic)) != 0)
+    return false;
+
+  len = sizeof(TokenMagic) + 8 + 1 + token[sizeof(TokenMagic) + 8];
+  if (token[sizeof(TokenMagic) + 8] > QUICHE_MAX_CONN_ID_LEN)
+    return false;
+  if (tokenLen != len + rdr::SHA1DigestSize)
+    return false;
+
+  // Constant time, so that the MAC cannot be guessed a byte at a time
+  sign(token, len, peer, peerlen, mac);
+  diff = 0;
+  for (size_t i = 0; i < sizeof(mac); i++)
+    diff |= mac[i] ^ token[len + i];
+  if (diff != 0)
+    return false;
+
+  timestamp = 0;
+  for (int i = 0; i < 8; i++)
+    timestamp = (timestamp << 8) | token[sizeof(TokenMagic) + i];
+
+  if ((timestamp > now) || (now - timestamp > Lifetime))
+    return false;
+
+  *odcidLen = token[sizeof(TokenMagic) + 8];
+  memcpy(odcid, token + sizeof(TokenMagic) + 8 + 1, *odcidLen);
+
+  return true;
+}
+
+void QuicTokenSigner::sign(const uint8_t* token, size_t tokenLen,
+                           const struct sockaddr* peer, socklen_t peerlen,
+                           uint8_t* mac)
+{
+  std::vector<uint8_t> data;
+
+  data.assign(token, token + tokenLen);
+  data.insert(data.end(), (const uint8_t*)peer,
+              (const uint8_t*)peer + peerlen);
+
+  rdr::hmacSHA1(key, sizeof(key), &data[0], data.size(), mac);
+}
+
+// -=- QuicSocket
+
+QuicSocket::QuicSocket(int sock, const struct sockaddr* peer_,
+                       socklen_t peerlen_)
+  : thread(NULL), peerlen(peerlen_)
+{
+  memcpy(&peer, peer_, peerlen);
+  setFd(sock);
+}
+
+QuicSocket::QuicSocket(const char *host, int port)
+  : thread(NULL)
+{
+  struct addrinfo *ai, hints;
+  char service[16];
+  char ntop[NI_MAXHOST];
+  int sock, result;
+  uint8_t scid[ConnIdLen];
+  quiche_config* config;
+  quiche_conn* q;
+  QuicConnection* conn;
+  struct timeval start;
+  int sv[2];
+
+  // - Look up the server
+
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_flags = AI_NUMERICSERV;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  snprintf(service, sizeof(service), "%d", port);
+  if ((result = getaddrinfo(host, service, &hints, &ai)) != 0)
+    throw GAIException("unable to resolve host by name", result);
+
+  memset(&peer, 0, sizeof(peer));
+  memcpy(&peer, ai->ai_addr, ai->ai_addrlen);
+  peerlen = ai->ai_addrlen;
+
+  freeaddrinfo(ai);
+
+  getnameinfo(&peer.u.sa, peerlen, ntop, sizeof(ntop), NULL, 0,
+              NI_NUMERICHOST);
+  vlog.debug("Connecting to %s [%s] port %d using QUIC", host, ntop, port);
+
+  // - Create the UDP socket
+
+  sock = socket(peer.u.sa.sa_family, SOCK_DGRAM, 0);
+  if (sock < 0)
+    throw SocketException("unable to create socket", errno);
+
+  fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+  // Connecting lets us see ICMP errors
+  if (connect(sock, &peer.u.sa, peerlen) < 0) {
+    int e = errno;
+    ::close(sock);
+    throw SocketException("unable to connect to socket", e);
+  }
+
+  // - Set up the QUIC connection
+
+  try {
+    getRandomBytes(scid, sizeof(scid));
+    config = createConfig(false);
+  } catch (Exception&) {
+    ::close(sock);
+    throw;
+  }
+
+  q = quiche_connect(host, scid, sizeof(scid), config);
+  quiche_config_free(config);
+  if (q == NULL) {
+    ::close(sock);
+    throw Exception("unable to create QUIC connection");
+  }
+
+  conn = new QuicConnection(q, scid, &peer.u.sa, peerlen, false);
+
+  // - Do the handshake
+
+  gettimeofday(&start, NULL);
+
+  conn->flush(sock);
+
+  while (!quiche_conn_is_established(q)) {
+    struct pollfd pfd;
+    int timeout;
+
+    if (conn->isDone() ||
+        (rfb::msSince(&start) >= (unsigned)HandshakeTimeout)) {
+      delete conn;
+      ::close(sock);
+      throw Exception("unable to establish QUIC connection");
+    }
+
+    timeout = HandshakeTimeout - rfb::msSince(&start);
+    if ((conn->timeout() != -1) && (conn->timeout() < timeout))
+      timeout = conn->timeout();
+
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+
+    if (poll(&pfd, 1, timeout) < 0) {
+      int e = errno;
+      if (e == EINTR)
+        continue;
+      delete conn;
+      ::close(sock);
+      throw SocketException("unable to wait for QUIC handshake", e);
+    }
+
+    if (pfd.revents)
+      conn->readPackets(sock);
+
+    conn->handleTimeouts();
+    conn->flush(sock);
+  }
+
+  // - Open the stream, see QuicSocket.h
+
+  quiche_conn_stream_send(q, StreamId, (const uint8_t*)"", 1, false);
+  conn->flush(sock);
+
+  // - Hand the connection over to a helper thread
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+    int e = errno;
+    delete conn;
+    ::close(sock);
+    throw SocketException("unable to create socket pair", e);
+  }
+
+  conn->attach(sv[0]);
+  setFd(sv[1]);
+
+  thread = new QuicClientThread(sock, conn);
+  thread->start();
+}
+
+QuicSocket::~QuicSocket()
+{
+  if (thread != NULL) {
+    // Closes our side of the stream, which ends the thread
+    ::shutdown(getFd(), SHUT_RDWR);
+    thread->wait();
+    delete thread;
+  }
+}
+
+bool QuicSocket::getPeerName(struct sockaddr* sa, socklen_t* salen)
+{
+  if (*salen > peerlen)
+    *salen = peerlen;
+  memcpy(sa, &peer, *salen);
+  *salen = peerlen;
+  return true;
+}
+
+// -=- QuicListener
+
+QuicListener::QuicListener(const struct sockaddr *listenaddr,
+                           socklen_t listenaddrlen)
+  : thread(NULL)
+{
+  int one = 1;
+  int sock;
+  int sv[2];
+  quiche_config* config;
+
+  config = createConfig(true);
+
+  if ((sock = socket(listenaddr->sa_family, SOCK_DGRAM, 0)) < 0) {
+    int e = errno;
+    quiche_config_free(config);
+    throw SocketException("unable to create listening socket", e);
+  }
+
+  if (listenaddr->sa_family == AF_INET6) {
+    if (setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (char*)&one, sizeof(one))) {
+      int e = errno;
+      ::close(sock);
+      quiche_config_free(config);
+      throw SocketException("unable to set IPV6_V6ONLY", e);
+    }
+  }
+
+  fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+  if (bind(sock, listenaddr, listenaddrlen) < 0) {
+    int e = errno;
+    ::close(sock);
+    quiche_config_free(config);
+    throw SocketException("failed to bind socket", e);
+  }
+
+  // The listener's file descriptor is one end of a socket pair that
+  // becomes readable whenever a new connection is established
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+    int e = errno;
+    ::close(sock);
+    quiche_config_free(config);
+    throw SocketException("unable to create socket pair", e);
+  }
+
+  fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+  fcntl(sv[1], F_SETFD, FD_CLOEXEC);
+
+  fd = sv[0];
+
+  try {
+    thread = new QuicServerThread(sock, sv[1], config);
+  } catch (Exception&) {
+    ::close(sv[0]);
+    ::close(sv[1]);
+    ::close(sock);
+    quiche_config_free(config);
+    throw;
+  }
+
+  thread->start();
+}
+
+QuicListener::~QuicListener()
+{
+  ::shutdown(fd, SHUT_RDWR);
+  thread->wait();
+  delete thread;
+}
+
+Socket* QuicListener::accept()
+{
+  char c;
+  int sock;
+  vnc_sockaddr_t peer;
+  socklen_t peerlen;
+  Socket* s;
+
+  if (read(fd, &c, 1) <= 0)
+    return NULL;
+
+  if (!thread->popPending(&sock, &peer, &peerlen))
+    return NULL;
+
+  // Create the socket object & check connection is allowed
+  s = new QuicSocket(sock, &peer.u.sa, peerlen);
+  if (filter && !filter->verifyConnection(s)) {
+    delete s;
+    return NULL;
+  }
+
+  return s;
+}
+
+int QuicListener::getMyPort()
+{
+  return getSockPort(thread->getSock());
+}
+
+Socket* QuicListener::createSocket(int /*fd*/)
+{
+  // Connections need their peer address, so accept() does it
+  throw Exception("QuicListener::createSocket: unsupported");
+}
+
+void network::createQuicListeners(std::list<SocketListener*> *listeners,
+                                  const char *addr,
+                                  int port)
+{
+  struct addrinfo *ai, *current, hints;
+  char service[16];
+  int result;
+  std::list<SocketListener*> new_listeners;
+
+  initSockets();
+
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  snprintf(service, sizeof(service), "%d", port);
+  if ((result = getaddrinfo(addr, service, &hints, &ai)) != 0)
+    throw GAIException("unable to resolve listening address", result);
+
+  for (current = ai; current != NULL; current = current->ai_next) {
+    if ((current->ai_family != AF_INET) && (current->ai_family != AF_INET6))
+      continue;
+
+    try {
+      new_listeners.push_back(new QuicListener(current->ai_addr,
+                                               current->ai_addrlen));
+    } catch (SocketException& e) {
+      // Ignore this if it is due to lack of address family support on
+      // the interface or on the system
+      if (e.err != EADDRNOTAVAIL && e.err != EAFNOSUPPORT) {
+        // Otherwise, report the error
+        while (!new_listeners.empty()) {
+          delete new_listeners.back();
+          new_listeners.pop_back();
+        }
+        freeaddrinfo(ai);
+        throw;
+      }
+    } catch (Exception&) {
+      while (!new_listeners.empty()) {
+        delete new_listeners.back();
+        new_listeners.pop_back();
+      }
+      freeaddrinfo(ai);
+      throw;
+    }
+  }
+
+  freeaddrinfo(ai);
+
+  if (new_listeners.empty ())
+    throw SocketException("createQuicListeners: no addresses available",
+                          EADDRNOTAVAIL);
+
+  listeners->splice (listeners->end(), new_listeners);
+}
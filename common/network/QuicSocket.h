@@ -0,0 +1,122 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+// -=- QuicSocket.h - stream sockets running over QUIC.
+//     This header also defines the QuicListener class, used
+//     to listen for incoming QUIC connections over UDP
+//
+//     The QUIC protocol itself is handled by a helper thread, which
+//     relays the data of a single bidirectional stream to one end of
+//     a local socket pair. The other end is what the Socket object
+//     uses, so that everything above can keep treating the connection
+//     as a normal file descriptor.
+//
+//     The client opens stream 0 by sending a single zero byte before
+//     any RFB data, as the server speaks first in RFB but is not
+//     allowed to start a client initiated stream.
+
+#ifndef __NETWORK_QUIC_SOCKET_H__
+#define __NETWORK_QUIC_SOCKET_H__
+
+#include <stdint.h>
+
+#include <network/TcpSocket.h>
+
+#include <list>
+
+namespace os { class Mutex; }
+
+namespace network {
+
+  class QuicClientThread;
+  class QuicServerThread;
+
+  class QuicSocket : public TcpSocket {
+  public:
+    QuicSocket(const char *name, int port);
+    virtual ~QuicSocket();
+
+    virtual bool getPeerName(struct sockaddr* sa, socklen_t* salen);
+
+  protected:
+    friend class QuicListener;
+    QuicSocket(int sock, const struct sockaddr* peer, socklen_t peerlen);
+
+  private:
+    QuicClientThread* thread;
+    vnc_sockaddr_t peer;
+    socklen_t peerlen;
+  };
+
+  class QuicListener : public SocketListener {
+  public:
+    QuicListener(const struct sockaddr *listenaddr, socklen_t listenaddrlen);
+    virtual ~QuicListener();
+
+    virtual Socket* accept();
+
+    virtual int getMyPort();
+
+  protected:
+    virtual Socket* createSocket(int fd);
+
+  private:
+    QuicServerThread* thread;
+  };
+
+  // QuicTokenSigner creates and checks the address validation tokens
+  // that are sent in Retry packets. They are signed with a random key
+  // that never leaves the process, and are only valid for a short
+  // while.
+
+  class QuicTokenSigner {
+  public:
+    QuicTokenSigner();
+    ~QuicTokenSigner();
+
+    // create() returns the length of the token, or 0 if it doesn't
+    // fit. now is in seconds, on any clock that doesn't jump.
+    size_t create(const struct sockaddr* peer, socklen_t peerlen,
+                  const uint8_t* odcid, size_t odcidLen, uint64_t now,
+                  uint8_t* token, size_t maxLen);
+
+    // validate() checks that the token was made by this signer for the
+    // given address, and hasn't expired. The original destination
+    // connection id is returned in odcid, which must have room for
+    // QUICHE_MAX_CONN_ID_LEN bytes.
+    bool validate(const uint8_t* token, size_t tokenLen,
+                  const struct sockaddr* peer, socklen_t peerlen,
+                  uint64_t now, uint8_t* odcid, size_t* odcidLen);
+
+    static const unsigned Lifetime = 10;
+
+  private:
+    void sign(const uint8_t* token, size_t tokenLen,
+              const struct sockaddr* peer, socklen_t peerlen,
+              uint8_t* mac);
+
+    uint8_t key[32];
+  };
+
+  void createQuicListeners(std::list<SocketListener*> *listeners,
+                           const char *addr,
+                           int port);
+
+}
+
+#endif // __NETWORK_QUIC_SOCKET_H__
@@ -87,8 +87,14 @@ Socket::Socket()
 
 Socket::~Socket()
 {
-  if (instream && outstream)
+  if (instream && outstream) {
+    // Nothing else may be using the fd once it is closed
+    outstream->setSendThread(NULL);
+    // The kernel can't tell us when it is done with our buffers after
+    // this
+    outstream->waitZeroCopy(1000);
     closesocket(getFd());
+  }
   delete instream;
   delete outstream;
 }
@@ -100,6 +106,11 @@ void Socket::shutdown()
   ::shutdown(getFd(), SHUT_RDWR);
 }
 
+bool Socket::getPeerName(struct sockaddr* sa, socklen_t* salen)
+{
+  return getpeername(getFd(), sa, salen) == 0;
+}
+
 bool Socket::isShutdown() const
 {
   return isShutdown_;
@@ -24,6 +24,14 @@
 #include <list>
 
 #include <limits.h>
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h> /* for socklen_t */
+#endif
+
 #include <rdr/FdInStream.h>
 #include <rdr/FdOutStream.h>
 #include <rdr/Exception.h>
@@ -48,10 +56,22 @@ namespace network {
 
     void cork(bool enable) { outstream->cork(enable); }
 
+    // Streams for the data carried by the socket. These differ from
+    // the above if the data is wrapped in some other protocol.
+    virtual rdr::InStream &dataInStream() {return *instream;}
+    virtual rdr::OutStream &dataOutStream() {return *outstream;}
+
+    // Is there data in any of the above that hasn't been sent yet?
+    virtual bool hasBufferedData() {return outstream->hasBufferedData();}
+
     // information about the remote end of the socket
     virtual char* getPeerAddress() = 0; // a string e.g. "192.168.0.1"
     virtual char* getPeerEndpoint() = 0; // <address>::<port>
 
+    // getPeerName() is getpeername() for the remote end, which might
+    // not be what the file descriptor is connected to
+    virtual bool getPeerName(struct sockaddr* sa, socklen_t* salen);
+
     // Was there a "?" in the ConnectionFilter used to accept this Socket?
     void setRequiresQuery();
     bool requiresQuery() const;
@@ -85,7 +105,7 @@ namespace network {
     // accept() returns a new Socket object if there is a connection
     // attempt in progress AND if the connection passes the filter
     // if one is installed.  Otherwise, returns 0.
-    Socket* accept();
+    virtual Socket* accept();
 
     virtual int getMyPort() = 0;
 
@@ -39,6 +39,7 @@
 #include <unistd.h>
 
 #include <network/TcpSocket.h>
+#include <network/WebSocket.h>
 #include <rfb/LogWriter.h>
 #include <rfb/Configuration.h>
 
@@ -70,6 +71,14 @@ static rfb::LogWriter vlog("TcpSocket");
 
 static rfb::BoolParameter UseIPv4("UseIPv4", "Use IPv4 for incoming and outgoing connections.", true);
 static rfb::BoolParameter UseIPv6("UseIPv6", "Use IPv6 for incoming and outgoing connections.", true);
+static rfb::IntParameter TCPNotSentLowat("TCPNotSentLowat",
+                                         "Only report the socket as writable when "
+                                         "less than this many bytes are waiting to be "
+                                         "sent (0 = no limit)", 0, 0,
+                                         64*1024*1024);
+static rfb::BoolParameter TCPZeroCopy("TCPZeroCopy",
+                                      "Avoid copying large updates when sending "
+                                      "them, if supported by the system", false);
 
 /* Tunnelling support. */
 int network::findFreeTcpPort (void)
@@ -116,6 +125,12 @@ TcpSocket::TcpSocket(int sock) : Socket(sock)
 {
   // Disable Nagle's algorithm, to reduce latency
   enableNagles(false);
+
+  setSendOptions();
+}
+
+TcpSocket::TcpSocket()
+{
 }
 
 TcpSocket::TcpSocket(const char *host, int port)
@@ -209,13 +224,15 @@ TcpSocket::TcpSocket(const char *host, int port)
 
   // Disable Nagle's algorithm, to reduce latency
   enableNagles(false);
+
+  setSendOptions();
 }
 
 char* TcpSocket::getPeerAddress() {
   vnc_sockaddr_t sa;
   socklen_t sa_size = sizeof(sa);
 
-  if (getpeername(getFd(), &sa.u.sa, &sa_size) != 0) {
+  if (!getPeerName(&sa.u.sa, &sa_size)) {
     vlog.error("unable to get peer name for socket");
     return rfb::strDup("");
   }
@@ -261,7 +278,8 @@ char* TcpSocket::getPeerEndpoint() {
   socklen_t sa_size = sizeof(sa);
   int port;
 
-  getpeername(getFd(), &sa.u.sa, &sa_size);
+  if (!getPeerName(&sa.u.sa, &sa_size))
+    sa.u.sa.sa_family = AF_UNSPEC;
 
   if (sa.u.sa.sa_family == AF_INET6)
     port = ntohs(sa.u.sin6.sin6_port);
@@ -287,12 +305,34 @@ bool TcpSocket::enableNagles(bool enable) {
   return true;
 }
 
-TcpListener::TcpListener(int sock) : SocketListener(sock)
+void TcpSocket::setSendOptions() {
+#ifdef TCP_NOTSENT_LOWAT
+  // Keep stale data out of the kernel's buffers, so that we can
+  // adapt what we send to how fast it is actually going out
+  if (TCPNotSentLowat > 0) {
+    int lowat = TCPNotSentLowat;
+    if (setsockopt(getFd(), IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+                   (char *)&lowat, sizeof(lowat)) < 0) {
+      int e = errorNumber;
+      vlog.error("unable to setsockopt TCP_NOTSENT_LOWAT: %d", e);
+    }
+  }
+#endif
+
+  if (TCPZeroCopy) {
+    if (!outStream().enableZeroCopy())
+      vlog.info("Zero copy sending is not supported on this system");
+  }
+}
+
+TcpListener::TcpListener(int sock)
+  : SocketListener(sock), webSocket(false)
 {
 }
 
 TcpListener::TcpListener(const struct sockaddr *listenaddr,
                          socklen_t listenaddrlen)
+  : webSocket(false)
 {
   int one = 1;
   vnc_sockaddr_t sa;
@@ -339,6 +379,8 @@ TcpListener::TcpListener(const struct sockaddr *listenaddr,
 }
 
 Socket* TcpListener::createSocket(int fd) {
+  if (webSocket)
+    return new WebSocket(fd);
   return new TcpSocket(fd);
 }
 
@@ -573,7 +615,7 @@ TcpFilter::verifyConnection(Socket* s) {
   vnc_sockaddr_t sa;
   socklen_t sa_size = sizeof(sa);
 
-  if (getpeername(s->getFd(), &sa.u.sa, &sa_size) != 0)
+  if (!s->getPeerName(&sa.u.sa, &sa_size))
     return false;
 
   name.buf = s->getPeerAddress();
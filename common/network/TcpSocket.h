@@ -59,7 +59,10 @@ namespace network {
     virtual char* getPeerEndpoint();
 
   protected:
+    TcpSocket();
+
     bool enableNagles(bool enable);
+    void setSendOptions();
   };
 
   class TcpListener : public SocketListener {
@@ -71,8 +74,14 @@ namespace network {
 
     static void getMyAddresses(std::list<char*>* result);
 
+    // setWebSocket() makes new connections expect WebSockets
+    void setWebSocket(bool enable) { webSocket = enable; }
+
   protected:
     virtual Socket* createSocket(int fd);
+
+  private:
+    bool webSocket;
   };
 
   void createLocalTcpListeners(std::list<SocketListener*> *listeners,
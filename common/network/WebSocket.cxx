@@ -0,0 +1,95 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <network/WebSocket.h>
+#include <rdr/WebSocketInStream.h>
+#include <rdr/WebSocketOutStream.h>
+#include <rfb/Configuration.h>
+#include <rfb/util.h>
+
+using namespace network;
+
+static rfb::StringParameter WebSocketOrigins("WebSocketOrigins",
+                                             "Comma separated list of web page "
+                                             "origins that may connect using "
+                                             "WebSockets (empty = any)", "");
+
+WebSocket::WebSocket(int sock) : TcpSocket(sock)
+{
+  wsos = new rdr::WebSocketOutStream(&outStream());
+  wsis = new rdr::WebSocketInStream(&inStream(), &outStream(), wsos);
+
+  rfb::CharArray origins(WebSocketOrigins.getData());
+  wsis->setAllowedOrigins(origins.buf);
+}
+
+WebSocket::~WebSocket()
+{
+  delete wsis;
+  delete wsos;
+}
+
+rdr::InStream &WebSocket::dataInStream()
+{
+  return *wsis;
+}
+
+rdr::OutStream &WebSocket::dataOutStream()
+{
+  return *wsos;
+}
+
+bool WebSocket::hasBufferedData()
+{
+  return wsos->hasBufferedData() || TcpSocket::hasBufferedData();
+}
+
+static void setWebSocket(std::list<SocketListener*> *listeners)
+{
+  std::list<SocketListener*>::iterator i;
+
+  for (i = listeners->begin(); i != listeners->end(); ++i)
+    static_cast<TcpListener*>(*i)->setWebSocket(true);
+}
+
+void network::createLocalWebSocketListeners(std::list<SocketListener*> *listeners,
+                                            int port)
+{
+  std::list<SocketListener*> new_listeners;
+
+  createLocalTcpListeners(&new_listeners, port);
+  setWebSocket(&new_listeners);
+
+  listeners->splice(listeners->end(), new_listeners);
+}
+
+void network::createWebSocketListeners(std::list<SocketListener*> *listeners,
+                                       const char *addr,
+                                       int port)
+{
+  std::list<SocketListener*> new_listeners;
+
+  createTcpListeners(&new_listeners, addr, port);
+  setWebSocket(&new_listeners);
+
+  listeners->splice(listeners->end(), new_listeners);
+}
@@ -0,0 +1,59 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+// -=- WebSocket.h - TCP connections where the data is wrapped in the
+//     WebSocket protocol, as used by browser based clients.
+
+#ifndef __NETWORK_WEBSOCKET_H__
+#define __NETWORK_WEBSOCKET_H__
+
+#include <list>
+
+#include <network/TcpSocket.h>
+
+namespace rdr {
+  class WebSocketInStream;
+  class WebSocketOutStream;
+}
+
+namespace network {
+
+  class WebSocket : public TcpSocket {
+  public:
+    WebSocket(int sock);
+    virtual ~WebSocket();
+
+    virtual rdr::InStream &dataInStream();
+    virtual rdr::OutStream &dataOutStream();
+
+    virtual bool hasBufferedData();
+
+  private:
+    rdr::WebSocketInStream* wsis;
+    rdr::WebSocketOutStream* wsos;
+  };
+
+  void createLocalWebSocketListeners(std::list<SocketListener*> *listeners,
+                                     int port);
+  void createWebSocketListeners(std::list<SocketListener*> *listeners,
+                                const char *addr,
+                                int port);
+
+}
+
+#endif // __NETWORK_WEBSOCKET_H__
@@ -29,17 +29,26 @@ using namespace rdr;
 static const size_t DEFAULT_BUF_SIZE = 8192;
 static const size_t MAX_BUF_SIZE = 4 * 1024 * 1024;
 
+// The memory of the buffer is reference counted, as retained data
+// might still be in use after we've moved on to a new buffer
+struct BufferedInStream::Buffer {
+  U8* data;
+  unsigned refs;
+};
+
 BufferedInStream::BufferedInStream()
-  : bufSize(DEFAULT_BUF_SIZE), offset(0)
+  : bufSize(DEFAULT_BUF_SIZE), offset(0), retainPoint(NULL)
 {
-  ptr = end = start = new U8[bufSize];
+  buffer = allocBuffer(bufSize);
+  ptr = end = start = buffer->data;
   gettimeofday(&lastSizeCheck, NULL);
   peakUsage = 0;
 }
 
 BufferedInStream::~BufferedInStream()
 {
-  delete [] start;
+  clearRetainPoint();
+  unrefBuffer(buffer);
 }
 
 size_t BufferedInStream::pos()
@@ -47,13 +56,78 @@ size_t BufferedInStream::pos()
   return offset + ptr - start;
 }
 
+void BufferedInStream::setRetainPoint()
+{
+  clearRetainPoint();
+  retainPoint = ptr;
+}
+
+void BufferedInStream::clearRetainPoint()
+{
+  std::vector<Piece>::iterator iter;
+
+  for (iter = retainedPieces.begin(); iter != retainedPieces.end(); ++iter)
+    unrefBuffer(iter->buffer);
+  retainedPieces.clear();
+
+  retainPoint = NULL;
+}
+
+const U8* BufferedInStream::retainData(size_t* length, void** handle)
+{
+  std::vector<Piece>::iterator iter;
+  Buffer* copy;
+  U8* out;
+
+  if (retainPoint == NULL)
+    throw Exception("BufferedInStream: no retain point set");
+
+  // Still all in the current buffer?
+  if (retainedPieces.empty()) {
+    const U8* data;
+
+    refBuffer(buffer);
+    *handle = buffer;
+
+    data = retainPoint;
+    *length = ptr - retainPoint;
+
+    retainPoint = NULL;
+
+    return data;
+  }
+
+  // Otherwise we have to piece it together
+  *length = ptr - retainPoint;
+  for (iter = retainedPieces.begin(); iter != retainedPieces.end(); ++iter)
+    *length += iter->length;
+
+  copy = allocBuffer(*length);
+  *handle = copy;
+
+  out = copy->data;
+  for (iter = retainedPieces.begin(); iter != retainedPieces.end(); ++iter) {
+    memcpy(out, iter->data, iter->length);
+    out += iter->length;
+  }
+  memcpy(out, retainPoint, ptr - retainPoint);
+
+  clearRetainPoint();
+
+  return copy->data;
+}
+
+void BufferedInStream::releaseData(void* handle)
+{
+  unrefBuffer((Buffer*)handle);
+}
+
 bool BufferedInStream::overrun(size_t needed)
 {
   struct timeval now;
 
   if (needed > bufSize) {
     size_t newSize;
-    U8* newBuffer;
 
     if (needed > MAX_BUF_SIZE)
       throw Exception("BufferedInStream overrun: requested size of "
@@ -64,14 +138,7 @@ bool BufferedInStream::overrun(size_t needed)
     while (newSize < needed)
       newSize *= 2;
 
-    newBuffer = new U8[newSize];
-    memcpy(newBuffer, ptr, end - ptr);
-    delete [] start;
-    bufSize = newSize;
-
-    offset += ptr - start;
-    end = newBuffer + (end - ptr);
-    ptr = start = newBuffer;
+    replaceBuffer(newSize);
 
     gettimeofday(&lastSizeCheck, NULL);
     peakUsage = needed;
@@ -92,10 +159,7 @@ bool BufferedInStream::overrun(size_t needed)
       while (newSize < peakUsage)
         newSize *= 2;
 
-      // We know the buffer is empty, so just reset everything
-      delete [] start;
-      ptr = end = start = new U8[newSize];
-      bufSize = newSize;
+      replaceBuffer(newSize);
     }
 
     gettimeofday(&lastSizeCheck, NULL);
@@ -104,11 +168,21 @@ bool BufferedInStream::overrun(size_t needed)
 
   // Do we need to shuffle things around?
   if ((bufSize - (ptr - start)) < needed) {
-    memmove(start, ptr, end - ptr);
+    cutRetained();
+
+    // Can't touch memory someone else is still using
+    if (isBufferShared()) {
+      replaceBuffer(bufSize);
+    } else {
+      memmove(start, ptr, end - ptr);
 
-    offset += ptr - start;
-    end -= ptr - start;
-    ptr = start;
+      offset += ptr - start;
+      end -= ptr - start;
+      ptr = start;
+
+      if (retainPoint != NULL)
+        retainPoint = ptr;
+    }
   }
 
   while (avail() < needed) {
@@ -118,3 +192,83 @@ bool BufferedInStream::overrun(size_t needed)
 
   return true;
 }
+
+BufferedInStream::Buffer* BufferedInStream::allocBuffer(size_t size)
+{
+  Buffer* buffer;
+
+  buffer = new Buffer;
+  buffer->data = new U8[size];
+  buffer->refs = 1;
+
+  return buffer;
+}
+
+void BufferedInStream::refBuffer(Buffer* buffer)
+{
+  __atomic_add_fetch(&buffer->refs, 1, __ATOMIC_RELAXED);
+}
+
+void BufferedInStream::unrefBuffer(Buffer* buffer)
+{
+  if (__atomic_sub_fetch(&buffer->refs, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
+
+  delete [] buffer->data;
+  delete buffer;
+}
+
+bool BufferedInStream::isBufferShared()
+{
+  return __atomic_load_n(&buffer->refs, __ATOMIC_ACQUIRE) > 1;
+}
+
+//
+// replaceBuffer() moves the unread data over to a new buffer of the
+// given size.
+//
+
+void BufferedInStream::replaceBuffer(size_t size)
+{
+  Buffer* newBuffer;
+
+  cutRetained();
+
+  newBuffer = allocBuffer(size);
+  memcpy(newBuffer->data, ptr, end - ptr);
+  unrefBuffer(buffer);
+  buffer = newBuffer;
+  bufSize = size;
+
+  offset += ptr - start;
+  end = newBuffer->data + (end - ptr);
+  ptr = start = newBuffer->data;
+
+  if (retainPoint != NULL)
+    retainPoint = ptr;
+}
+
+//
+// cutRetained() is called before data is moved, and keeps hold of the
+// retained data that has already been read.
+//
+
+void BufferedInStream::cutRetained()
+{
+  Piece piece;
+
+  if (retainPoint == NULL)
+    return;
+
+  if (ptr == retainPoint)
+    return;
+
+  piece.buffer = buffer;
+  piece.data = retainPoint;
+  piece.length = ptr - retainPoint;
+
+  refBuffer(buffer);
+  retainedPieces.push_back(piece);
+
+  retainPoint = ptr;
+}
@@ -26,6 +26,8 @@
 
 #include <sys/time.h>
 
+#include <vector>
+
 #include <rdr/InStream.h>
 
 namespace rdr {
@@ -37,15 +39,49 @@ namespace rdr {
 
     virtual size_t pos();
 
+    // setRetainPoint() marks the start of some data that the caller
+    // wants to keep using after it has been read. retainData() then
+    // returns everything read since, in one piece. This is done
+    // without copying anything, unless the buffer had to be refilled
+    // in between. The data stays valid until releaseData() has been
+    // called with the returned handle, which can be done from any
+    // thread.
+
+    void setRetainPoint();
+    void clearRetainPoint();
+    const U8* retainData(size_t* length, void** handle);
+    static void releaseData(void* handle);
+
   private:
     virtual bool fillBuffer(size_t maxSize) = 0;
 
     virtual bool overrun(size_t needed);
 
+    struct Buffer;
+
+    static Buffer* allocBuffer(size_t size);
+    static void refBuffer(Buffer* buffer);
+    static void unrefBuffer(Buffer* buffer);
+    bool isBufferShared();
+
+    void replaceBuffer(size_t size);
+    void cutRetained();
+
   private:
     size_t bufSize;
     size_t offset;
     U8* start;
+    Buffer* buffer;
+
+    // Retained data that was left behind in earlier buffers
+    struct Piece {
+      Buffer* buffer;
+      const U8* data;
+      size_t length;
+    };
+
+    const U8* retainPoint;
+    std::vector<Piece> retainedPieces;
 
     struct timeval lastSizeCheck;
     size_t peakUsage;
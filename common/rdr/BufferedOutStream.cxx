@@ -31,8 +31,12 @@ using namespace rdr;
 static const size_t DEFAULT_BUF_SIZE = 16384;
 static const size_t MAX_BUF_SIZE = 32 * 1024 * 1024;
 
+// Anything smaller is cheaper to just copy
+static const size_t MIN_CHAIN_SIZE = 8192;
+
 BufferedOutStream::BufferedOutStream()
-  : bufSize(DEFAULT_BUF_SIZE), offset(0)
+  : chainBuffers(false), bufSize(DEFAULT_BUF_SIZE), offset(0),
+    chunkedAhead(0), chunkedPending(0)
 {
   ptr = start = sentUpTo = new U8[bufSize];
   end = start + bufSize;
@@ -44,26 +48,31 @@ BufferedOutStream::~BufferedOutStream()
 {
   // FIXME: Complain about non-flushed buffer?
   delete [] start;
+
+  while (!chunks.empty()) {
+    delete [] chunks.front().data;
+    chunks.pop_front();
+  }
 }
 
 size_t BufferedOutStream::length()
 {
-  return offset + ptr - sentUpTo;
+  return offset + ptr - sentUpTo + chunkedPending;
 }
 
 void BufferedOutStream::flush()
 {
   struct timeval now;
 
-  while (sentUpTo < ptr) {
+  while (hasBufferedData()) {
     size_t len;
 
-    len = (ptr - sentUpTo);
+    len = (ptr - sentUpTo) + chunkedPending;
 
     if (!flushBuffer())
       break;
 
-    offset += len - (ptr - sentUpTo);
+    offset += len - ((ptr - sentUpTo) + chunkedPending);
   }
 
   // Managed to flush everything?
@@ -94,9 +103,130 @@ void BufferedOutStream::flush()
   }
 }
 
+bool BufferedOutStream::canAdoptBuffer(size_t length)
+{
+  return chainBuffers && (length >= MIN_CHAIN_SIZE);
+}
+
+void BufferedOutStream::adoptBuffer(U8* data, size_t length)
+{
+  Chunk chunk;
+
+  if (!canAdoptBuffer(length)) {
+    OutStream::adoptBuffer(data, length);
+    return;
+  }
+
+  chunk.ahead = (ptr - sentUpTo) - chunkedAhead;
+  chunk.data = data;
+  chunk.length = length;
+  chunk.sent = 0;
+
+  chunks.push_back(chunk);
+
+  chunkedAhead += chunk.ahead;
+  chunkedPending += length;
+}
+
 bool BufferedOutStream::hasBufferedData()
 {
-  return sentUpTo != ptr;
+  return (sentUpTo != ptr) || !chunks.empty();
+}
+
+size_t BufferedOutStream::getPending(Segment* segments, size_t maxSegments)
+{
+  std::list<Chunk>::const_iterator iter;
+  const U8* data;
+  size_t count;
+
+  data = sentUpTo;
+  count = 0;
+
+  for (iter = chunks.begin(); iter != chunks.end(); ++iter) {
+    if (iter->ahead > 0) {
+      if (count == maxSegments)
+        return count;
+      segments[count].data = data;
+      segments[count].length = iter->ahead;
+      segments[count].buffer = NULL;
+      data += iter->ahead;
+      count++;
+    }
+
+    if (count == maxSegments)
+      return count;
+    segments[count].data = iter->data + iter->sent;
+    segments[count].length = iter->length - iter->sent;
+    segments[count].buffer = iter->data;
+    count++;
+  }
+
+  if ((data < ptr) && (count < maxSegments)) {
+    segments[count].data = data;
+    segments[count].length = ptr - data;
+    segments[count].buffer = NULL;
+    count++;
+  }
+
+  return count;
+}
+
+void BufferedOutStream::markSent(size_t length)
+{
+  while (length > 0) {
+    size_t n;
+
+    if (chunks.empty()) {
+      sentUpTo += length;
+      return;
+    }
+
+    Chunk& chunk = chunks.front();
+
+    if (chunk.ahead > 0) {
+      n = length;
+      if (n > chunk.ahead)
+        n = chunk.ahead;
+
+      sentUpTo += n;
+      chunk.ahead -= n;
+      chunkedAhead -= n;
+      length -= n;
+
+      continue;
+    }
+
+    n = length;
+    if (n > chunk.length - chunk.sent)
+      n = chunk.length - chunk.sent;
+
+    chunk.sent += n;
+    chunkedPending -= n;
+    length -= n;
+
+    if (chunk.sent == chunk.length) {
+      U8* data = chunk.data;
+      chunks.pop_front();
+      releaseBuffer(data);
+    }
+  }
+}
+
+void BufferedOutStream::releaseBuffer(U8* data)
+{
+  delete [] data;
+}
+
+void BufferedOutStream::releaseChunks()
+{
+  while (!chunks.empty()) {
+    U8* data = chunks.front().data;
+    chunks.pop_front();
+    releaseBuffer(data);
+  }
+
+  chunkedAhead = 0;
+  chunkedPending = 0;
 }
 
 void BufferedOutStream::overrun(size_t needed)
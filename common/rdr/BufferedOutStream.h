@@ -26,6 +26,8 @@
 
 #include <sys/time.h>
 
+#include <list>
+
 #include <rdr/OutStream.h>
 
 namespace rdr {
@@ -38,9 +40,39 @@ namespace rdr {
     virtual size_t length();
     virtual void flush();
 
+    virtual bool canAdoptBuffer(size_t length);
+    virtual void adoptBuffer(U8* data, size_t length);
+
     // hasBufferedData() checks if there is any data yet to be flushed
 
-    bool hasBufferedData();
+    virtual bool hasBufferedData();
+
+  protected:
+    // Streams that can send several separate pieces of memory at once
+    // set chainBuffers, and will then get adopted buffers queued up
+    // as they are. Their flushBuffer() must use getPending() and
+    // markSent() rather than looking at sentUpTo directly.
+
+    struct Segment {
+      const U8* data;
+      size_t length;
+      // Start of the adopted buffer this is part of, or NULL if the
+      // data is in our own buffer and will move around
+      const U8* buffer;
+    };
+
+    size_t getPending(Segment* segments, size_t maxSegments);
+    void markSent(size_t length);
+
+    // releaseBuffer() is called once an adopted buffer has been sent
+    virtual void releaseBuffer(U8* data);
+
+    // releaseChunks() drops every adopted buffer that hasn't been sent
+    // yet. Subclasses that override releaseBuffer() must call this
+    // from their destructor, as it can't reach them from ours.
+    void releaseChunks();
+
+    bool chainBuffers;
 
   private:
     // flushBuffer() requests that the stream be flushed. Returns true if it is
@@ -49,6 +81,7 @@ namespace rdr {
 
     virtual bool flushBuffer() = 0;
 
+  protected:
     virtual void overrun(size_t needed);
 
   private:
@@ -59,6 +92,19 @@ namespace rdr {
     struct timeval lastSizeCheck;
     size_t peakUsage;
 
+    // Adopted buffers, each to be sent after the given amount of
+    // buffered data following the previous one
+    struct Chunk {
+      size_t ahead;
+      U8* data;
+      size_t length;
+      size_t sent;
+    };
+
+    std::list<Chunk> chunks;
+    size_t chunkedAhead;
+    size_t chunkedPending;
+
   protected:
     U8* sentUpTo;
 
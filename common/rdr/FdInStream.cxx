@@ -33,14 +33,10 @@
 #else
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
-/* Old systems have select() in sys/time.h */
-#ifdef HAVE_SYS_SELECT_H
-#include <sys/select.h>
-#endif
-
 #include <rdr/FdInStream.h>
 #include <rdr/Exception.h>
 
@@ -49,6 +45,14 @@ using namespace rdr;
 FdInStream::FdInStream(int fd_, bool closeWhenDone_)
   : fd(fd_), closeWhenDone(closeWhenDone_)
 {
+  // We never want to block, and a non-blocking fd lets us skip
+  // checking with select() before every recv()
+#ifdef _WIN32
+  u_long one = 1;
+  ioctlsocket(fd, FIONBIO, &one);
+#else
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
 }
 
 FdInStream::~FdInStream()
@@ -70,39 +74,24 @@ bool FdInStream::fillBuffer(size_t maxSize)
 //
 // readFd() reads up to the given length in bytes from the
 // file descriptor into a buffer. Zero is
-// returned if no bytes can be read. Otherwise it returns the number of bytes read.  It
-// never attempts to recv() unless select() indicates that the fd is readable -
-// this means it can be used on an fd which has been set non-blocking.  It also
-// has to cope with the annoying possibility of both select() and recv()
-// returning EINTR.
+// returned if no bytes can be read. Otherwise it returns the number of bytes read.  The
+// fd is non-blocking so this returns straight away if there is no data.  It
+// also has to cope with the annoying possibility of recv() returning EINTR.
 //
 
 size_t FdInStream::readFd(void* buf, size_t len)
 {
   int n;
-  do {
-    fd_set fds;
-    struct timeval tv;
-
-    tv.tv_sec = tv.tv_usec = 0;
-
-    FD_ZERO(&fds);
-    FD_SET(fd, &fds);
-    n = select(fd+1, &fds, 0, 0, &tv);
-  } while (n < 0 && errno == EINTR);
-
-  if (n < 0)
-    throw SystemException("select",errno);
-
-  if (n == 0)
-    return 0;
 
   do {
     n = ::recv(fd, (char*)buf, len, 0);
   } while (n < 0 && errno == EINTR);
 
-  if (n < 0)
+  if (n < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+      return 0;
     throw SystemException("read",errno);
+  }
   if (n == 0)
     throw EndOfStream();
 
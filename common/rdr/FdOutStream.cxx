@@ -32,33 +32,118 @@
 #include <os/winerrno.h>
 #else
 #include <sys/types.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #endif
 
-/* Old systems have select() in sys/time.h */
-#ifdef HAVE_SYS_SELECT_H
-#include <sys/select.h>
+#ifdef __linux__
+#include <poll.h>
+#include <linux/errqueue.h>
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && \
+    defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HAVE_ZEROCOPY
 #endif
+#endif
+
+#include <os/Mutex.h>
 
 #include <rdr/FdOutStream.h>
 #include <rdr/Exception.h>
+#include <rdr/SendBatch.h>
+#include <rdr/SendThread.h>
 #include <rfb/util.h>
 
 
 using namespace rdr;
 
+// How many separate pieces of data we try to send at once
+static const size_t MAX_SEGMENTS = 64;
+
 FdOutStream::FdOutStream(int fd_)
-  : fd(fd_)
+  : fd(fd_), zeroCopy(false), zeroCopySeq(0), batch(NULL),
+    batchQueued(false), batchSent(0), batchFull(false), batchError(0),
+    sendThread(NULL), threadQueued(false), threadBusy(false),
+    threadError(0), handingOver(false)
 {
+  // See FdInStream
+#ifdef _WIN32
+  u_long one = 1;
+  ioctlsocket(fd, FIONBIO, &one);
+#else
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  // sendmsg() can gather adopted buffers without copying them
+  chainBuffers = true;
+#endif
+
   gettimeofday(&lastWrite, NULL);
 }
 
 FdOutStream::~FdOutStream()
 {
+  setBatch(NULL);
+  setSendThread(NULL);
+  clearThreadBlocks();
+
+  // The kernel only pins the pages, so anything it might still be
+  // sending cannot be handed back to the heap. Hopefully
+  // waitZeroCopy() was called and there is nothing left, but if not
+  // then leaking the memory is the only safe option. releaseBuffer()
+  // takes care of that for the buffers that haven't been fully sent.
+  releaseChunks();
+}
+
+//
+// waitZeroCopy() waits, for at most the given number of milliseconds,
+// for the kernel to finish with every buffer that has been sent using
+// zero copy. This has to be done before the fd is closed, as the
+// completions are lost after that.
+//
+
+void FdOutStream::waitZeroCopy(int timeout)
+{
+#ifdef HAVE_ZEROCOPY
+  struct timeval start;
+
+  gettimeofday(&start, NULL);
+
+  while (!zeroCopySends.empty()) {
+    struct pollfd pfd;
+    int remaining;
+
+    try {
+      readCompletions();
+    } catch (SystemException&) {
+      return;
+    }
+
+    if (zeroCopySends.empty())
+      break;
+
+    remaining = timeout - (int)rfb::msSince(&start);
+    if (remaining <= 0)
+      break;
+
+    // Completions show up as errors on the socket
+    pfd.fd = fd;
+    pfd.events = 0;
+    pfd.revents = 0;
+    if ((poll(&pfd, 1, remaining) < 0) && (errno != EINTR))
+      break;
+    if (pfd.revents & POLLNVAL)
+      break;
+
+    // A closed connection is reported constantly, so avoid spinning
+    // whilst waiting for the remaining completions
+    if (pfd.revents & POLLHUP)
+      poll(NULL, 0, remaining < 10 ? remaining : 10);
+  }
+#endif
 }
 
 unsigned FdOutStream::getIdleTime()
@@ -66,8 +151,63 @@ unsigned FdOutStream::getIdleTime()
   return rfb::msSince(&lastWrite);
 }
 
+void FdOutStream::flush()
+{
+  // The batch sends everything in one go, so just make sure it knows
+  // there is something to send
+  if (batch != NULL) {
+    if (batchError != 0)
+      throw SystemException("write", batchError);
+    if (hasBufferedData())
+      batch->queue(this);
+    return;
+  }
+
+  flushNow();
+}
+
+//
+// flushNow() sends as much as possible right away, even if a batch is
+// attached.
+//
+
+void FdOutStream::flushNow()
+{
+  BufferedOutStream::flush();
+
+  // Also a good time to free up anything the kernel is done with
+  if (!zeroCopySends.empty())
+    readCompletions();
+}
+
+void FdOutStream::overrun(size_t needed)
+{
+  // Better to send what we have than to grow the buffer whilst
+  // waiting for the batch
+  if (batch != NULL)
+    flushNow();
+
+  BufferedOutStream::overrun(needed);
+}
+
 void FdOutStream::cork(bool enable)
 {
+  // The batch sends everything in one go, so there is no need to
+  // involve the kernel or to send anything yet
+  if (batch != NULL) {
+    corked = enable;
+    if (!enable && hasBufferedData())
+      batch->queue(this);
+    return;
+  }
+
+  // Same with the send thread, and the kernel's idea of corking
+  // wouldn't match up with when the data is actually sent anyway
+  if (sendThread != NULL) {
+    BufferedOutStream::cork(enable);
+    return;
+  }
+
   BufferedOutStream::cork(enable);
 
 #ifdef TCP_CORK
@@ -76,60 +216,430 @@ void FdOutStream::cork(bool enable)
 #endif
 }
 
+void FdOutStream::setBatch(SendBatch* batch_)
+{
+  if (batch != NULL)
+    batch->detach(this);
+
+  batch = batch_;
+
+  if (batch != NULL)
+    batch->attach(this);
+}
+
+void FdOutStream::setSendThread(SendThread* thread)
+{
+  if (sendThread != NULL)
+    sendThread->detach(this);
+
+  if (thread == NULL)
+    return;
+
+  // The thread doesn't do the bookkeeping needed for zero copy
+  zeroCopy = false;
+
+  sendThread = thread;
+  sendThread->attach(this);
+}
+
+bool FdOutStream::hasBufferedData()
+{
+  if (BufferedOutStream::hasBufferedData())
+    return true;
+
+  if (sendThread != NULL) {
+    os::AutoMutex a(sendThread->mutex);
+    return !threadBlocks.empty() || (threadError != 0);
+  }
+
+  return !threadBlocks.empty() || (threadError != 0);
+}
+
+bool FdOutStream::enableZeroCopy()
+{
+#ifdef HAVE_ZEROCOPY
+  int one = 1;
+
+  if (!chainBuffers)
+    return false;
+
+  if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0)
+    return false;
+
+  zeroCopy = true;
+
+  return true;
+#else
+  return false;
+#endif
+}
+
 bool FdOutStream::flushBuffer()
 {
-  size_t n = writeFd((const void*) sentUpTo, ptr - sentUpTo);
+  Segment segments[MAX_SEGMENTS];
+  size_t count;
+  size_t n;
+
+  if (sendThread != NULL)
+    return handOver();
+
+  // Failed sends elsewhere are reported once someone is around to
+  // deal with it
+  if (threadError != 0)
+    throw SystemException("write", threadError);
+  if (batchError != 0)
+    throw SystemException("write", batchError);
+
+  // Anything a send thread left behind goes first
+  if (!threadBlocks.empty())
+    return flushThreadBlocks();
+
+  // Already sent by the batch?
+  if (batchSent > 0) {
+    markSent(batchSent);
+    batchSent = 0;
+    return true;
+  }
+
+  // No point trying again if the batch didn't get everything out
+  if (batchFull) {
+    batchFull = false;
+    return false;
+  }
+
+  count = getPending(segments, MAX_SEGMENTS);
+
+#ifdef HAVE_ZEROCOPY
+  if (zeroCopy) {
+    // Each adopted buffer is sent on its own, so that we know which
+    // buffers a completion refers to. Our own buffer gets reused
+    // right away so that has to be copied as usual.
+    if (segments[0].buffer != NULL) {
+      try {
+        std::map<U8*, ZeroCopyBuffer>::iterator iter;
+        U8* buffer;
+
+        n = writeFd(segments, 1, MSG_ZEROCOPY);
+        if (n == 0)
+          return false;
+
+        buffer = (U8*)segments[0].buffer;
+
+        iter = zeroCopyBuffers.find(buffer);
+        if (iter == zeroCopyBuffers.end()) {
+          ZeroCopyBuffer zcb;
+          zcb.inFlight = 0;
+          zcb.released = false;
+          iter = zeroCopyBuffers.insert(std::make_pair(buffer, zcb)).first;
+        }
+
+        iter->second.inFlight++;
+        zeroCopySends[zeroCopySeq++] = buffer;
+
+        markSent(n);
+
+        return true;
+      } catch (SystemException& e) {
+        if (e.err != ENOBUFS)
+          throw;
+      }
+
+      // Not allowed to pin any more memory, so copy this one
+      count = 1;
+    } else {
+      for (size_t i = 1; i < count; i++) {
+        if (segments[i].buffer != NULL) {
+          count = i;
+          break;
+        }
+      }
+    }
+  }
+#endif
+
+  n = writeFd(segments, count, 0);
   if (n == 0)
     return false;
 
-  sentUpTo += n;
+  markSent(n);
 
   return true;
 }
 
+void FdOutStream::releaseBuffer(U8* data)
+{
+  std::map<U8*, ZeroCopyBuffer>::iterator iter;
+
+  // Owned by the send thread now
+  if (handingOver)
+    return;
+
+  iter = zeroCopyBuffers.find(data);
+  if (iter == zeroCopyBuffers.end()) {
+    delete [] data;
+    return;
+  }
+
+  // Still in use by the kernel?
+  iter->second.released = true;
+  if (iter->second.inFlight == 0)
+    freeBuffer(data);
+}
+
 //
-// writeFd() writes up to the given length in bytes from the given
-// buffer to the file descriptor. It returns the number of bytes written.  It
-// never attempts to send() unless select() indicates that the fd is writable
-// - this means it can be used on an fd which has been set non-blocking.  It
-// also has to cope with the annoying possibility of both select() and send()
-// returning EINTR.
+// completeBatch() is called by SendBatch with the result of sending
+// the given amount of data from this stream.
 //
 
-size_t FdOutStream::writeFd(const void* data, size_t length)
+void FdOutStream::completeBatch(int result, size_t length)
 {
-  int n;
+  if (result < 0) {
+    if ((result == -EAGAIN) || (result == -EWOULDBLOCK) ||
+        (result == -EINTR))
+      return;
+    batchError = -result;
+    return;
+  }
 
-  do {
-    fd_set fds;
-    struct timeval tv;
+  gettimeofday(&lastWrite, NULL);
+
+  batchSent = result;
+  batchFull = (size_t)result < length;
+
+  try {
+    flushNow();
+  } catch (SystemException& e) {
+    batchError = e.err;
+  }
+}
+
+//
+// handOver() gives all pending data to the send thread. Our own
+// buffer is about to be reused, so that data has to be copied, but
+// adopted buffers are passed on as they are.
+//
+
+bool FdOutStream::handOver()
+{
+  Segment segments[MAX_SEGMENTS];
+  std::list<ThreadBlock> blocks;
+  size_t count, length;
+
+  {
+    os::AutoMutex a(sendThread->mutex);
+    if (threadError != 0)
+      throw SystemException("write", threadError);
+  }
+
+  count = getPending(segments, MAX_SEGMENTS);
+  if (count == 0)
+    return false;
 
-    tv.tv_sec = tv.tv_usec = 0;
+  length = 0;
+  for (size_t i = 0; i < count; i++) {
+    ThreadBlock block;
 
-    FD_ZERO(&fds);
-    FD_SET(fd, &fds);
-    n = select(fd+1, 0, &fds, 0, &tv);
-  } while (n < 0 && errno == EINTR);
+    if (segments[i].buffer == NULL) {
+      block.buffer = new U8[segments[i].length];
+      memcpy(block.buffer, segments[i].data, segments[i].length);
+      block.data = block.buffer;
+    } else {
+      block.buffer = (U8*)segments[i].buffer;
+      block.data = segments[i].data;
+    }
 
-  if (n < 0)
-    throw SystemException("select", errno);
+    block.length = segments[i].length;
+    length += block.length;
 
+    blocks.push_back(block);
+  }
+
+  handingOver = true;
+  markSent(length);
+  handingOver = false;
+
+  gettimeofday(&lastWrite, NULL);
+
+  os::AutoMutex a(sendThread->mutex);
+
+  threadBlocks.splice(threadBlocks.end(), blocks);
+  sendThread->queue(this);
+
+  return true;
+}
+
+bool FdOutStream::flushThreadBlocks()
+{
+  Segment segments[MAX_SEGMENTS];
+  std::list<ThreadBlock>::const_iterator iter;
+  size_t count;
+  size_t n;
+
+  count = 0;
+  for (iter = threadBlocks.begin();
+       (iter != threadBlocks.end()) && (count < MAX_SEGMENTS);
+       ++iter) {
+    segments[count].data = iter->data;
+    segments[count].length = iter->length;
+    segments[count].buffer = iter->buffer;
+    count++;
+  }
+
+  n = writeFd(segments, count, 0);
   if (n == 0)
-    return 0;
+    return false;
+
+  markThreadSent(n);
+
+  return true;
+}
+
+void FdOutStream::markThreadSent(size_t length)
+{
+  while (length > 0) {
+    ThreadBlock& block = threadBlocks.front();
+
+    if (length < block.length) {
+      block.data += length;
+      block.length -= length;
+      return;
+    }
+
+    length -= block.length;
 
+    delete [] block.buffer;
+    threadBlocks.pop_front();
+  }
+}
+
+void FdOutStream::clearThreadBlocks()
+{
+  while (!threadBlocks.empty()) {
+    delete [] threadBlocks.front().buffer;
+    threadBlocks.pop_front();
+  }
+}
+
+//
+// readCompletions() collects the notifications from the kernel about
+// which zero copy sends it no longer needs the memory for.
+//
+
+void FdOutStream::readCompletions()
+{
+#ifdef HAVE_ZEROCOPY
+  while (!zeroCopySends.empty()) {
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+    struct msghdr msg;
+    struct cmsghdr* cmsg;
+    int n;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    do {
+      n = ::recvmsg(fd, &msg, MSG_ERRQUEUE);
+    } while (n < 0 && (errno == EINTR));
+
+    if (n < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return;
+      throw SystemException("recvmsg", errno);
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      struct sock_extended_err serr;
+
+      if (!(((cmsg->cmsg_level == SOL_IP) &&
+             (cmsg->cmsg_type == IP_RECVERR)) ||
+            ((cmsg->cmsg_level == SOL_IPV6) &&
+             (cmsg->cmsg_type == IPV6_RECVERR))))
+        continue;
+
+      memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+      if ((serr.ee_errno != 0) ||
+          (serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY))
+        continue;
+
+      // The kernel had to copy the data anyway, so there is no point
+      // in the extra bookkeeping
+      if (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        zeroCopy = false;
+
+      // An inclusive range of send calls
+      for (U32 seq = serr.ee_info; ; seq++) {
+        std::map<U32, U8*>::iterator iter;
+
+        iter = zeroCopySends.find(seq);
+        if (iter != zeroCopySends.end()) {
+          U8* buffer;
+
+          buffer = iter->second;
+          zeroCopySends.erase(iter);
+
+          ZeroCopyBuffer& zcb = zeroCopyBuffers[buffer];
+          zcb.inFlight--;
+          if ((zcb.inFlight == 0) && zcb.released)
+            freeBuffer(buffer);
+        }
+
+        if (seq == serr.ee_data)
+          break;
+      }
+    }
+  }
+#endif
+}
+
+void FdOutStream::freeBuffer(U8* data)
+{
+  zeroCopyBuffers.erase(data);
+  delete [] data;
+}
+
+//
+// writeFd() writes as much as possible of the given segments to the
+// file descriptor, in a single call. It returns the number of bytes
+// written.  The fd is non-blocking so this returns zero straight away if
+// nothing can be written.  It also has to cope with the annoying
+// possibility of send() returning EINTR.
+//
+
+size_t FdOutStream::writeFd(const Segment* segments, size_t count,
+                            int flags)
+{
+  int n;
+
+#ifdef _WIN32
+  // Nothing gets chained here, so there is only ever one segment
   do {
-    // select only guarantees that you can write SO_SNDLOWAT without
-    // blocking, which is normally 1. Use MSG_DONTWAIT to avoid
-    // blocking, when possible.
-#ifndef MSG_DONTWAIT
-    n = ::send(fd, (const char*)data, length, 0);
+    n = ::send(fd, (const char*)segments[0].data, segments[0].length, flags);
+  } while (n < 0 && (errno == EINTR));
 #else
-    n = ::send(fd, (const char*)data, length, MSG_DONTWAIT);
-#endif
+  struct iovec iov[MAX_SEGMENTS];
+  struct msghdr msg;
+
+  for (size_t i = 0; i < count; i++) {
+    iov[i].iov_base = (void*)segments[i].data;
+    iov[i].iov_len = segments[i].length;
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = count;
+
+  do {
+    n = ::sendmsg(fd, &msg, flags);
   } while (n < 0 && (errno == EINTR));
+#endif
 
-  if (n < 0)
+  if (n < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+      return 0;
     throw SystemException("write", errno);
+  }
 
   gettimeofday(&lastWrite, NULL);
 
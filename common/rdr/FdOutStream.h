@@ -26,10 +26,16 @@
 
 #include <sys/time.h>
 
+#include <list>
+#include <map>
+
 #include <rdr/BufferedOutStream.h>
 
 namespace rdr {
 
+  class SendBatch;
+  class SendThread;
+
   class FdOutStream : public BufferedOutStream {
 
   public:
@@ -41,13 +47,91 @@ namespace rdr {
 
     unsigned getIdleTime();
 
+    virtual void flush();
     virtual void cork(bool enable);
 
+    // enableZeroCopy() makes adopted buffers get sent using
+    // MSG_ZEROCOPY, i.e. without the kernel copying them. Returns
+    // false if this isn't supported by the system.
+
+    bool enableZeroCopy();
+    void disableZeroCopy() { zeroCopy = false; }
+
+    // waitZeroCopy() gives the kernel up to the given number of
+    // milliseconds to finish with any buffers sent using zero copy.
+    // Buffers still in use when the stream is destroyed are leaked
+    // rather than freed.
+
+    void waitZeroCopy(int timeout);
+
+    // setBatch() makes the stream leave sending to the given batch,
+    // rather than sending each time it is flushed or uncorked. Data is
+    // only sent right away if the buffer fills up. Detach the batch
+    // before flushing if the data has to go out immediately, e.g.
+    // before closing the connection.
+
+    void setBatch(SendBatch* batch);
+
+    // setSendThread() makes the stream hand over its data to the
+    // given thread rather than sending it itself. Anything the thread
+    // hasn't sent is taken back when this is reset, and will be sent
+    // as usual. Cannot be combined with a batch, or with zero copy.
+
+    void setSendThread(SendThread* thread);
+
+    virtual bool hasBufferedData();
+
   private:
+    friend class SendBatch;
+    friend class SendThread;
+
+    void flushNow();
     virtual bool flushBuffer();
-    size_t writeFd(const void* data, size_t length);
+    virtual void overrun(size_t needed);
+    virtual void releaseBuffer(U8* data);
+    size_t writeFd(const Segment* segments, size_t count, int flags);
+    void readCompletions();
+    void freeBuffer(U8* data);
+    void completeBatch(int result, size_t length);
+    bool handOver();
+    bool flushThreadBlocks();
+    void markThreadSent(size_t length);
+    void clearThreadBlocks();
     int fd;
     struct timeval lastWrite;
+
+    // Adopted buffers that the kernel might still be reading from,
+    // and which send calls they were given to
+    struct ZeroCopyBuffer {
+      unsigned inFlight;
+      bool released;
+    };
+
+    bool zeroCopy;
+    U32 zeroCopySeq;
+    std::map<U8*, ZeroCopyBuffer> zeroCopyBuffers;
+    std::map<U32, U8*> zeroCopySends;
+
+    SendBatch* batch;
+    bool batchQueued;
+    size_t batchSent;
+    bool batchFull;
+    int batchError;
+
+    // Data given to the send thread, which owns these fields whilst
+    // it is attached
+    struct ThreadBlock {
+      U8* buffer;
+      const U8* data;
+      size_t length;
+    };
+
+    SendThread* sendThread;
+    std::list<ThreadBlock> threadBlocks;
+    bool threadQueued;
+    bool threadBusy;
+    int threadError;
+    bool handingOver;
   };
 
 }
@@ -32,7 +32,7 @@ namespace rdr {
 
   public:
 
-    MemOutStream(int len=1024) {
+    MemOutStream(int len=1024) : initialLen(len) {
       start = ptr = new U8[len];
       end = start + len;
     }
@@ -50,6 +50,28 @@ namespace rdr {
 
     const void* data() { return (const void*)start; }
 
+    // writeTo() writes everything to another stream and clears this
+    // one. The buffer is handed over rather than copied if the other
+    // stream can send it as it is. The replacement is sized for what
+    // was just written rather than for the old buffer, so that a
+    // single large rect doesn't leave us with a large buffer forever.
+
+    void writeTo(OutStream* os) {
+      size_t len = ptr - start;
+      if (os->canAdoptBuffer(len)) {
+        size_t newLen = len;
+        if (newLen < initialLen)
+          newLen = initialLen;
+        U8* newStart = new U8[newLen];
+        os->adoptBuffer(start, len);
+        end = newStart + newLen;
+        start = newStart;
+      } else {
+        os->writeBytes(start, len);
+      }
+      ptr = start;
+    }
+
   protected:
 
     // overrun() either doubles the buffer or adds enough space for
@@ -72,6 +94,7 @@ namespace rdr {
     }
 
     U8* start;
+    size_t initialLen;
   };
 
 }
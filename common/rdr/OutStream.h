@@ -81,7 +81,7 @@ namespace rdr {
 
     // copyBytes() efficiently transfers data between streams
 
-    void copyBytes(InStream* is, size_t length) {
+    virtual void copyBytes(InStream* is, size_t length) {
       while (length > 0) {
         check(1);
         size_t n = length;
@@ -93,6 +93,16 @@ namespace rdr {
       }
     }
 
+    // adoptBuffer() writes a buffer allocated with new[] and takes
+    // ownership of it. canAdoptBuffer() tells if the stream would send
+    // such a buffer as it is, rather than copying it.
+
+    virtual bool canAdoptBuffer(size_t /*length*/) { return false; }
+    virtual void adoptBuffer(U8* data, size_t length) {
+      writeBytes(data, length);
+      delete [] data;
+    }
+
     // writeOpaqueN() writes a quantity without byte-swapping.
 
     inline void writeOpaque8( U8  u) { writeU8(u); }
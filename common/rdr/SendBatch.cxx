@@ -0,0 +1,377 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAVE_IO_URING
+#endif
+#endif
+
+#include <rdr/Exception.h>
+#include <rdr/FdOutStream.h>
+#include <rdr/SendBatch.h>
+#include <rfb/LogWriter.h>
+
+using namespace rdr;
+
+static rfb::LogWriter vlog("SendBatch");
+
+// How many streams we send to with a single system call
+static const unsigned RING_ENTRIES = 64;
+
+// How many separate pieces of data we send per stream
+static const size_t MAX_SEGMENTS = 16;
+
+#ifdef HAVE_IO_URING
+struct SendBatch::Entry {
+  FdOutStream* os;
+  size_t length;
+  struct msghdr msg;
+  struct iovec iov[MAX_SEGMENTS];
+};
+#else
+struct SendBatch::Entry {
+};
+#endif
+
+SendBatch::SendBatch()
+  : ringFd(-1), ringEntries(0), sqRing(NULL), cqRing(NULL), sqes(NULL),
+    entries(NULL)
+{
+  setupRing();
+}
+
+SendBatch::~SendBatch()
+{
+  std::set<FdOutStream*>::iterator iter;
+
+  for (iter = streams.begin(); iter != streams.end(); ++iter) {
+    (*iter)->batch = NULL;
+    (*iter)->batchQueued = false;
+  }
+
+  closeRing();
+}
+
+void SendBatch::flush()
+{
+  std::vector<FdOutStream*> pending;
+
+  while (!queued.empty()) {
+    FdOutStream* os;
+
+    os = queued.front();
+    queued.pop_front();
+    os->batchQueued = false;
+
+    // Failed streams get dealt with the next time someone tries to
+    // write to them
+    if (os->batchError != 0)
+      continue;
+
+    if (!os->hasBufferedData())
+      continue;
+
+    // Zero copy needs its own bookkeeping for each send
+    if (!hasRing() || os->zeroCopy) {
+      try {
+        os->flushNow();
+      } catch (SystemException& e) {
+        os->batchError = e.err;
+      }
+      continue;
+    }
+
+    pending.push_back(os);
+    if (pending.size() == ringEntries) {
+      sendRing(pending);
+      pending.clear();
+    }
+  }
+
+  if (!pending.empty())
+    sendRing(pending);
+}
+
+void SendBatch::attach(FdOutStream* os)
+{
+  streams.insert(os);
+}
+
+void SendBatch::detach(FdOutStream* os)
+{
+  streams.erase(os);
+  if (os->batchQueued) {
+    queued.remove(os);
+    os->batchQueued = false;
+  }
+}
+
+void SendBatch::queue(FdOutStream* os)
+{
+  if (os->batchQueued)
+    return;
+
+  queued.push_back(os);
+  os->batchQueued = true;
+}
+
+void SendBatch::setupRing()
+{
+#ifdef HAVE_IO_URING
+  struct io_uring_params params;
+  char* ptr;
+
+  memset(&params, 0, sizeof(params));
+
+  ringFd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+  if (ringFd < 0) {
+    vlog.info("io_uring not available, sending data separately: %s",
+              strerror(errno));
+    ringFd = -1;
+    return;
+  }
+
+  ringEntries = params.sq_entries;
+
+  sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize = params.cq_off.cqes +
+               params.cq_entries * sizeof(struct io_uring_cqe);
+
+  // Newer kernels have both rings in the same mapping
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cqRingSize > sqRingSize)
+      sqRingSize = cqRingSize;
+    cqRingSize = sqRingSize;
+  }
+
+  sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED) {
+    sqRing = NULL;
+    closeRing();
+    return;
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cqRing = sqRing;
+  } else {
+    cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED) {
+      cqRing = NULL;
+      closeRing();
+      return;
+    }
+  }
+
+  sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    sqes = NULL;
+    closeRing();
+    return;
+  }
+
+  ptr = (char*)sqRing;
+  sqTail = (unsigned*)(ptr + params.sq_off.tail);
+  sqMask = (unsigned*)(ptr + params.sq_off.ring_mask);
+  sqArray = (unsigned*)(ptr + params.sq_off.array);
+
+  ptr = (char*)cqRing;
+  cqHead = (unsigned*)(ptr + params.cq_off.head);
+  cqTail = (unsigned*)(ptr + params.cq_off.tail);
+  cqMask = (unsigned*)(ptr + params.cq_off.ring_mask);
+  cqes = ptr + params.cq_off.cqes;
+
+  entries = new Entry[ringEntries];
+
+  vlog.debug("Using io_uring to send data");
+#endif
+}
+
+void SendBatch::closeRing()
+{
+#ifdef HAVE_IO_URING
+  if (sqes != NULL)
+    munmap(sqes, sqesSize);
+  if ((cqRing != NULL) && (cqRing != sqRing))
+    munmap(cqRing, cqRingSize);
+  if (sqRing != NULL)
+    munmap(sqRing, sqRingSize);
+  if (ringFd != -1)
+    close(ringFd);
+#endif
+
+  delete [] entries;
+
+  ringFd = -1;
+  ringEntries = 0;
+  sqRing = cqRing = sqes = NULL;
+  entries = NULL;
+}
+
+//
+// sendRing() queues up a send for each of the given streams and then
+// waits for them all to finish. The sockets are non-blocking and we
+// ask io_uring to not retry, so they all finish right away.
+//
+
+void SendBatch::sendRing(const std::vector<FdOutStream*>& streams)
+{
+#ifdef HAVE_IO_URING
+  FdOutStream::Segment segments[MAX_SEGMENTS];
+  struct io_uring_sqe* sqe;
+  struct io_uring_cqe* cqe;
+  unsigned tail, head;
+  size_t count, submitted, completed;
+  bool lost;
+
+  count = streams.size();
+
+  tail = *sqTail;
+  for (size_t i = 0; i < count; i++) {
+    Entry* entry;
+    size_t segCount;
+    unsigned index;
+
+    entry = &entries[i];
+
+    entry->os = streams[i];
+    entry->length = 0;
+
+    segCount = streams[i]->getPending(segments, MAX_SEGMENTS);
+    for (size_t j = 0; j < segCount; j++) {
+      entry->iov[j].iov_base = (void*)segments[j].data;
+      entry->iov[j].iov_len = segments[j].length;
+      entry->length += segments[j].length;
+    }
+
+    memset(&entry->msg, 0, sizeof(entry->msg));
+    entry->msg.msg_iov = entry->iov;
+    entry->msg.msg_iovlen = segCount;
+
+    index = tail & *sqMask;
+    sqe = &((struct io_uring_sqe*)sqes)[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = streams[i]->getFd();
+    sqe->addr = (unsigned long)&entry->msg;
+    sqe->len = 1;
+    // Fail rather than wait for the socket to become writable
+    sqe->msg_flags = MSG_DONTWAIT;
+    sqe->user_data = i;
+
+    sqArray[index] = index;
+    tail++;
+  }
+
+  __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+  // The sends are done right away as part of this, so this is
+  // normally the only system call needed
+  submitted = 0;
+  while (submitted < count) {
+    int ret;
+
+    ret = syscall(__NR_io_uring_enter, ringFd, count - submitted, 0, 0,
+                  NULL, 0);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      vlog.error("Failed to submit data to io_uring: %s", strerror(errno));
+      break;
+    }
+
+    submitted += ret;
+  }
+
+  // Take back anything the kernel never saw, so that it can't pick it
+  // up later
+  if (submitted < count)
+    __atomic_store_n(sqTail, tail - (count - submitted), __ATOMIC_RELEASE);
+
+  // Everything submitted must be accounted for before the entries
+  // can be reused or freed, as the kernel reads from them
+  lost = false;
+  completed = 0;
+  while (true) {
+    int ret;
+
+    head = *cqHead;
+    while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+      Entry* entry;
+
+      cqe = &((struct io_uring_cqe*)cqes)[head & *cqMask];
+      entry = &entries[cqe->user_data];
+
+      entry->os->completeBatch(cqe->res, entry->length);
+      entry->os = NULL;
+
+      head++;
+      completed++;
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+    if (completed >= submitted)
+      break;
+
+    ret = syscall(__NR_io_uring_enter, ringFd, 0, 1,
+                  IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0) {
+      if ((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY))
+        continue;
+      vlog.error("Failed to get results from io_uring: %s",
+                 strerror(errno));
+      lost = true;
+      break;
+    }
+  }
+
+  if (completed < count) {
+    // We don't know what happened to these, so the connections are
+    // no longer usable
+    for (size_t i = 0; i < count; i++) {
+      if (entries[i].os != NULL)
+        entries[i].os->batchError = EIO;
+    }
+
+    // The kernel might still be using some of the entries, and there
+    // is no way of knowing when it is done, so they have to be leaked
+    if (lost)
+      entries = NULL;
+
+    closeRing();
+  }
+#endif
+}
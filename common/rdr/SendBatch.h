@@ -0,0 +1,93 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// SendBatch collects the output of several FdOutStreams and sends it
+// all in one go. On Linux this is done with io_uring, so it only
+// takes a single system call no matter how many streams there are.
+//
+
+#ifndef __RDR_SENDBATCH_H__
+#define __RDR_SENDBATCH_H__
+
+#include <list>
+#include <set>
+#include <vector>
+
+#include <rdr/types.h>
+
+namespace rdr {
+
+  class FdOutStream;
+
+  class SendBatch {
+
+  public:
+
+    SendBatch();
+    virtual ~SendBatch();
+
+    // hasRing() returns true if io_uring is used to send the data,
+    // rather than a separate system call for each stream
+
+    bool hasRing() { return ringFd != -1; }
+
+    // flush() sends as much as possible of the data queued up since
+    // the last call
+
+    void flush();
+
+  private:
+    friend class FdOutStream;
+
+    void attach(FdOutStream* os);
+    void detach(FdOutStream* os);
+    void queue(FdOutStream* os);
+
+    void setupRing();
+    void closeRing();
+    void sendRing(const std::vector<FdOutStream*>& streams);
+
+    std::set<FdOutStream*> streams;
+    std::list<FdOutStream*> queued;
+
+    int ringFd;
+    unsigned ringEntries;
+
+    void* sqRing;
+    void* cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    void* sqes;
+    size_t sqesSize;
+
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    void* cqes;
+
+    struct Entry;
+    Entry* entries;
+  };
+
+}
+
+#endif
@@ -0,0 +1,307 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#include <vector>
+
+#include <os/Mutex.h>
+
+#include <rdr/Exception.h>
+#include <rdr/FdOutStream.h>
+#include <rdr/SendThread.h>
+
+using namespace rdr;
+
+// How many separate pieces of data we send at once
+static const size_t MAX_SEGMENTS = 64;
+
+#ifndef WIN32
+static void setupPipe(int fds[2])
+{
+  if (pipe(fds) < 0)
+    throw SystemException("pipe", errno);
+
+  for (int i = 0; i < 2; i++) {
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+  }
+}
+
+static void clearPipe(int fd)
+{
+  char buf[64];
+
+  while (read(fd, buf, sizeof(buf)) > 0)
+    ;
+}
+#endif
+
+SendThread::SendThread()
+  : stopRequested(false)
+{
+#ifdef WIN32
+  throw Exception("Sending from a separate thread is not supported "
+                  "on this platform");
+#else
+  setupPipe(wakeupFds);
+  try {
+    setupPipe(notifyFds);
+  } catch (...) {
+    close(wakeupFds[0]);
+    close(wakeupFds[1]);
+    throw;
+  }
+
+  mutex = new os::Mutex();
+  idleCond = new os::Condition(mutex);
+
+  start();
+#endif
+}
+
+SendThread::~SendThread()
+{
+#ifndef WIN32
+  mutex->lock();
+  stopRequested = true;
+  mutex->unlock();
+
+  wakeup();
+  wait();
+
+  while (!streams.empty())
+    detach(*streams.begin());
+
+  delete idleCond;
+  delete mutex;
+
+  close(wakeupFds[0]);
+  close(wakeupFds[1]);
+  close(notifyFds[0]);
+  close(notifyFds[1]);
+#endif
+}
+
+void SendThread::clearNotify()
+{
+#ifndef WIN32
+  clearPipe(notifyFds[0]);
+#endif
+}
+
+void SendThread::attach(FdOutStream* os)
+{
+  os::AutoMutex a(mutex);
+
+  streams.insert(os);
+}
+
+//
+// detach() stops any sending for the stream and leaves it whatever
+// data the thread didn't get around to.
+//
+
+void SendThread::detach(FdOutStream* os)
+{
+  os::AutoMutex a(mutex);
+
+  // We can't pull the data away while it is being sent
+  while (os->threadBusy)
+    idleCond->wait();
+
+  streams.erase(os);
+
+  if (os->threadQueued) {
+    active.remove(os);
+    os->threadQueued = false;
+  }
+
+  os->sendThread = NULL;
+}
+
+// Called with the mutex held
+void SendThread::queue(FdOutStream* os)
+{
+  if (os->threadQueued)
+    return;
+
+  active.push_back(os);
+  os->threadQueued = true;
+
+  wakeup();
+}
+
+void SendThread::worker()
+{
+#ifndef WIN32
+  mutex->lock();
+
+  while (!stopRequested) {
+    std::list<FdOutStream*>::iterator iter;
+    std::vector<struct pollfd> fds;
+    struct pollfd pfd;
+    bool progress;
+
+    progress = false;
+
+    iter = active.begin();
+    while (iter != active.end()) {
+      FdOutStream* os;
+
+      os = *iter;
+
+      if (!sendStream(os)) {
+        pfd.fd = os->getFd();
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        fds.push_back(pfd);
+        ++iter;
+        continue;
+      }
+
+      progress = true;
+
+      if (os->threadBlocks.empty()) {
+        iter = active.erase(iter);
+        os->threadQueued = false;
+        notify();
+        continue;
+      }
+
+      ++iter;
+    }
+
+    // Keep going for as long as some stream can take more data
+    if (progress)
+      continue;
+
+    pfd.fd = wakeupFds[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    fds.push_back(pfd);
+
+    mutex->unlock();
+
+    while (poll(&fds[0], fds.size(), -1) < 0) {
+      if (errno != EINTR)
+        break;
+    }
+
+    clearPipe(wakeupFds[0]);
+
+    mutex->lock();
+  }
+
+  mutex->unlock();
+#endif
+}
+
+//
+// sendStream() does a single send of as much as possible of the data
+// the stream has handed over. It is called with the mutex held, but
+// releases it whilst waiting for the kernel. Returns false if the
+// socket couldn't take any data.
+//
+
+bool SendThread::sendStream(FdOutStream* os)
+{
+#ifdef WIN32
+  return false;
+#else
+  std::list<FdOutStream::ThreadBlock>::iterator iter;
+  struct iovec iov[MAX_SEGMENTS];
+  struct msghdr msg;
+  size_t count;
+  ssize_t n;
+  int err;
+
+  count = 0;
+  for (iter = os->threadBlocks.begin();
+       (iter != os->threadBlocks.end()) && (count < MAX_SEGMENTS);
+       ++iter) {
+    iov[count].iov_base = (void*)iter->data;
+    iov[count].iov_len = iter->length;
+    count++;
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = count;
+
+  // The owner can add more data meanwhile, but must not touch what
+  // we are sending
+  os->threadBusy = true;
+  mutex->unlock();
+
+  do {
+    // Our signals are blocked, so a SIGPIPE would just linger
+    n = sendmsg(os->getFd(), &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+  } while ((n < 0) && (errno == EINTR));
+  err = errno;
+
+  mutex->lock();
+  os->threadBusy = false;
+  idleCond->broadcast();
+
+  if (n < 0) {
+    if ((err == EAGAIN) || (err == EWOULDBLOCK))
+      return false;
+
+    // The owner gets told about this the next time it sends
+    os->threadError = err;
+    os->clearThreadBlocks();
+
+    return true;
+  }
+
+  os->markThreadSent(n);
+
+  return true;
+#endif
+}
+
+void SendThread::wakeup()
+{
+#ifndef WIN32
+  // A full pipe means a wakeup is already pending
+  if (write(wakeupFds[1], "", 1) < 0)
+    return;
+#endif
+}
+
+void SendThread::notify()
+{
+#ifndef WIN32
+  if (write(notifyFds[1], "", 1) < 0)
+    return;
+#endif
+}
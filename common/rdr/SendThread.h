@@ -0,0 +1,87 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// SendThread writes the output of FdOutStreams from a separate
+// thread. The thread owning the streams only has to hand over the
+// data, so it is never held up by the kernel copying it or by slow
+// connections.
+//
+
+#ifndef __RDR_SENDTHREAD_H__
+#define __RDR_SENDTHREAD_H__
+
+#include <list>
+#include <set>
+
+#include <os/Thread.h>
+
+namespace os {
+  class Condition;
+  class Mutex;
+}
+
+namespace rdr {
+
+  class FdOutStream;
+
+  class SendThread : public os::Thread {
+
+  public:
+
+    SendThread();
+    virtual ~SendThread();
+
+    // getNotifyFd() returns a file descriptor that becomes readable
+    // when a stream has sent all its data, or has failed. Call
+    // clearNotify() before checking the streams.
+
+    int getNotifyFd() { return notifyFds[0]; }
+    void clearNotify();
+
+  protected:
+    virtual void worker();
+
+  private:
+    friend class FdOutStream;
+
+    void attach(FdOutStream* os);
+    void detach(FdOutStream* os);
+    void queue(FdOutStream* os);
+
+    bool sendStream(FdOutStream* os);
+    void wakeup();
+    void notify();
+
+    os::Mutex* mutex;
+    os::Condition* idleCond;
+
+    bool stopRequested;
+
+    std::set<FdOutStream*> streams;
+
+    // Streams with data that still needs to be sent
+    std::list<FdOutStream*> active;
+
+    int wakeupFds[2];
+    int notifyFds[2];
+  };
+
+}
+
+#endif
@@ -23,10 +23,22 @@
 #endif
 
 #include <rdr/Exception.h>
+#include <rdr/FdOutStream.h>
 #include <rdr/TLSException.h>
 #include <rdr/TLSOutStream.h>
 #include <rfb/LogWriter.h>
 #include <errno.h>
+#include <string.h>
+
+#ifdef HAVE_LINUX_TLS_H
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#if defined(TCP_ULP) && defined(SOL_TLS)
+#define HAVE_KTLS
+#endif
+#endif
 
 #ifdef HAVE_GNUTLS
 using namespace rdr;
@@ -41,6 +53,14 @@ ssize_t TLSOutStream::push(gnutls_transport_ptr_t str, const void* data,
   TLSOutStream* self= (TLSOutStream*) str;
   OutStream *out = self->out;
 
+  // The kernel has the state of the session now, so anything GnuTLS
+  // sends would be wrapped a second time
+  if (self->offloaded) {
+    vlog.error("Unexpected TLS data after offloading to the kernel");
+    gnutls_transport_set_errno(self->session, EINVAL);
+    return -1;
+  }
+
   try {
     out->writeBytes(data, size);
     out->flush();
@@ -54,7 +74,8 @@ ssize_t TLSOutStream::push(gnutls_transport_ptr_t str, const void* data,
 }
 
 TLSOutStream::TLSOutStream(OutStream* _out, gnutls_session_t _session)
-  : session(_session), out(_out), bufSize(DEFAULT_BUF_SIZE), offset(0)
+  : session(_session), out(_out), bufSize(DEFAULT_BUF_SIZE), offset(0),
+    offloaded(false)
 {
   gnutls_transport_ptr_t recv, send;
 
@@ -110,6 +131,169 @@ void TLSOutStream::cork(bool enable)
   out->cork(enable);
 }
 
+bool TLSOutStream::offload()
+{
+#ifdef HAVE_KTLS
+  FdOutStream* fdout;
+  int fd;
+
+  gnutls_protocol_t version;
+  gnutls_cipher_algorithm_t cipher;
+  gnutls_datum_t mac_key, iv, cipher_key;
+  unsigned char seq_number[8];
+
+  union {
+    struct tls12_crypto_info_aes_gcm_128 aes128;
+    struct tls12_crypto_info_aes_gcm_256 aes256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    struct tls12_crypto_info_chacha20_poly1305 chacha20;
+#endif
+  } info;
+  size_t infoSize;
+
+  // We need to be able to talk to the socket directly, and everything
+  // GnuTLS has produced must have made it there already
+  fdout = dynamic_cast<FdOutStream*>(out);
+  if (fdout == NULL)
+    return false;
+  if ((ptr != start) || fdout->hasBufferedData())
+    return false;
+
+  // Only the sending side is offloaded, so GnuTLS must never need to
+  // send anything again. TLS 1.3 peers can ask for a key update at
+  // any time, which GnuTLS would have to respond to.
+  version = gnutls_protocol_get_version(session);
+  if (version != GNUTLS_TLS1_2)
+    return false;
+
+  if (gnutls_record_get_state(session, 0, &mac_key, &iv, &cipher_key,
+                              seq_number) != GNUTLS_E_SUCCESS)
+    return false;
+
+  memset(&info, 0, sizeof(info));
+
+  // Same layout as GnuTLS' own kernel offload. The explicit nonce is
+  // simply the sequence number.
+  cipher = gnutls_cipher_get(session);
+  switch (cipher) {
+  case GNUTLS_CIPHER_AES_128_GCM:
+    if ((cipher_key.size != TLS_CIPHER_AES_GCM_128_KEY_SIZE) ||
+        (iv.size < TLS_CIPHER_AES_GCM_128_SALT_SIZE))
+      return false;
+    info.aes128.info.version = TLS_1_2_VERSION;
+    info.aes128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+    memcpy(info.aes128.iv, seq_number, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+    memcpy(info.aes128.salt, iv.data, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+    memcpy(info.aes128.rec_seq, seq_number,
+           TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE);
+    memcpy(info.aes128.key, cipher_key.data,
+           TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+    infoSize = sizeof(info.aes128);
+    break;
+  case GNUTLS_CIPHER_AES_256_GCM:
+    if ((cipher_key.size != TLS_CIPHER_AES_GCM_256_KEY_SIZE) ||
+        (iv.size < TLS_CIPHER_AES_GCM_256_SALT_SIZE))
+      return false;
+    info.aes256.info.version = TLS_1_2_VERSION;
+    info.aes256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+    memcpy(info.aes256.iv, seq_number, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+    memcpy(info.aes256.salt, iv.data, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+    memcpy(info.aes256.rec_seq, seq_number,
+           TLS_CIPHER_AES_GCM_256_REC_SEQ_SIZE);
+    memcpy(info.aes256.key, cipher_key.data,
+           TLS_CIPHER_AES_GCM_256_KEY_SIZE);
+    infoSize = sizeof(info.aes256);
+    break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+  case GNUTLS_CIPHER_CHACHA20_POLY1305:
+    if ((cipher_key.size != TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE) ||
+        (iv.size != TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE))
+      return false;
+    info.chacha20.info.version = TLS_1_2_VERSION;
+    info.chacha20.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+    memcpy(info.chacha20.iv, iv.data, TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE);
+    memcpy(info.chacha20.rec_seq, seq_number,
+           TLS_CIPHER_CHACHA20_POLY1305_REC_SEQ_SIZE);
+    memcpy(info.chacha20.key, cipher_key.data,
+           TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE);
+    infoSize = sizeof(info.chacha20);
+    break;
+#endif
+  default:
+    return false;
+  }
+
+  fd = fdout->getFd();
+
+  // Fails if the tls module isn't available. The socket is otherwise
+  // unaffected until TLS_TX is set.
+  if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0)
+    return false;
+
+  if (setsockopt(fd, SOL_TLS, TLS_TX, &info, infoSize) < 0) {
+    memset(&info, 0, sizeof(info));
+    return false;
+  }
+
+  memset(&info, 0, sizeof(info));
+
+  // MSG_ZEROCOPY isn't accepted on kernel TLS sockets
+  fdout->disableZeroCopy();
+
+  offloaded = true;
+
+  vlog.debug("Offloaded TLS encryption to the kernel");
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+void TLSOutStream::sendCloseNotify()
+{
+#ifdef HAVE_KTLS
+  FdOutStream* fdout;
+  const U8 alert[2] = { 1, 0 }; // warning, close_notify
+  char control[CMSG_SPACE(sizeof(U8))];
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+  struct iovec iov;
+
+  if (!offloaded)
+    return;
+
+  fdout = dynamic_cast<FdOutStream*>(out);
+
+  // Anything still queued up has to go before the alert
+  try {
+    fdout->flush();
+  } catch (Exception&) {
+    return;
+  }
+  if (fdout->hasBufferedData())
+    return;
+
+  iov.iov_base = (void*)alert;
+  iov.iov_len = sizeof(alert);
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_TLS;
+  cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(U8));
+  *CMSG_DATA(cmsg) = 21; // alert
+
+  if (sendmsg(fdout->getFd(), &msg, MSG_DONTWAIT) < 0)
+    vlog.debug("Failed to send TLS close notification: %d", errno);
+#endif
+}
+
 void TLSOutStream::overrun(size_t needed)
 {
   if (needed > bufSize)
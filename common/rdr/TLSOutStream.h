@@ -39,6 +39,20 @@ namespace rdr {
     size_t length();
     virtual void cork(bool enable);
 
+    // offload() hands over encryption of all further data to the
+    // kernel, after which the underlying stream should be written to
+    // directly. Only done for TLS 1.2, as GnuTLS cannot send anything
+    // once this is done. Returns false if this isn't possible, in
+    // which case this stream is used as usual.
+
+    bool offload();
+    bool isOffloaded() { return offloaded; }
+
+    // sendCloseNotify() terminates an offloaded session, as
+    // gnutls_bye() can no longer be used for that
+
+    void sendCloseNotify();
+
   protected:
     virtual void overrun(size_t needed);
 
@@ -51,6 +65,7 @@ namespace rdr {
     size_t bufSize;
     U8* start;
     size_t offset;
+    bool offloaded;
   };
 };
 
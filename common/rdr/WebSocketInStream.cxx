@@ -0,0 +1,353 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <string>
+
+#include <rdr/Exception.h>
+#include <rdr/WebSocketInStream.h>
+#include <rdr/WebSocketOutStream.h>
+#include <rdr/base64.h>
+#include <rdr/sha1.h>
+
+using namespace rdr;
+
+// Any sane request is a lot smaller than this
+static const size_t MAX_HANDSHAKE_SIZE = 8192;
+
+static const char* WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static std::string toLower(std::string s)
+{
+  for (size_t i = 0; i < s.size(); i++) {
+    if ((s[i] >= 'A') && (s[i] <= 'Z'))
+      s[i] = s[i] - 'A' + 'a';
+  }
+  return s;
+}
+
+static std::string trim(const std::string& s)
+{
+  size_t first, last;
+
+  first = s.find_first_not_of(" \t");
+  if (first == std::string::npos)
+    return "";
+  last = s.find_last_not_of(" \t");
+
+  return s.substr(first, last - first + 1);
+}
+
+// Checks for a token in a comma separated header value
+static bool hasToken(const std::string& value, const char* token)
+{
+  size_t pos;
+
+  pos = 0;
+  while (pos <= value.size()) {
+    size_t next;
+
+    next = value.find(',', pos);
+    if (next == std::string::npos)
+      next = value.size();
+
+    if (toLower(trim(value.substr(pos, next - pos))) == token)
+      return true;
+
+    pos = next + 1;
+  }
+
+  return false;
+}
+
+WebSocketInStream::WebSocketInStream(InStream* in_, OutStream* out_,
+                                     WebSocketOutStream* wsos_)
+  : in(in_), out(out_), wsos(wsos_), handshakeDone(false),
+    frameLeft(0), maskPos(0)
+{
+  memset(mask, 0, sizeof(mask));
+}
+
+WebSocketInStream::~WebSocketInStream()
+{
+}
+
+void WebSocketInStream::setAllowedOrigins(const char* origins)
+{
+  allowedOrigins = origins;
+}
+
+bool WebSocketInStream::fillBuffer(size_t maxSize)
+{
+  while (true) {
+    const U8* data;
+    size_t n;
+
+    if (!handshakeDone) {
+      if (!readHandshake())
+        return false;
+      continue;
+    }
+
+    if (frameLeft == 0) {
+      if (!readHeader())
+        return false;
+      continue;
+    }
+
+    if (!in->hasData(1))
+      return false;
+
+    n = in->avail();
+    if (n > maxSize)
+      n = maxSize;
+    if (n > frameLeft)
+      n = frameLeft;
+
+    data = in->getptr(n);
+    for (size_t i = 0; i < n; i++)
+      ((U8*)end)[i] = data[i] ^ mask[(maskPos + i) & 3];
+    in->setptr(n);
+
+    maskPos = (maskPos + n) & 3;
+    frameLeft -= n;
+    end += n;
+
+    return true;
+  }
+}
+
+// Picks out what we need from the client's request, or returns false
+// if it isn't a valid WebSocket request
+static bool parseRequest(const std::string& request, std::string* key,
+                         std::string* protocols, std::string* origin)
+{
+  bool upgrade, connection, version;
+  size_t pos, lineEnd;
+
+  if (request.compare(0, 4, "GET ") != 0)
+    return false;
+
+  upgrade = connection = version = false;
+
+  pos = request.find("\r\n") + 2;
+  while (pos < request.size()) {
+    std::string line, name, value;
+    size_t colon;
+
+    lineEnd = request.find("\r\n", pos);
+    line = request.substr(pos, lineEnd - pos);
+    pos = lineEnd + 2;
+
+    colon = line.find(':');
+    if (colon == std::string::npos)
+      continue;
+
+    name = toLower(trim(line.substr(0, colon)));
+    value = trim(line.substr(colon + 1));
+
+    if (name == "upgrade")
+      upgrade = hasToken(value, "websocket");
+    else if (name == "connection")
+      connection = hasToken(value, "upgrade");
+    else if (name == "sec-websocket-version")
+      version = (value == "13");
+    else if (name == "sec-websocket-key")
+      *key = value;
+    else if (name == "sec-websocket-protocol")
+      *protocols = value;
+    else if (name == "origin")
+      *origin = toLower(value);
+  }
+
+  return upgrade && connection && version && !key->empty();
+}
+
+bool WebSocketInStream::readHandshake()
+{
+  std::string request, key, protocols, origin, response;
+  size_t length, pos;
+  U8 digest[SHA1DigestSize];
+
+  // Wait for the entire request
+  while (true) {
+    const char* data;
+
+    length = in->avail();
+    data = (const char*)in->getptr(length);
+
+    request.assign(data, length);
+    if (request.find("\r\n\r\n") != std::string::npos)
+      break;
+
+    if (length >= MAX_HANDSHAKE_SIZE)
+      throw Exception("WebSocket handshake request too large");
+
+    if (!in->hasData(length + 1))
+      return false;
+  }
+
+  pos = request.find("\r\n\r\n");
+  in->setptr(pos + 4);
+  request.resize(pos + 2);
+
+  if (!parseRequest(request, &key, &protocols, &origin)) {
+    response = "HTTP/1.1 400 Bad Request\r\n\r\n";
+    out->writeBytes(response.data(), response.size());
+    out->flush();
+    throw Exception("Invalid WebSocket handshake");
+  }
+
+  // Browsers will connect anywhere a page asks them to, so this is
+  // the only way of telling if the client was served by a page that
+  // is allowed to use this server. Other clients don't send it.
+  if (!allowedOrigins.empty() && !origin.empty() &&
+      !hasToken(allowedOrigins, origin.c_str())) {
+    response = "HTTP/1.1 403 Forbidden\r\n\r\n";
+    out->writeBytes(response.data(), response.size());
+    out->flush();
+    throw Exception("WebSocket connection from disallowed origin %s",
+                    origin.c_str());
+  }
+
+  key += WEBSOCKET_GUID;
+  sha1((const U8*)key.data(), key.size(), digest);
+
+  response = "HTTP/1.1 101 Switching Protocols\r\n"
+             "Upgrade: websocket\r\n"
+             "Connection: Upgrade\r\n"
+             "Sec-WebSocket-Accept: " + base64(digest, sizeof(digest)) +
+             "\r\n";
+  // Older clients insist on a protocol, and binary is the only one
+  // that makes sense for us
+  if (hasToken(protocols, "binary"))
+    response += "Sec-WebSocket-Protocol: binary\r\n";
+  response += "\r\n";
+
+  out->writeBytes(response.data(), response.size());
+  out->flush();
+
+  handshakeDone = true;
+
+  wsos->setReady();
+
+  return true;
+}
+
+bool WebSocketInStream::readHeader()
+{
+  const U8* data;
+  size_t headerLength;
+  U8 opcode;
+  U64 length;
+
+  if (!in->hasData(2))
+    return false;
+
+  data = in->getptr(2);
+
+  if (data[0] & 0x70)
+    throw Exception("Unsupported WebSocket extension used");
+  if (!(data[1] & 0x80))
+    throw Exception("Unmasked WebSocket frame from client");
+
+  opcode = data[0] & 0x0f;
+  length = data[1] & 0x7f;
+
+  headerLength = 2 + 4;
+  if (length == 126)
+    headerLength += 2;
+  else if (length == 127)
+    headerLength += 8;
+
+  if (!in->hasData(headerLength))
+    return false;
+
+  data = in->getptr(headerLength);
+
+  if (length == 126) {
+    length = data[2] << 8 | data[3];
+  } else if (length == 127) {
+    // The most significant bit must be zero
+    if (data[2] & 0x80)
+      throw Exception("Invalid WebSocket frame length");
+    length = 0;
+    for (int i = 0; i < 8; i++)
+      length = length << 8 | data[2 + i];
+  }
+
+  // Control frames are small and handled as a whole
+  if (opcode & 0x8) {
+    U8 payload[125];
+
+    if (!(data[0] & 0x80) || (length > sizeof(payload)))
+      throw Exception("Invalid WebSocket control frame");
+
+    if (!in->hasData(headerLength + length))
+      return false;
+
+    data = in->getptr(headerLength + length);
+    for (size_t i = 0; i < length; i++)
+      payload[i] = data[headerLength + i] ^ data[headerLength - 4 + (i & 3)];
+    in->setptr(headerLength + length);
+
+    handleControl(opcode, payload, length);
+
+    return true;
+  }
+
+  switch (opcode) {
+  case WebSocketOutStream::OPCODE_CONTINUATION:
+  case WebSocketOutStream::OPCODE_BINARY:
+    break;
+  default:
+    throw Exception("Unsupported WebSocket frame type %d", (int)opcode);
+  }
+
+  memcpy(mask, data + headerLength - 4, 4);
+  maskPos = 0;
+  frameLeft = length;
+
+  in->setptr(headerLength);
+
+  return true;
+}
+
+void WebSocketInStream::handleControl(U8 opcode, const U8* data,
+                                      size_t length)
+{
+  switch (opcode) {
+  case WebSocketOutStream::OPCODE_PING:
+    wsos->writeControl(WebSocketOutStream::OPCODE_PONG, data, length);
+    break;
+  case WebSocketOutStream::OPCODE_PONG:
+    break;
+  case WebSocketOutStream::OPCODE_CLOSE:
+    // Echo the status code back and consider the stream done
+    wsos->writeControl(WebSocketOutStream::OPCODE_CLOSE, data,
+                       length < 2 ? length : 2);
+    throw EndOfStream();
+  default:
+    throw Exception("Unsupported WebSocket control frame %d", (int)opcode);
+  }
+}
@@ -0,0 +1,72 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// WebSocketInStream handles the WebSocket handshake (RFC 6455) and
+// unwraps the data from the frames the client sends.
+//
+
+#ifndef __RDR_WEBSOCKETINSTREAM_H__
+#define __RDR_WEBSOCKETINSTREAM_H__
+
+#include <string>
+
+#include <rdr/BufferedInStream.h>
+
+namespace rdr {
+
+  class OutStream;
+  class WebSocketOutStream;
+
+  class WebSocketInStream : public BufferedInStream {
+  public:
+    // The handshake response is written directly to out, and wsos is
+    // told once it can start sending frames
+    WebSocketInStream(InStream* in, OutStream* out,
+                      WebSocketOutStream* wsos);
+    virtual ~WebSocketInStream();
+
+    // setAllowedOrigins() limits which web pages may connect, as a
+    // comma separated list of origins such as "https://example.com".
+    // Clients that don't say where they come from are always allowed.
+
+    void setAllowedOrigins(const char* origins);
+
+  private:
+    virtual bool fillBuffer(size_t maxSize);
+
+    bool readHandshake();
+    bool readHeader();
+
+    void handleControl(U8 opcode, const U8* data, size_t length);
+
+    InStream* in;
+    OutStream* out;
+    WebSocketOutStream* wsos;
+
+    bool handshakeDone;
+    std::string allowedOrigins;
+
+    U64 frameLeft;
+    U8 mask[4];
+    unsigned maskPos;
+  };
+
+}
+
+#endif
@@ -0,0 +1,153 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <rdr/Exception.h>
+#include <rdr/WebSocketOutStream.h>
+
+using namespace rdr;
+
+enum { DEFAULT_BUF_SIZE = 16384 };
+
+WebSocketOutStream::WebSocketOutStream(OutStream* out_)
+  : out(out_), bufSize(DEFAULT_BUF_SIZE), offset(0), ready(false)
+{
+  ptr = start = new U8[bufSize];
+  end = start + bufSize;
+}
+
+WebSocketOutStream::~WebSocketOutStream()
+{
+  delete [] start;
+}
+
+size_t WebSocketOutStream::length()
+{
+  return offset + ptr - start;
+}
+
+void WebSocketOutStream::flush()
+{
+  // Can't send anything until the client has asked for WebSockets
+  if (!ready)
+    return;
+
+  // Only send small frames if we really have to
+  if (corked && ((ptr - start) < 1024))
+    return;
+
+  writeFrame();
+
+  out->flush();
+}
+
+void WebSocketOutStream::cork(bool enable)
+{
+  OutStream::cork(enable);
+
+  out->cork(enable);
+}
+
+bool WebSocketOutStream::canAdoptBuffer(size_t length)
+{
+  return ready && out->canAdoptBuffer(length);
+}
+
+void WebSocketOutStream::adoptBuffer(U8* data, size_t length)
+{
+  if (!canAdoptBuffer(length)) {
+    OutStream::adoptBuffer(data, length);
+    return;
+  }
+
+  // Whatever is in our buffer has to go first
+  writeFrame();
+
+  writeHeader(OPCODE_BINARY, length);
+  out->adoptBuffer(data, length);
+  offset += length;
+}
+
+bool WebSocketOutStream::hasBufferedData()
+{
+  return ready && (ptr != start);
+}
+
+void WebSocketOutStream::setReady()
+{
+  ready = true;
+  flush();
+}
+
+void WebSocketOutStream::writeControl(U8 opcode, const U8* data,
+                                      size_t length)
+{
+  // Control frames may come between data frames, and our buffer
+  // hasn't been turned in to a frame yet
+  writeHeader(opcode, length);
+  out->writeBytes(data, length);
+  out->flush();
+}
+
+void WebSocketOutStream::overrun(size_t needed)
+{
+  bool wasCorked;
+
+  if (needed > bufSize)
+    throw Exception("WebSocketOutStream overrun: buffer size exceeded");
+
+  if (!ready)
+    throw Exception("WebSocketOutStream overrun: handshake not done");
+
+  // A cork might prevent the flush, so disable it temporarily
+  wasCorked = corked;
+  corked = false;
+  flush();
+  corked = wasCorked;
+}
+
+void WebSocketOutStream::writeFrame()
+{
+  if (ptr == start)
+    return;
+
+  writeHeader(OPCODE_BINARY, ptr - start);
+  out->writeBytes(start, ptr - start);
+
+  offset += ptr - start;
+  ptr = start;
+}
+
+void WebSocketOutStream::writeHeader(U8 opcode, size_t length)
+{
+  // Every frame is complete on its own, and the server never masks
+  out->writeU8(0x80 | opcode);
+  if (length < 126) {
+    out->writeU8(length);
+  } else if (length < 65536) {
+    out->writeU8(126);
+    out->writeU16(length);
+  } else {
+    out->writeU8(127);
+    out->writeU32((U64)length >> 32);
+    out->writeU32(length & 0xffffffff);
+  }
+}
@@ -0,0 +1,83 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// WebSocketOutStream wraps everything written to it in WebSocket
+// frames (RFC 6455), as needed for browser based clients.
+//
+
+#ifndef __RDR_WEBSOCKETOUTSTREAM_H__
+#define __RDR_WEBSOCKETOUTSTREAM_H__
+
+#include <rdr/OutStream.h>
+
+namespace rdr {
+
+  class WebSocketOutStream : public OutStream {
+  public:
+    WebSocketOutStream(OutStream* out);
+    virtual ~WebSocketOutStream();
+
+    virtual void flush();
+    virtual size_t length();
+    virtual void cork(bool enable);
+
+    virtual bool canAdoptBuffer(size_t length);
+    virtual void adoptBuffer(U8* data, size_t length);
+
+    // hasBufferedData() checks if there is anything that hasn't been
+    // passed on to the underlying stream yet. Data written before the
+    // handshake is done doesn't count, as it can never be sent.
+
+    bool hasBufferedData();
+
+    // setReady() is called by WebSocketInStream once the handshake is
+    // done. Nothing written before that is sent until then.
+
+    void setReady();
+
+    // writeControl() sends a control frame straight away
+
+    void writeControl(U8 opcode, const U8* data, size_t length);
+
+    enum {
+      OPCODE_CONTINUATION = 0x0,
+      OPCODE_TEXT = 0x1,
+      OPCODE_BINARY = 0x2,
+      OPCODE_CLOSE = 0x8,
+      OPCODE_PING = 0x9,
+      OPCODE_PONG = 0xa
+    };
+
+  protected:
+    virtual void overrun(size_t needed);
+
+  private:
+    void writeFrame();
+    void writeHeader(U8 opcode, size_t length);
+
+    OutStream* out;
+    size_t bufSize;
+    U8* start;
+    size_t offset;
+    bool ready;
+  };
+
+}
+
+#endif
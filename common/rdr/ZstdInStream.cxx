@@ -0,0 +1,105 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <rdr/ZstdInStream.h>
+#include <rdr/Exception.h>
+
+#include <zstd.h>
+
+using namespace rdr;
+
+ZstdInStream::ZstdInStream()
+  : underlying(0), bytesIn(0)
+{
+  zs = ZSTD_createDCtx();
+  if (zs == NULL)
+    throw Exception("ZstdInStream: ZSTD_createDCtx failed");
+}
+
+ZstdInStream::~ZstdInStream()
+{
+  ZSTD_freeDCtx(zs);
+}
+
+void ZstdInStream::setUnderlying(InStream* is, size_t bytesIn_)
+{
+  underlying = is;
+  bytesIn = bytesIn_;
+  skip(avail());
+}
+
+void ZstdInStream::flushUnderlying()
+{
+  while (bytesIn > 0) {
+    if (!hasData(1))
+      throw Exception("ZstdInStream: failed to flush remaining stream data");
+    skip(avail());
+  }
+
+  setUnderlying(NULL, 0);
+}
+
+void ZstdInStream::reset()
+{
+  setUnderlying(NULL, 0);
+  ZSTD_DCtx_reset(zs, ZSTD_reset_session_only);
+}
+
+bool ZstdInStream::fillBuffer(size_t maxSize)
+{
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer out;
+  size_t length, rc;
+
+  if (!underlying)
+    throw Exception("ZstdInStream overrun: no underlying stream");
+
+  // zstd can hold on to decompressed data after it has consumed all of
+  // the input, so we might still have something to give even when the
+  // underlying stream is exhausted
+  length = 0;
+  if (bytesIn > 0) {
+    if (!underlying->hasData(1))
+      return false;
+    length = underlying->avail();
+    if (length > bytesIn)
+      length = bytesIn;
+  }
+
+  in.src = underlying->getptr(length);
+  in.size = length;
+  in.pos = 0;
+
+  out.dst = (U8*)end;
+  out.size = maxSize;
+  out.pos = 0;
+
+  rc = ZSTD_decompressStream(zs, &out, &in);
+  if (ZSTD_isError(rc))
+    throw Exception("ZstdInStream: decompression failed: %s",
+                    ZSTD_getErrorName(rc));
+
+  bytesIn -= in.pos;
+  end += out.pos;
+  underlying->setptr(in.pos);
+
+  if ((length == 0) && (out.pos == 0))
+    return false;
+
+  return true;
+}
@@ -0,0 +1,176 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <rdr/ZstdOutStream.h>
+#include <rdr/Exception.h>
+
+#include <zstd.h>
+
+using namespace rdr;
+
+enum { DEFAULT_BUF_SIZE = 16384 };
+
+ZstdOutStream::ZstdOutStream(OutStream* os, int compressLevel)
+  : underlying(os), compressionLevel(compressLevel), newLevel(compressLevel),
+    bufSize(DEFAULT_BUF_SIZE), offset(0), inFrame(false)
+{
+  size_t rc;
+
+  zs = ZSTD_createCCtx();
+  if (zs == NULL)
+    throw Exception("ZstdOutStream: ZSTD_createCCtx failed");
+
+  rc = ZSTD_CCtx_setParameter(zs, ZSTD_c_compressionLevel, compressLevel);
+  if (ZSTD_isError(rc)) {
+    ZSTD_freeCCtx(zs);
+    throw Exception("ZstdOutStream: failed to set compression level: %s",
+                    ZSTD_getErrorName(rc));
+  }
+
+  ptr = start = new U8[bufSize];
+  end = start + bufSize;
+}
+
+ZstdOutStream::~ZstdOutStream()
+{
+  try {
+    flush();
+  } catch (Exception&) {
+  }
+  delete [] start;
+  ZSTD_freeCCtx(zs);
+}
+
+void ZstdOutStream::setUnderlying(OutStream* os)
+{
+  underlying = os;
+}
+
+void ZstdOutStream::setCompressionLevel(int level)
+{
+  newLevel = level;
+}
+
+size_t ZstdOutStream::length()
+{
+  return offset + ptr - start;
+}
+
+void ZstdOutStream::flush()
+{
+  checkCompressionLevel();
+
+  // Force out everything from the zstd encoder
+  compress(!corked);
+
+  offset += ptr - start;
+  ptr = start;
+}
+
+void ZstdOutStream::cork(bool enable)
+{
+  OutStream::cork(enable);
+
+  underlying->cork(enable);
+}
+
+void ZstdOutStream::overrun(size_t needed)
+{
+  if (needed > bufSize)
+    throw Exception("ZstdOutStream overrun: buffer size exceeded");
+
+  checkCompressionLevel();
+
+  // zstd always consumes all input if it isn't asked to flush, so a
+  // single call is enough to make room
+  compress(false);
+
+  offset += ptr - start;
+  ptr = start;
+}
+
+void ZstdOutStream::compress(bool flush, bool endFrame)
+{
+  ZSTD_inBuffer in;
+  ZSTD_EndDirective mode;
+  size_t rc;
+
+  if (!underlying)
+    throw Exception("ZstdOutStream: underlying OutStream has not been set");
+
+  in.src = start;
+  in.size = ptr - start;
+  in.pos = 0;
+
+  if (endFrame)
+    mode = ZSTD_e_end;
+  else if (flush)
+    mode = ZSTD_e_flush;
+  else
+    mode = ZSTD_e_continue;
+
+  if ((mode == ZSTD_e_continue) && (in.size == 0))
+    return;
+
+  do {
+    ZSTD_outBuffer out;
+
+    out.dst = underlying->getptr(1);
+    out.size = underlying->avail();
+    out.pos = 0;
+
+    rc = ZSTD_compressStream2(zs, &out, &in, mode);
+    if (ZSTD_isError(rc))
+      throw Exception("ZstdOutStream: compression failed: %s",
+                      ZSTD_getErrorName(rc));
+
+    underlying->setptr(out.pos);
+
+    // When flushing, rc is the amount of data still to be written out
+  } while ((in.pos < in.size) || ((mode != ZSTD_e_continue) && (rc != 0)));
+
+  inFrame = !endFrame;
+}
+
+void ZstdOutStream::checkCompressionLevel()
+{
+  size_t rc;
+
+  if (newLevel == compressionLevel)
+    return;
+
+  // zstd only picks up a new level when it starts a new frame, so the
+  // current one has to be ended first. Anything that has been written
+  // since the level was changed goes in the new frame. The decoder
+  // handles consecutive frames without any special treatment.
+  if (inFrame) {
+    U8* pending;
+
+    pending = ptr;
+    ptr = start;
+    compress(true, true);
+    ptr = pending;
+  }
+
+  rc = ZSTD_CCtx_setParameter(zs, ZSTD_c_compressionLevel, newLevel);
+  if (ZSTD_isError(rc))
+    throw Exception("ZstdOutStream: failed to set compression level: %s",
+                    ZSTD_getErrorName(rc));
+
+  compressionLevel = newLevel;
+}
@@ -0,0 +1,64 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// ZstdOutStream streams to a compressed data stream (underlying), compressing
+// with zstd on the fly.
+//
+
+#ifndef __RDR_ZSTDOUTSTREAM_H__
+#define __RDR_ZSTDOUTSTREAM_H__
+
+#include <rdr/OutStream.h>
+
+struct ZSTD_CCtx_s;
+
+namespace rdr {
+
+  class ZstdOutStream : public OutStream {
+
+  public:
+
+    ZstdOutStream(OutStream* os=0, int compressionLevel=0);
+    virtual ~ZstdOutStream();
+
+    void setUnderlying(OutStream* os);
+    void setCompressionLevel(int level=0);
+    void flush();
+    size_t length();
+    virtual void cork(bool enable);
+
+  private:
+
+    virtual void overrun(size_t needed);
+    void compress(bool flush, bool endFrame=false);
+    void checkCompressionLevel();
+
+    OutStream* underlying;
+    int compressionLevel;
+    int newLevel;
+    size_t bufSize;
+    size_t offset;
+    bool inFrame;
+    ZSTD_CCtx_s* zs;
+    U8* start;
+  };
+
+} // end of namespace rdr
+
+#endif
@@ -0,0 +1,45 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <rdr/base64.h>
+
+using namespace rdr;
+
+std::string rdr::base64(const U8* data, size_t length)
+{
+  static const char* chars =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string result;
+
+  for (size_t i = 0; i < length; i += 3) {
+    U32 v;
+
+    v = data[i] << 16;
+    if (i + 1 < length)
+      v |= data[i+1] << 8;
+    if (i + 2 < length)
+      v |= data[i+2];
+
+    result += chars[(v >> 18) & 0x3f];
+    result += chars[(v >> 12) & 0x3f];
+    result += (i + 1 < length) ? chars[(v >> 6) & 0x3f] : '=';
+    result += (i + 2 < length) ? chars[v & 0x3f] : '=';
+  }
+
+  return result;
+}
@@ -0,0 +1,38 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// Base64 encoding (RFC 4648), as needed for the WebSocket handshake.
+//
+
+#ifndef __RDR_BASE64_H__
+#define __RDR_BASE64_H__
+
+#include <stddef.h>
+
+#include <string>
+
+#include <rdr/types.h>
+
+namespace rdr {
+
+  std::string base64(const U8* data, size_t length);
+
+}
+
+#endif
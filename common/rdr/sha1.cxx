@@ -0,0 +1,116 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <string.h>
+
+#include <string>
+
+#include <rdr/sha1.h>
+
+using namespace rdr;
+
+static const size_t BlockSize = 64;
+
+static inline U32 rol(U32 value, int bits)
+{
+  return (value << bits) | (value >> (32 - bits));
+}
+
+void rdr::sha1(const U8* data, size_t length, U8 digest[SHA1DigestSize])
+{
+  U32 h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+  std::string msg((const char*)data, length);
+  U64 bits;
+
+  bits = (U64)length * 8;
+  msg += (char)0x80;
+  while (msg.size() % BlockSize != 56)
+    msg += (char)0x00;
+  for (int i = 7; i >= 0; i--)
+    msg += (char)((bits >> (i * 8)) & 0xff);
+
+  for (size_t chunk = 0; chunk < msg.size(); chunk += BlockSize) {
+    const U8* p = (const U8*)msg.data() + chunk;
+    U32 w[80];
+    U32 a, b, c, d, e;
+
+    for (int i = 0; i < 16; i++)
+      w[i] = p[i*4] << 24 | p[i*4+1] << 16 | p[i*4+2] << 8 | p[i*4+3];
+    for (int i = 16; i < 80; i++)
+      w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+
+    for (int i = 0; i < 80; i++) {
+      U32 f, k, tmp;
+
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5a827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+
+      tmp = rol(a, 5) + f + e + k + w[i];
+      e = d; d = c; c = rol(b, 30); b = a; a = tmp;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+
+  for (int i = 0; i < 5; i++) {
+    digest[i*4] = h[i] >> 24;
+    digest[i*4+1] = h[i] >> 16;
+    digest[i*4+2] = h[i] >> 8;
+    digest[i*4+3] = h[i];
+  }
+}
+
+// RFC 2104
+void rdr::hmacSHA1(const U8* key, size_t keyLength,
+                   const U8* data, size_t length,
+                   U8 digest[SHA1DigestSize])
+{
+  U8 block[BlockSize];
+  U8 inner[SHA1DigestSize];
+  std::string msg;
+
+  memset(block, 0, sizeof(block));
+  if (keyLength > BlockSize)
+    sha1(key, keyLength, block);
+  else
+    memcpy(block, key, keyLength);
+
+  for (size_t i = 0; i < BlockSize; i++)
+    msg += (char)(block[i] ^ 0x36);
+  msg.append((const char*)data, length);
+  sha1((const U8*)msg.data(), msg.size(), inner);
+
+  msg.clear();
+  for (size_t i = 0; i < BlockSize; i++)
+    msg += (char)(block[i] ^ 0x5c);
+  msg.append((const char*)inner, sizeof(inner));
+  sha1((const U8*)msg.data(), msg.size(), digest);
+}
@@ -0,0 +1,44 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// SHA-1 and HMAC-SHA-1, for the few places that need them without
+// pulling in a crypto library. SHA-1 on its own must not be relied on
+// for collision resistance, but HMAC-SHA-1 is still a sound MAC.
+//
+
+#ifndef __RDR_SHA1_H__
+#define __RDR_SHA1_H__
+
+#include <stddef.h>
+
+#include <rdr/types.h>
+
+namespace rdr {
+
+  static const size_t SHA1DigestSize = 20;
+
+  void sha1(const U8* data, size_t length, U8 digest[SHA1DigestSize]);
+
+  void hmacSHA1(const U8* key, size_t keyLength,
+                const U8* data, size_t length,
+                U8 digest[SHA1DigestSize]);
+
+}
+
+#endif
@@ -101,9 +101,13 @@ void CSecurityTLS::setDefaults()
 
 void CSecurityTLS::shutdown(bool needbye)
 {
-  if (session && needbye)
+  if (tlsos && tlsos->isOffloaded()) {
+    if (needbye)
+      tlsos->sendCloseNotify();
+  } else if (session && needbye) {
     if (gnutls_bye(session, GNUTLS_SHUT_RDWR) != GNUTLS_E_SUCCESS)
       vlog.error("gnutls_bye failed");
+  }
 
   if (anon_cred) {
     gnutls_anon_free_client_credentials(anon_cred);
@@ -195,7 +199,11 @@ bool CSecurityTLS::processMsg()
 
   checkSession();
 
-  cc->setStreams(tlsis, tlsos);
+  // Let the kernel do the encryption from here on if it can
+  if (Security::TLSOffload && tlsos->offload())
+    cc->setStreams(tlsis, rawos);
+  else
+    cc->setStreams(tlsis, tlsos);
 
   return true;
 }
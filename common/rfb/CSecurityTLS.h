@@ -37,6 +37,8 @@
 #include <rdr/OutStream.h>
 #include <gnutls/gnutls.h>
 
+namespace rdr { class TLSOutStream; }
+
 namespace rfb {
   class UserMsgBox;
   class CSecurityTLS : public CSecurity {
@@ -70,7 +72,7 @@ namespace rfb {
     char *cafile, *crlfile;
 
     rdr::InStream* tlsis;
-    rdr::OutStream* tlsos;
+    rdr::TLSOutStream* tlsos;
 
     rdr::InStream* rawis;
     rdr::OutStream* rawos;
@@ -15,40 +15,320 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
  * USA.
  */
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
+
+#include <algorithm>
 #include <vector>
+
+#include <os/Mutex.h>
+
+#include <rfb/cpuFeatures.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+#ifdef HAVE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
 #include <rdr/types.h>
 #include <rfb/Exception.h>
 #include <rfb/LogWriter.h>
 #include <rfb/ComparingUpdateTracker.h>
+#include <rfb/ServerCore.h>
+#include <rfb/util.h>
 
 using namespace rfb;
 
 static LogWriter vlog("ComparingUpdateTracker");
 
+#define BLOCK_SIZE 64
+
+//
+// The comparison kernels. They compare length bytes of dst and src,
+// and return false if they are identical. Otherwise they return the
+// offsets of the first and last byte that differ, and make sure that
+// dst is updated to match src.
+//
+
+typedef bool (*CompareAndCopyFunc)(rdr::U8* dst, const rdr::U8* src,
+                                   size_t length,
+                                   size_t* first, size_t* last);
+
+static bool compareAndCopyPlain(rdr::U8* dst, const rdr::U8* src,
+                                size_t length, size_t* first, size_t* last)
+{
+  size_t start, end;
+
+  if (memcmp(dst, src, length) == 0)
+    return false;
+
+  start = 0;
+  while (dst[start] == src[start])
+    start++;
+
+  end = length - 1;
+  while (dst[end] == src[end])
+    end--;
+
+  memcpy(dst + start, src + start, end - start + 1);
+
+  *first = start;
+  *last = end;
+
+  return true;
+}
+
+// Handles the bytes that don't fill an entire vector
+static inline void compareAndCopyTail(rdr::U8* dst, const rdr::U8* src,
+                                      size_t offset, size_t length,
+                                      bool* found,
+                                      size_t* first, size_t* last)
+{
+  for (; offset < length; offset++) {
+    if (dst[offset] == src[offset])
+      continue;
+
+    if (!*found) {
+      *first = offset;
+      *found = true;
+    }
+    *last = offset;
+
+    dst[offset] = src[offset];
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+
+__target_sse2_attr
+static bool compareAndCopySSE2(rdr::U8* dst, const rdr::U8* src,
+                               size_t length, size_t* first, size_t* last)
+{
+  size_t offset;
+  bool found;
+
+  found = false;
+
+  for (offset = 0; offset + 16 <= length; offset += 16) {
+    __m128i a, b;
+    unsigned mask;
+
+    a = _mm_loadu_si128((const __m128i*)(dst + offset));
+    b = _mm_loadu_si128((const __m128i*)(src + offset));
+
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xffff;
+    if (mask == 0)
+      continue;
+
+    if (!found) {
+      *first = offset + __builtin_ctz(mask);
+      found = true;
+    }
+    *last = offset + 31 - __builtin_clz(mask);
+
+    _mm_storeu_si128((__m128i*)(dst + offset), b);
+  }
+
+  compareAndCopyTail(dst, src, offset, length, &found, first, last);
+
+  return found;
+}
+
+__target_avx2_attr
+static bool compareAndCopyAVX2(rdr::U8* dst, const rdr::U8* src,
+                               size_t length, size_t* first, size_t* last)
+{
+  size_t offset;
+  bool found;
+
+  found = false;
+
+  for (offset = 0; offset + 32 <= length; offset += 32) {
+    __m256i a, b;
+    unsigned mask;
+
+    a = _mm256_loadu_si256((const __m256i*)(dst + offset));
+    b = _mm256_loadu_si256((const __m256i*)(src + offset));
+
+    mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+    if (mask == 0)
+      continue;
+
+    if (!found) {
+      *first = offset + __builtin_ctz(mask);
+      found = true;
+    }
+    *last = offset + 31 - __builtin_clz(mask);
+
+    _mm256_storeu_si256((__m256i*)(dst + offset), b);
+  }
+
+  compareAndCopyTail(dst, src, offset, length, &found, first, last);
+
+  return found;
+}
+
+#endif // HAVE_X86_SIMD
+
+#if defined(HAVE_NEON_SIMD) && defined(__aarch64__)
+
+static bool compareAndCopyNEON(rdr::U8* dst, const rdr::U8* src,
+                               size_t length, size_t* first, size_t* last)
+{
+  size_t offset;
+  bool found;
+
+  found = false;
+
+  for (offset = 0; offset + 16 <= length; offset += 16) {
+    uint8x16_t a, b;
+    uint64x2_t diff;
+    rdr::U64 lo, hi;
+
+    a = vld1q_u8(dst + offset);
+    b = vld1q_u8(src + offset);
+
+    diff = vreinterpretq_u64_u8(veorq_u8(a, b));
+    lo = vgetq_lane_u64(diff, 0);
+    hi = vgetq_lane_u64(diff, 1);
+    if ((lo | hi) == 0)
+      continue;
+
+    // NEON is little endian here, so the lowest byte comes first
+    if (!found) {
+      if (lo != 0)
+        *first = offset + __builtin_ctzll(lo) / 8;
+      else
+        *first = offset + 8 + __builtin_ctzll(hi) / 8;
+      found = true;
+    }
+    if (hi != 0)
+      *last = offset + 8 + (63 - __builtin_clzll(hi)) / 8;
+    else
+      *last = offset + (63 - __builtin_clzll(lo)) / 8;
+
+    vst1q_u8(dst + offset, b);
+  }
+
+  compareAndCopyTail(dst, src, offset, length, &found, first, last);
+
+  return found;
+}
+
+#endif // HAVE_NEON_SIMD && __aarch64__
+
+static CompareAndCopyFunc selectCompareAndCopy(unsigned features)
+{
+#ifdef HAVE_X86_SIMD
+  if (features & cpuAVX2) {
+    vlog.debug("Using AVX2 framebuffer comparison");
+    return compareAndCopyAVX2;
+  }
+  if (features & cpuSSE2) {
+    vlog.debug("Using SSE2 framebuffer comparison");
+    return compareAndCopySSE2;
+  }
+#endif
+
+#if defined(HAVE_NEON_SIMD) && defined(__aarch64__)
+  if (features & cpuNEON) {
+    vlog.debug("Using NEON framebuffer comparison");
+    return compareAndCopyNEON;
+  }
+#endif
+
+  vlog.debug("Using plain framebuffer comparison");
+  return compareAndCopyPlain;
+}
+
+static CompareAndCopyFunc compareAndCopy = compareAndCopyPlain;
+
+static bool initCompareAndCopy()
+{
+  compareAndCopy = selectCompareAndCopy(getCPUFeatures());
+  return true;
+}
+
+// Other trackers' threads might already be using the kernel, so it
+// must only be picked once
+static void setupCompareAndCopy()
+{
+  static bool kernelSelected = initCompareAndCopy();
+  (void)kernelSelected;
+}
+
+static bool largerArea(const Rect& a, const Rect& b)
+{
+  return a.area() > b.area();
+}
+
 ComparingUpdateTracker::ComparingUpdateTracker(PixelBuffer* buffer)
   : fb(buffer), oldFb(fb->getPF(), 0, 0), firstCompare(true),
-    enabled(true), totalPixels(0), missedPixels(0)
+    enabled(true), totalPixels(0), missedPixels(0),
+    hashing(Server::compareHashes), tilesX(0), tilesY(0),
+    detectScrolling(Server::detectScrolling),
+    activeThreads(0), threadException(NULL)
 {
-    changed.assign_union(fb->getRect());
+  int threadCount;
+
+  changed.assign_union(fb->getRect());
+
+  setupCompareAndCopy();
+
+  queueMutex = new os::Mutex();
+  producerCond = new os::Condition(queueMutex);
+  consumerCond = new os::Condition(queueMutex);
+
+  threadCount = Server::compareThreads;
+  if (threadCount <= 0)
+    return;
+
+  vlog.debug("Creating %d comparison thread(s)", threadCount);
+
+  while (threadCount--)
+    threads.push_back(new CompareThread(this));
 }
 
 ComparingUpdateTracker::~ComparingUpdateTracker()
 {
-}
+  while (!threads.empty()) {
+    delete threads.back();
+    threads.pop_back();
+  }
 
+  delete threadException;
 
-#define BLOCK_SIZE 64
+  delete consumerCond;
+  delete producerCond;
+  delete queueMutex;
+}
 
 bool ComparingUpdateTracker::compare()
 {
   std::vector<Rect> rects;
   std::vector<Rect>::iterator i;
+  bool foundCopy;
 
   if (!enabled)
     return false;
 
+  foundCopy = false;
+
+  if (firstCompare && hashing) {
+    tilesX = (fb->width() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    tilesY = (fb->height() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    tileHashes.resize(tilesX * tilesY);
+
+    hashTiles(fb->getRect());
+
+    firstCompare = false;
+
+    return false;
+  }
+
   if (firstCompare) {
     // NB: We leave the change region untouched on this iteration,
     // since in effect the entire framebuffer has changed.
@@ -66,15 +346,48 @@ bool ComparingUpdateTracker::compare()
     return false;
   }
 
-  copied.get_rects(&rects, copy_delta.x<=0, copy_delta.y<=0);
-  for (i = rects.begin(); i != rects.end(); i++)
-    oldFb.copyRect(*i, copy_delta);
+  if (hashing) {
+    // We can't tell which part of a tile has changed, so compare whole
+    // rows of tiles and report the damage within any that differ
+    Rect bounds;
 
-  changed.get_rects(&rects);
+    bounds = changed.get_bounding_rect().intersect(fb->getRect());
+
+    rects.clear();
+    if (!bounds.is_empty()) {
+      for (int y = bounds.tl.y - bounds.tl.y % BLOCK_SIZE;
+           y < bounds.br.y; y += BLOCK_SIZE) {
+        rects.push_back(Rect(bounds.tl.x, y, bounds.br.x,
+                             __rfbmin(fb->height(), y + BLOCK_SIZE)));
+      }
+    }
+  } else {
+    copied.get_rects(&rects, copy_delta.x<=0, copy_delta.y<=0);
+    for (i = rects.begin(); i != rects.end(); i++)
+      oldFb.copyRect(*i, copy_delta);
+
+    // We can only describe a single copy, so don't try to find one if
+    // we've already been told about one
+    if (detectScrolling && copied.is_empty())
+      foundCopy = detectCopy();
+
+    changed.get_rects(&rects);
+  }
 
   Region newChanged;
-  for (i = rects.begin(); i != rects.end(); i++)
-    compareRect(*i, &newChanged);
+  if (threads.empty()) {
+    for (i = rects.begin(); i != rects.end(); i++)
+      compareRect(*i, &newChanged);
+  } else {
+    compareRects(rects, &newChanged);
+  }
+
+  // Copied tiles have new content, so their hashes need updating
+  if (hashing) {
+    copied.get_rects(&rects);
+    for (i = rects.begin(); i != rects.end(); i++)
+      hashTiles(*i);
+  }
 
   changed.get_rects(&rects);
   for (i = rects.begin(); i != rects.end(); i++)
@@ -83,7 +396,7 @@ bool ComparingUpdateTracker::compare()
   for (i = rects.begin(); i != rects.end(); i++)
     missedPixels += i->area();
 
-  if (changed.equals(newChanged))
+  if (changed.equals(newChanged) && !foundCopy)
     return false;
 
   changed = newChanged;
@@ -91,6 +404,14 @@ bool ComparingUpdateTracker::compare()
   return true;
 }
 
+void ComparingUpdateTracker::setCompareFeatures(unsigned features)
+{
+  // Make sure this isn't overridden later
+  setupCompareAndCopy();
+
+  compareAndCopy = selectCompareAndCopy(getCPUFeatures() & features);
+}
+
 void ComparingUpdateTracker::enable()
 {
   enabled = true;
@@ -104,6 +425,41 @@ void ComparingUpdateTracker::disable()
   firstCompare = true;
 }
 
+bool ComparingUpdateTracker::detectCopy()
+{
+  std::vector<Rect> rects;
+  std::vector<Rect>::iterator i;
+  Rect dest;
+  Point delta;
+
+  // Big changes are more likely to be scrolling, so check them first
+  changed.get_rects(&rects);
+  std::sort(rects.begin(), rects.end(), largerArea);
+
+  for (i = rects.begin(); i != rects.end(); i++) {
+    if (!i->enclosed_by(fb->getRect()))
+      continue;
+
+    if (!scrollDetector.detect(&oldFb, fb, *i, &dest, &delta))
+      continue;
+
+    vlog.debug("Detected copy of %dx%d at %d,%d by %d,%d",
+               dest.width(), dest.height(), dest.tl.x, dest.tl.y,
+               delta.x, delta.y);
+
+    // Update oldFb so that the comparison will remove the copied area
+    // from the changed region
+    oldFb.copyRect(dest, delta);
+
+    copied = dest;
+    copy_delta = delta;
+
+    return true;
+  }
+
+  return false;
+}
+
 void ComparingUpdateTracker::compareRect(const Rect& r, Region* newChanged)
 {
   if (!r.enclosed_by(fb->getRect())) {
@@ -115,128 +471,70 @@ void ComparingUpdateTracker::compareRect(const Rect& r, Region* newChanged)
     return;
   }
 
+  if (hashing) {
+    compareTiles(r, newChanged);
+    return;
+  }
+
   int bytesPerPixel = fb->getPF().bpp/8;
   int oldStride;
   rdr::U8* oldData = oldFb.getBufferRW(r, &oldStride);
   int oldStrideBytes = oldStride * bytesPerPixel;
 
-  // Used to efficiently crop the left and right of the change rectangle
-  int minCompareWidthInPixels = BLOCK_SIZE / 8;
-  int minCompareWidthInBytes = minCompareWidthInPixels * bytesPerPixel;
+  // The change rectangle of each block in the current strip
+  std::vector<Rect> blockChanges((r.width() + BLOCK_SIZE - 1) / BLOCK_SIZE);
 
   for (int blockTop = r.tl.y; blockTop < r.br.y; blockTop += BLOCK_SIZE)
   {
     // Get a strip of the source buffer
     Rect pos(r.tl.x, blockTop, r.br.x, __rfbmin(r.br.y, blockTop+BLOCK_SIZE));
     int fbStride;
-    const rdr::U8* newBlockPtr = fb->getBuffer(pos, &fbStride);
+    const rdr::U8* newRowPtr = fb->getBuffer(pos, &fbStride);
     int newStrideBytes = fbStride * bytesPerPixel;
 
-    rdr::U8* oldBlockPtr = oldData;
+    rdr::U8* oldRowPtr = oldData;
     int blockBottom = __rfbmin(blockTop+BLOCK_SIZE, r.br.y);
 
-    for (int blockLeft = r.tl.x; blockLeft < r.br.x; blockLeft += BLOCK_SIZE)
-    {
-      const rdr::U8* newPtr = newBlockPtr;
-      rdr::U8* oldPtr = oldBlockPtr;
+    std::vector<Rect>::iterator change;
 
-      int blockRight = __rfbmin(blockLeft+BLOCK_SIZE, r.br.x);
-      int blockWidthInBytes = (blockRight-blockLeft) * bytesPerPixel;
+    for (change = blockChanges.begin(); change != blockChanges.end(); ++change)
+      change->clear();
 
-      // Scan the block top to bottom, to identify the first row of change
-      for (int y = blockTop; y < blockBottom; y++)
+    // Scan the strip a row at a time, growing the change rectangle of
+    // each block as we find differences. Anything that differs is
+    // copied from fb to oldFb as we go, to allow future changes to be
+    // identified.
+    for (int y = blockTop; y < blockBottom; y++)
+    {
+      const rdr::U8* newPtr = newRowPtr;
+      rdr::U8* oldPtr = oldRowPtr;
+
+      change = blockChanges.begin();
+      for (int blockLeft = r.tl.x; blockLeft < r.br.x; blockLeft += BLOCK_SIZE)
       {
-        if (memcmp(oldPtr, newPtr, blockWidthInBytes) != 0)
-        {
-          // Define the change rectangle using pessimistic values to start
-          int changeHeight = blockBottom - y;
-          int changeLeft = blockLeft;
-          int changeRight = blockRight;
-
-          // For every unchanged row at the bottom of the block, decrement change height
-          {
-            const rdr::U8* newRowPtr = newPtr + ((changeHeight - 1) * newStrideBytes);
-            const rdr::U8* oldRowPtr = oldPtr + ((changeHeight - 1) * oldStrideBytes);
-            while (changeHeight > 1 && memcmp(oldRowPtr, newRowPtr, blockWidthInBytes) == 0)
-            {
-              newRowPtr -= newStrideBytes;
-              oldRowPtr -= oldStrideBytes;
-
-              changeHeight--;
-            }
-          }
-
-          // For every unchanged column at the left of the block, increment change left
-          {
-            const rdr::U8* newColumnPtr = newPtr;
-            const rdr::U8* oldColumnPtr = oldPtr;
-            while (changeLeft + minCompareWidthInPixels < changeRight)
-            {
-              const rdr::U8* newRowPtr = newColumnPtr;
-              const rdr::U8* oldRowPtr = oldColumnPtr;
-              for (int row = 0; row < changeHeight; row++)
-              {
-                if (memcmp(oldRowPtr, newRowPtr, minCompareWidthInBytes) != 0)
-                  goto endOfChangeLeft;
-
-                newRowPtr += newStrideBytes;
-                oldRowPtr += oldStrideBytes;
-              }
-
-              newColumnPtr += minCompareWidthInBytes;
-              oldColumnPtr += minCompareWidthInBytes;
-
-              changeLeft += minCompareWidthInPixels;
-            }
-          }
-        endOfChangeLeft:
-
-          // For every unchanged column at the right of the block, decrement change right
-          {
-            const rdr::U8* newColumnPtr = newPtr + blockWidthInBytes;
-            const rdr::U8* oldColumnPtr = oldPtr + blockWidthInBytes;
-            while (changeLeft + minCompareWidthInPixels < changeRight)
-            {
-              newColumnPtr -= minCompareWidthInBytes;
-              oldColumnPtr -= minCompareWidthInBytes;
-
-              const rdr::U8* newRowPtr = newColumnPtr;
-              const rdr::U8* oldRowPtr = oldColumnPtr;
-              for (int row = 0; row < changeHeight; row++)
-              {
-                if (memcmp(oldRowPtr, newRowPtr, minCompareWidthInBytes) != 0)
-                  goto endOfChangeRight;
-
-                newRowPtr += newStrideBytes;
-                oldRowPtr += oldStrideBytes;
-              }
-
-              changeRight -= minCompareWidthInPixels;
-            }
-          }
-        endOfChangeRight:
-
-          // Block change extends from (changeLeft, y) to (changeRight, y + changeHeight)
-          newChanged->assign_union(Region(Rect(changeLeft, y, changeRight, y + changeHeight)));
-
-          // Copy the change from fb to oldFb to allow future changes to be identified
-          for (int row = 0; row < changeHeight; row++)
-          {
-            memcpy(oldPtr, newPtr, blockWidthInBytes);
-            newPtr += newStrideBytes;
-            oldPtr += oldStrideBytes;
-          }
-
-          // No further processing is required for this block
-          break;
+        int blockRight = __rfbmin(blockLeft+BLOCK_SIZE, r.br.x);
+        int blockWidthInBytes = (blockRight-blockLeft) * bytesPerPixel;
+
+        size_t first, last;
+
+        if (compareAndCopy(oldPtr, newPtr, blockWidthInBytes, &first, &last)) {
+          Rect rowChange(blockLeft + first / bytesPerPixel, y,
+                         blockLeft + last / bytesPerPixel + 1, y + 1);
+          *change = change->union_boundary(rowChange);
         }
 
-        newPtr += newStrideBytes;
-        oldPtr += oldStrideBytes;
+        newPtr += blockWidthInBytes;
+        oldPtr += blockWidthInBytes;
+        ++change;
       }
 
-      oldBlockPtr += blockWidthInBytes;
-      newBlockPtr += blockWidthInBytes;
+      newRowPtr += newStrideBytes;
+      oldRowPtr += oldStrideBytes;
+    }
+
+    for (change = blockChanges.begin(); change != blockChanges.end(); ++change) {
+      if (!change->is_empty())
+        newChanged->assign_union(Region(*change));
     }
 
     oldData += oldStrideBytes * BLOCK_SIZE;
@@ -245,6 +543,242 @@ void ComparingUpdateTracker::compareRect(const Rect& r, Region* newChanged)
   oldFb.commitBufferRW(r);
 }
 
+void ComparingUpdateTracker::compareTiles(const Rect& band,
+                                          Region* newChanged)
+{
+  int ty;
+
+  ty = band.tl.y / BLOCK_SIZE;
+  assert(band.tl.y == ty * BLOCK_SIZE);
+
+  for (int tx = band.tl.x / BLOCK_SIZE; tx * BLOCK_SIZE < band.br.x; tx++) {
+    Rect tile;
+    Region damage;
+    rdr::U64 hash;
+
+    tile.setXYWH(tx * BLOCK_SIZE, ty * BLOCK_SIZE, BLOCK_SIZE, BLOCK_SIZE);
+    tile = tile.intersect(fb->getRect());
+
+    damage = changed.intersect(tile);
+    if (damage.is_empty())
+      continue;
+
+    hash = hashTile(tile);
+    if (hash == tileHashes[ty * tilesX + tx])
+      continue;
+
+    tileHashes[ty * tilesX + tx] = hash;
+    newChanged->assign_union(damage);
+  }
+}
+
+void ComparingUpdateTracker::hashTiles(const Rect& r)
+{
+  Rect area;
+
+  area = r.intersect(fb->getRect());
+  if (area.is_empty())
+    return;
+
+  for (int ty = area.tl.y / BLOCK_SIZE; ty * BLOCK_SIZE < area.br.y; ty++) {
+    for (int tx = area.tl.x / BLOCK_SIZE; tx * BLOCK_SIZE < area.br.x; tx++) {
+      Rect tile;
+
+      tile.setXYWH(tx * BLOCK_SIZE, ty * BLOCK_SIZE, BLOCK_SIZE, BLOCK_SIZE);
+      tile = tile.intersect(fb->getRect());
+
+      tileHashes[ty * tilesX + tx] = hashTile(tile);
+    }
+  }
+}
+
+rdr::U64 ComparingUpdateTracker::hashTile(const Rect& tile)
+{
+  const rdr::U8* data;
+  int stride;
+  size_t rowBytes;
+  rdr::U64 hash;
+
+  data = fb->getBuffer(tile, &stride);
+  stride *= fb->getPF().bpp/8;
+  rowBytes = tile.width() * (fb->getPF().bpp/8);
+
+  // A simple multiply and shift hash, fed 64 bits at a time. It only
+  // needs to be fast and to spread small changes, nothing more.
+  hash = 0xcbf29ce484222325ULL;
+  for (int y = 0; y < tile.height(); y++) {
+    const rdr::U8* ptr;
+    size_t len;
+
+    ptr = data;
+    len = rowBytes;
+
+    while (len >= 8) {
+      rdr::U64 word;
+      memcpy(&word, ptr, 8);
+      hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+      hash ^= hash >> 29;
+      ptr += 8;
+      len -= 8;
+    }
+    while (len > 0) {
+      hash = (hash ^ *ptr) * 0x100000001b3ULL;
+      ptr++;
+      len--;
+    }
+
+    data += stride;
+  }
+
+  return hash;
+}
+
+void ComparingUpdateTracker::compareRects(const std::vector<Rect>& rects,
+                                          Region* newChanged)
+{
+  std::vector<Rect>::const_iterator i;
+  std::list<CompareThread*>::iterator iter;
+
+  // Split everything in to bands of blocks, which the worker threads
+  // can then compare independently of each other
+  queueMutex->lock();
+
+  for (i = rects.begin(); i != rects.end(); i++) {
+    for (int y = i->tl.y; y < i->br.y; y += BLOCK_SIZE) {
+      workQueue.push_back(Rect(i->tl.x, y, i->br.x,
+                               __rfbmin(i->br.y, y + BLOCK_SIZE)));
+    }
+  }
+
+  consumerCond->broadcast();
+
+  // Help out rather than just waiting for the threads
+  while (!workQueue.empty()) {
+    Rect band;
+
+    band = workQueue.front();
+    workQueue.pop_front();
+
+    queueMutex->unlock();
+
+    try {
+      compareRect(band, newChanged);
+    } catch (rdr::Exception& e) {
+      setThreadException(e);
+    } catch(...) {
+      assert(false);
+    }
+
+    queueMutex->lock();
+  }
+
+  while (activeThreads > 0)
+    producerCond->wait();
+
+  queueMutex->unlock();
+
+  throwThreadException();
+
+  // Everything is done, so no need to lock to look at the result
+  for (iter = threads.begin(); iter != threads.end(); ++iter) {
+    newChanged->assign_union((*iter)->changed);
+    (*iter)->changed.clear();
+  }
+}
+
+void ComparingUpdateTracker::setThreadException(const rdr::Exception& e)
+{
+  os::AutoMutex a(queueMutex);
+
+  if (threadException != NULL)
+    return;
+
+  threadException = new rdr::Exception("Exception on comparison thread: %s", e.str());
+}
+
+void ComparingUpdateTracker::throwThreadException()
+{
+  os::AutoMutex a(queueMutex);
+
+  if (threadException == NULL)
+    return;
+
+  rdr::Exception e(*threadException);
+
+  delete threadException;
+  threadException = NULL;
+
+  throw e;
+}
+
+ComparingUpdateTracker::CompareThread::CompareThread(ComparingUpdateTracker* tracker)
+{
+  this->tracker = tracker;
+
+  stopRequested = false;
+
+  start();
+}
+
+ComparingUpdateTracker::CompareThread::~CompareThread()
+{
+  stop();
+  wait();
+}
+
+void ComparingUpdateTracker::CompareThread::stop()
+{
+  os::AutoMutex a(tracker->queueMutex);
+
+  if (!isRunning())
+    return;
+
+  stopRequested = true;
+
+  // We can't wake just this thread, so wake everyone
+  tracker->consumerCond->broadcast();
+}
+
+void ComparingUpdateTracker::CompareThread::worker()
+{
+  tracker->queueMutex->lock();
+
+  while (!stopRequested) {
+    Rect band;
+
+    if (tracker->workQueue.empty()) {
+      // Wait and try again
+      tracker->consumerCond->wait();
+      continue;
+    }
+
+    band = tracker->workQueue.front();
+    tracker->workQueue.pop_front();
+
+    tracker->activeThreads++;
+
+    tracker->queueMutex->unlock();
+
+    try {
+      tracker->compareRect(band, &changed);
+    } catch (rdr::Exception& e) {
+      tracker->setThreadException(e);
+    } catch(...) {
+      assert(false);
+    }
+
+    tracker->queueMutex->lock();
+
+    tracker->activeThreads--;
+
+    // Only the main thread waits for bands to finish
+    if (tracker->activeThreads == 0)
+      tracker->producerCond->signal();
+  }
+
+  tracker->queueMutex->unlock();
+}
+
 void ComparingUpdateTracker::logStats()
 {
   double ratio;
@@ -19,8 +19,24 @@
 #ifndef __RFB_COMPARINGUPDATETRACKER_H__
 #define __RFB_COMPARINGUPDATETRACKER_H__
 
+#include <list>
+#include <vector>
+
+#include <os/Thread.h>
+
+#include <rdr/types.h>
+#include <rfb/ScrollDetector.h>
 #include <rfb/UpdateTracker.h>
 
+namespace os {
+  class Condition;
+  class Mutex;
+}
+
+namespace rdr {
+  struct Exception;
+}
+
 namespace rfb {
 
   class ComparingUpdateTracker : public SimpleUpdateTracker {
@@ -43,14 +59,67 @@ namespace rfb {
 
     void logStats();
 
+    // setCompareFeatures() limits the comparison to code that only
+    // needs the given CPUFeatures. Only meant for testing and
+    // benchmarking.
+
+    static void setCompareFeatures(unsigned features);
+
   private:
     void compareRect(const Rect& r, Region* newchanged);
+    void compareRects(const std::vector<Rect>& rects, Region* newChanged);
+
+    bool detectCopy();
+
+    void compareTiles(const Rect& band, Region* newChanged);
+    void hashTiles(const Rect& r);
+    rdr::U64 hashTile(const Rect& tile);
+
+    void setThreadException(const rdr::Exception& e);
+    void throwThreadException();
+
     PixelBuffer* fb;
     ManagedPixelBuffer oldFb;
     bool firstCompare;
     bool enabled;
 
     unsigned long long totalPixels, missedPixels;
+
+    // Hash of each tile, used instead of oldFb to save memory
+    bool hashing;
+    int tilesX, tilesY;
+    std::vector<rdr::U64> tileHashes;
+
+    bool detectScrolling;
+    ScrollDetector scrollDetector;
+
+    std::list<Rect> workQueue;
+    int activeThreads;
+
+    os::Mutex* queueMutex;
+    os::Condition* producerCond;
+    os::Condition* consumerCond;
+
+    class CompareThread : public os::Thread {
+    public:
+      CompareThread(ComparingUpdateTracker* tracker);
+      ~CompareThread();
+
+      void stop();
+
+      Region changed;
+
+    protected:
+      void worker();
+
+    private:
+      ComparingUpdateTracker* tracker;
+
+      bool stopRequested;
+    };
+
+    std::list<CompareThread*> threads;
+    rdr::Exception *threadException;
   };
 
 }
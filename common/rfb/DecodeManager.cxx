@@ -27,6 +27,7 @@
 
 #include <rfb/LogWriter.h>
 
+#include <rdr/BufferedInStream.h>
 #include <rdr/Exception.h>
 #include <rdr/MemOutStream.h>
 
@@ -36,6 +37,35 @@ using namespace rfb;
 
 static LogWriter vlog("DecodeManager");
 
+namespace rfb {
+  // SkipOutStream throws away everything written to it, and simply
+  // skips over any data that would have been copied
+  class SkipOutStream : public rdr::OutStream {
+  public:
+    SkipOutStream() : skipped(0) { ptr = buf; end = buf + sizeof(buf); }
+
+    void clear() { skipped = 0; ptr = buf; }
+
+    virtual size_t length() { return skipped + (ptr - buf); }
+
+    virtual void copyBytes(rdr::InStream* is, size_t length) {
+      is->skip(length);
+      skipped += length;
+    }
+
+  private:
+    virtual void overrun(size_t needed) {
+      assert(needed <= sizeof(buf));
+      skipped += ptr - buf;
+      ptr = buf;
+    }
+
+  private:
+    size_t skipped;
+    rdr::U8 buf[256];
+  };
+}
+
 DecodeManager::DecodeManager(CConnection *conn) :
   conn(conn), threadException(NULL)
 {
@@ -47,6 +77,8 @@ DecodeManager::DecodeManager(CConnection *conn) :
   producerCond = new os::Condition(queueMutex);
   consumerCond = new os::Condition(queueMutex);
 
+  skipStream = new SkipOutStream();
+
   cpuCount = os::Thread::getSystemCPUCount();
   if (cpuCount == 0) {
     vlog.error("Unable to determine the number of CPU cores on this system");
@@ -68,6 +100,7 @@ DecodeManager::DecodeManager(CConnection *conn) :
   if (cpuCount == 1) {
     // Threads are not used on single CPU machines
     freeBuffers.push_back(new rdr::MemOutStream());
+    freeEntries.push_back(new QueueEntry);
     return;
   }
 
@@ -76,6 +109,8 @@ DecodeManager::DecodeManager(CConnection *conn) :
     // are worker threads to make sure they don't stall
     freeBuffers.push_back(new rdr::MemOutStream());
     freeBuffers.push_back(new rdr::MemOutStream());
+    freeEntries.push_back(new QueueEntry);
+    freeEntries.push_back(new QueueEntry);
 
     threads.push_back(new DecodeThread(this));
   }
@@ -95,6 +130,13 @@ DecodeManager::~DecodeManager()
     freeBuffers.pop_back();
   }
 
+  while (!freeEntries.empty()) {
+    delete freeEntries.back();
+    freeEntries.pop_back();
+  }
+
+  delete skipStream;
+
   delete consumerCond;
   delete producerCond;
   delete queueMutex;
@@ -110,6 +152,7 @@ bool DecodeManager::decodeRect(const Rect& r, int encoding,
   rdr::MemOutStream *bufferStream;
 
   QueueEntry *entry;
+  bool ready;
 
   assert(pb != NULL);
 
@@ -131,16 +174,20 @@ bool DecodeManager::decodeRect(const Rect& r, int encoding,
   // Fast path for single CPU machines to avoid the context
   // switching overhead
   if (threads.empty()) {
-    bufferStream = freeBuffers.front();
-    bufferStream->clear();
-    if (!decoder->readRect(r, conn->getInStream(), conn->server, bufferStream))
+    entry = freeEntries.front();
+    entry->rect = r;
+    entry->decoder = decoder;
+    entry->server = &conn->server;
+    entry->bufferStream = freeBuffers.front();
+    if (!readEntryData(entry))
       return false;
     try {
-      decoder->decodeRect(r, bufferStream->data(), bufferStream->length(),
-                          conn->server, pb);
+      decoder->decodeRect(r, entry->data, entry->length, conn->server, pb);
     } catch (rdr::Exception& e) {
+      releaseEntryData(entry);
       throw Exception("Error decoding rect: %s", e.str());
     }
+    releaseEntryData(entry);
     return true;
   }
 
@@ -154,6 +201,8 @@ bool DecodeManager::decodeRect(const Rect& r, int encoding,
   // Don't pop the buffer in case we throw an exception
   // whilst reading
   bufferStream = freeBuffers.front();
+  // There is always an entry for each buffer
+  entry = freeEntries.front();
 
   queueMutex->unlock();
 
@@ -161,14 +210,6 @@ bool DecodeManager::decodeRect(const Rect& r, int encoding,
   throwThreadException();
 
   // Read the rect
-  bufferStream->clear();
-  if (!decoder->readRect(r, conn->getInStream(), conn->server, bufferStream))
-    return false;
-
-  // Then try to put it on the queue
-  entry = new QueueEntry;
-
-  entry->active = false;
   entry->rect = r;
   entry->encoding = encoding;
   entry->decoder = decoder;
@@ -176,24 +217,30 @@ bool DecodeManager::decodeRect(const Rect& r, int encoding,
   entry->pb = pb;
   entry->bufferStream = bufferStream;
 
-  decoder->getAffectedRegion(r, bufferStream->data(),
-                             bufferStream->length(), conn->server,
-                             &entry->affectedRegion);
+  if (!readEntryData(entry))
+    return false;
+
+  // Then try to put it on the queue
+  decoder->getAffectedRegion(r, entry->data, entry->length,
+                             conn->server, &entry->affectedRegion);
 
   queueMutex->lock();
 
-  // The workers add buffers to the end so it's safe to assume
-  // the front is still the same buffer
+  // The workers add buffers and entries to the end so it's safe to
+  // assume the front is still the same
   freeBuffers.pop_front();
+  freeEntries.pop_front();
 
-  workQueue.push_back(entry);
-
-  // We only put a single entry on the queue so waking a single
-  // thread is sufficient
-  consumerCond->signal();
+  ready = queueEntry(entry);
 
   queueMutex->unlock();
 
+  // We only put a single entry on the queue so waking a single
+  // thread is sufficient. Done without the lock so that the thread
+  // doesn't immediately have to wait for us.
+  if (ready)
+    consumerCond->signal();
+
   return true;
 }
 
@@ -209,6 +256,162 @@ void DecodeManager::flush()
   throwThreadException();
 }
 
+//
+// readEntryData() reads the data for the entry's rect. If possible the
+// data is left in the input stream's buffer rather than copied out.
+//
+
+bool DecodeManager::readEntryData(QueueEntry* entry)
+{
+  rdr::InStream* is;
+  rdr::BufferedInStream* bis;
+
+  is = conn->getInStream();
+  bis = dynamic_cast<rdr::BufferedInStream*>(is);
+
+  if (bis == NULL) {
+    entry->bufferStream->clear();
+    if (!entry->decoder->readRect(entry->rect, is, *entry->server,
+                                  entry->bufferStream))
+      return false;
+
+    entry->data = (const rdr::U8*)entry->bufferStream->data();
+    entry->length = entry->bufferStream->length();
+    entry->retained = NULL;
+
+    return true;
+  }
+
+  bis->setRetainPoint();
+
+  try {
+    skipStream->clear();
+    if (!entry->decoder->readRect(entry->rect, is, *entry->server,
+                                  skipStream)) {
+      bis->clearRetainPoint();
+      return false;
+    }
+  } catch (...) {
+    bis->clearRetainPoint();
+    throw;
+  }
+
+  entry->data = bis->retainData(&entry->length, &entry->retained);
+
+  // Should be impossible given how readRect() must behave
+  assert(entry->length == skipStream->length());
+
+  return true;
+}
+
+void DecodeManager::releaseEntryData(QueueEntry* entry)
+{
+  if (entry->retained == NULL)
+    return;
+
+  rdr::BufferedInStream::releaseData(entry->retained);
+  entry->retained = NULL;
+}
+
+//
+// entriesConflict() checks if the second entry has to wait for the
+// first one to be decoded.
+//
+
+bool DecodeManager::entriesConflict(const QueueEntry* first,
+                                    const QueueEntry* second)
+{
+  if (first->encoding == second->encoding) {
+    // An ordered decoder handles its rectangles in the order they
+    // arrived
+    if (second->decoder->flags & DecoderOrdered)
+      return true;
+
+    // For a partially ordered decoder we must ask the decoder for
+    // each pair of rectangles
+    if (second->decoder->flags & DecoderPartiallyOrdered) {
+      if (second->decoder->doRectsConflict(second->rect,
+                                           second->data, second->length,
+                                           first->rect,
+                                           first->data, first->length,
+                                           *second->server))
+        return true;
+    }
+  }
+
+  // Check overlap with the earlier rectangle
+  return !first->affectedRegion.intersect(second->affectedRegion).is_empty();
+}
+
+//
+// queueEntry() works out which of the queued up entries this one has
+// to wait for, so that the workers don't have to search the queue
+// for something to do. Returns true if the entry can be started right
+// away. Called with the queue mutex held.
+//
+
+bool DecodeManager::queueEntry(QueueEntry* entry)
+{
+  std::list<QueueEntry*>::iterator iter;
+
+  entry->blockers = 0;
+
+  for (iter = workQueue.begin(); iter != workQueue.end(); ++iter) {
+    if (!entriesConflict(*iter, entry))
+      continue;
+
+    (*iter)->blocked.push_back(entry);
+    entry->blockers++;
+  }
+
+  entry->queuePos = workQueue.insert(workQueue.end(), entry);
+
+  if (entry->blockers > 0)
+    return false;
+
+  readyQueue.push_back(entry);
+
+  return true;
+}
+
+//
+// finishEntry() removes a decoded entry from the queue and lets the
+// entries waiting for it go ahead. Called with the queue mutex held.
+//
+
+void DecodeManager::finishEntry(QueueEntry* entry)
+{
+  std::vector<QueueEntry*>::iterator iter;
+  bool wakeup;
+
+  // The calling thread will pick up the first entry made ready, so we
+  // only need to wake others for any beyond that
+  wakeup = !readyQueue.empty();
+
+  for (iter = entry->blocked.begin(); iter != entry->blocked.end(); ++iter) {
+    (*iter)->blockers--;
+    if ((*iter)->blockers == 0) {
+      readyQueue.push_back(*iter);
+      if (wakeup)
+        consumerCond->signal();
+      wakeup = true;
+    }
+  }
+
+  entry->blocked.clear();
+
+  workQueue.erase(entry->queuePos);
+
+  releaseEntryData(entry);
+
+  // Give back the memory buffer and the entry
+  freeBuffers.push_back(entry->bufferStream);
+  freeEntries.push_back(entry);
+
+  // Wake the main thread in case it is waiting for a memory buffer
+  producerCond->signal();
+}
+
 void DecodeManager::setThreadException(const rdr::Exception& e)
 {
   os::AutoMutex a(queueMutex);
@@ -270,22 +473,21 @@ void DecodeManager::DecodeThread::worker()
     DecodeManager::QueueEntry *entry;
 
     // Look for an available entry in the work queue
-    entry = findEntry();
-    if (entry == NULL) {
+    if (manager->readyQueue.empty()) {
       // Wait and try again
       manager->consumerCond->wait();
       continue;
     }
 
     // This is ours now
-    entry->active = true;
+    entry = manager->readyQueue.front();
+    manager->readyQueue.pop_front();
 
     manager->queueMutex->unlock();
 
     // Do the actual decoding
     try {
-      entry->decoder->decodeRect(entry->rect, entry->bufferStream->data(),
-                                 entry->bufferStream->length(),
+      entry->decoder->decodeRect(entry->rect, entry->data, entry->length,
                                  *entry->server, entry->pb);
     } catch (rdr::Exception& e) {
       manager->setThreadException(e);
@@ -295,81 +497,8 @@ void DecodeManager::DecodeThread::worker()
 
     manager->queueMutex->lock();
 
-    // Remove the entry from the queue and give back the memory buffer
-    manager->freeBuffers.push_back(entry->bufferStream);
-    manager->workQueue.remove(entry);
-    delete entry;
-
-    // Wake the main thread in case it is waiting for a memory buffer
-    manager->producerCond->signal();
-    // This rect might have been blocking multiple other rects, so
-    // wake up every worker thread
-    if (manager->workQueue.size() > 1)
-      manager->consumerCond->broadcast();
+    manager->finishEntry(entry);
   }
 
   manager->queueMutex->unlock();
 }
-
-DecodeManager::QueueEntry* DecodeManager::DecodeThread::findEntry()
-{
-  std::list<DecodeManager::QueueEntry*>::iterator iter;
-  Region lockedRegion;
-
-  if (manager->workQueue.empty())
-    return NULL;
-
-  if (!manager->workQueue.front()->active)
-    return manager->workQueue.front();
-
-  for (iter = manager->workQueue.begin();
-       iter != manager->workQueue.end();
-       ++iter) {
-    DecodeManager::QueueEntry* entry;
-
-    std::list<DecodeManager::QueueEntry*>::iterator iter2;
-
-    entry = *iter;
-
-    // Another thread working on this?
-    if (entry->active)
-      goto next;
-
-    // If this is an ordered decoder then make sure this is the first
-    // rectangle in the queue for that decoder
-    if (entry->decoder->flags & DecoderOrdered) {
-      for (iter2 = manager->workQueue.begin(); iter2 != iter; ++iter2) {
-        if (entry->encoding == (*iter2)->encoding)
-          goto next;
-      }
-    }
-
-    // For a partially ordered decoder we must ask the decoder for each
-    // pair of rectangles.
-    if (entry->decoder->flags & DecoderPartiallyOrdered) {
-      for (iter2 = manager->workQueue.begin(); iter2 != iter; ++iter2) {
-        if (entry->encoding != (*iter2)->encoding)
-          continue;
-        if (entry->decoder->doRectsConflict(entry->rect,
-                                            entry->bufferStream->data(),
-                                            entry->bufferStream->length(),
-                                            (*iter2)->rect,
-                                            (*iter2)->bufferStream->data(),
-                                            (*iter2)->bufferStream->length(),
-                                            *entry->server))
-          goto next;
-      }
-    }
-
-    // Check overlap with earlier rectangles
-    if (!lockedRegion.intersect(entry->affectedRegion).is_empty())
-      goto next;
-
-    return entry;
-
-next:
-    lockedRegion.assign_union(entry->affectedRegion);
-  }
-
-  return NULL;
-}
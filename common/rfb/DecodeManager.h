@@ -20,6 +20,7 @@
 #define __RFB_DECODEMANAGER_H__
 
 #include <list>
+#include <vector>
 
 #include <os/Thread.h>
 
@@ -38,6 +39,7 @@ namespace rdr {
 
 namespace rfb {
   class CConnection;
+  class SkipOutStream;
   class Decoder;
   class ModifiablePixelBuffer;
   struct Rect;
@@ -61,7 +63,6 @@ namespace rfb {
     Decoder *decoders[encodingMax+1];
 
     struct QueueEntry {
-      bool active;
       Rect rect;
       int encoding;
       Decoder* decoder;
@@ -69,10 +70,38 @@ namespace rfb {
       ModifiablePixelBuffer* pb;
       rdr::MemOutStream* bufferStream;
       Region affectedRegion;
+
+      // The rect data, either in bufferStream or retained directly
+      // from the connection's input stream
+      const rdr::U8* data;
+      size_t length;
+      void* retained;
+
+      // Number of earlier entries that must be done before this one
+      // can be started, and the later entries waiting for this one
+      unsigned blockers;
+      std::vector<QueueEntry*> blocked;
+
+      std::list<QueueEntry*>::iterator queuePos;
     };
 
+    bool readEntryData(QueueEntry* entry);
+    void releaseEntryData(QueueEntry* entry);
+
+    bool entriesConflict(const QueueEntry* first,
+                         const QueueEntry* second);
+    bool queueEntry(QueueEntry* entry);
+    void finishEntry(QueueEntry* entry);
+
     std::list<rdr::MemOutStream*> freeBuffers;
+    std::list<QueueEntry*> freeEntries;
+
+    SkipOutStream* skipStream;
+
+    // Every entry not yet done, in order, and the ones that can be
+    // started right away
     std::list<QueueEntry*> workQueue;
+    std::list<QueueEntry*> readyQueue;
 
     os::Mutex* queueMutex;
     os::Condition* producerCond;
@@ -88,7 +117,6 @@ namespace rfb {
 
     protected:
       void worker();
-      DecodeManager::QueueEntry* findEntry();
 
     private:
       DecodeManager* manager;
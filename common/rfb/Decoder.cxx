@@ -26,6 +26,10 @@
 #include <rfb/HextileDecoder.h>
 #include <rfb/ZRLEDecoder.h>
 #include <rfb/TightDecoder.h>
+#include <rfb/TileCacheDecoder.h>
+#ifdef HAVE_H264
+#include <rfb/H264Decoder.h>
+#endif
 
 using namespace rfb;
 
@@ -61,6 +65,13 @@ bool Decoder::supported(int encoding)
   case encodingHextile:
   case encodingZRLE:
   case encodingTight:
+  case encodingTileCache:
+#ifdef HAVE_ZSTD
+  case encodingZstdRLE:
+#endif
+#ifdef HAVE_H264
+  case encodingH264:
+#endif
     return true;
   default:
     return false;
@@ -82,6 +93,16 @@ Decoder* Decoder::createDecoder(int encoding)
     return new ZRLEDecoder();
   case encodingTight:
     return new TightDecoder();
+  case encodingTileCache:
+    return new TileCacheDecoder();
+#ifdef HAVE_ZSTD
+  case encodingZstdRLE:
+    return new ZRLEDecoder(encodingZstdRLE);
+#endif
+#ifdef HAVE_H264
+  case encodingH264:
+    return new H264Decoder();
+#endif
   default:
     return NULL;
   }
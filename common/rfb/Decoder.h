@@ -49,9 +49,11 @@ namespace rfb {
     // These functions are the main interface to an individual decoder
 
     // readRect() transfers data for the given rectangle from the
-    // InStream to the OutStream, possibly changing it along the way to
-    // make it easier to decode. This function will always be called in
-    // a serial manner on the main thread.
+    // InStream to the OutStream. The data must be transferred exactly
+    // as it appears on the InStream, as the caller may skip the copy
+    // and hand the stream's own buffer directly to decodeRect(). This
+    // function will always be called in a serial manner on the main
+    // thread.
     virtual bool readRect(const Rect& r, rdr::InStream* is,
                           const ServerParams& server, rdr::OutStream* os)=0;
 
@@ -0,0 +1,291 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <assert.h>
+
+#include <rfb/EncodeCache.h>
+#include <rfb/LogWriter.h>
+#include <rfb/Region.h>
+#include <rfb/util.h>
+
+using namespace rfb;
+
+static LogWriter vlog("EncodeCache");
+
+// Upper limit for the amount of encoded data we hold on to
+static const size_t MaxCacheSize = 64 * 1024 * 1024;
+
+// Size of the cells used to find the entries affected by a change
+static const int CellSize = 256;
+
+static inline rdr::U32 cellKey(int x, int y)
+{
+  return ((rdr::U32)y << 16) | (rdr::U32)x;
+}
+
+EncodeCache::EncodeCache()
+  : pb(NULL), enabled(false), totalSize(0), currentMark(0),
+    hits(0), misses(0), hitBytes(0)
+{
+}
+
+EncodeCache::~EncodeCache()
+{
+  clear();
+}
+
+void EncodeCache::logStats()
+{
+  char a[1024];
+
+  if ((hits == 0) && (misses == 0))
+    return;
+
+  iecPrefix(hitBytes, "B", a, sizeof(a));
+  vlog.info("%u hits, %u misses, %s reused",
+            hits, misses, a);
+}
+
+void EncodeCache::setPixelBuffer(const PixelBuffer* pb_)
+{
+  pb = pb_;
+  clear();
+}
+
+void EncodeCache::setEnabled(bool enabled_)
+{
+  if (enabled == enabled_)
+    return;
+
+  enabled = enabled_;
+  if (!enabled)
+    clear();
+}
+
+bool EncodeCache::isEnabled(const PixelBuffer* pb_) const
+{
+  return enabled && (pb_ != NULL) && (pb_ == pb);
+}
+
+void EncodeCache::invalidate(const Region& changed)
+{
+  std::vector<Rect> rects;
+  std::vector<Rect>::const_iterator rect;
+  std::vector<Entry*> victims;
+  std::vector<Entry*>::const_iterator iter;
+
+  if (lru.empty())
+    return;
+
+  // New mark so we can tell which entries we've already looked at
+  currentMark++;
+
+  changed.get_rects(&rects);
+
+  for (rect = rects.begin(); rect != rects.end(); ++rect) {
+    for (int cy = rect->tl.y / CellSize;
+         cy <= (rect->br.y - 1) / CellSize; cy++) {
+      for (int cx = rect->tl.x / CellSize;
+           cx <= (rect->br.x - 1) / CellSize; cx++) {
+        CellMap::const_iterator cell;
+
+        cell = cells.find(cellKey(cx, cy));
+        if (cell == cells.end())
+          continue;
+
+        for (iter = cell->second.begin();
+             iter != cell->second.end(); ++iter) {
+          if ((*iter)->mark == currentMark)
+            continue;
+          if (!(*iter)->rect.overlaps(*rect))
+            continue;
+
+          (*iter)->mark = currentMark;
+          victims.push_back(*iter);
+        }
+      }
+    }
+  }
+
+  for (iter = victims.begin(); iter != victims.end(); ++iter)
+    remove(*iter);
+}
+
+void EncodeCache::clear()
+{
+  while (!lru.empty())
+    remove(lru.front());
+}
+
+bool EncodeCache::lookup(const Rect& rect, const PixelFormat& pf,
+                         const std::vector<int>& settings, int* type,
+                         const rdr::U8** data, size_t* length)
+{
+  Entry* entry;
+
+  entry = find(hashKey(rect, pf, settings), rect, pf, settings);
+  if (entry == NULL) {
+    misses++;
+    return false;
+  }
+
+  // Keep it fresh
+  lru.splice(lru.begin(), lru, entry->lruPos);
+
+  *type = entry->type;
+  *data = entry->data.empty() ? NULL : &entry->data[0];
+  *length = entry->data.size();
+
+  hits++;
+  hitBytes += entry->data.size();
+
+  return true;
+}
+
+void EncodeCache::insert(const Rect& rect, const PixelFormat& pf,
+                         const std::vector<int>& settings, int type,
+                         const rdr::U8* data, size_t length)
+{
+  Entry* entry;
+  size_t hash;
+
+  if (rect.is_empty())
+    return;
+
+  if (length > MaxCacheSize)
+    return;
+
+  hash = hashKey(rect, pf, settings);
+
+  // Newer data replaces the old
+  entry = find(hash, rect, pf, settings);
+  if (entry != NULL)
+    remove(entry);
+
+  while ((totalSize + length) > MaxCacheSize)
+    remove(lru.back());
+
+  entry = new Entry;
+  entry->rect = rect;
+  entry->pf = pf;
+  entry->settings = settings;
+  entry->type = type;
+  entry->data.assign(data, data + length);
+  entry->hash = hash;
+  entry->mark = currentMark;
+
+  lru.push_front(entry);
+  entry->lruPos = lru.begin();
+
+  index.insert(EntryIndex::value_type(hash, entry));
+
+  for (int cy = rect.tl.y / CellSize; cy <= (rect.br.y - 1) / CellSize; cy++) {
+    for (int cx = rect.tl.x / CellSize; cx <= (rect.br.x - 1) / CellSize; cx++)
+      cells[cellKey(cx, cy)].push_back(entry);
+  }
+
+  totalSize += length;
+}
+
+size_t EncodeCache::hashKey(const Rect& rect, const PixelFormat& pf,
+                            const std::vector<int>& settings)
+{
+  std::vector<int>::const_iterator iter;
+  size_t hash;
+
+  // FNV-1a style mixing of everything that is cheap to get at. The
+  // pixel format is compared in full on lookup, so only the most
+  // common difference is included here.
+  hash = 2166136261U;
+  hash = (hash ^ (unsigned)rect.tl.x) * 16777619U;
+  hash = (hash ^ (unsigned)rect.tl.y) * 16777619U;
+  hash = (hash ^ (unsigned)rect.br.x) * 16777619U;
+  hash = (hash ^ (unsigned)rect.br.y) * 16777619U;
+  hash = (hash ^ (unsigned)pf.bpp) * 16777619U;
+  for (iter = settings.begin(); iter != settings.end(); ++iter)
+    hash = (hash ^ (unsigned)*iter) * 16777619U;
+
+  return hash;
+}
+
+EncodeCache::Entry* EncodeCache::find(size_t hash, const Rect& rect,
+                                      const PixelFormat& pf,
+                                      const std::vector<int>& settings)
+{
+  std::pair<EntryIndex::iterator, EntryIndex::iterator> range;
+  EntryIndex::iterator iter;
+
+  range = index.equal_range(hash);
+  for (iter = range.first; iter != range.second; ++iter) {
+    Entry* entry;
+
+    entry = iter->second;
+
+    if (!entry->rect.equals(rect))
+      continue;
+    if (!entry->pf.equal(pf))
+      continue;
+    if (entry->settings != settings)
+      continue;
+
+    return entry;
+  }
+
+  return NULL;
+}
+
+void EncodeCache::remove(Entry* entry)
+{
+  std::pair<EntryIndex::iterator, EntryIndex::iterator> range;
+  EntryIndex::iterator iter;
+  const Rect& rect = entry->rect;
+
+  range = index.equal_range(entry->hash);
+  for (iter = range.first; iter != range.second; ++iter) {
+    if (iter->second == entry) {
+      index.erase(iter);
+      break;
+    }
+  }
+
+  for (int cy = rect.tl.y / CellSize; cy <= (rect.br.y - 1) / CellSize; cy++) {
+    for (int cx = rect.tl.x / CellSize; cx <= (rect.br.x - 1) / CellSize; cx++) {
+      CellMap::iterator cell;
+      std::vector<Entry*>::iterator pos;
+
+      cell = cells.find(cellKey(cx, cy));
+      assert(cell != cells.end());
+
+      for (pos = cell->second.begin(); pos != cell->second.end(); ++pos) {
+        if (*pos == entry) {
+          *pos = cell->second.back();
+          cell->second.pop_back();
+          break;
+        }
+      }
+
+      if (cell->second.empty())
+        cells.erase(cell);
+    }
+  }
+
+  lru.erase(entry->lruPos);
+  totalSize -= entry->data.size();
+
+  delete entry;
+}
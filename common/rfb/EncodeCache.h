@@ -0,0 +1,120 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// EncodeCache keeps the encoded data for recently sent rects so that
+// it can be reused by every other client that needs to send the exact
+// same rect with the exact same encoding parameters.
+//
+
+#ifndef __RFB_ENCODECACHE_H__
+#define __RFB_ENCODECACHE_H__
+
+#include <stddef.h>
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <rdr/types.h>
+#include <rfb/PixelFormat.h>
+#include <rfb/Rect.h>
+
+namespace rfb {
+  class PixelBuffer;
+  class Region;
+
+  class EncodeCache {
+  public:
+    EncodeCache();
+    ~EncodeCache();
+
+    void logStats();
+
+    // setPixelBuffer() must be called whenever the framebuffer is
+    // replaced, as it forgets everything that is cached
+    void setPixelBuffer(const PixelBuffer* pb);
+
+    // The cache only makes sense when there are multiple clients, so
+    // the server turns it on and off as clients come and go
+    void setEnabled(bool enabled);
+
+    // isEnabled() checks if the cache can be used for data from the
+    // given PixelBuffer
+    bool isEnabled(const PixelBuffer* pb) const;
+
+    // invalidate() drops every rect that has been (partially) changed
+    void invalidate(const Region& changed);
+    void clear();
+
+    // lookup() finds previously encoded data for the rect. The settings
+    // are an opaque description of all encoder parameters that can
+    // affect the data. The returned pointer is only valid until the
+    // cache is modified.
+    bool lookup(const Rect& rect, const PixelFormat& pf,
+                const std::vector<int>& settings, int* type,
+                const rdr::U8** data, size_t* length);
+    void insert(const Rect& rect, const PixelFormat& pf,
+                const std::vector<int>& settings, int type,
+                const rdr::U8* data, size_t length);
+
+  protected:
+    struct Entry {
+      Rect rect;
+      PixelFormat pf;
+      std::vector<int> settings;
+      int type;
+      std::vector<rdr::U8> data;
+
+      size_t hash;
+      std::list<Entry*>::iterator lruPos;
+      unsigned mark;
+    };
+
+    typedef std::unordered_multimap<size_t, Entry*> EntryIndex;
+    typedef std::unordered_map<rdr::U32, std::vector<Entry*> > CellMap;
+
+    static size_t hashKey(const Rect& rect, const PixelFormat& pf,
+                          const std::vector<int>& settings);
+
+    Entry* find(size_t hash, const Rect& rect, const PixelFormat& pf,
+                const std::vector<int>& settings);
+    void remove(Entry* entry);
+
+  protected:
+    const PixelBuffer* pb;
+    bool enabled;
+
+    // Most recently used first
+    std::list<Entry*> lru;
+    size_t totalSize;
+
+    // Entries by their rect, format and settings
+    EntryIndex index;
+    // Entries by the parts of the screen they cover
+    CellMap cells;
+    // Used to visit every entry only once when invalidating
+    unsigned currentMark;
+
+    unsigned hits, misses;
+    unsigned long long hitBytes;
+  };
+
+}
+
+#endif
@@ -19,16 +19,34 @@
  * USA.
  */
 
+#include <assert.h>
 #include <stdlib.h>
 
+#include <rdr/Exception.h>
+#include <rdr/MemOutStream.h>
+
+#include <os/Mutex.h>
+
+#include <rfb/cpuFeatures.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+#ifdef HAVE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+#include <rfb/EncodeCache.h>
 #include <rfb/EncodeManager.h>
 #include <rfb/Encoder.h>
 #include <rfb/Palette.h>
 #include <rfb/SConnection.h>
 #include <rfb/SMsgWriter.h>
+#include <rfb/ServerCore.h>
 #include <rfb/UpdateTracker.h>
 #include <rfb/LogWriter.h>
 #include <rfb/Exception.h>
+#include <rfb/util.h>
 
 #include <rfb/RawEncoder.h>
 #include <rfb/RREEncoder.h>
@@ -52,9 +70,322 @@ static const int SolidSearchBlock = 16;
 // Don't bother with blocks smaller than this
 static const int SolidBlockMinArea = 2048;
 
+// Don't bother with the client's tile cache for rects smaller than this
+static const int TileCacheMinArea = 4096;
+
+// The screen is divided in to tiles of this size when tracking how
+// often things change
+static const int VideoTileSize = 64;
+// A tile needs to change this many times in a row, with no more than
+// this many ms between each change, before we consider it to be video
+static const unsigned VideoMinFrames = 10;
+static const unsigned VideoMaxInterval = 200;
+// Smaller areas are more likely to be animations that should stay sharp
+static const int VideoMinTiles = 4;
+
 // How long we consider a region recently changed (in ms)
 static const int RecentChangeTimeout = 50;
 
+//
+// The run scanning kernels. They return how many bytes at the start
+// of buf that match pattern, which is repeated over the whole buffer.
+// A pixel is then part of the run if all of its bytes match.
+//
+// The solid area kernels instead check that height rows of length
+// bytes, each stride bytes apart, match pattern completely. length
+// must be a multiple of the pixel size.
+//
+
+typedef size_t (*MatchingBytesFunc)(const rdr::U8* buf, size_t length,
+                                    rdr::U32 pattern);
+typedef bool (*SolidBytesFunc)(const rdr::U8* buf, size_t length,
+                               size_t stride, int height,
+                               rdr::U32 pattern);
+
+// Handles the bytes that don't fill an entire vector
+static inline size_t matchingBytesTail(const rdr::U8* buf, size_t offset,
+                                       size_t length, rdr::U32 pattern)
+{
+  rdr::U8 bytes[4];
+
+  memcpy(bytes, &pattern, sizeof(bytes));
+
+  for (; offset < length; offset++) {
+    if (buf[offset] != bytes[offset % 4])
+      break;
+  }
+
+  return offset;
+}
+
+static size_t matchingBytesPlain(const rdr::U8* buf, size_t length,
+                                 rdr::U32 pattern)
+{
+  size_t offset;
+
+  for (offset = 0; offset + 4 <= length; offset += 4) {
+    rdr::U32 value;
+    memcpy(&value, buf + offset, sizeof(value));
+    if (value != pattern)
+      break;
+  }
+
+  return matchingBytesTail(buf, offset, length, pattern);
+}
+
+static bool solidBytesPlain(const rdr::U8* buf, size_t length,
+                            size_t stride, int height, rdr::U32 pattern)
+{
+  while (height--) {
+    if (matchingBytesPlain(buf, length, pattern) != length)
+      return false;
+    buf += stride;
+  }
+
+  return true;
+}
+
+#ifdef HAVE_X86_SIMD
+
+__target_sse2_attr
+static size_t matchingBytesSSE2(const rdr::U8* buf, size_t length,
+                                rdr::U32 pattern)
+{
+  size_t offset;
+  __m128i ref;
+
+  ref = _mm_set1_epi32(pattern);
+
+  for (offset = 0; offset + 16 <= length; offset += 16) {
+    __m128i a;
+    unsigned mask;
+
+    a = _mm_loadu_si128((const __m128i*)(buf + offset));
+
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, ref)) ^ 0xffff;
+    if (mask != 0)
+      return offset + __builtin_ctz(mask);
+  }
+
+  return matchingBytesTail(buf, offset, length, pattern);
+}
+
+// The pattern repeats every pixel, so as long as a row is at least
+// one vector long, the end can be covered by a vector that overlaps
+// the previous one rather than having to look at individual bytes
+
+__target_sse2_attr
+static bool solidBytesSSE2(const rdr::U8* buf, size_t length,
+                           size_t stride, int height, rdr::U32 pattern)
+{
+  __m128i ref;
+
+  if (length < 16)
+    return solidBytesPlain(buf, length, stride, height, pattern);
+
+  ref = _mm_set1_epi32(pattern);
+
+  while (height--) {
+    size_t offset;
+    __m128i same;
+
+    same = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)
+                                          (buf + length - 16)), ref);
+
+    for (offset = 0; offset + 16 < length; offset += 16) {
+      __m128i a;
+      a = _mm_loadu_si128((const __m128i*)(buf + offset));
+      same = _mm_and_si128(same, _mm_cmpeq_epi8(a, ref));
+    }
+
+    if (_mm_movemask_epi8(same) != 0xffff)
+      return false;
+
+    buf += stride;
+  }
+
+  return true;
+}
+
+__target_avx2_attr
+static size_t matchingBytesAVX2(const rdr::U8* buf, size_t length,
+                                rdr::U32 pattern)
+{
+  size_t offset;
+  __m256i ref;
+
+  ref = _mm256_set1_epi32(pattern);
+
+  for (offset = 0; offset + 32 <= length; offset += 32) {
+    __m256i a;
+    unsigned mask;
+
+    a = _mm256_loadu_si256((const __m256i*)(buf + offset));
+
+    mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, ref));
+    if (mask != 0)
+      return offset + __builtin_ctz(mask);
+  }
+
+  if (offset + 16 <= length) {
+    __m128i a;
+    unsigned mask;
+
+    a = _mm_loadu_si128((const __m128i*)(buf + offset));
+
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, _mm256_castsi256_si128(ref)));
+    mask ^= 0xffff;
+    if (mask != 0)
+      return offset + __builtin_ctz(mask);
+
+    offset += 16;
+  }
+
+  return matchingBytesTail(buf, offset, length, pattern);
+}
+
+__target_avx2_attr
+static bool solidBytesAVX2(const rdr::U8* buf, size_t length,
+                           size_t stride, int height, rdr::U32 pattern)
+{
+  __m256i ref;
+
+  if (length < 32)
+    return solidBytesSSE2(buf, length, stride, height, pattern);
+
+  ref = _mm256_set1_epi32(pattern);
+
+  while (height--) {
+    size_t offset;
+    __m256i same;
+
+    same = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)
+                                                (buf + length - 32)), ref);
+
+    for (offset = 0; offset + 32 < length; offset += 32) {
+      __m256i a;
+      a = _mm256_loadu_si256((const __m256i*)(buf + offset));
+      same = _mm256_and_si256(same, _mm256_cmpeq_epi8(a, ref));
+    }
+
+    if (_mm256_movemask_epi8(same) != -1)
+      return false;
+
+    buf += stride;
+  }
+
+  return true;
+}
+
+#endif // HAVE_X86_SIMD
+
+#if defined(HAVE_NEON_SIMD) && defined(__aarch64__)
+
+static size_t matchingBytesNEON(const rdr::U8* buf, size_t length,
+                                rdr::U32 pattern)
+{
+  size_t offset;
+  uint8x16_t ref;
+
+  ref = vreinterpretq_u8_u32(vdupq_n_u32(pattern));
+
+  for (offset = 0; offset + 16 <= length; offset += 16) {
+    uint64x2_t diff;
+    rdr::U64 lo, hi;
+
+    diff = vreinterpretq_u64_u8(veorq_u8(vld1q_u8(buf + offset), ref));
+    lo = vgetq_lane_u64(diff, 0);
+    hi = vgetq_lane_u64(diff, 1);
+    if ((lo | hi) == 0)
+      continue;
+
+    // NEON is little endian here, so the lowest byte comes first
+    if (lo != 0)
+      return offset + __builtin_ctzll(lo) / 8;
+    return offset + 8 + __builtin_ctzll(hi) / 8;
+  }
+
+  return matchingBytesTail(buf, offset, length, pattern);
+}
+
+static bool solidBytesNEON(const rdr::U8* buf, size_t length,
+                           size_t stride, int height, rdr::U32 pattern)
+{
+  uint8x16_t ref;
+
+  if (length < 16)
+    return solidBytesPlain(buf, length, stride, height, pattern);
+
+  ref = vreinterpretq_u8_u32(vdupq_n_u32(pattern));
+
+  while (height--) {
+    size_t offset;
+    uint8x16_t diff;
+
+    diff = veorq_u8(vld1q_u8(buf + length - 16), ref);
+
+    for (offset = 0; offset + 16 < length; offset += 16)
+      diff = vorrq_u8(diff, veorq_u8(vld1q_u8(buf + offset), ref));
+
+    if (vmaxvq_u8(diff) != 0)
+      return false;
+
+    buf += stride;
+  }
+
+  return true;
+}
+
+#endif // HAVE_NEON_SIMD && __aarch64__
+
+static MatchingBytesFunc matchingBytes = matchingBytesPlain;
+static SolidBytesFunc solidBytes = solidBytesPlain;
+
+static void selectAnalysisKernels(unsigned features)
+{
+#ifdef HAVE_X86_SIMD
+  if (features & cpuAVX2) {
+    vlog.debug("Using AVX2 rect analysis");
+    matchingBytes = matchingBytesAVX2;
+    solidBytes = solidBytesAVX2;
+    return;
+  }
+  if (features & cpuSSE2) {
+    vlog.debug("Using SSE2 rect analysis");
+    matchingBytes = matchingBytesSSE2;
+    solidBytes = solidBytesSSE2;
+    return;
+  }
+#endif
+
+#if defined(HAVE_NEON_SIMD) && defined(__aarch64__)
+  if (features & cpuNEON) {
+    vlog.debug("Using NEON rect analysis");
+    matchingBytes = matchingBytesNEON;
+    solidBytes = solidBytesNEON;
+    return;
+  }
+#endif
+
+  vlog.debug("Using plain rect analysis");
+  matchingBytes = matchingBytesPlain;
+  solidBytes = solidBytesPlain;
+}
+
+static bool initAnalysisKernels()
+{
+  selectAnalysisKernels(getCPUFeatures());
+  return true;
+}
+
+// Other connections might already be using the kernels, so they must
+// only be picked once
+static void setupAnalysisKernels()
+{
+  static bool kernelsSelected = initAnalysisKernels();
+  (void)kernelsSelected;
+}
+
 namespace rfb {
 
 enum EncoderClass {
@@ -64,6 +395,8 @@ enum EncoderClass {
   encoderTight,
   encoderTightJPEG,
   encoderZRLE,
+  encoderZstdRLE,
+  encoderTightJPEGVideo,
   encoderClassMax,
 };
 
@@ -74,6 +407,7 @@ enum EncoderType {
   encoderIndexed,
   encoderIndexedRLE,
   encoderFullColour,
+  encoderVideo,
   encoderTypeMax,
 };
 
@@ -99,6 +433,10 @@ static const char *encoderClassName(EncoderClass klass)
     return "Tight (JPEG)";
   case encoderZRLE:
     return "ZRLE";
+  case encoderZstdRLE:
+    return "ZstdRLE";
+  case encoderTightJPEGVideo:
+    return "Tight (JPEG, video)";
   case encoderClassMax:
     break;
   }
@@ -121,6 +459,8 @@ static const char *encoderTypeName(EncoderType type)
     return "Indexed RLE";
   case encoderFullColour:
     return "Full Colour";
+  case encoderVideo:
+    return "Video";
   case encoderTypeMax:
     break;
   }
@@ -128,23 +468,42 @@ static const char *encoderTypeName(EncoderType type)
   return "Unknown Encoder Type";
 }
 
-EncodeManager::EncodeManager(SConnection* conn_)
-  : conn(conn_), recentChangeTimer(this)
+static void createEncoders(SConnection* conn, std::vector<Encoder*>* encoders)
+{
+  encoders->resize(encoderClassMax, NULL);
+
+  (*encoders)[encoderRaw] = new RawEncoder(conn);
+  (*encoders)[encoderRRE] = new RREEncoder(conn);
+  (*encoders)[encoderHextile] = new HextileEncoder(conn);
+  (*encoders)[encoderTight] = new TightEncoder(conn);
+  (*encoders)[encoderTightJPEG] = new TightJPEGEncoder(conn);
+  (*encoders)[encoderZRLE] = new ZRLEEncoder(conn);
+  (*encoders)[encoderZstdRLE] = new ZRLEEncoder(conn, encodingZstdRLE);
+  // Separate instance as video gets its own quality level
+  (*encoders)[encoderTightJPEGVideo] = new TightJPEGEncoder(conn);
+}
+
+EncodeManager::EncodeManager(SConnection* conn_, EncodeCache* cache_)
+  : conn(conn_), cache(cache_), recentChangeTimer(this),
+    threadException(NULL)
 {
   StatsVector::iterator iter;
+  int threadCount;
+  size_t cpuCount;
 
-  encoders.resize(encoderClassMax, NULL);
-  activeEncoders.resize(encoderTypeMax, encoderRaw);
+  setupAnalysisKernels();
 
-  encoders[encoderRaw] = new RawEncoder(conn);
-  encoders[encoderRRE] = new RREEncoder(conn);
-  encoders[encoderHextile] = new HextileEncoder(conn);
-  encoders[encoderTight] = new TightEncoder(conn);
-  encoders[encoderTightJPEG] = new TightJPEGEncoder(conn);
-  encoders[encoderZRLE] = new ZRLEEncoder(conn);
+  createEncoders(conn, &encoders);
+  activeEncoders.resize(encoderTypeMax, encoderRaw);
 
   updates = 0;
   memset(&copyStats, 0, sizeof(copyStats));
+  memset(&tileCacheStats, 0, sizeof(tileCacheStats));
+  memset(&videoStats, 0, sizeof(videoStats));
+
+  videoTilesX = videoTilesY = 0;
+  gettimeofday(&videoStart, NULL);
+  videoQuality = -1;
   stats.resize(encoderClassMax);
   for (iter = stats.begin();iter != stats.end();++iter) {
     StatsVector::value_type::iterator iter2;
@@ -152,6 +511,42 @@ EncodeManager::EncodeManager(SConnection* conn_)
     for (iter2 = iter->begin();iter2 != iter->end();++iter2)
       memset(&*iter2, 0, sizeof(EncoderStats));
   }
+
+  queueMutex = new os::Mutex();
+  producerCond = new os::Condition(queueMutex);
+  consumerCond = new os::Condition(queueMutex);
+
+  threadCount = Server::encodeThreads;
+  if (threadCount <= 0)
+    return;
+
+  // Every thread gets a full set of encoders, so there is no point
+  // in having more of them than there are CPUs to run them
+  cpuCount = os::Thread::getSystemCPUCount();
+  if ((cpuCount != 0) && (threadCount > (int)cpuCount)) {
+    vlog.info("Limiting encoder threads to the %d CPU core(s) available",
+              (int)cpuCount);
+    threadCount = cpuCount;
+  }
+
+  vlog.info("Creating %d encoder thread(s)", threadCount);
+
+  while (threadCount--) {
+    // Twice as many possible entries in the queue as there
+    // are worker threads to make sure they don't stall
+    for (int i = 0;i < 2;i++) {
+      QueueEntry* entry;
+
+      entry = new QueueEntry;
+      entry->info = new RectInfo;
+      entry->bufferStream = new rdr::MemOutStream();
+
+      entries.push_back(entry);
+      freeEntries.push_back(entry);
+    }
+
+    threads.push_back(new EncodeThread(this));
+  }
 }
 
 EncodeManager::~EncodeManager()
@@ -160,6 +555,24 @@ EncodeManager::~EncodeManager()
 
   logStats();
 
+  while (!threads.empty()) {
+    delete threads.back();
+    threads.pop_back();
+  }
+
+  delete threadException;
+
+  while (!entries.empty()) {
+    delete entries.back()->bufferStream;
+    delete entries.back()->info;
+    delete entries.back();
+    entries.pop_back();
+  }
+
+  delete consumerCond;
+  delete producerCond;
+  delete queueMutex;
+
   for (iter = encoders.begin();iter != encoders.end();iter++)
     delete *iter;
 }
@@ -199,6 +612,44 @@ void EncodeManager::logStats()
               a, ratio);
   }
 
+  if (tileCacheStats.rects != 0) {
+    vlog.info("  %s:", "TileCache");
+
+    rects += tileCacheStats.rects;
+    pixels += tileCacheStats.pixels;
+    bytes += tileCacheStats.bytes;
+    equivalent += tileCacheStats.equivalent;
+
+    ratio = (double)tileCacheStats.equivalent / tileCacheStats.bytes;
+
+    siPrefix(tileCacheStats.rects, "rects", a, sizeof(a));
+    siPrefix(tileCacheStats.pixels, "pixels", b, sizeof(b));
+    vlog.info("    %s: %s, %s", "Hits", a, b);
+    iecPrefix(tileCacheStats.bytes, "B", a, sizeof(a));
+    vlog.info("    %*s  %s (1:%g ratio)",
+              (int)strlen("Hits"), "",
+              a, ratio);
+  }
+
+  if (videoStats.rects != 0) {
+    vlog.info("  %s:", "H.264");
+
+    rects += videoStats.rects;
+    pixels += videoStats.pixels;
+    bytes += videoStats.bytes;
+    equivalent += videoStats.equivalent;
+
+    ratio = (double)videoStats.equivalent / videoStats.bytes;
+
+    siPrefix(videoStats.rects, "rects", a, sizeof(a));
+    siPrefix(videoStats.pixels, "pixels", b, sizeof(b));
+    vlog.info("    %s: %s, %s", "Frames", a, b);
+    iecPrefix(videoStats.bytes, "B", a, sizeof(a));
+    vlog.info("    %*s  %s (1:%g ratio)",
+              (int)strlen("Frames"), "",
+              a, ratio);
+  }
+
   for (i = 0;i < stats.size();i++) {
     // Did this class do anything at all?
     for (j = 0;j < stats[i].size();j++) {
@@ -248,12 +699,23 @@ bool EncodeManager::supported(int encoding)
   case encodingHextile:
   case encodingZRLE:
   case encodingTight:
+#ifdef HAVE_ZSTD
+  case encodingZstdRLE:
+#endif
     return true;
   default:
     return false;
   }
 }
 
+void EncodeManager::setAnalysisFeatures(unsigned features)
+{
+  // Make sure this isn't overridden later
+  setupAnalysisKernels();
+
+  selectAnalysisKernels(getCPUFeatures() & features);
+}
+
 bool EncodeManager::needsLosslessRefresh(const Region& req)
 {
   return !lossyRegion.intersect(req).is_empty();
@@ -280,6 +742,8 @@ void EncodeManager::pruneLosslessRefresh(const Region& limits)
 void EncodeManager::writeUpdate(const UpdateInfo& ui, const PixelBuffer* pb,
                                 const RenderedCursor* renderedCursor)
 {
+  updateVideoRegion(ui.changed, pb);
+
   doUpdate(true, ui.changed, ui.copied, ui.copy_delta, pb, renderedCursor);
 
   recentlyChangedRegion.assign_union(ui.changed);
@@ -318,7 +782,9 @@ void EncodeManager::doUpdate(bool allowLossy, const Region& changed_,
                              const RenderedCursor* renderedCursor)
 {
     int nRects;
-    Region changed, cursorRegion;
+    Region changed, cursorRegion, video;
+    bool useTileCache;
+    std::vector<TileCacheMiss> tileCacheMisses;
 
     updates++;
 
@@ -338,6 +804,15 @@ void EncodeManager::doUpdate(bool allowLossy, const Region& changed_,
       changed.assign_subtract(renderedCursor->getEffectiveRect());
     }
 
+    /*
+     * Things that keep changing are sent lossy and without any effort
+     * spent on finding a palette.
+     */
+    if (allowLossy) {
+      video = changed.intersect(videoRegion);
+      changed.assign_subtract(video);
+    }
+
     if (conn->client.supportsEncoding(pseudoEncodingLastRect))
       nRects = 0xFFFF;
     else {
@@ -345,6 +820,7 @@ void EncodeManager::doUpdate(bool allowLossy, const Region& changed_,
       if (conn->client.supportsEncoding(encodingCopyRect))
         nRects += copied.numRects();
       nRects += computeNumRects(changed);
+      nRects += computeNumRects(video);
       nRects += computeNumRects(cursorRegion);
     }
 
@@ -360,8 +836,32 @@ void EncodeManager::doUpdate(bool allowLossy, const Region& changed_,
     if (conn->client.supportsEncoding(pseudoEncodingLastRect))
       writeSolidRects(&changed, pb);
 
-    writeRects(changed, pb);
-    writeRects(cursorRegion, renderedCursor);
+#ifdef HAVE_H264
+    /*
+     * H.264 covers the video in a single rect, so we can't know the
+     * number of rects in advance.
+     */
+    if (conn->client.supportsEncoding(encodingH264) &&
+        conn->client.supportsEncoding(pseudoEncodingLastRect))
+      writeH264Rects(&changed, &video, pb);
+#endif
+
+    /*
+     * The tile cache adds extra rects for the client to store things,
+     * so it can only be used if we don't need to count the rects.
+     */
+    useTileCache = conn->client.supportsEncoding(encodingTileCache) &&
+                   conn->client.supportsEncoding(pseudoEncodingLastRect);
+
+    if (useTileCache)
+      writeTileCacheRects(&changed, pb, &tileCacheMisses);
+
+    writeRects(changed, pb, false);
+    writeRects(video, pb, true);
+    writeRects(cursorRegion, renderedCursor, false);
+
+    if (useTileCache)
+      storeTileCacheRects(tileCacheMisses, pb);
 
     conn->writer()->writeFramebufferUpdateEnd();
 }
@@ -370,6 +870,7 @@ void EncodeManager::prepareEncoders(bool allowLossy)
 {
   enum EncoderClass solid, bitmap, bitmapRLE;
   enum EncoderClass indexed, indexedRLE, fullColour;
+  enum EncoderClass video;
 
   bool allowJPEG;
 
@@ -410,6 +911,11 @@ void EncodeManager::prepareEncoders(bool allowLossy)
     bitmapRLE = indexedRLE = encoderZRLE;
     bitmap = indexed = encoderZRLE;
     break;
+  case encodingZstdRLE:
+    fullColour = encoderZstdRLE;
+    bitmapRLE = indexedRLE = encoderZstdRLE;
+    bitmap = indexed = encoderZstdRLE;
+    break;
   }
 
   // Any encoders still unassigned?
@@ -417,6 +923,8 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   if (fullColour == encoderRaw) {
     if (encoders[encoderTightJPEG]->isSupported() && allowJPEG)
       fullColour = encoderTightJPEG;
+    else if (encoders[encoderZstdRLE]->isSupported())
+      fullColour = encoderZstdRLE;
     else if (encoders[encoderZRLE]->isSupported())
       fullColour = encoderZRLE;
     else if (encoders[encoderTight]->isSupported())
@@ -426,7 +934,9 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   }
 
   if (indexed == encoderRaw) {
-    if (encoders[encoderZRLE]->isSupported())
+    if (encoders[encoderZstdRLE]->isSupported())
+      indexed = encoderZstdRLE;
+    else if (encoders[encoderZRLE]->isSupported())
       indexed = encoderZRLE;
     else if (encoders[encoderTight]->isSupported())
       indexed = encoderTight;
@@ -453,6 +963,12 @@ void EncodeManager::prepareEncoders(bool allowLossy)
       solid = encoderHextile;
   }
 
+  // Video can always be lossy, as it will get refreshed once it stops
+  if (encoders[encoderTightJPEG]->isSupported() && allowJPEG && allowLossy)
+    video = encoderTightJPEGVideo;
+  else
+    video = fullColour;
+
   // JPEG is the only encoder that can reduce things to grayscale
   if ((conn->client.subsampling == subsampleGray) &&
       encoders[encoderTightJPEG]->isSupported() && allowLossy) {
@@ -466,23 +982,51 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   activeEncoders[encoderIndexed] = indexed;
   activeEncoders[encoderIndexedRLE] = indexedRLE;
   activeEncoders[encoderFullColour] = fullColour;
+  activeEncoders[encoderVideo] = video;
+
+  // Everything that can affect how a rect gets encoded, so that we
+  // know when we can share encoded data with other clients
+  cacheSettings.clear();
+  cacheSettings.push_back(allowLossy);
+  cacheSettings.push_back(conn->client.compressLevel);
+  cacheSettings.push_back(conn->client.qualityLevel);
+  cacheSettings.push_back(conn->client.fineQualityLevel);
+  cacheSettings.push_back(conn->client.subsampling);
+  cacheSettings.push_back(videoQuality);
+  cacheSettings.insert(cacheSettings.end(),
+                       activeEncoders.begin(), activeEncoders.end());
 
   for (iter = activeEncoders.begin(); iter != activeEncoders.end(); ++iter) {
-    Encoder *encoder;
-
-    encoder = encoders[*iter];
-
-    encoder->setCompressLevel(conn->client.compressLevel);
-
-    if (allowLossy) {
-      encoder->setQualityLevel(conn->client.qualityLevel);
-      encoder->setFineQualityLevel(conn->client.fineQualityLevel,
-                                   conn->client.subsampling);
-    } else {
-      int level = __rfbmax(conn->client.qualityLevel,
-                           encoder->losslessQuality);
-      encoder->setQualityLevel(level);
-      encoder->setFineQualityLevel(-1, subsampleUndefined);
+    std::vector<Encoder*> instances;
+    std::vector<Encoder*>::iterator instance;
+    std::list<EncodeThread*>::iterator thread;
+
+    // The worker threads have their own copies that need to be kept
+    // in sync with ours
+    instances.push_back(encoders[*iter]);
+    for (thread = threads.begin(); thread != threads.end(); ++thread)
+      instances.push_back((*thread)->encoders[*iter]);
+
+    for (instance = instances.begin(); instance != instances.end(); ++instance) {
+      Encoder *encoder;
+
+      encoder = *instance;
+
+      encoder->setCompressLevel(conn->client.compressLevel);
+
+      if (*iter == encoderTightJPEGVideo) {
+        encoder->setQualityLevel(videoQuality);
+        encoder->setFineQualityLevel(-1, conn->client.subsampling);
+      } else if (allowLossy) {
+        encoder->setQualityLevel(conn->client.qualityLevel);
+        encoder->setFineQualityLevel(conn->client.fineQualityLevel,
+                                     conn->client.subsampling);
+      } else {
+        int level = __rfbmax(conn->client.qualityLevel,
+                             encoder->losslessQuality);
+        encoder->setQualityLevel(level);
+        encoder->setFineQualityLevel(-1, subsampleUndefined);
+      }
     }
   }
 }
@@ -756,7 +1300,102 @@ void EncodeManager::findSolidRect(const Rect& rect, Region *changed,
   }
 }
 
-void EncodeManager::writeRects(const Region& changed, const PixelBuffer* pb)
+void EncodeManager::writeTileCacheRects(Region *changed,
+                                        const PixelBuffer* pb,
+                                        std::vector<TileCacheMiss>* misses)
+{
+  std::vector<Rect> rects;
+  std::vector<Rect>::const_iterator rect;
+
+  char pfStr[256];
+  rdr::U64 seed;
+
+  // The client stores pixels in its own format, so it must be part of
+  // the key or a format change would bring back stale content
+  seed = 0;
+  pb->getPF().print(pfStr, sizeof(pfStr));
+  for (const char* c = pfStr; *c != '\0'; c++)
+    seed = (seed ^ *c) * 0x100000001b3ULL;
+  conn->client.pf().print(pfStr, sizeof(pfStr));
+  for (const char* c = pfStr; *c != '\0'; c++)
+    seed = (seed ^ *c) * 0x100000001b3ULL;
+
+  beforeLength = conn->getOutStream()->length();
+
+  splitRects(*changed, &rects);
+  for (rect = rects.begin(); rect != rects.end(); ++rect) {
+    TileCacheMiss miss;
+    int equiv;
+
+    if (rect->area() < TileCacheMinArea)
+      continue;
+
+    miss.rect = *rect;
+    miss.key = TileCache::hashRect(pb, *rect, seed);
+
+    if (!tileCache.lookupRect(miss.key, pb, *rect)) {
+      misses->push_back(miss);
+      continue;
+    }
+
+    tileCacheStats.rects++;
+    tileCacheStats.pixels += rect->area();
+    equiv = 12 + rect->area() * (conn->client.pf().bpp/8);
+    tileCacheStats.equivalent += equiv;
+
+    conn->writer()->writeTileCacheRect(*rect, tileCacheRef, miss.key);
+
+    // We only ever store lossless content
+    lossyRegion.assign_subtract(Region(*rect));
+    pendingRefreshRegion.assign_subtract(Region(*rect));
+
+    changed->assign_subtract(Region(*rect));
+  }
+
+  tileCacheStats.bytes += conn->getOutStream()->length() - beforeLength;
+}
+
+void EncodeManager::storeTileCacheRects(const std::vector<TileCacheMiss>& misses,
+                                        const PixelBuffer* pb)
+{
+  std::vector<TileCacheMiss>::const_iterator miss;
+
+  beforeLength = conn->getOutStream()->length();
+
+  for (miss = misses.begin(); miss != misses.end(); ++miss) {
+    // A lossy version would be shown if we got a hit later, and we
+    // would have no way of knowing that it needs to be refreshed
+    if (!lossyRegion.intersect(miss->rect).is_empty())
+      continue;
+
+    conn->writer()->writeTileCacheRect(miss->rect, tileCacheStore, miss->key);
+    // We keep the pixels as well, so hits can be verified
+    tileCache.insert(miss->key, miss->rect.width(), miss->rect.height(),
+                     pb, miss->rect);
+  }
+
+  tileCacheStats.bytes += conn->getOutStream()->length() - beforeLength;
+}
+
+void EncodeManager::writeRects(const Region& changed, const PixelBuffer* pb,
+                               bool video)
+{
+  std::vector<Rect> subRects;
+  std::vector<Rect>::const_iterator rect;
+
+  splitRects(changed, &subRects);
+
+  if (!threads.empty()) {
+    writeSubRects(subRects, pb, video);
+    return;
+  }
+
+  for (rect = subRects.begin(); rect != subRects.end(); ++rect)
+    writeSubRect(*rect, pb, video);
+}
+
+void EncodeManager::splitRects(const Region& changed,
+                               std::vector<Rect>* subRects)
 {
   std::vector<Rect> rects;
   std::vector<Rect>::const_iterator rect;
@@ -771,7 +1410,7 @@ void EncodeManager::writeRects(const Region& changed, const PixelBuffer* pb)
 
     // No split necessary?
     if (((w*h) < SubRectMaxArea) && (w < SubRectMaxWidth)) {
-      writeSubRect(*rect, pb);
+      subRects->push_back(*rect);
       continue;
     }
 
@@ -792,23 +1431,271 @@ void EncodeManager::writeRects(const Region& changed, const PixelBuffer* pb)
         if (sr.br.x > rect->br.x)
           sr.br.x = rect->br.x;
 
-        writeSubRect(sr, pb);
+        subRects->push_back(sr);
       }
     }
   }
 }
 
-void EncodeManager::writeSubRect(const Rect& rect, const PixelBuffer *pb)
+void EncodeManager::updateVideoRegion(const Region& changed,
+                                      const PixelBuffer* pb)
+{
+  std::vector<Rect> rects;
+  std::vector<Rect>::const_iterator rect;
+  std::vector<bool> touched;
+
+  unsigned now;
+  int tiles;
+  unsigned long long intervals;
+  int rate, drop;
+
+  // Start over if the frame buffer has changed size
+  if ((videoTilesX != (pb->width() + VideoTileSize - 1) / VideoTileSize) ||
+      (videoTilesY != (pb->height() + VideoTileSize - 1) / VideoTileSize)) {
+    VideoTile tile;
+
+    videoTilesX = (pb->width() + VideoTileSize - 1) / VideoTileSize;
+    videoTilesY = (pb->height() + VideoTileSize - 1) / VideoTileSize;
+
+    tile.lastChange = 0;
+    tile.interval = VideoMaxInterval;
+    tile.frames = 0;
+
+    videoTiles.assign(videoTilesX * videoTilesY, tile);
+  }
+
+  now = msSince(&videoStart);
+
+  // A tile can be part of several rects, but should only be counted once
+  touched.assign(videoTiles.size(), false);
+
+  changed.get_rects(&rects);
+  for (rect = rects.begin(); rect != rects.end(); ++rect) {
+    Rect r;
+
+    r = rect->intersect(pb->getRect());
+    if (r.is_empty())
+      continue;
+
+    for (int ty = r.tl.y / VideoTileSize;
+         ty <= (r.br.y - 1) / VideoTileSize; ty++) {
+      for (int tx = r.tl.x / VideoTileSize;
+           tx <= (r.br.x - 1) / VideoTileSize; tx++)
+        touched[ty * videoTilesX + tx] = true;
+    }
+  }
+
+  for (size_t i = 0; i < videoTiles.size(); i++) {
+    VideoTile* tile;
+    unsigned elapsed;
+
+    if (!touched[i])
+      continue;
+
+    tile = &videoTiles[i];
+
+    elapsed = now - tile->lastChange;
+    if (elapsed > VideoMaxInterval) {
+      tile->frames = 0;
+      tile->interval = VideoMaxInterval;
+    } else {
+      tile->interval = (tile->interval * 3 + elapsed) / 4;
+    }
+
+    if (tile->frames < VideoMinFrames)
+      tile->frames++;
+
+    tile->lastChange = now;
+  }
+
+  // Collect everything that is still hot, a row of tiles at a time
+  videoRegion.clear();
+  tiles = 0;
+  intervals = 0;
+
+  for (int ty = 0; ty < videoTilesY; ty++) {
+    int start;
+
+    start = -1;
+    for (int tx = 0; tx <= videoTilesX; tx++) {
+      const VideoTile* tile;
+      bool hot;
+
+      hot = false;
+      if (tx < videoTilesX) {
+        tile = &videoTiles[ty * videoTilesX + tx];
+        hot = (tile->frames >= VideoMinFrames) &&
+              ((now - tile->lastChange) <= VideoMaxInterval);
+        if (hot) {
+          tiles++;
+          intervals += tile->interval;
+        }
+      }
+
+      if (hot && (start == -1))
+        start = tx;
+
+      if (!hot && (start != -1)) {
+        Rect r(start * VideoTileSize, ty * VideoTileSize,
+               tx * VideoTileSize, (ty + 1) * VideoTileSize);
+        videoRegion.assign_union(r.intersect(pb->getRect()));
+        start = -1;
+      }
+    }
+  }
+
+  if (tiles < VideoMinTiles) {
+    videoRegion.clear();
+    return;
+  }
+
+  // Faster moving content gets a lower quality to keep the bandwidth
+  // in check, and since it is harder to see the details anyway
+  rate = 1000 * tiles / __rfbmax(intervals, (unsigned long long)1);
+  if (rate >= 24)
+    drop = 3;
+  else if (rate >= 12)
+    drop = 2;
+  else
+    drop = 1;
+
+  if (conn->client.qualityLevel != -1)
+    videoQuality = conn->client.qualityLevel;
+  else if (conn->client.fineQualityLevel != -1)
+    videoQuality = conn->client.fineQualityLevel / 10;
+  else
+    videoQuality = 8;
+
+  videoQuality = __rfbmax(videoQuality - drop, 0);
+}
+
+#ifdef HAVE_H264
+void EncodeManager::writeH264Rects(Region *changed, Region *video,
+                                   const PixelBuffer* pb)
+{
+  Rect videoRect;
+  int equiv;
+
+  if (videoRegion.is_empty())
+    return;
+
+  // A single stream is easier on the client than many small ones
+  videoRect = h264Encoder.streamRect(videoRegion.get_bounding_rect(),
+                                     pb->getRect());
+
+  if (videoRect.is_empty() || video->intersect(videoRect).is_empty())
+    return;
+
+  h264Encoder.setQualityLevel(conn->client.qualityLevel);
+
+  beforeLength = conn->getOutStream()->length();
+
+  videoStats.rects++;
+  videoStats.pixels += videoRect.area();
+  equiv = 12 + videoRect.area() * (conn->client.pf().bpp/8);
+  videoStats.equivalent += equiv;
+
+  conn->writer()->startRect(videoRect, encodingH264);
+  h264Encoder.writeRect(videoRect, pb, conn->getOutStream());
+  conn->writer()->endRect();
+
+  videoStats.bytes += conn->getOutStream()->length() - beforeLength;
+
+  lossyRegion.assign_union(Region(videoRect));
+  pendingRefreshRegion.assign_subtract(Region(videoRect));
+
+  changed->assign_subtract(Region(videoRect));
+  video->assign_subtract(Region(videoRect));
+}
+#endif
+
+void EncodeManager::writeSubRect(const Rect& rect, const PixelBuffer *pb,
+                                 bool video)
 {
   PixelBuffer *ppb;
 
   Encoder *encoder;
 
   struct RectInfo info;
-  unsigned int divisor, maxColours;
+  int type;
 
-  bool useRLE;
-  EncoderType type;
+  bool useCache;
+
+  useCache = (cache != NULL) && cache->isEnabled(pb);
+
+  // Another client might already have done all the hard work
+  if (useCache && writeCachedRect(rect))
+    return;
+
+  ppb = preparePixelBuffer(rect, pb, true,
+                           &offsetPixelBuffer, &convertedPixelBuffer);
+
+  if (video) {
+    // Not worth looking for a palette in something that keeps changing
+    info.palette.clear();
+    type = encoderVideo;
+  } else {
+    type = classifyRect(ppb, &info, getMaxColours(rect));
+  }
+
+  encoder = startRect(rect, type);
+
+  if (encoder->flags & EncoderUseNativePF)
+    ppb = preparePixelBuffer(rect, pb, false,
+                             &offsetPixelBuffer, &convertedPixelBuffer);
+
+  if (useCache && !(encoder->flags & EncoderOrdered))
+    writeCacheableRect(rect, encoder, type, ppb, info.palette);
+  else
+    encoder->writeRect(ppb, info.palette);
+
+  endRect();
+}
+
+bool EncodeManager::writeCachedRect(const Rect& rect)
+{
+  int type;
+  const rdr::U8* data;
+  size_t length;
+
+  if (!cache->lookup(rect, conn->client.pf(), cacheSettings,
+                     &type, &data, &length))
+    return false;
+
+  startRect(rect, type);
+  conn->getOutStream()->writeBytes(data, length);
+  endRect();
+
+  return true;
+}
+
+void EncodeManager::writeCacheableRect(const Rect& rect, Encoder* encoder,
+                                       int type, const PixelBuffer* ppb,
+                                       const Palette& palette)
+{
+  // We need the data separately so it can be stored in the cache
+  cacheStream.clear();
+
+  encoder->setOutStream(&cacheStream);
+  try {
+    encoder->writeRect(ppb, palette);
+  } catch (...) {
+    encoder->setOutStream(NULL);
+    throw;
+  }
+  encoder->setOutStream(NULL);
+
+  cache->insert(rect, conn->client.pf(), cacheSettings, type,
+                (const rdr::U8*)cacheStream.data(), cacheStream.length());
+
+  cacheStream.writeTo(conn->getOutStream());
+}
+
+unsigned int EncodeManager::getMaxColours(const Rect& rect)
+{
+  Encoder *encoder;
+
+  unsigned int divisor, maxColours;
 
   // FIXME: This is roughly the algorithm previously used by the Tight
   //        encoder. It seems a bit backwards though, that higher
@@ -842,17 +1729,25 @@ void EncodeManager::writeSubRect(const Rect& rect, const PixelBuffer *pb)
   if (maxColours > encoder->maxPaletteSize)
     maxColours = encoder->maxPaletteSize;
 
-  ppb = preparePixelBuffer(rect, pb, true);
+  return maxColours;
+}
 
-  if (!analyseRect(ppb, &info, maxColours))
-    info.palette.clear();
+int EncodeManager::classifyRect(const PixelBuffer *ppb,
+                                struct RectInfo *info,
+                                unsigned int maxColours)
+{
+  bool useRLE;
+  EncoderType type;
+
+  if (!analyseRect(ppb, info, maxColours))
+    info->palette.clear();
 
   // Different encoders might have different RLE overhead, but
   // here we do a guess at RLE being the better choice if reduces
   // the pixel count by 50%.
-  useRLE = info.rleRuns <= (rect.area() * 2);
+  useRLE = info->rleRuns <= (ppb->getRect().area() * 2);
 
-  switch (info.palette.size()) {
+  switch (info->palette.size()) {
   case 0:
     type = encoderFullColour;
     break;
@@ -872,16 +1767,234 @@ void EncodeManager::writeSubRect(const Rect& rect, const PixelBuffer *pb)
       type = encoderIndexed;
   }
 
-  encoder = startRect(rect, type);
+  return type;
+}
 
-  if (encoder->flags & EncoderUseNativePF)
-    ppb = preparePixelBuffer(rect, pb, false);
+void EncodeManager::writeSubRects(const std::vector<Rect>& rects,
+                                  const PixelBuffer* pb, bool video)
+{
+  std::vector<Rect>::const_iterator rect;
+  std::list<QueueEntry*> pending;
+  std::list<QueueEntry*> deferred;
+
+  bool useCache;
+
+  useCache = (cache != NULL) && cache->isEnabled(pb);
+
+  rect = rects.begin();
+  while ((rect != rects.end()) || !pending.empty() || !deferred.empty()) {
+    QueueEntry* entry;
+
+    queueMutex->lock();
 
-  encoder->writeRect(ppb, info.palette);
+    // Keep the workers busy with as many rects as we have room for
+    while ((rect != rects.end()) && !freeEntries.empty()) {
+      entry = freeEntries.front();
+      freeEntries.pop_front();
+
+      entry->done = false;
+      entry->rect = *rect;
+      entry->pb = pb;
+      entry->video = video;
+      entry->maxColours = getMaxColours(*rect);
+      entry->cached = false;
+
+      pending.push_back(entry);
+
+      ++rect;
+
+      if (useCache) {
+        const rdr::U8* data;
+        size_t length;
+
+        // No need to bother the workers if another client has
+        // already encoded this
+        if (cache->lookup(entry->rect, conn->client.pf(), cacheSettings,
+                          &entry->type, &data, &length)) {
+          entry->bufferStream->clear();
+          entry->bufferStream->writeBytes(data, length);
+          entry->encoded = true;
+          entry->cached = true;
+          entry->done = true;
+          continue;
+        }
+      }
+
+      workQueue.push_back(entry);
+
+      // We only put a single entry on the queue so waking a single
+      // thread is sufficient
+      consumerCond->signal();
+    }
+
+    // Everything we have is being finished in the background, so
+    // wait for the oldest one so we can make room for more
+    if (pending.empty()) {
+      queueMutex->unlock();
+
+      entry = deferred.front();
+      deferred.pop_front();
+
+      try {
+        writeDeferredEntry(entry);
+      } catch (...) {
+        recycleEntries(entry, &pending, &deferred);
+        throw;
+      }
+
+      queueMutex->lock();
+      freeEntries.push_back(entry);
+      queueMutex->unlock();
+
+      continue;
+    }
+
+    // The oldest rect is the next one that has to go out
+    entry = pending.front();
+    while (!entry->done)
+      producerCond->wait();
+
+    queueMutex->unlock();
+
+    pending.pop_front();
+
+    try {
+      Encoder *encoder;
+
+      throwThreadException();
+
+      encoder = encoders[activeEncoders[entry->type]];
+
+      // Ordered encoders that can finish in the background get their
+      // part done now, and the rect is written once they are done.
+      // Other threads can then work on the next rects meanwhile.
+      if (!entry->encoded && (encoder->flags & EncoderDeferred)) {
+        deferQueueEntry(entry);
+        deferred.push_back(entry);
+        continue;
+      }
+
+      // Everything before this rect has to go out first
+      while (!deferred.empty()) {
+        writeDeferredEntry(deferred.front());
+
+        queueMutex->lock();
+        freeEntries.push_back(deferred.front());
+        queueMutex->unlock();
+
+        deferred.pop_front();
+      }
+
+      // Before writing, as that might hand over the buffer
+      if (useCache && entry->encoded && !entry->cached)
+        cache->insert(entry->rect, conn->client.pf(), cacheSettings,
+                      entry->type,
+                      (const rdr::U8*)entry->bufferStream->data(),
+                      entry->bufferStream->length());
+
+      writeQueueEntry(entry);
+    } catch (...) {
+      recycleEntries(entry, &pending, &deferred);
+      throw;
+    }
+
+    queueMutex->lock();
+    freeEntries.push_back(entry);
+    queueMutex->unlock();
+  }
+}
+
+void EncodeManager::writeQueueEntry(QueueEntry* entry)
+{
+  Encoder *encoder;
+
+  encoder = startRect(entry->rect, entry->type);
+
+  if (entry->encoded) {
+    entry->bufferStream->writeTo(conn->getOutStream());
+  } else {
+    // Ordered encoders have to be run here, on our own instance
+    if (encoder->flags & EncoderUseNativePF)
+      entry->ppb = preparePixelBuffer(entry->rect, entry->pb, false,
+                                      &entry->offsetPixelBuffer,
+                                      &entry->convertedPixelBuffer);
+
+    encoder->writeRect(entry->ppb, entry->info->palette);
+  }
 
   endRect();
 }
 
+void EncodeManager::deferQueueEntry(QueueEntry* entry)
+{
+  Encoder *encoder;
+
+  encoder = encoders[activeEncoders[entry->type]];
+
+  if (encoder->flags & EncoderUseNativePF)
+    entry->ppb = preparePixelBuffer(entry->rect, entry->pb, false,
+                                    &entry->offsetPixelBuffer,
+                                    &entry->convertedPixelBuffer);
+
+  entry->bufferStream->clear();
+
+  encoder->setOutStream(entry->bufferStream, true);
+  try {
+    encoder->writeRect(entry->ppb, entry->info->palette);
+  } catch (...) {
+    encoder->setOutStream(NULL);
+    encoder->waitOutStream(entry->bufferStream);
+    throw;
+  }
+  encoder->setOutStream(NULL);
+
+  entry->encoded = true;
+}
+
+void EncodeManager::writeDeferredEntry(QueueEntry* entry)
+{
+  Encoder *encoder;
+
+  encoder = encoders[activeEncoders[entry->type]];
+  encoder->waitOutStream(entry->bufferStream);
+
+  // Not put in the cache, as the data depends on what this encoder
+  // has sent before
+  writeQueueEntry(entry);
+}
+
+void EncodeManager::recycleEntries(QueueEntry* entry,
+                                   std::list<QueueEntry*>* pending,
+                                   std::list<QueueEntry*>* deferred)
+{
+  os::AutoMutex a(queueMutex);
+
+  // The workers might still be busy with our other entries, so
+  // wait for them before recycling everything
+  freeEntries.push_back(entry);
+  while (!pending->empty()) {
+    while (!pending->front()->done)
+      producerCond->wait();
+    freeEntries.push_back(pending->front());
+    pending->pop_front();
+  }
+
+  // Same thing for whatever the encoders are finishing up
+  while (!deferred->empty()) {
+    Encoder *encoder;
+
+    encoder = encoders[activeEncoders[deferred->front()->type]];
+    try {
+      encoder->waitOutStream(deferred->front()->bufferStream);
+    } catch (...) {
+      // We are already dealing with an error
+    }
+
+    freeEntries.push_back(deferred->front());
+    deferred->pop_front();
+  }
+}
+
 bool EncodeManager::checkSolidTile(const Rect& r, const rdr::U8* colourValue,
                                    const PixelBuffer *pb)
 {
@@ -993,22 +2106,24 @@ void EncodeManager::extendSolidAreaByPixel(const Rect& r, const Rect& sr,
 
 PixelBuffer* EncodeManager::preparePixelBuffer(const Rect& rect,
                                                const PixelBuffer *pb,
-                                               bool convert)
+                                               bool convert,
+                                               OffsetPixelBuffer* offsetBuffer,
+                                               ManagedPixelBuffer* convertedBuffer)
 {
   const rdr::U8* buffer;
   int stride;
 
   // Do wo need to convert the data?
   if (convert && !conn->client.pf().equal(pb->getPF())) {
-    convertedPixelBuffer.setPF(conn->client.pf());
-    convertedPixelBuffer.setSize(rect.width(), rect.height());
+    convertedBuffer->setPF(conn->client.pf());
+    convertedBuffer->setSize(rect.width(), rect.height());
 
     buffer = pb->getBuffer(rect, &stride);
-    convertedPixelBuffer.imageRect(pb->getPF(),
-                                   convertedPixelBuffer.getRect(),
-                                   buffer, stride);
+    convertedBuffer->imageRect(pb->getPF(),
+                               convertedBuffer->getRect(),
+                               buffer, stride);
 
-    return &convertedPixelBuffer;
+    return convertedBuffer;
   }
 
   // Otherwise we still need to shift the coordinates. We have our own
@@ -1016,10 +2131,10 @@ PixelBuffer* EncodeManager::preparePixelBuffer(const Rect& rect,
 
   buffer = pb->getBuffer(rect, &stride);
 
-  offsetPixelBuffer.update(pb->getPF(), rect.width(), rect.height(),
-                           buffer, stride);
+  offsetBuffer->update(pb->getPF(), rect.width(), rect.height(),
+                       buffer, stride);
 
-  return &offsetPixelBuffer;
+  return offsetBuffer;
 }
 
 bool EncodeManager::analyseRect(const PixelBuffer *pb,
@@ -1061,6 +2176,149 @@ rdr::U8* EncodeManager::OffsetPixelBuffer::getBufferRW(const Rect& r, int* strid
   throw rfb::Exception("Invalid write attempt to OffsetPixelBuffer");
 }
 
+void EncodeManager::setThreadException(const rdr::Exception& e)
+{
+  os::AutoMutex a(queueMutex);
+
+  if (threadException != NULL)
+    return;
+
+  threadException = new rdr::Exception("Exception on worker thread: %s", e.str());
+}
+
+void EncodeManager::throwThreadException()
+{
+  os::AutoMutex a(queueMutex);
+
+  if (threadException == NULL)
+    return;
+
+  rdr::Exception e(*threadException);
+
+  delete threadException;
+  threadException = NULL;
+
+  throw e;
+}
+
+EncodeManager::EncodeThread::EncodeThread(EncodeManager* manager)
+{
+  this->manager = manager;
+
+  createEncoders(manager->conn, &encoders);
+
+  stopRequested = false;
+
+  start();
+}
+
+EncodeManager::EncodeThread::~EncodeThread()
+{
+  std::vector<Encoder*>::iterator iter;
+
+  stop();
+  wait();
+
+  for (iter = encoders.begin();iter != encoders.end();iter++)
+    delete *iter;
+}
+
+void EncodeManager::EncodeThread::stop()
+{
+  os::AutoMutex a(manager->queueMutex);
+
+  if (!isRunning())
+    return;
+
+  stopRequested = true;
+
+  // We can't wake just this thread, so wake everyone
+  manager->consumerCond->broadcast();
+}
+
+void EncodeManager::EncodeThread::worker()
+{
+  manager->queueMutex->lock();
+
+  while (!stopRequested) {
+    EncodeManager::QueueEntry *entry;
+
+    if (manager->workQueue.empty()) {
+      // Wait and try again
+      manager->consumerCond->wait();
+      continue;
+    }
+
+    // Rects are independent of each other at this stage, so simply
+    // take the first one
+    entry = manager->workQueue.front();
+    manager->workQueue.pop_front();
+
+    manager->queueMutex->unlock();
+
+    try {
+      processEntry(entry);
+    } catch (rdr::Exception& e) {
+      manager->setThreadException(e);
+    } catch(...) {
+      assert(false);
+    }
+
+    manager->queueMutex->lock();
+
+    entry->done = true;
+
+    // Only the main thread waits for entries to finish
+    manager->producerCond->signal();
+  }
+
+  manager->queueMutex->unlock();
+}
+
+void EncodeManager::EncodeThread::processEntry(QueueEntry* entry)
+{
+  Encoder *encoder;
+
+  entry->encoded = false;
+
+  entry->ppb = manager->preparePixelBuffer(entry->rect, entry->pb, true,
+                                           &entry->offsetPixelBuffer,
+                                           &entry->convertedPixelBuffer);
+
+  if (entry->video) {
+    entry->info->palette.clear();
+    entry->type = encoderVideo;
+  } else {
+    entry->type = manager->classifyRect(entry->ppb, entry->info,
+                                        entry->maxColours);
+  }
+
+  encoder = encoders[manager->activeEncoders[entry->type]];
+
+  // Encoders with state between rects must be left for the main
+  // thread, which writes things out in order
+  if (encoder->flags & EncoderOrdered)
+    return;
+
+  if (encoder->flags & EncoderUseNativePF)
+    entry->ppb = manager->preparePixelBuffer(entry->rect, entry->pb, false,
+                                             &entry->offsetPixelBuffer,
+                                             &entry->convertedPixelBuffer);
+
+  entry->bufferStream->clear();
+
+  encoder->setOutStream(entry->bufferStream);
+  try {
+    encoder->writeRect(entry->ppb, entry->info->palette);
+  } catch (...) {
+    encoder->setOutStream(NULL);
+    throw;
+  }
+  encoder->setOutStream(NULL);
+
+  entry->encoded = true;
+}
+
 // Preprocessor generated, optimised methods
 
 #define BPP 8
@@ -20,16 +20,37 @@
 #ifndef __RFB_ENCODEMANAGER_H__
 #define __RFB_ENCODEMANAGER_H__
 
+#include <list>
 #include <vector>
 
+#include <sys/time.h>
+
+#include <os/Thread.h>
+
+#include <rdr/MemOutStream.h>
 #include <rdr/types.h>
+#ifdef HAVE_H264
+#include <rfb/H264Encoder.h>
+#endif
 #include <rfb/PixelBuffer.h>
 #include <rfb/Region.h>
+#include <rfb/TileCache.h>
 #include <rfb/Timer.h>
 
+namespace os {
+  class Condition;
+  class Mutex;
+}
+
+namespace rdr {
+  struct Exception;
+}
+
 namespace rfb {
   class SConnection;
+  class EncodeCache;
   class Encoder;
+  class Palette;
   class UpdateInfo;
   class PixelBuffer;
   class RenderedCursor;
@@ -39,7 +60,7 @@ namespace rfb {
 
   class EncodeManager : public Timer::Callback {
   public:
-    EncodeManager(SConnection* conn);
+    EncodeManager(SConnection* conn, EncodeCache* cache=NULL);
     ~EncodeManager();
 
     void logStats();
@@ -47,6 +68,11 @@ namespace rfb {
     // Hack to let ConnParams calculate the client's preferred encoding
     static bool supported(int encoding);
 
+    // setAnalysisFeatures() limits the rect analysis to code that only
+    // needs the given CPUFeatures. Only meant for testing and
+    // benchmarking.
+    static void setAnalysisFeatures(unsigned features);
+
     bool needsLosslessRefresh(const Region& req);
     int getNextLosslessRefresh(const Region& req);
 
@@ -78,9 +104,35 @@ namespace rfb {
     void writeCopyRects(const Region& copied, const Point& delta);
     void writeSolidRects(Region *changed, const PixelBuffer* pb);
     void findSolidRect(const Rect& rect, Region *changed, const PixelBuffer* pb);
-    void writeRects(const Region& changed, const PixelBuffer* pb);
+    void writeRects(const Region& changed, const PixelBuffer* pb,
+                    bool video);
+    void splitRects(const Region& changed, std::vector<Rect>* subRects);
+
+    struct TileCacheMiss {
+      Rect rect;
+      rdr::U64 key;
+    };
 
-    void writeSubRect(const Rect& rect, const PixelBuffer *pb);
+    void writeTileCacheRects(Region *changed, const PixelBuffer* pb,
+                             std::vector<TileCacheMiss>* misses);
+    void storeTileCacheRects(const std::vector<TileCacheMiss>& misses,
+                             const PixelBuffer* pb);
+
+    void updateVideoRegion(const Region& changed, const PixelBuffer* pb);
+
+#ifdef HAVE_H264
+    void writeH264Rects(Region *changed, Region *video,
+                        const PixelBuffer* pb);
+#endif
+
+    void writeSubRect(const Rect& rect, const PixelBuffer *pb, bool video);
+    bool writeCachedRect(const Rect& rect);
+    void writeCacheableRect(const Rect& rect, Encoder* encoder, int type,
+                            const PixelBuffer* ppb, const Palette& palette);
+
+    unsigned int getMaxColours(const Rect& rect);
+    int classifyRect(const PixelBuffer *ppb, struct RectInfo *info,
+                     unsigned int maxColours);
 
     bool checkSolidTile(const Rect& r, const rdr::U8* colourValue,
                         const PixelBuffer *pb);
@@ -90,8 +142,12 @@ namespace rfb {
                                 const rdr::U8* colourValue,
                                 const PixelBuffer *pb, Rect* er);
 
+    class OffsetPixelBuffer;
+
     PixelBuffer* preparePixelBuffer(const Rect& rect,
-                                    const PixelBuffer *pb, bool convert);
+                                    const PixelBuffer *pb, bool convert,
+                                    OffsetPixelBuffer* offsetBuffer,
+                                    ManagedPixelBuffer* convertedBuffer);
 
     bool analyseRect(const PixelBuffer *pb,
                      struct RectInfo *info, int maxColours);
@@ -121,6 +177,33 @@ namespace rfb {
     std::vector<Encoder*> encoders;
     std::vector<int> activeEncoders;
 
+    EncodeCache* cache;
+    std::vector<int> cacheSettings;
+    rdr::MemOutStream cacheStream;
+
+    // What we've asked the client to keep
+    TileCache tileCache;
+
+    // How often each tile of the screen has been changing
+    struct VideoTile {
+      unsigned lastChange;
+      unsigned interval;
+      unsigned frames;
+    };
+
+    std::vector<VideoTile> videoTiles;
+    int videoTilesX, videoTilesY;
+    struct timeval videoStart;
+
+    // Areas that are constantly changing, and what quality to use
+    // for them
+    Region videoRegion;
+    int videoQuality;
+
+#ifdef HAVE_H264
+    H264Encoder h264Encoder;
+#endif
+
     Region lossyRegion;
     Region recentlyChangedRegion;
     Region pendingRefreshRegion;
@@ -137,6 +220,8 @@ namespace rfb {
 
     unsigned updates;
     EncoderStats copyStats;
+    EncoderStats tileCacheStats;
+    EncoderStats videoStats;
     StatsVector stats;
     int activeType;
     int beforeLength;
@@ -155,6 +240,73 @@ namespace rfb {
 
     OffsetPixelBuffer offsetPixelBuffer;
     ManagedPixelBuffer convertedPixelBuffer;
+
+  private:
+    // Threaded encoding of sub-rects. The workers do the conversion,
+    // analysis and (for encoders that aren't ordered) the actual
+    // encoding into a private buffer. The main thread then writes
+    // everything out in the original order. Ordered encoders that
+    // support it are run by the main thread into the private buffer
+    // as well, finishing in the background until it is time to write
+    // the rect.
+
+    struct QueueEntry {
+      bool done;
+      Rect rect;
+      const PixelBuffer* pb;
+      bool video;
+      unsigned int maxColours;
+      int type;
+      bool encoded;
+      bool cached;
+      PixelBuffer* ppb;
+      RectInfo* info;
+      rdr::MemOutStream* bufferStream;
+      OffsetPixelBuffer offsetPixelBuffer;
+      ManagedPixelBuffer convertedPixelBuffer;
+    };
+
+    void writeSubRects(const std::vector<Rect>& rects,
+                       const PixelBuffer* pb, bool video);
+    void writeQueueEntry(QueueEntry* entry);
+    void deferQueueEntry(QueueEntry* entry);
+    void writeDeferredEntry(QueueEntry* entry);
+    void recycleEntries(QueueEntry* entry,
+                        std::list<QueueEntry*>* pending,
+                        std::list<QueueEntry*>* deferred);
+
+    void setThreadException(const rdr::Exception& e);
+    void throwThreadException();
+
+    std::list<QueueEntry*> entries;
+    std::list<QueueEntry*> freeEntries;
+    std::list<QueueEntry*> workQueue;
+
+    os::Mutex* queueMutex;
+    os::Condition* producerCond;
+    os::Condition* consumerCond;
+
+    class EncodeThread : public os::Thread {
+    public:
+      EncodeThread(EncodeManager* manager);
+      ~EncodeThread();
+
+      void stop();
+
+      std::vector<Encoder*> encoders;
+
+    protected:
+      void worker();
+      void processEntry(QueueEntry* entry);
+
+    private:
+      EncodeManager* manager;
+
+      bool stopRequested;
+    };
+
+    std::list<EncodeThread*> threads;
+    rdr::Exception *threadException;
   };
 }
 
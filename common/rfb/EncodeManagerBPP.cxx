@@ -23,55 +23,59 @@
 
 #define UBPP CONCAT2E(U,BPP)
 
+// The pixel repeated over 32 bits, as the run scanning expects
+static inline rdr::U32 CONCAT2E(repeatPixel,BPP)(rdr::UBPP colour)
+{
+#if BPP == 8
+  return colour * 0x01010101U;
+#elif BPP == 16
+  return colour * 0x00010001U;
+#else
+  return colour;
+#endif
+}
+
 inline bool EncodeManager::checkSolidTile(const Rect& r,
                                           rdr::UBPP colourValue,
                                           const PixelBuffer *pb)
 {
-  int w, h;
   const rdr::UBPP* buffer;
-  int stride, pad;
-
-  w = r.width();
-  h = r.height();
+  int stride;
 
   buffer = (const rdr::UBPP*)pb->getBuffer(r, &stride);
-  pad = stride - w;
-
-  while (h--) {
-    int w_ = w;
-    while (w_--) {
-      if (*buffer != colourValue)
-        return false;
-      buffer++;
-    }
-    buffer += pad;
-  }
 
-  return true;
+  return solidBytes((const rdr::U8*)buffer, r.width() * sizeof(rdr::UBPP),
+                    stride * sizeof(rdr::UBPP), r.height(),
+                    CONCAT2E(repeatPixel,BPP)(colourValue));
 }
 
 inline bool EncodeManager::analyseRect(int width, int height,
                                        const rdr::UBPP* buffer, int stride,
                                        struct RectInfo *info, int maxColours)
 {
-  int pad;
-
   rdr::UBPP colour;
   int count;
 
   info->rleRuns = 0;
   info->palette.clear();
 
-  pad = stride - width;
-
-  // For efficiency, we only update the palette on changes in colour
+  // For efficiency, we only update the palette on changes in colour,
+  // and the palette is only sorted once at the end
   colour = buffer[0];
   count = 0;
   while (height--) {
-    int w_ = width;
-    while (w_--) {
-      if (*buffer != colour) {
-        if (!info->palette.insert(colour, count))
+    const rdr::UBPP* ptr;
+    const rdr::UBPP* end;
+
+    ptr = buffer;
+    end = buffer + width;
+
+    while (ptr < end) {
+      rdr::U32 pattern;
+      size_t run;
+
+      if (*ptr != colour) {
+        if (!info->palette.add(colour, count))
           return false;
         if (info->palette.size() > maxColours)
           return false;
@@ -79,20 +83,37 @@ inline bool EncodeManager::analyseRect(int width, int height,
         // FIXME: This doesn't account for switching lines
         info->rleRuns++;
 
-        colour = *buffer;
+        colour = *ptr;
         count = 0;
       }
-      buffer++;
-      count++;
+
+      // Short runs are common in detailed content, so avoid the
+      // overhead of scanning for the end of those
+      if ((ptr + 1 == end) || (ptr[1] != colour)) {
+        ptr++;
+        count++;
+        continue;
+      }
+
+      pattern = CONCAT2E(repeatPixel,BPP)(colour);
+
+      run = matchingBytes((const rdr::U8*)ptr, (end - ptr) * sizeof(*ptr),
+                          pattern) / sizeof(*ptr);
+
+      ptr += run;
+      count += run;
     }
-    buffer += pad;
+
+    buffer += stride;
   }
 
   // Make sure the final pixels also get counted
-  if (!info->palette.insert(colour, count))
+  if (!info->palette.add(colour, count))
     return false;
   if (info->palette.size() > maxColours)
     return false;
 
+  info->palette.sort();
+
   return true;
 }
@@ -23,6 +23,8 @@
 #include <rdr/types.h>
 #include <rfb/Rect.h>
 
+namespace rdr { class OutStream; }
+
 namespace rfb {
   class SConnection;
   class PixelBuffer;
@@ -37,6 +39,12 @@ namespace rfb {
     EncoderUseNativePF = 1 << 0,
     // Encoder does not encode pixels perfectly accurate
     EncoderLossy = 1 << 1,
+    // Encoder keeps state between rects (e.g. zlib streams), so all
+    // rects must be encoded in order by the same instance
+    EncoderOrdered = 1 << 2,
+    // Encoder can finish writing rects in the background, when asked
+    // to via setOutStream()
+    EncoderDeferred = 1 << 3,
   };
 
   class Encoder {
@@ -84,11 +92,31 @@ namespace rfb {
                                 const PixelFormat& pf,
                                 const rdr::U8* colour)=0;
 
+    // setOutStream() makes the encoder write to the given stream
+    // rather than the one of the SConnection. Passing NULL restores
+    // the default.
+    //
+    // If deferred is set, and the encoder has the EncoderDeferred
+    // flag, then writeRect() may return before all data has been
+    // written to the stream. waitOutStream() must then be called
+    // before the stream is used for anything else.
+    void setOutStream(rdr::OutStream* os, bool deferred=false) {
+      outStream = os; deferOutput = deferred;
+    }
+
+    virtual void waitOutStream(rdr::OutStream* os) {};
+
   protected:
     // Helper method for redirecting a single colour palette to the
     // short cut method.
     void writeSolidRect(const PixelBuffer* pb, const Palette& palette);
 
+    // The stream all encoded data should be written to
+    rdr::OutStream* getOutStream();
+
+    // Is the encoder allowed to finish writing in the background?
+    bool isOutputDeferred() { return deferOutput; }
+
   public:
     const int encoding;
     const enum EncoderFlags flags;
@@ -102,6 +130,10 @@ namespace rfb {
 
   protected:
     SConnection* conn;
+
+  private:
+    rdr::OutStream* outStream;
+    bool deferOutput;
   };
 }
 
@@ -0,0 +1,228 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include <wels/codec_api.h>
+
+#include <rdr/MemInStream.h>
+#include <rdr/OutStream.h>
+#include <rfb/Exception.h>
+#include <rfb/H264Constants.h>
+#include <rfb/H264Decoder.h>
+#include <rfb/PixelBuffer.h>
+
+using namespace rfb;
+
+// Should match the server's limit, or exceed it
+static const size_t MaxContexts = 64;
+
+static inline rdr::U8 clamp(int v)
+{
+  if (v < 0)
+    return 0;
+  if (v > 255)
+    return 255;
+  return v;
+}
+
+// BT.601, limited range, as produced by the server
+static void yuvToRGB(rdr::U8* dst, const rdr::U8* y, const rdr::U8* u,
+                     const rdr::U8* v, int width)
+{
+  for (int x = 0; x < width; x++) {
+    int c, d, e;
+
+    c = y[x] - 16;
+    d = u[x/2] - 128;
+    e = v[x/2] - 128;
+
+    *dst++ = clamp((298 * c + 409 * e + 128) >> 8);
+    *dst++ = clamp((298 * c - 100 * d - 208 * e + 128) >> 8);
+    *dst++ = clamp((298 * c + 516 * d + 128) >> 8);
+  }
+}
+
+// The H.264 streams need to see every frame in order
+H264Decoder::H264Decoder() : Decoder(DecoderOrdered)
+{
+}
+
+H264Decoder::~H264Decoder()
+{
+  resetContexts();
+}
+
+bool H264Decoder::readRect(const Rect& r, rdr::InStream* is,
+                           const ServerParams& server, rdr::OutStream* os)
+{
+  rdr::U32 len;
+
+  if (!is->hasData(8))
+    return false;
+
+  is->setRestorePoint();
+
+  len = is->readU32();
+  os->writeU32(len);
+  os->writeU32(is->readU32());
+
+  if (!is->hasDataOrRestore(len))
+    return false;
+
+  is->clearRestorePoint();
+
+  os->copyBytes(is, len);
+
+  return true;
+}
+
+void H264Decoder::decodeRect(const Rect& r, const void* buffer,
+                             size_t buflen, const ServerParams& server,
+                             ModifiablePixelBuffer* pb)
+{
+  rdr::MemInStream is(buffer, buflen);
+  rdr::U32 len, flags;
+  Context* ctx;
+
+  unsigned char* yuv[3];
+  SBufferInfo info;
+  DECODING_STATE state;
+
+  const PixelFormat& pf = pb->getPF();
+  std::vector<rdr::U8> rgb;
+  rdr::U8* dst;
+  int stride, bpp;
+
+  len = is.readU32();
+  flags = is.readU32();
+
+  if (flags & h264ResetAllContexts)
+    resetContexts();
+  else if (flags & h264ResetContext)
+    removeContext(r);
+
+  // A rect with no data is just a way of resetting things
+  if (len == 0)
+    return;
+
+  ctx = findContext(r);
+  if (ctx == NULL)
+    ctx = createContext(r);
+
+  memset(yuv, 0, sizeof(yuv));
+  memset(&info, 0, sizeof(info));
+
+  state = ctx->decoder->DecodeFrameNoDelay(is.getptr(len), len, yuv, &info);
+  if (state != dsErrorFree)
+    throw Exception("H.264 decoding failed (%d)", (int)state);
+
+  // Nothing to show yet?
+  if (info.iBufferStatus != 1)
+    return;
+
+  if ((info.UsrData.sSystemBuffer.iWidth < r.width()) ||
+      (info.UsrData.sSystemBuffer.iHeight < r.height()))
+    throw Exception("H.264 frame is smaller than the rect");
+
+  rgb.resize(r.width() * 3);
+
+  dst = pb->getBufferRW(r, &stride);
+  bpp = pf.bpp / 8;
+
+  for (int y = 0; y < r.height(); y++) {
+    yuvToRGB(&rgb[0],
+             info.pDst[0] + y * info.UsrData.sSystemBuffer.iStride[0],
+             info.pDst[1] + y/2 * info.UsrData.sSystemBuffer.iStride[1],
+             info.pDst[2] + y/2 * info.UsrData.sSystemBuffer.iStride[1],
+             r.width());
+    pf.bufferFromRGB(dst + y * stride * bpp, &rgb[0], r.width());
+  }
+
+  pb->commitBufferRW(r);
+}
+
+H264Decoder::Context* H264Decoder::findContext(const Rect& r)
+{
+  std::list<Context>::iterator iter;
+
+  for (iter = contexts.begin(); iter != contexts.end(); ++iter) {
+    if (iter->rect.equals(r))
+      return &*iter;
+  }
+
+  return NULL;
+}
+
+H264Decoder::Context* H264Decoder::createContext(const Rect& r)
+{
+  Context ctx;
+  SDecodingParam param;
+
+  // Forget the oldest stream if there are too many
+  if (contexts.size() >= MaxContexts) {
+    contexts.front().decoder->Uninitialize();
+    WelsDestroyDecoder(contexts.front().decoder);
+    contexts.pop_front();
+  }
+
+  ctx.rect = r;
+
+  if (WelsCreateDecoder(&ctx.decoder) != 0)
+    throw Exception("Failed to create H.264 decoder");
+
+  memset(&param, 0, sizeof(param));
+  param.sVideoProperty.eVideoBsType = VIDEO_BITSTREAM_AVC;
+
+  if (ctx.decoder->Initialize(&param) != 0) {
+    WelsDestroyDecoder(ctx.decoder);
+    throw Exception("Failed to initialise H.264 decoder");
+  }
+
+  contexts.push_back(ctx);
+
+  return &contexts.back();
+}
+
+void H264Decoder::removeContext(const Rect& r)
+{
+  std::list<Context>::iterator iter;
+
+  for (iter = contexts.begin(); iter != contexts.end(); ++iter) {
+    if (iter->rect.equals(r)) {
+      iter->decoder->Uninitialize();
+      WelsDestroyDecoder(iter->decoder);
+      contexts.erase(iter);
+      return;
+    }
+  }
+}
+
+void H264Decoder::resetContexts()
+{
+  std::list<Context>::iterator iter;
+
+  for (iter = contexts.begin(); iter != contexts.end(); ++iter) {
+    iter->decoder->Uninitialize();
+    WelsDestroyDecoder(iter->decoder);
+  }
+
+  contexts.clear();
+}
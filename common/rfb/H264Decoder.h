@@ -0,0 +1,56 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+#ifndef __RFB_H264DECODER_H__
+#define __RFB_H264DECODER_H__
+
+#include <list>
+
+#include <rfb/Decoder.h>
+#include <rfb/Rect.h>
+
+class ISVCDecoder;
+
+namespace rfb {
+
+  class H264Decoder : public Decoder {
+  public:
+    H264Decoder();
+    virtual ~H264Decoder();
+    virtual bool readRect(const Rect& r, rdr::InStream* is,
+                          const ServerParams& server, rdr::OutStream* os);
+    virtual void decodeRect(const Rect& r, const void* buffer,
+                            size_t buflen, const ServerParams& server,
+                            ModifiablePixelBuffer* pb);
+
+  private:
+    // Every video area has its own stream, identified by its rect
+    struct Context {
+      Rect rect;
+      ISVCDecoder* decoder;
+    };
+
+    Context* findContext(const Rect& r);
+    Context* createContext(const Rect& r);
+    void removeContext(const Rect& r);
+    void resetContexts();
+
+  private:
+    std::list<Context> contexts;
+  };
+}
+#endif
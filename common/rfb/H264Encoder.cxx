@@ -0,0 +1,304 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <string.h>
+
+#include <wels/codec_api.h>
+
+#include <rdr/OutStream.h>
+#include <rfb/Exception.h>
+#include <rfb/H264Constants.h>
+#include <rfb/H264Encoder.h>
+#include <rfb/PixelBuffer.h>
+
+using namespace rfb;
+
+// Must not exceed what the client keeps around
+static const size_t MaxContexts = 16;
+
+static const int FrameRate = 30;
+
+static const int DefaultQualityLevel = 8;
+
+static inline rdr::U8 rgbToY(const rdr::U8* p)
+{
+  return ((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16;
+}
+
+H264Encoder::H264Encoder()
+  : resetPending(false), currentRect(0, 0, 0, 0),
+    qualityLevel(DefaultQualityLevel)
+{
+}
+
+H264Encoder::~H264Encoder()
+{
+  resetContexts();
+}
+
+void H264Encoder::setQualityLevel(int level)
+{
+  if (level < 0 || level > 9)
+    level = DefaultQualityLevel;
+
+  if (level == qualityLevel)
+    return;
+
+  // Simpler to start over than to adjust the rate control of every
+  // running stream
+  qualityLevel = level;
+  reset();
+}
+
+Rect H264Encoder::streamRect(const Rect& video, const Rect& bounds)
+{
+  Rect r;
+
+  // The detected video area flickers a bit at the edges, so we grow
+  // the current area rather than follow it exactly. We only start over
+  // once the video has moved elsewhere or shrunk to less than half.
+  if (currentRect.overlaps(video) && (video.area() * 2 >= currentRect.area()))
+    r = currentRect.union_boundary(video);
+  else
+    r = video;
+
+  r = r.intersect(bounds);
+
+  // H.264 can only handle even dimensions
+  r.br.x -= r.width() % 2;
+  r.br.y -= r.height() % 2;
+
+  currentRect = r;
+
+  return r;
+}
+
+void H264Encoder::writeRect(const Rect& r, const PixelBuffer* pb,
+                            rdr::OutStream* os)
+{
+  Context* ctx;
+  rdr::U32 flags;
+
+  SSourcePicture pic;
+  SFrameBSInfo info;
+  size_t length;
+
+  if ((r.width() % 2) || (r.height() % 2))
+    throw Exception("H.264 rects must have even dimensions");
+
+  flags = 0;
+
+  if (resetPending) {
+    flags |= h264ResetAllContexts;
+    resetPending = false;
+  }
+
+  ctx = findContext(r);
+  if (ctx == NULL) {
+    ctx = createContext(r);
+    flags |= h264ResetContext;
+  }
+
+  convertToYUV(r, pb);
+
+  memset(&pic, 0, sizeof(pic));
+  pic.iColorFormat = videoFormatI420;
+  pic.iPicWidth = r.width();
+  pic.iPicHeight = r.height();
+  pic.iStride[0] = r.width();
+  pic.iStride[1] = r.width() / 2;
+  pic.iStride[2] = r.width() / 2;
+  pic.pData[0] = &yuvBuffer[0];
+  pic.pData[1] = pic.pData[0] + r.area();
+  pic.pData[2] = pic.pData[1] + r.area() / 4;
+  pic.uiTimeStamp = (long long)ctx->frames * 1000 / FrameRate;
+
+  memset(&info, 0, sizeof(info));
+
+  if (ctx->encoder->EncodeFrame(&pic, &info) != 0)
+    throw Exception("H.264 encoding failed");
+
+  ctx->frames++;
+
+  length = 0;
+  if (info.eFrameType != videoFrameTypeSkip) {
+    for (int i = 0; i < info.iLayerNum; i++) {
+      const SLayerBSInfo* layer = &info.sLayerInfo[i];
+      for (int j = 0; j < layer->iNalCount; j++)
+        length += layer->pNalLengthInByte[j];
+    }
+  }
+
+  // The client would be missing the start of the stream if the first
+  // frame gets dropped by the rate control
+  if ((flags & h264ResetContext) && (length == 0))
+    removeContext(r);
+
+  os->writeU32(length);
+  os->writeU32(flags);
+
+  if (length == 0)
+    return;
+
+  for (int i = 0; i < info.iLayerNum; i++) {
+    const SLayerBSInfo* layer = &info.sLayerInfo[i];
+    size_t layerLength;
+
+    layerLength = 0;
+    for (int j = 0; j < layer->iNalCount; j++)
+      layerLength += layer->pNalLengthInByte[j];
+
+    os->writeBytes(layer->pBsBuf, layerLength);
+  }
+}
+
+void H264Encoder::reset()
+{
+  resetContexts();
+  resetPending = true;
+}
+
+H264Encoder::Context* H264Encoder::findContext(const Rect& r)
+{
+  std::list<Context>::iterator iter;
+
+  for (iter = contexts.begin(); iter != contexts.end(); ++iter) {
+    if (iter->rect.equals(r))
+      return &*iter;
+  }
+
+  return NULL;
+}
+
+H264Encoder::Context* H264Encoder::createContext(const Rect& r)
+{
+  Context ctx;
+  SEncParamBase param;
+
+  // The oldest stream is the one the client will drop as well
+  if (contexts.size() >= MaxContexts) {
+    contexts.front().encoder->Uninitialize();
+    WelsDestroySVCEncoder(contexts.front().encoder);
+    contexts.pop_front();
+  }
+
+  ctx.rect = r;
+  ctx.frames = 0;
+
+  if (WelsCreateSVCEncoder(&ctx.encoder) != 0)
+    throw Exception("Failed to create H.264 encoder");
+
+  memset(&param, 0, sizeof(param));
+  param.iUsageType = CAMERA_VIDEO_REAL_TIME;
+  param.iPicWidth = r.width();
+  param.iPicHeight = r.height();
+  // Roughly a hundredth of a bit per pixel and frame per quality level
+  param.iTargetBitrate = (long long)r.area() * FrameRate *
+                         (qualityLevel + 1) / 100;
+  param.iRCMode = RC_BITRATE_MODE;
+  param.fMaxFrameRate = FrameRate;
+
+  if (ctx.encoder->Initialize(&param) != 0) {
+    WelsDestroySVCEncoder(ctx.encoder);
+    throw Exception("Failed to initialise H.264 encoder");
+  }
+
+  contexts.push_back(ctx);
+
+  return &contexts.back();
+}
+
+void H264Encoder::removeContext(const Rect& r)
+{
+  std::list<Context>::iterator iter;
+
+  for (iter = contexts.begin(); iter != contexts.end(); ++iter) {
+    if (iter->rect.equals(r)) {
+      iter->encoder->Uninitialize();
+      WelsDestroySVCEncoder(iter->encoder);
+      contexts.erase(iter);
+      return;
+    }
+  }
+}
+
+void H264Encoder::resetContexts()
+{
+  std::list<Context>::iterator iter;
+
+  for (iter = contexts.begin(); iter != contexts.end(); ++iter) {
+    iter->encoder->Uninitialize();
+    WelsDestroySVCEncoder(iter->encoder);
+  }
+
+  contexts.clear();
+}
+
+// BT.601, limited range, with chroma averaged over 2x2 blocks
+void H264Encoder::convertToYUV(const Rect& r, const PixelBuffer* pb)
+{
+  const rdr::U8* src;
+  int stride, bpp;
+  int width, height;
+  rdr::U8 *y, *u, *v;
+
+  width = r.width();
+  height = r.height();
+
+  rgbBuffer.resize(width * 2 * 3);
+  yuvBuffer.resize(width * height * 3 / 2);
+
+  src = pb->getBuffer(r, &stride);
+  bpp = pb->getPF().bpp / 8;
+
+  y = &yuvBuffer[0];
+  u = y + width * height;
+  v = u + width * height / 4;
+
+  for (int row = 0; row < height; row += 2) {
+    const rdr::U8* top;
+    const rdr::U8* bottom;
+
+    pb->getPF().rgbFromBuffer(&rgbBuffer[0], src + row * stride * bpp,
+                              width, stride, 2);
+
+    top = &rgbBuffer[0];
+    bottom = top + width * 3;
+
+    for (int x = 0; x < width; x += 2) {
+      int red, green, blue;
+
+      y[x] = rgbToY(top);
+      y[x + 1] = rgbToY(top + 3);
+      y[x + width] = rgbToY(bottom);
+      y[x + width + 1] = rgbToY(bottom + 3);
+
+      red = top[0] + top[3] + bottom[0] + bottom[3];
+      green = top[1] + top[4] + bottom[1] + bottom[4];
+      blue = top[2] + top[5] + bottom[2] + bottom[5];
+
+      *u++ = ((-38 * red - 74 * green + 112 * blue + 512) >> 10) + 128;
+      *v++ = ((112 * red - 94 * green - 18 * blue + 512) >> 10) + 128;
+
+      top += 6;
+      bottom += 6;
+    }
+
+    y += width * 2;
+  }
+}
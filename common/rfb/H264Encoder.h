@@ -0,0 +1,85 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+#ifndef __RFB_H264ENCODER_H__
+#define __RFB_H264ENCODER_H__
+
+#include <list>
+#include <vector>
+
+#include <rdr/types.h>
+#include <rfb/Rect.h>
+
+class ISVCEncoder;
+
+namespace rdr { class OutStream; }
+
+namespace rfb {
+
+  class PixelBuffer;
+
+  // H264Encoder keeps a separate H.264 stream for every video area of
+  // the screen. It is not a normal Encoder as every rect depends on the
+  // previous ones for the same area.
+
+  class H264Encoder {
+  public:
+    H264Encoder();
+    ~H264Encoder();
+
+    void setQualityLevel(int level);
+
+    // streamRect() picks the area to encode to cover the given video
+    // area. It sticks to the previous area where it can, as every new
+    // area means a new stream that has to start with a key frame.
+    Rect streamRect(const Rect& video, const Rect& bounds);
+
+    // writeRect() encodes the given area of the frame buffer as the next
+    // frame of the stream for that area, including the data length and
+    // flags
+    void writeRect(const Rect& r, const PixelBuffer* pb, rdr::OutStream* os);
+
+    // reset() drops all streams, here and at the client
+    void reset();
+
+  private:
+    struct Context {
+      Rect rect;
+      ISVCEncoder* encoder;
+      unsigned frames;
+    };
+
+    Context* findContext(const Rect& r);
+    Context* createContext(const Rect& r);
+    void removeContext(const Rect& r);
+    void resetContexts();
+
+    void convertToYUV(const Rect& r, const PixelBuffer* pb);
+
+  private:
+    std::list<Context> contexts;
+    bool resetPending;
+
+    Rect currentRect;
+
+    int qualityLevel;
+
+    std::vector<rdr::U8> rgbBuffer;
+    std::vector<rdr::U8> yuvBuffer;
+  };
+}
+#endif
@@ -60,7 +60,7 @@ bool HextileEncoder::isSupported()
 
 void HextileEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
 {
-  rdr::OutStream* os = conn->getOutStream();
+  rdr::OutStream* os = getOutStream();
   switch (pb->getPF().bpp) {
   case 8:
     if (improvedHextile) {
@@ -93,7 +93,7 @@ void HextileEncoder::writeSolidRect(int width, int height,
   rdr::OutStream* os;
   int tiles;
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   tiles = ((width + 15)/16) * ((height + 15)/16);
 
@@ -23,23 +23,486 @@
 #include <rfb/Rect.h>
 #include <rfb/PixelFormat.h>
 #include <rfb/ClientParams.h>
+#include <rfb/LogWriter.h>
+#include <rfb/cpuFeatures.h>
+#include <rfb/util.h>
 
 #include <stdio.h>
+#include <string.h>
 extern "C" {
 #include <jpeglib.h>
 }
 #include <setjmp.h>
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+#ifdef HAVE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
 using namespace rfb;
 
+static LogWriter vlog("JpegCompressor");
+
 //
-// Special formats that libjpeg can have optimised code paths for
+// Format that other pixel formats get converted to before the colour
+// conversion
 //
 
 static const PixelFormat pfRGBX(32, 24, false, true, 255, 255, 255, 0, 8, 16);
-static const PixelFormat pfBGRX(32, 24, false, true, 255, 255, 255, 16, 8, 0);
-static const PixelFormat pfXRGB(32, 24, false, true, 255, 255, 255, 8, 16, 24);
-static const PixelFormat pfXBGR(32, 24, false, true, 255, 255, 255, 24, 16, 8);
+
+//
+// Colour conversion kernels. They convert width pixels of 32-bit
+// data, with red, green and blue at the given byte offsets, in to
+// full resolution Y, Cb and Cr samples. The maths is identical to
+// what libjpeg uses internally, so the result is the same as if it
+// had been given the RGB data.
+//
+
+typedef void (*RGBToYCbCrFunc)(const rdr::U8* src, int width,
+                               const int offsets[3],
+                               rdr::U8* y, rdr::U8* cb, rdr::U8* cr);
+
+//
+// Downsampling kernels, averaging 2x1 or 2x2 full resolution samples
+// in to width output samples. The rounding alternates between
+// samples, as in libjpeg.
+//
+
+typedef void (*DownsampleH2V1Func)(const rdr::U8* src, int width,
+                                   rdr::U8* dst);
+typedef void (*DownsampleH2V2Func)(const rdr::U8* src0,
+                                   const rdr::U8* src1,
+                                   int width, rdr::U8* dst);
+
+// libjpeg's fixed point constants
+#define SCALEBITS 16
+#define ONE_HALF (1 << (SCALEBITS - 1))
+#define CBCR_OFFSET (128 << SCALEBITS)
+
+#define FIX_0_29900 19595
+#define FIX_0_58700 38470
+#define FIX_0_11400 7471
+#define FIX_0_16874 11059
+#define FIX_0_33126 21709
+#define FIX_0_50000 32768
+#define FIX_0_41869 27439
+#define FIX_0_08131 5329
+
+static inline void rgbToYCbCr(int r, int g, int b,
+                              rdr::U8* y, rdr::U8* cb, rdr::U8* cr)
+{
+  *y = (FIX_0_29900 * r + FIX_0_58700 * g + FIX_0_11400 * b +
+        ONE_HALF) >> SCALEBITS;
+  *cb = (-FIX_0_16874 * r - FIX_0_33126 * g + FIX_0_50000 * b +
+         CBCR_OFFSET + ONE_HALF - 1) >> SCALEBITS;
+  *cr = (FIX_0_50000 * r - FIX_0_41869 * g - FIX_0_08131 * b +
+         CBCR_OFFSET + ONE_HALF - 1) >> SCALEBITS;
+}
+
+static void rgbToYCbCrPlain(const rdr::U8* src, int width,
+                            const int offsets[3],
+                            rdr::U8* y, rdr::U8* cb, rdr::U8* cr)
+{
+  int offR, offG, offB;
+
+  offR = offsets[0];
+  offG = offsets[1];
+  offB = offsets[2];
+
+  while (width--) {
+    rgbToYCbCr(src[offR], src[offG], src[offB], y++, cb++, cr++);
+    src += 4;
+  }
+}
+
+static void downsampleH2V1Plain(const rdr::U8* src, int width,
+                                rdr::U8* dst)
+{
+  int x;
+
+  for (x = 0; x < width; x++)
+    dst[x] = (src[x*2] + src[x*2+1] + (x & 1)) >> 1;
+}
+
+static void downsampleH2V2Plain(const rdr::U8* src0, const rdr::U8* src1,
+                                int width, rdr::U8* dst)
+{
+  int x;
+
+  for (x = 0; x < width; x++)
+    dst[x] = (src0[x*2] + src0[x*2+1] + src1[x*2] + src1[x*2+1] +
+              1 + (x & 1)) >> 2;
+}
+
+#ifdef HAVE_X86_SIMD
+
+// Constants for _mm_madd_epi16() on pairs of 16-bit values. The
+// G => Y factor doesn't fit in 16 bits, so it is split in two.
+#define PAIR(lo, hi) ((rdr::U32)(rdr::U16)(lo) | ((rdr::U32)(rdr::U16)(hi) << 16))
+
+static const rdr::U32 yRG = PAIR(FIX_0_29900, FIX_0_58700 - 16384);
+static const rdr::U32 yBG = PAIR(FIX_0_11400, 16384);
+static const rdr::U32 cbRG = PAIR(-FIX_0_16874, -FIX_0_33126);
+static const rdr::U32 crGB = PAIR(-FIX_0_41869, -FIX_0_08131);
+
+__target_sse2_attr
+static void rgbToYCbCrSSE2(const rdr::U8* src, int width,
+                           const int offsets[3],
+                           rdr::U8* y, rdr::U8* cb, rdr::U8* cr)
+{
+  __m128i shiftR, shiftG, shiftB;
+  __m128i mask, cYRG, cYBG, cCbRG, cCrGB, yOffset, cOffset;
+  int x;
+
+  shiftR = _mm_cvtsi32_si128(offsets[0] * 8);
+  shiftG = _mm_cvtsi32_si128(offsets[1] * 8);
+  shiftB = _mm_cvtsi32_si128(offsets[2] * 8);
+
+  mask = _mm_set1_epi32(0xff);
+  cYRG = _mm_set1_epi32(yRG);
+  cYBG = _mm_set1_epi32(yBG);
+  cCbRG = _mm_set1_epi32(cbRG);
+  cCrGB = _mm_set1_epi32(crGB);
+  yOffset = _mm_set1_epi32(ONE_HALF);
+  cOffset = _mm_set1_epi32(CBCR_OFFSET + ONE_HALF - 1);
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    __m128i outY[2], outCb[2], outCr[2];
+
+    for (int i = 0; i < 2; i++) {
+      __m128i pixels, r, g, b, rg, bg, gb;
+
+      pixels = _mm_loadu_si128((const __m128i*)(src + i * 16));
+
+      r = _mm_and_si128(_mm_srl_epi32(pixels, shiftR), mask);
+      g = _mm_and_si128(_mm_srl_epi32(pixels, shiftG), mask);
+      b = _mm_and_si128(_mm_srl_epi32(pixels, shiftB), mask);
+
+      rg = _mm_or_si128(r, _mm_slli_epi32(g, 16));
+      bg = _mm_or_si128(b, _mm_slli_epi32(g, 16));
+      gb = _mm_or_si128(g, _mm_slli_epi32(b, 16));
+
+      outY[i] = _mm_add_epi32(_mm_madd_epi16(rg, cYRG),
+                              _mm_madd_epi16(bg, cYBG));
+      outY[i] = _mm_srli_epi32(_mm_add_epi32(outY[i], yOffset), 16);
+
+      outCb[i] = _mm_add_epi32(_mm_madd_epi16(rg, cCbRG),
+                               _mm_slli_epi32(b, 15));
+      outCb[i] = _mm_srli_epi32(_mm_add_epi32(outCb[i], cOffset), 16);
+
+      outCr[i] = _mm_add_epi32(_mm_madd_epi16(gb, cCrGB),
+                               _mm_slli_epi32(r, 15));
+      outCr[i] = _mm_srli_epi32(_mm_add_epi32(outCr[i], cOffset), 16);
+    }
+
+    _mm_storel_epi64((__m128i*)(y + x),
+                     _mm_packus_epi16(_mm_packs_epi32(outY[0], outY[1]),
+                                      _mm_setzero_si128()));
+    _mm_storel_epi64((__m128i*)(cb + x),
+                     _mm_packus_epi16(_mm_packs_epi32(outCb[0], outCb[1]),
+                                      _mm_setzero_si128()));
+    _mm_storel_epi64((__m128i*)(cr + x),
+                     _mm_packus_epi16(_mm_packs_epi32(outCr[0], outCr[1]),
+                                      _mm_setzero_si128()));
+
+    src += 32;
+  }
+
+  rgbToYCbCrPlain(src, width - x, offsets, y + x, cb + x, cr + x);
+}
+
+__target_avx2_attr
+static void rgbToYCbCrAVX2(const rdr::U8* src, int width,
+                           const int offsets[3],
+                           rdr::U8* y, rdr::U8* cb, rdr::U8* cr)
+{
+  rdr::U8 rgIndex[32], bgIndex[32], gbIndex[32];
+  __m256i shuffleRG, shuffleBG, shuffleGB;
+  __m256i mask, cYRG, cYBG, cCbRG, cCrGB, yOffset, cOffset;
+  int x;
+
+  // Shuffles that put two of the components next to each other as
+  // 16-bit values in each 32-bit lane
+  for (int i = 0; i < 32; i += 4) {
+    rgIndex[i] = (i % 16) + offsets[0];
+    rgIndex[i+2] = (i % 16) + offsets[1];
+    bgIndex[i] = (i % 16) + offsets[2];
+    bgIndex[i+2] = (i % 16) + offsets[1];
+    gbIndex[i] = (i % 16) + offsets[1];
+    gbIndex[i+2] = (i % 16) + offsets[2];
+    rgIndex[i+1] = rgIndex[i+3] = 0x80;
+    bgIndex[i+1] = bgIndex[i+3] = 0x80;
+    gbIndex[i+1] = gbIndex[i+3] = 0x80;
+  }
+
+  shuffleRG = _mm256_loadu_si256((const __m256i*)rgIndex);
+  shuffleBG = _mm256_loadu_si256((const __m256i*)bgIndex);
+  shuffleGB = _mm256_loadu_si256((const __m256i*)gbIndex);
+
+  mask = _mm256_set1_epi32(0xffff);
+  cYRG = _mm256_set1_epi32(yRG);
+  cYBG = _mm256_set1_epi32(yBG);
+  cCbRG = _mm256_set1_epi32(cbRG);
+  cCrGB = _mm256_set1_epi32(crGB);
+  yOffset = _mm256_set1_epi32(ONE_HALF);
+  cOffset = _mm256_set1_epi32(CBCR_OFFSET + ONE_HALF - 1);
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m256i outY[2], outCb[2], outCr[2];
+    __m256i packed;
+
+    for (int i = 0; i < 2; i++) {
+      __m256i pixels, rg, bg, gb;
+
+      pixels = _mm256_loadu_si256((const __m256i*)(src + i * 32));
+
+      rg = _mm256_shuffle_epi8(pixels, shuffleRG);
+      bg = _mm256_shuffle_epi8(pixels, shuffleBG);
+      gb = _mm256_shuffle_epi8(pixels, shuffleGB);
+
+      outY[i] = _mm256_add_epi32(_mm256_madd_epi16(rg, cYRG),
+                                 _mm256_madd_epi16(bg, cYBG));
+      outY[i] = _mm256_srli_epi32(_mm256_add_epi32(outY[i], yOffset), 16);
+
+      outCb[i] = _mm256_add_epi32(_mm256_madd_epi16(rg, cCbRG),
+                                  _mm256_slli_epi32(_mm256_and_si256(bg, mask), 15));
+      outCb[i] = _mm256_srli_epi32(_mm256_add_epi32(outCb[i], cOffset), 16);
+
+      outCr[i] = _mm256_add_epi32(_mm256_madd_epi16(gb, cCrGB),
+                                  _mm256_slli_epi32(_mm256_and_si256(rg, mask), 15));
+      outCr[i] = _mm256_srli_epi32(_mm256_add_epi32(outCr[i], cOffset), 16);
+    }
+
+    // Packing works within each 128-bit lane, so the order needs to
+    // be fixed up before the final step
+    packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(outY[0], outY[1]),
+                                      _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i*)(y + x),
+                     _mm_packus_epi16(_mm256_castsi256_si128(packed),
+                                      _mm256_extracti128_si256(packed, 1)));
+    packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(outCb[0], outCb[1]),
+                                      _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i*)(cb + x),
+                     _mm_packus_epi16(_mm256_castsi256_si128(packed),
+                                      _mm256_extracti128_si256(packed, 1)));
+    packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(outCr[0], outCr[1]),
+                                      _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i*)(cr + x),
+                     _mm_packus_epi16(_mm256_castsi256_si128(packed),
+                                      _mm256_extracti128_si256(packed, 1)));
+
+    src += 64;
+  }
+
+  rgbToYCbCrSSE2(src, width - x, offsets, y + x, cb + x, cr + x);
+}
+
+__target_sse2_attr
+static void downsampleH2V1SSE2(const rdr::U8* src, int width, rdr::U8* dst)
+{
+  __m128i mask, bias;
+  int x;
+
+  mask = _mm_set1_epi16(0xff);
+  bias = _mm_set1_epi32(0x00010000);
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    __m128i a, sum;
+
+    a = _mm_loadu_si128((const __m128i*)(src + x * 2));
+
+    sum = _mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8));
+    sum = _mm_srli_epi16(_mm_add_epi16(sum, bias), 1);
+
+    _mm_storel_epi64((__m128i*)(dst + x),
+                     _mm_packus_epi16(sum, _mm_setzero_si128()));
+  }
+
+  downsampleH2V1Plain(src + x * 2, width - x, dst + x);
+}
+
+__target_sse2_attr
+static void downsampleH2V2SSE2(const rdr::U8* src0, const rdr::U8* src1,
+                               int width, rdr::U8* dst)
+{
+  __m128i mask, bias;
+  int x;
+
+  mask = _mm_set1_epi16(0xff);
+  bias = _mm_set1_epi32(0x00020001);
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    __m128i a, b, sum;
+
+    a = _mm_loadu_si128((const __m128i*)(src0 + x * 2));
+    b = _mm_loadu_si128((const __m128i*)(src1 + x * 2));
+
+    sum = _mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8));
+    sum = _mm_add_epi16(sum, _mm_and_si128(b, mask));
+    sum = _mm_add_epi16(sum, _mm_srli_epi16(b, 8));
+    sum = _mm_srli_epi16(_mm_add_epi16(sum, bias), 2);
+
+    _mm_storel_epi64((__m128i*)(dst + x),
+                     _mm_packus_epi16(sum, _mm_setzero_si128()));
+  }
+
+  downsampleH2V2Plain(src0 + x * 2, src1 + x * 2, width - x, dst + x);
+}
+
+#endif // HAVE_X86_SIMD
+
+#if defined(HAVE_NEON_SIMD) && defined(__aarch64__)
+
+static inline uint8x8_t yFromRGBNEON(uint16x8_t r, uint16x8_t g,
+                                     uint16x8_t b)
+{
+  uint32x4_t lo, hi;
+
+  lo = vmull_n_u16(vget_low_u16(r), FIX_0_29900);
+  lo = vmlal_n_u16(lo, vget_low_u16(g), FIX_0_58700);
+  lo = vmlal_n_u16(lo, vget_low_u16(b), FIX_0_11400);
+  hi = vmull_n_u16(vget_high_u16(r), FIX_0_29900);
+  hi = vmlal_n_u16(hi, vget_high_u16(g), FIX_0_58700);
+  hi = vmlal_n_u16(hi, vget_high_u16(b), FIX_0_11400);
+
+  lo = vaddq_u32(lo, vdupq_n_u32(ONE_HALF));
+  hi = vaddq_u32(hi, vdupq_n_u32(ONE_HALF));
+
+  return vmovn_u16(vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16)));
+}
+
+// Computes add * FIX_0_50000 - sub1 * f1 - sub2 * f2, which is the
+// form both Cb and Cr have
+static inline uint8x8_t chromaFromRGBNEON(uint16x8_t add,
+                                          uint16x8_t sub1, uint16_t f1,
+                                          uint16x8_t sub2, uint16_t f2)
+{
+  uint32x4_t lo, hi;
+
+  lo = vshll_n_u16(vget_low_u16(add), 15);
+  lo = vaddq_u32(lo, vdupq_n_u32(CBCR_OFFSET + ONE_HALF - 1));
+  lo = vmlsl_n_u16(lo, vget_low_u16(sub1), f1);
+  lo = vmlsl_n_u16(lo, vget_low_u16(sub2), f2);
+  hi = vshll_n_u16(vget_high_u16(add), 15);
+  hi = vaddq_u32(hi, vdupq_n_u32(CBCR_OFFSET + ONE_HALF - 1));
+  hi = vmlsl_n_u16(hi, vget_high_u16(sub1), f1);
+  hi = vmlsl_n_u16(hi, vget_high_u16(sub2), f2);
+
+  return vmovn_u16(vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16)));
+}
+
+static void rgbToYCbCrNEON(const rdr::U8* src, int width,
+                           const int offsets[3],
+                           rdr::U8* y, rdr::U8* cb, rdr::U8* cr)
+{
+  int x;
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint8x8x4_t pixels;
+    uint8x8_t comps[4];
+    uint16x8_t r, g, b;
+
+    pixels = vld4_u8(src);
+    comps[0] = pixels.val[0];
+    comps[1] = pixels.val[1];
+    comps[2] = pixels.val[2];
+    comps[3] = pixels.val[3];
+
+    r = vmovl_u8(comps[offsets[0]]);
+    g = vmovl_u8(comps[offsets[1]]);
+    b = vmovl_u8(comps[offsets[2]]);
+
+    vst1_u8(y + x, yFromRGBNEON(r, g, b));
+    vst1_u8(cb + x, chromaFromRGBNEON(b, r, FIX_0_16874, g, FIX_0_33126));
+    vst1_u8(cr + x, chromaFromRGBNEON(r, g, FIX_0_41869, b, FIX_0_08131));
+
+    src += 32;
+  }
+
+  rgbToYCbCrPlain(src, width - x, offsets, y + x, cb + x, cr + x);
+}
+
+static void downsampleH2V1NEON(const rdr::U8* src, int width, rdr::U8* dst)
+{
+  static const uint16_t biasValues[8] = { 0, 1, 0, 1, 0, 1, 0, 1 };
+  uint16x8_t bias;
+  int x;
+
+  bias = vld1q_u16(biasValues);
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint16x8_t sum;
+
+    sum = vpaddlq_u8(vld1q_u8(src + x * 2));
+    vst1_u8(dst + x, vshrn_n_u16(vaddq_u16(sum, bias), 1));
+  }
+
+  downsampleH2V1Plain(src + x * 2, width - x, dst + x);
+}
+
+static void downsampleH2V2NEON(const rdr::U8* src0, const rdr::U8* src1,
+                               int width, rdr::U8* dst)
+{
+  static const uint16_t biasValues[8] = { 1, 2, 1, 2, 1, 2, 1, 2 };
+  uint16x8_t bias;
+  int x;
+
+  bias = vld1q_u16(biasValues);
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint16x8_t sum;
+
+    sum = vpaddlq_u8(vld1q_u8(src0 + x * 2));
+    sum = vpadalq_u8(sum, vld1q_u8(src1 + x * 2));
+    vst1_u8(dst + x, vshrn_n_u16(vaddq_u16(sum, bias), 2));
+  }
+
+  downsampleH2V2Plain(src0 + x * 2, src1 + x * 2, width - x, dst + x);
+}
+
+#endif // HAVE_NEON_SIMD && __aarch64__
+
+static RGBToYCbCrFunc rgbToYCbCrRow = rgbToYCbCrPlain;
+static DownsampleH2V1Func downsampleH2V1 = downsampleH2V1Plain;
+static DownsampleH2V2Func downsampleH2V2 = downsampleH2V2Plain;
+
+static bool selectConversionKernels()
+{
+  unsigned features __unused_attr;
+
+  features = getCPUFeatures();
+
+#ifdef HAVE_X86_SIMD
+  if (features & cpuSSE2) {
+    downsampleH2V1 = downsampleH2V1SSE2;
+    downsampleH2V2 = downsampleH2V2SSE2;
+  }
+  if (features & cpuAVX2) {
+    vlog.debug("Using AVX2 colour conversion");
+    rgbToYCbCrRow = rgbToYCbCrAVX2;
+    return true;
+  }
+  if (features & cpuSSE2) {
+    vlog.debug("Using SSE2 colour conversion");
+    rgbToYCbCrRow = rgbToYCbCrSSE2;
+    return true;
+  }
+#endif
+
+#if defined(HAVE_NEON_SIMD) && defined(__aarch64__)
+  if (features & cpuNEON) {
+    vlog.debug("Using NEON colour conversion");
+    rgbToYCbCrRow = rgbToYCbCrNEON;
+    downsampleH2V1 = downsampleH2V1NEON;
+    downsampleH2V2 = downsampleH2V2NEON;
+    return true;
+  }
+#endif
+
+  return true;
+}
 
 //
 // Error manager implementation for the JPEG library
@@ -134,6 +597,11 @@ JpegCompressor::JpegCompressor(int bufferLen) : MemOutStream(bufferLen)
   dest->pub.term_destination = JpegTermDestination;
   dest->instance = this;
   cinfo->dest = (struct jpeg_destination_mgr *)dest;
+
+  // Other threads might already be using the kernels, so they must
+  // only be picked once
+  static bool kernelsSelected = selectConversionKernels();
+  (void)kernelsSelected;
 }
 
 JpegCompressor::~JpegCompressor(void)
@@ -156,54 +624,34 @@ void JpegCompressor::compress(const rdr::U8 *buf, int stride, const Rect& r,
 {
   int w = r.width();
   int h = r.height();
-  int pixelsize;
-  rdr::U8 *srcBuf = NULL;
-  bool srcBufIsTemp = false;
-  JSAMPROW *rowPointer = NULL;
+  int offsets[4];
+  int maxRows, fullWidth;
+  int planeWidth[3];
+  rdr::U8 *planes[3], *scratch[4];
+  JSAMPROW rowPointers[3][2 * DCTSIZE];
+  JSAMPARRAY planePointers[3];
 
   if(setjmp(err->jmpBuffer)) {
     // this will execute if libjpeg has an error
     jpeg_abort_compress(cinfo);
-    if (srcBufIsTemp && srcBuf) delete[] srcBuf;
-    if (rowPointer) delete[] rowPointer;
     throw rdr::Exception("%s", err->lastError);
   }
 
-  cinfo->image_width = w;
-  cinfo->image_height = h;
-  cinfo->in_color_space = JCS_RGB;
-  pixelsize = 3;
-
-#ifdef JCS_EXTENSIONS
-  // Try to have libjpeg output directly to our native format
-  // libjpeg can only handle some "standard" formats
-  if (pfRGBX.equal(pf))
-    cinfo->in_color_space = JCS_EXT_RGBX;
-  else if (pfBGRX.equal(pf))
-    cinfo->in_color_space = JCS_EXT_BGRX;
-  else if (pfXRGB.equal(pf))
-    cinfo->in_color_space = JCS_EXT_XRGB;
-  else if (pfXBGR.equal(pf))
-    cinfo->in_color_space = JCS_EXT_XBGR;
-
-  if (cinfo->in_color_space != JCS_RGB) {
-    srcBuf = (rdr::U8 *)buf;
-    pixelsize = 4;
-  }
-#endif
-
   if (stride == 0)
     stride = w;
 
-  if (cinfo->in_color_space == JCS_RGB) {
-    srcBuf = new rdr::U8[w * h * pixelsize];
-    srcBufIsTemp = true;
-    pf.rgbFromBuffer(srcBuf, (const rdr::U8 *)buf, w, stride, h);
-    stride = w;
+  // We do the colour conversion and downsampling ourselves, straight
+  // from the source format, and hand libjpeg the raw planes
+  cinfo->image_width = w;
+  cinfo->image_height = h;
+  if (subsamp == subsampleGray) {
+    cinfo->in_color_space = JCS_GRAYSCALE;
+    cinfo->input_components = 1;
+  } else {
+    cinfo->in_color_space = JCS_YCbCr;
+    cinfo->input_components = 3;
   }
 
-  cinfo->input_components = pixelsize;
-
   jpeg_set_defaults(cinfo);
 
   if (quality >= 1 && quality <= 100) {
@@ -226,26 +674,135 @@ void JpegCompressor::compress(const rdr::U8 *buf, int stride, const Rect& r,
     cinfo->comp_info[0].h_samp_factor = 2;
     cinfo->comp_info[0].v_samp_factor = 1;
     break;
-  case subsampleGray:
-    jpeg_set_colorspace(cinfo, JCS_GRAYSCALE);
   default:
     cinfo->comp_info[0].h_samp_factor = 1;
     cinfo->comp_info[0].v_samp_factor = 1;
   }
 
-  rowPointer = new JSAMPROW[h];
-  for (int dy = 0; dy < h; dy++)
-    rowPointer[dy] = (JSAMPROW)(&srcBuf[dy * stride * pixelsize]);
+  cinfo->raw_data_in = TRUE;
 
   jpeg_start_compress(cinfo, TRUE);
-  while (cinfo->next_scanline < cinfo->image_height)
-    jpeg_write_scanlines(cinfo, &rowPointer[cinfo->next_scanline],
-      cinfo->image_height - cinfo->next_scanline);
+
+  // libjpeg wants whole blocks, so the planes are padded by repeating
+  // the last sample (just as it would have done itself)
+  maxRows = cinfo->max_v_samp_factor * DCTSIZE;
+  fullWidth = 0;
+  for (int ci = 0; ci < cinfo->num_components; ci++) {
+    jpeg_component_info* comp;
+
+    comp = &cinfo->comp_info[ci];
+    planeWidth[ci] = comp->width_in_blocks * DCTSIZE;
+    fullWidth = __rfbmax(fullWidth, planeWidth[ci] *
+                                    cinfo->max_h_samp_factor /
+                                    comp->h_samp_factor);
+  }
+
+  // Three planes, plus two rows of full resolution Cb and Cr
+  planeBuffer.resize(fullWidth * (maxRows * 3 + 4));
+
+  for (int ci = 0; ci < 3; ci++) {
+    planes[ci] = &planeBuffer[fullWidth * maxRows * ci];
+    for (int row = 0; row < maxRows; row++)
+      rowPointers[ci][row] = planes[ci] + fullWidth * row;
+    planePointers[ci] = rowPointers[ci];
+  }
+  for (int i = 0; i < 4; i++)
+    scratch[i] = &planeBuffer[fullWidth * (maxRows * 3 + i)];
+
+  if (pf.is888())
+    pf.get888Offsets(offsets);
+  else
+    pfRGBX.get888Offsets(offsets);
+
+  while (cinfo->next_scanline < cinfo->image_height) {
+    for (int row = 0; row < maxRows; row++) {
+      int y;
+      rdr::U8 *yRow, *cbRow, *crRow;
+
+      y = cinfo->next_scanline + row;
+      yRow = planes[0] + fullWidth * row;
+
+      // Rows past the bottom repeat the last one, after downsampling
+      // (as libjpeg does it)
+      if (y >= h) {
+        memcpy(yRow, yRow - fullWidth, fullWidth);
+
+        if (cinfo->num_components == 1)
+          continue;
+
+        if (cinfo->max_v_samp_factor == 1) {
+          for (int ci = 1; ci < 3; ci++) {
+            memcpy(planes[ci] + fullWidth * row,
+                   planes[ci] + fullWidth * (row - 1), fullWidth);
+          }
+        } else if (row & 1) {
+          if (y - 1 >= h) {
+            for (int ci = 1; ci < 3; ci++) {
+              memcpy(planes[ci] + fullWidth * (row / 2),
+                     planes[ci] + fullWidth * (row / 2 - 1), fullWidth);
+            }
+          } else {
+            downsampleH2V2(scratch[0], scratch[0], planeWidth[1],
+                           planes[1] + fullWidth * (row / 2));
+            downsampleH2V2(scratch[1], scratch[1], planeWidth[2],
+                           planes[2] + fullWidth * (row / 2));
+          }
+        }
+
+        continue;
+      }
+
+      if (cinfo->max_h_samp_factor == 1) {
+        // Full resolution, so the chroma goes straight to the planes
+        cbRow = planes[1] + fullWidth * row;
+        crRow = planes[2] + fullWidth * row;
+      } else {
+        cbRow = scratch[(row & 1) * 2];
+        crRow = scratch[(row & 1) * 2 + 1];
+      }
+
+      rgbToYCbCrRow(getRow(buf, stride, y, pf, w), w, offsets,
+                    yRow, cbRow, crRow);
+
+      memset(yRow + w, yRow[w - 1], fullWidth - w);
+      memset(cbRow + w, cbRow[w - 1], fullWidth - w);
+      memset(crRow + w, crRow[w - 1], fullWidth - w);
+
+      if (cinfo->num_components == 1)
+        continue;
+
+      if (cinfo->max_v_samp_factor == 2) {
+        if (row & 1) {
+          downsampleH2V2(scratch[0], scratch[2], planeWidth[1],
+                         planes[1] + fullWidth * (row / 2));
+          downsampleH2V2(scratch[1], scratch[3], planeWidth[2],
+                         planes[2] + fullWidth * (row / 2));
+        }
+      } else if (cinfo->max_h_samp_factor == 2) {
+        downsampleH2V1(cbRow, planeWidth[1], planes[1] + fullWidth * row);
+        downsampleH2V1(crRow, planeWidth[2], planes[2] + fullWidth * row);
+      }
+    }
+
+    jpeg_write_raw_data(cinfo, planePointers, maxRows);
+  }
 
   jpeg_finish_compress(cinfo);
+}
+
+const rdr::U8* JpegCompressor::getRow(const rdr::U8 *buf, int stride,
+                                      int y, const PixelFormat& pf, int w)
+{
+  const rdr::U8* row;
+
+  row = buf + y * stride * (pf.bpp / 8);
+  if (pf.is888())
+    return row;
+
+  rowBuffer.resize(w * 4);
+  pfRGBX.bufferFromBuffer(&rowBuffer[0], pf, row, w);
 
-  if (srcBufIsTemp) delete[] srcBuf;
-  delete[] rowPointer;
+  return &rowBuffer[0];
 }
 
 void JpegCompressor::writeBytes(const void* data, int length)
@@ -25,6 +25,8 @@
 #ifndef __RFB_JPEGCOMPRESSOR_H__
 #define __RFB_JPEGCOMPRESSOR_H__
 
+#include <vector>
+
 #include <rdr/MemOutStream.h>
 #include <rfb/PixelFormat.h>
 #include <rfb/Rect.h>
@@ -49,11 +51,20 @@ namespace rfb {
 
   private:
 
+    const rdr::U8* getRow(const rdr::U8 *buf, int stride, int y,
+                          const PixelFormat& pf, int w);
+
+
     struct jpeg_compress_struct *cinfo;
 
     struct JPEG_ERROR_MGR *err;
     struct JPEG_DEST_MGR *dest;
 
+    // Y, Cb and Cr planes handed to libjpeg, kept between rects
+    std::vector<rdr::U8> planeBuffer;
+    // Source rows converted to a format we can handle directly
+    std::vector<rdr::U8> rowBuffer;
+
   };
 
 } // end of namespace rfb
@@ -23,151 +23,134 @@
 #include <assert.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include <rdr/types.h>
 
 namespace rfb {
   class Palette {
   public:
-    Palette() { clear(); }
+    Palette() : numColours(0), generation(0) {
+      memset(slots, 0, sizeof(slots)); clear();
+    }
     ~Palette() {}
 
     int size() const { return numColours; }
 
-    void clear() { numColours = 0; memset(hash, 0, sizeof(hash)); }
+    inline void clear();
 
     inline bool insert(rdr::U32 colour, int numPixels);
     inline unsigned char lookup(rdr::U32 colour) const;
     inline rdr::U32 getColour(unsigned char index) const;
     inline int getCount(unsigned char index) const;
 
+    // add() is a faster version of insert() for when a lot of
+    // colours will be added. The colours are not kept in order,
+    // so sort() must be called before the palette is used.
+    inline bool add(rdr::U32 colour, int numPixels);
+    inline void sort();
+
   protected:
-    inline unsigned char genHash(rdr::U32 colour) const;
+    inline unsigned findSlot(rdr::U32 colour) const;
+    inline void moveUp(unsigned char idx);
 
   protected:
     int numColours;
 
-    struct PaletteListNode {
-      PaletteListNode *next;
-      unsigned char idx;
+    // Open addressing hash table, with twice the number of slots as
+    // there can be colours. Slots from an earlier generation are
+    // free, which avoids having to wipe the table on every clear().
+    static const unsigned numSlots = 512;
+
+    struct Slot {
       rdr::U32 colour;
+      rdr::U16 generation;
+      unsigned char idx;
     };
 
+    Slot slots[numSlots];
+    rdr::U16 generation;
+
+    // Occurances of each colour, where the 0:th entry is the most common.
+    // Indices also refer to this array.
     struct PaletteEntry {
-      PaletteListNode *listNode;
+      rdr::U32 colour;
       int numPixels;
+      rdr::U16 slot;
     };
 
-    // This is the raw list of colours, allocated from 0 and up
-    PaletteListNode list[256];
-    // Hash table for quick lookup into the list above
-    PaletteListNode *hash[256];
-    // Occurances of each colour, where the 0:th entry is the most common.
-    // Indices also refer to this array.
     PaletteEntry entry[256];
   };
 }
 
-inline bool rfb::Palette::insert(rdr::U32 colour, int numPixels)
+inline void rfb::Palette::clear()
 {
-  PaletteListNode* pnode;
-  PaletteListNode* prev_pnode;
-  unsigned char hash_key, idx;
+  numColours = 0;
 
-  hash_key = genHash(colour);
+  generation++;
+  if (generation == 0) {
+    // Wrapped around, so old slots might look current
+    memset(slots, 0, sizeof(slots));
+    generation = 1;
+  }
+}
 
-  pnode = hash[hash_key];
-  prev_pnode = NULL;
+inline bool rfb::Palette::insert(rdr::U32 colour, int numPixels)
+{
+  unsigned slot;
+  unsigned char idx;
+
+  slot = findSlot(colour);
 
   // Do we already have an entry for this colour?
-  while (pnode != NULL) {
-    if (pnode->colour == colour) {
-      // Yup
-
-      idx = pnode->idx;
-      numPixels = entry[idx].numPixels + numPixels;
-
-      // The extra pixels might mean we have to adjust the sort list
-      while (idx > 0) {
-        if (entry[idx-1].numPixels >= numPixels)
-          break;
-        entry[idx] = entry[idx-1];
-        entry[idx].listNode->idx = idx;
-        idx--;
-      }
-
-      if (idx != pnode->idx) {
-        entry[idx].listNode = pnode;
-        pnode->idx = idx;
-      }
-
-      entry[idx].numPixels = numPixels;
-
-      return true;
-    }
+  if (slots[slot].generation == generation) {
+    idx = slots[slot].idx;
+    entry[idx].numPixels += numPixels;
 
-    prev_pnode = pnode;
-    pnode = pnode->next;
+    // The extra pixels might mean we have to adjust the sort list
+    moveUp(idx);
+
+    return true;
   }
 
   // Check if palette is full.
   if (numColours == 256)
     return false;
 
-  // Create a new colour entry
-  pnode = &list[numColours];
-  pnode->next = NULL;
-  pnode->idx = 0;
-  pnode->colour = colour;
-
-  // Add it to the hash table
-  if (prev_pnode != NULL)
-    prev_pnode->next = pnode;
-  else
-    hash[hash_key] = pnode;
-
-  // Move palette entries with lesser pixel counts.
+  // Create a new colour entry at the end
   idx = numColours;
-  while (idx > 0) {
-    if (entry[idx-1].numPixels >= numPixels)
-      break;
-    entry[idx] = entry[idx-1];
-    entry[idx].listNode->idx = idx;
-    idx--;
-  }
 
-  // And add it into the freed slot.
-  pnode->idx = idx;
-  entry[idx].listNode = pnode;
+  slots[slot].colour = colour;
+  slots[slot].generation = generation;
+  slots[slot].idx = idx;
+
+  entry[idx].colour = colour;
   entry[idx].numPixels = numPixels;
+  entry[idx].slot = slot;
 
   numColours++;
 
+  // And move it ahead of entries with lesser pixel counts
+  moveUp(idx);
+
   return true;
 }
 
 inline unsigned char rfb::Palette::lookup(rdr::U32 colour) const
 {
-  unsigned char hash_key;
-  PaletteListNode* pnode;
-
-  hash_key = genHash(colour);
-  pnode = hash[hash_key];
+  unsigned slot;
 
-  while (pnode != NULL) {
-    if (pnode->colour == colour)
-      return pnode->idx;
-    pnode = pnode->next;
-  }
+  slot = findSlot(colour);
 
   // We are being fed a bad colour
-  assert(false);
+  assert(slots[slot].generation == generation);
 
-  return 0;
+  return slots[slot].idx;
 }
 
 inline rdr::U32 rfb::Palette::getColour(unsigned char index) const
 {
-  return entry[index].listNode->colour;
+  return entry[index].colour;
 }
 
 inline int rfb::Palette::getCount(unsigned char index) const
@@ -175,16 +158,91 @@ inline int rfb::Palette::getCount(unsigned char index) const
   return entry[index].numPixels;
 }
 
-inline unsigned char rfb::Palette::genHash(rdr::U32 colour) const
+inline bool rfb::Palette::add(rdr::U32 colour, int numPixels)
 {
-  unsigned char hash_key;
+  unsigned slot;
+  unsigned char idx;
+
+  slot = findSlot(colour);
+
+  if (slots[slot].generation == generation) {
+    entry[slots[slot].idx].numPixels += numPixels;
+    return true;
+  }
+
+  if (numColours == 256)
+    return false;
 
-  // djb2 hash function
-  hash_key = 5; // 5381 & 0xff
-  for (int i = 0; i < 32; i += 8)
-    hash_key = ((hash_key << 5) + hash_key) ^ (colour >> i);
+  idx = numColours;
+
+  slots[slot].colour = colour;
+  slots[slot].generation = generation;
+  slots[slot].idx = idx;
+
+  entry[idx].colour = colour;
+  entry[idx].numPixels = numPixels;
+  entry[idx].slot = slot;
+
+  numColours++;
+
+  return true;
+}
+
+namespace rfb {
+  struct PaletteMoreCommon {
+    template<class T>
+    bool operator()(const T& a, const T& b) const {
+      return a.numPixels > b.numPixels;
+    }
+  };
+}
+
+inline void rfb::Palette::sort()
+{
+  int i;
+
+  // Stable, so that equally common colours stay in the order they
+  // were first seen
+  std::stable_sort(entry, entry + numColours, PaletteMoreCommon());
+
+  for (i = 0;i < numColours;i++)
+    slots[entry[i].slot].idx = i;
+}
+
+inline unsigned rfb::Palette::findSlot(rdr::U32 colour) const
+{
+  unsigned slot;
+
+  // Fibonacci hashing, using the top bits of the product
+  slot = (colour * 2654435769U) >> 23;
+
+  // Linear probing, which always ends as there are more slots than
+  // there can be colours
+  while (slots[slot].generation == generation) {
+    if (slots[slot].colour == colour)
+      break;
+    slot = (slot + 1) % numSlots;
+  }
+
+  return slot;
+}
+
+inline void rfb::Palette::moveUp(unsigned char idx)
+{
+  PaletteEntry moving;
+
+  moving = entry[idx];
+
+  while (idx > 0) {
+    if (entry[idx-1].numPixels >= moving.numPixels)
+      break;
+    entry[idx] = entry[idx-1];
+    slots[entry[idx].slot].idx = idx;
+    idx--;
+  }
 
-  return hash_key;
+  entry[idx] = moving;
+  slots[moving.slot].idx = idx;
 }
 
 #endif
@@ -25,6 +25,7 @@
 #include <rdr/OutStream.h>
 #include <rfb/Exception.h>
 #include <rfb/PixelFormat.h>
+#include <rfb/PixelFormatSIMD.h>
 #include <rfb/util.h>
 
 #ifdef _WIN32
@@ -237,7 +238,22 @@ void PixelFormat::bufferFromRGB(rdr::U8 *dst, const rdr::U8* src, int pixels) co
 void PixelFormat::bufferFromRGB(rdr::U8 *dst, const rdr::U8* src,
                                 int w, int stride, int h) const
 {
-  if (is888()) {
+  const ConversionKernels* kernels;
+
+  kernels = getConversionKernels();
+
+  if (is888() && (kernels->expandRGB != NULL)) {
+    int offsets[4];
+    rdr::U8 order[4];
+
+    get888Offsets(offsets);
+    order[offsets[0]] = 0;
+    order[offsets[1]] = 1;
+    order[offsets[2]] = 2;
+    order[offsets[3]] = 0xff;
+
+    kernels->expandRGB(dst, src, w, h, stride, w, order);
+  } else if (is888()) {
     // Optimised common case
     rdr::U8 *r, *g, *b, *x;
 
@@ -304,7 +320,21 @@ void PixelFormat::rgbFromBuffer(rdr::U8* dst, const rdr::U8* src, int pixels) co
 void PixelFormat::rgbFromBuffer(rdr::U8* dst, const rdr::U8* src,
                                 int w, int stride, int h) const
 {
-  if (is888()) {
+  const ConversionKernels* kernels;
+
+  kernels = getConversionKernels();
+
+  if (is888() && (kernels->compactRGB != NULL)) {
+    int offsets[4];
+    rdr::U8 order[3];
+
+    get888Offsets(offsets);
+    order[0] = offsets[0];
+    order[1] = offsets[1];
+    order[2] = offsets[2];
+
+    kernels->compactRGB(dst, src, w, h, w, stride, order);
+  } else if (is888()) {
     // Optimised common case
     const rdr::U8 *r, *g, *b;
 
@@ -377,6 +407,10 @@ void PixelFormat::bufferFromBuffer(rdr::U8* dst, const PixelFormat &srcPF,
                                    const rdr::U8* src, int w, int h,
                                    int dstStride, int srcStride) const
 {
+  const ConversionKernels* kernels;
+
+  kernels = getConversionKernels();
+
   if (equal(srcPF)) {
     // Trivial case
     while (h--) {
@@ -384,6 +418,58 @@ void PixelFormat::bufferFromBuffer(rdr::U8* dst, const PixelFormat &srcPF,
       dst += dstStride * bpp/8;
       src += srcStride * srcPF.bpp/8;
     }
+  } else if (is888() && srcPF.is888() && (kernels->shuffle32 != NULL)) {
+    // Vectorised common case A
+    int dstOffsets[4], srcOffsets[4];
+    rdr::U8 order[4];
+    int i;
+
+    get888Offsets(dstOffsets);
+    srcPF.get888Offsets(srcOffsets);
+    for (i = 0;i < 4;i++)
+      order[dstOffsets[i]] = srcOffsets[i];
+
+    kernels->shuffle32(dst, src, w, h, dstStride, srcStride, order);
+  } else if (IS_ALIGNED(dst, 2) && (bpp == 16) && (maxBits <= 8) &&
+             srcPF.is888() && (kernels->pack16 != NULL)) {
+    // Vectorised common case B
+    int srcOffsets[4];
+    Pack16Params params;
+
+    srcPF.get888Offsets(srcOffsets);
+    params.offset[0] = srcOffsets[0];
+    params.offset[1] = srcOffsets[1];
+    params.offset[2] = srcOffsets[2];
+    params.bits[0] = redBits;
+    params.bits[1] = greenBits;
+    params.bits[2] = blueBits;
+    params.shift[0] = redShift;
+    params.shift[1] = greenShift;
+    params.shift[2] = blueShift;
+    params.swap = endianMismatch;
+
+    kernels->pack16((rdr::U16*)dst, src, w, h, dstStride, srcStride,
+                    &params);
+  } else if (IS_ALIGNED(src, 2) && is888() && (srcPF.bpp == 16) &&
+             (srcPF.maxBits <= 8) && (kernels->unpack16 != NULL)) {
+    // Vectorised common case C
+    int dstOffsets[4];
+    Unpack16Params params;
+
+    get888Offsets(dstOffsets);
+    params.offset[0] = dstOffsets[0];
+    params.offset[1] = dstOffsets[1];
+    params.offset[2] = dstOffsets[2];
+    params.bits[0] = srcPF.redBits;
+    params.bits[1] = srcPF.greenBits;
+    params.bits[2] = srcPF.blueBits;
+    params.shift[0] = srcPF.redShift;
+    params.shift[1] = srcPF.greenShift;
+    params.shift[2] = srcPF.blueShift;
+    params.swap = srcPF.endianMismatch;
+
+    kernels->unpack16(dst, (const rdr::U16*)src, w, h, dstStride, srcStride,
+                      &params);
   } else if (is888() && srcPF.is888()) {
     // Optimised common case A: byte shuffling (e.g. endian conversion)
     rdr::U8 *d[4], *s[4];
@@ -490,6 +576,22 @@ void PixelFormat::bufferFromBuffer(rdr::U8* dst, const PixelFormat &srcPF,
 }
 
 
+void PixelFormat::get888Offsets(int offsets[4]) const
+{
+  if (bigEndian) {
+    offsets[0] = (24 - redShift)/8;
+    offsets[1] = (24 - greenShift)/8;
+    offsets[2] = (24 - blueShift)/8;
+    offsets[3] = (24 - (48 - redShift - greenShift - blueShift))/8;
+  } else {
+    offsets[0] = redShift/8;
+    offsets[1] = greenShift/8;
+    offsets[2] = blueShift/8;
+    offsets[3] = (48 - redShift - greenShift - blueShift)/8;
+  }
+}
+
+
 void PixelFormat::print(char* str, int len) const
 {
   // Unfortunately snprintf is not widely available so we build the string up
@@ -58,6 +58,9 @@ namespace rfb {
     bool isBigEndian(void) const;
     bool isLittleEndian(void) const;
 
+    // Byte positions of red, green, blue and padding for 888 formats
+    void get888Offsets(int offsets[4]) const;
+
     inline Pixel pixelFromBuffer(const rdr::U8* buffer) const;
     inline void bufferFromPixel(rdr::U8* buffer, Pixel pixel) const;
 
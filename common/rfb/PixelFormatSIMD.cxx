@@ -0,0 +1,989 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+#include <rfb/cpuFeatures.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+#ifdef HAVE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+#include <rfb/LogWriter.h>
+#include <rfb/PixelFormatSIMD.h>
+
+using namespace rfb;
+
+static LogWriter vlog("PixelFormat");
+
+//
+// Up conversion is v * 255 / max, which we do as (v * mul + add) >>
+// shift to avoid division. The constants are found by brute force and
+// then verified for every value, so they give the exact same result
+// as PixelFormat's tables.
+//
+
+struct UpconvConstants {
+  bool valid;
+  rdr::U16 mul, add;
+  int shift;
+};
+
+static UpconvConstants upconv[8];
+
+static bool checkUpconv(int bits, unsigned mul, unsigned add, int shift)
+{
+  unsigned max, v;
+
+  max = (1 << bits) - 1;
+
+  // Must fit in 16 bits
+  if (max * mul + add > 0xffff)
+    return false;
+
+  for (v = 0;v <= max;v++) {
+    if (((v * mul + add) >> shift) != v * 255 / max)
+      return false;
+  }
+
+  return true;
+}
+
+static void findUpconvConstants()
+{
+  int bits;
+
+  for (bits = 1;bits <= 8;bits++) {
+    unsigned max;
+    int shift;
+
+    max = (1 << bits) - 1;
+    upconv[bits-1].valid = false;
+
+    for (shift = 0;shift <= 8;shift++) {
+      unsigned mul, add;
+
+      for (mul = (255 << shift) / max;mul <= (255 << shift) / max + 1;mul++) {
+        for (add = 0;add < (1U << shift);add++) {
+          if (!checkUpconv(bits, mul, add, shift))
+            continue;
+
+          upconv[bits-1].valid = true;
+          upconv[bits-1].mul = mul;
+          upconv[bits-1].add = add;
+          upconv[bits-1].shift = shift;
+          break;
+        }
+        if (upconv[bits-1].valid)
+          break;
+      }
+      if (upconv[bits-1].valid)
+        break;
+    }
+
+    assert(upconv[bits-1].valid);
+  }
+}
+
+//
+// Plain versions for the pixels that don't fill an entire vector
+//
+
+static inline void shuffle32Tail(rdr::U8* dst, const rdr::U8* src,
+                                 int w, const rdr::U8 order[4])
+{
+  while (w--) {
+    dst[0] = src[order[0]];
+    dst[1] = src[order[1]];
+    dst[2] = src[order[2]];
+    dst[3] = src[order[3]];
+    dst += 4;
+    src += 4;
+  }
+}
+
+static inline void expandRGBTail(rdr::U8* dst, const rdr::U8* src,
+                                 int w, const rdr::U8 order[4])
+{
+  while (w--) {
+    int i;
+    for (i = 0;i < 4;i++)
+      dst[i] = (order[i] == 0xff) ? 0 : src[order[i]];
+    dst += 4;
+    src += 3;
+  }
+}
+
+static inline void compactRGBTail(rdr::U8* dst, const rdr::U8* src,
+                                  int w, const rdr::U8 order[3])
+{
+  while (w--) {
+    dst[0] = src[order[0]];
+    dst[1] = src[order[1]];
+    dst[2] = src[order[2]];
+    dst += 3;
+    src += 4;
+  }
+}
+
+static inline void pack16Tail(rdr::U16* dst, const rdr::U8* src,
+                              int w, const Pack16Params* params)
+{
+  while (w--) {
+    rdr::U16 d;
+    int i;
+
+    d = 0;
+    for (i = 0;i < 3;i++) {
+      unsigned max;
+      max = (1 << params->bits[i]) - 1;
+      d |= ((src[params->offset[i]] * max + 128) / 255) << params->shift[i];
+    }
+
+    if (params->swap)
+      d = (d >> 8) | (d << 8);
+
+    *dst = d;
+
+    dst++;
+    src += 4;
+  }
+}
+
+static inline void unpack16Tail(rdr::U8* dst, const rdr::U16* src,
+                                int w, const Unpack16Params* params)
+{
+  while (w--) {
+    rdr::U16 s;
+    int i;
+
+    s = *src;
+    if (params->swap)
+      s = (s >> 8) | (s << 8);
+
+    memset(dst, 0, 4);
+    for (i = 0;i < 3;i++) {
+      unsigned max;
+      max = (1 << params->bits[i]) - 1;
+      dst[params->offset[i]] = ((s >> params->shift[i]) & max) * 255 / max;
+    }
+
+    dst += 4;
+    src++;
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+
+//
+// SSE2
+//
+
+__target_sse2_attr
+static inline __m128i pack16ChannelSSE2(__m128i px, const Pack16Params* params,
+                                        int channel)
+{
+  __m128i v, x;
+
+  v = _mm_srl_epi32(px, _mm_cvtsi32_si128(params->offset[channel] * 8));
+  v = _mm_and_si128(v, _mm_set1_epi32(0xff));
+
+  // Products fit in 16 bits, and the upper half is zero
+  x = _mm_mullo_epi16(v, _mm_set1_epi32((1 << params->bits[channel]) - 1));
+  x = _mm_add_epi32(x, _mm_set1_epi32(128));
+
+  // Exact division by 255 for these values
+  x = _mm_add_epi32(x, _mm_srli_epi32(x, 8));
+  x = _mm_add_epi32(x, _mm_set1_epi32(1));
+  x = _mm_srli_epi32(x, 8);
+
+  return _mm_sll_epi32(x, _mm_cvtsi32_si128(params->shift[channel]));
+}
+
+__target_sse2_attr
+static inline __m128i pack16PixelsSSE2(__m128i px, const Pack16Params* params)
+{
+  __m128i d;
+
+  d = pack16ChannelSSE2(px, params, 0);
+  d = _mm_or_si128(d, pack16ChannelSSE2(px, params, 1));
+  d = _mm_or_si128(d, pack16ChannelSSE2(px, params, 2));
+
+  return d;
+}
+
+__target_sse2_attr
+static void pack16SSE2(rdr::U16* dst, const rdr::U8* src,
+                       int w, int h, int dstStride, int srcStride,
+                       const Pack16Params* params)
+{
+  // Local copy so the compiler knows it won't change
+  const Pack16Params p = *params;
+
+  const __m128i bias = _mm_set1_epi32(0x8000);
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 8 <= w;x += 8) {
+      __m128i a, b, d;
+
+      a = _mm_loadu_si128((const __m128i*)(src + x * 4));
+      b = _mm_loadu_si128((const __m128i*)(src + x * 4 + 16));
+
+      a = pack16PixelsSSE2(a, &p);
+      b = pack16PixelsSSE2(b, &p);
+
+      // No unsigned saturating pack in SSE2, so shift the range
+      a = _mm_sub_epi32(a, bias);
+      b = _mm_sub_epi32(b, bias);
+      d = _mm_packs_epi32(a, b);
+      d = _mm_xor_si128(d, _mm_set1_epi16((short)0x8000));
+
+      if (p.swap)
+        d = _mm_or_si128(_mm_slli_epi16(d, 8), _mm_srli_epi16(d, 8));
+
+      _mm_storeu_si128((__m128i*)(dst + x), d);
+    }
+
+    pack16Tail(dst + x, src + x * 4, w - x, &p);
+
+    dst += dstStride;
+    src += srcStride * 4;
+  }
+}
+
+__target_sse2_attr
+static inline __m128i unpack16ChannelSSE2(__m128i px,
+                                          const Unpack16Params* params,
+                                          const UpconvConstants* up,
+                                          int channel)
+{
+  const UpconvConstants* c;
+  __m128i v;
+
+  c = &up[channel];
+
+  v = _mm_srl_epi32(px, _mm_cvtsi32_si128(params->shift[channel]));
+  v = _mm_and_si128(v, _mm_set1_epi32((1 << params->bits[channel]) - 1));
+
+  v = _mm_mullo_epi16(v, _mm_set1_epi32(c->mul));
+  v = _mm_add_epi32(v, _mm_set1_epi32(c->add));
+  v = _mm_srl_epi32(v, _mm_cvtsi32_si128(c->shift));
+
+  return _mm_sll_epi32(v, _mm_cvtsi32_si128(params->offset[channel] * 8));
+}
+
+__target_sse2_attr
+static inline __m128i unpack16PixelsSSE2(__m128i px,
+                                         const Unpack16Params* params,
+                                         const UpconvConstants* up)
+{
+  __m128i d;
+
+  d = unpack16ChannelSSE2(px, params, up, 0);
+  d = _mm_or_si128(d, unpack16ChannelSSE2(px, params, up, 1));
+  d = _mm_or_si128(d, unpack16ChannelSSE2(px, params, up, 2));
+
+  return d;
+}
+
+__target_sse2_attr
+static void unpack16SSE2(rdr::U8* dst, const rdr::U16* src,
+                         int w, int h, int dstStride, int srcStride,
+                         const Unpack16Params* params)
+{
+  // Local copies so the compiler knows they won't change
+  const Unpack16Params p = *params;
+  UpconvConstants up[3];
+
+  up[0] = upconv[p.bits[0]-1];
+  up[1] = upconv[p.bits[1]-1];
+  up[2] = upconv[p.bits[2]-1];
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 8 <= w;x += 8) {
+      __m128i s, a, b;
+
+      s = _mm_loadu_si128((const __m128i*)(src + x));
+
+      if (p.swap)
+        s = _mm_or_si128(_mm_slli_epi16(s, 8), _mm_srli_epi16(s, 8));
+
+      a = _mm_unpacklo_epi16(s, _mm_setzero_si128());
+      b = _mm_unpackhi_epi16(s, _mm_setzero_si128());
+
+      a = unpack16PixelsSSE2(a, &p, up);
+      b = unpack16PixelsSSE2(b, &p, up);
+
+      _mm_storeu_si128((__m128i*)(dst + x * 4), a);
+      _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), b);
+    }
+
+    unpack16Tail(dst + x * 4, src + x, w - x, &p);
+
+    dst += dstStride * 4;
+    src += srcStride;
+  }
+}
+
+//
+// SSSE3
+//
+
+__target_ssse3_attr
+static void shuffle32SSSE3(rdr::U8* dst, const rdr::U8* src,
+                           int w, int h, int dstStride, int srcStride,
+                           const rdr::U8 order[4])
+{
+  rdr::U8 maskBytes[16];
+  __m128i mask;
+  int i;
+
+  for (i = 0;i < 16;i++)
+    maskBytes[i] = (i & ~3) + order[i & 3];
+  mask = _mm_loadu_si128((const __m128i*)maskBytes);
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 4 <= w;x += 4) {
+      __m128i px;
+      px = _mm_loadu_si128((const __m128i*)(src + x * 4));
+      px = _mm_shuffle_epi8(px, mask);
+      _mm_storeu_si128((__m128i*)(dst + x * 4), px);
+    }
+
+    shuffle32Tail(dst + x * 4, src + x * 4, w - x, order);
+
+    dst += dstStride * 4;
+    src += srcStride * 4;
+  }
+}
+
+__target_ssse3_attr
+static void expandRGBSSSE3(rdr::U8* dst, const rdr::U8* src,
+                           int w, int h, int dstStride, int srcStride,
+                           const rdr::U8 order[4])
+{
+  rdr::U8 maskBytes[16];
+  __m128i mask;
+  int i;
+
+  for (i = 0;i < 16;i++) {
+    if (order[i & 3] == 0xff)
+      maskBytes[i] = 0x80;
+    else
+      maskBytes[i] = (i / 4) * 3 + order[i & 3];
+  }
+  mask = _mm_loadu_si128((const __m128i*)maskBytes);
+
+  while (h--) {
+    int x;
+
+    // Each load reads 16 bytes, but only uses 12 of them
+    for (x = 0;x + 6 <= w;x += 4) {
+      __m128i px;
+      px = _mm_loadu_si128((const __m128i*)(src + x * 3));
+      px = _mm_shuffle_epi8(px, mask);
+      _mm_storeu_si128((__m128i*)(dst + x * 4), px);
+    }
+
+    expandRGBTail(dst + x * 4, src + x * 3, w - x, order);
+
+    dst += dstStride * 4;
+    src += srcStride * 3;
+  }
+}
+
+__target_ssse3_attr
+static void compactRGBSSSE3(rdr::U8* dst, const rdr::U8* src,
+                            int w, int h, int dstStride, int srcStride,
+                            const rdr::U8 order[3])
+{
+  rdr::U8 maskBytes[16];
+  __m128i mask;
+  int i;
+
+  for (i = 0;i < 16;i++) {
+    if (i >= 12)
+      maskBytes[i] = 0x80;
+    else
+      maskBytes[i] = (i / 3) * 4 + order[i % 3];
+  }
+  mask = _mm_loadu_si128((const __m128i*)maskBytes);
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 4 <= w;x += 4) {
+      __m128i px;
+      int last;
+
+      px = _mm_loadu_si128((const __m128i*)(src + x * 4));
+      px = _mm_shuffle_epi8(px, mask);
+
+      // Only 12 bytes to store
+      _mm_storel_epi64((__m128i*)(dst + x * 3), px);
+      last = _mm_cvtsi128_si32(_mm_srli_si128(px, 8));
+      memcpy(dst + x * 3 + 8, &last, 4);
+    }
+
+    compactRGBTail(dst + x * 3, src + x * 4, w - x, order);
+
+    dst += dstStride * 3;
+    src += srcStride * 4;
+  }
+}
+
+//
+// AVX2
+//
+
+__target_avx2_attr
+static void shuffle32AVX2(rdr::U8* dst, const rdr::U8* src,
+                          int w, int h, int dstStride, int srcStride,
+                          const rdr::U8 order[4])
+{
+  rdr::U8 maskBytes[32];
+  __m256i mask;
+  int i;
+
+  // The shuffle works on each 128-bit half separately
+  for (i = 0;i < 32;i++)
+    maskBytes[i] = (i & 0xc) + order[i & 3];
+  mask = _mm256_loadu_si256((const __m256i*)maskBytes);
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 8 <= w;x += 8) {
+      __m256i px;
+      px = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+      px = _mm256_shuffle_epi8(px, mask);
+      _mm256_storeu_si256((__m256i*)(dst + x * 4), px);
+    }
+
+    shuffle32Tail(dst + x * 4, src + x * 4, w - x, order);
+
+    dst += dstStride * 4;
+    src += srcStride * 4;
+  }
+}
+
+__target_avx2_attr
+static void expandRGBAVX2(rdr::U8* dst, const rdr::U8* src,
+                          int w, int h, int dstStride, int srcStride,
+                          const rdr::U8 order[4])
+{
+  rdr::U8 maskBytes[32];
+  __m256i mask, split;
+  int i;
+
+  for (i = 0;i < 32;i++) {
+    if (order[i & 3] == 0xff)
+      maskBytes[i] = 0x80;
+    else
+      maskBytes[i] = ((i & 0xf) / 4) * 3 + order[i & 3];
+  }
+  mask = _mm256_loadu_si256((const __m256i*)maskBytes);
+
+  split = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+
+  while (h--) {
+    int x;
+
+    // Reads 32 bytes but only uses 24, with the upper 12 moved to
+    // the upper half
+    for (x = 0;x + 11 <= w;x += 8) {
+      __m256i px;
+      px = _mm256_loadu_si256((const __m256i*)(src + x * 3));
+      px = _mm256_permutevar8x32_epi32(px, split);
+      px = _mm256_shuffle_epi8(px, mask);
+      _mm256_storeu_si256((__m256i*)(dst + x * 4), px);
+    }
+
+    expandRGBTail(dst + x * 4, src + x * 3, w - x, order);
+
+    dst += dstStride * 4;
+    src += srcStride * 3;
+  }
+}
+
+__target_avx2_attr
+static void compactRGBAVX2(rdr::U8* dst, const rdr::U8* src,
+                           int w, int h, int dstStride, int srcStride,
+                           const rdr::U8 order[3])
+{
+  rdr::U8 maskBytes[32];
+  __m256i mask, merge;
+  int i;
+
+  for (i = 0;i < 32;i++) {
+    if ((i & 0xf) >= 12)
+      maskBytes[i] = 0x80;
+    else
+      maskBytes[i] = ((i & 0xf) / 3) * 4 + order[(i & 0xf) % 3];
+  }
+  mask = _mm256_loadu_si256((const __m256i*)maskBytes);
+
+  // Moves the 12 bytes from each half next to each other
+  merge = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 8 <= w;x += 8) {
+      __m256i px;
+
+      px = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+      px = _mm256_shuffle_epi8(px, mask);
+      px = _mm256_permutevar8x32_epi32(px, merge);
+
+      // Only 24 bytes to store
+      _mm_storeu_si128((__m128i*)(dst + x * 3),
+                       _mm256_castsi256_si128(px));
+      _mm_storel_epi64((__m128i*)(dst + x * 3 + 16),
+                       _mm256_extracti128_si256(px, 1));
+    }
+
+    compactRGBTail(dst + x * 3, src + x * 4, w - x, order);
+
+    dst += dstStride * 3;
+    src += srcStride * 4;
+  }
+}
+
+__target_avx2_attr
+static inline __m256i pack16ChannelAVX2(__m256i px, const Pack16Params* params,
+                                        int channel)
+{
+  __m256i v, x;
+
+  v = _mm256_srl_epi32(px, _mm_cvtsi32_si128(params->offset[channel] * 8));
+  v = _mm256_and_si256(v, _mm256_set1_epi32(0xff));
+
+  x = _mm256_mullo_epi16(v, _mm256_set1_epi32((1 << params->bits[channel]) - 1));
+  x = _mm256_add_epi32(x, _mm256_set1_epi32(128));
+
+  x = _mm256_add_epi32(x, _mm256_srli_epi32(x, 8));
+  x = _mm256_add_epi32(x, _mm256_set1_epi32(1));
+  x = _mm256_srli_epi32(x, 8);
+
+  return _mm256_sll_epi32(x, _mm_cvtsi32_si128(params->shift[channel]));
+}
+
+__target_avx2_attr
+static inline __m256i pack16PixelsAVX2(__m256i px, const Pack16Params* params)
+{
+  __m256i d;
+
+  d = pack16ChannelAVX2(px, params, 0);
+  d = _mm256_or_si256(d, pack16ChannelAVX2(px, params, 1));
+  d = _mm256_or_si256(d, pack16ChannelAVX2(px, params, 2));
+
+  return d;
+}
+
+__target_avx2_attr
+static void pack16AVX2(rdr::U16* dst, const rdr::U8* src,
+                       int w, int h, int dstStride, int srcStride,
+                       const Pack16Params* params)
+{
+  // Local copy so the compiler knows it won't change
+  const Pack16Params p = *params;
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 16 <= w;x += 16) {
+      __m256i a, b, d;
+
+      a = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+      b = _mm256_loadu_si256((const __m256i*)(src + x * 4 + 32));
+
+      a = pack16PixelsAVX2(a, &p);
+      b = pack16PixelsAVX2(b, &p);
+
+      // The pack interleaves the halves, so put them back in order
+      d = _mm256_packus_epi32(a, b);
+      d = _mm256_permute4x64_epi64(d, 0xd8);
+
+      if (p.swap)
+        d = _mm256_or_si256(_mm256_slli_epi16(d, 8), _mm256_srli_epi16(d, 8));
+
+      _mm256_storeu_si256((__m256i*)(dst + x), d);
+    }
+
+    pack16Tail(dst + x, src + x * 4, w - x, &p);
+
+    dst += dstStride;
+    src += srcStride * 4;
+  }
+}
+
+__target_avx2_attr
+static inline __m256i unpack16ChannelAVX2(__m256i px,
+                                          const Unpack16Params* params,
+                                          const UpconvConstants* up,
+                                          int channel)
+{
+  const UpconvConstants* c;
+  __m256i v;
+
+  c = &up[channel];
+
+  v = _mm256_srl_epi32(px, _mm_cvtsi32_si128(params->shift[channel]));
+  v = _mm256_and_si256(v, _mm256_set1_epi32((1 << params->bits[channel]) - 1));
+
+  v = _mm256_mullo_epi16(v, _mm256_set1_epi32(c->mul));
+  v = _mm256_add_epi32(v, _mm256_set1_epi32(c->add));
+  v = _mm256_srl_epi32(v, _mm_cvtsi32_si128(c->shift));
+
+  return _mm256_sll_epi32(v, _mm_cvtsi32_si128(params->offset[channel] * 8));
+}
+
+__target_avx2_attr
+static void unpack16AVX2(rdr::U8* dst, const rdr::U16* src,
+                         int w, int h, int dstStride, int srcStride,
+                         const Unpack16Params* params)
+{
+  // Local copies so the compiler knows they won't change
+  const Unpack16Params p = *params;
+  UpconvConstants up[3];
+
+  up[0] = upconv[p.bits[0]-1];
+  up[1] = upconv[p.bits[1]-1];
+  up[2] = upconv[p.bits[2]-1];
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 8 <= w;x += 8) {
+      __m128i s;
+      __m256i px, d;
+
+      s = _mm_loadu_si128((const __m128i*)(src + x));
+
+      if (p.swap)
+        s = _mm_or_si128(_mm_slli_epi16(s, 8), _mm_srli_epi16(s, 8));
+
+      px = _mm256_cvtepu16_epi32(s);
+
+      d = unpack16ChannelAVX2(px, &p, up, 0);
+      d = _mm256_or_si256(d, unpack16ChannelAVX2(px, &p, up, 1));
+      d = _mm256_or_si256(d, unpack16ChannelAVX2(px, &p, up, 2));
+
+      _mm256_storeu_si256((__m256i*)(dst + x * 4), d);
+    }
+
+    unpack16Tail(dst + x * 4, src + x, w - x, &p);
+
+    dst += dstStride * 4;
+    src += srcStride;
+  }
+}
+
+#endif // HAVE_X86_SIMD
+
+#if defined(HAVE_NEON_SIMD) && defined(__aarch64__) && \
+    (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+
+#define HAVE_NEON_CONVERSION 1
+
+//
+// NEON
+//
+
+static void shuffle32NEON(rdr::U8* dst, const rdr::U8* src,
+                          int w, int h, int dstStride, int srcStride,
+                          const rdr::U8 order[4])
+{
+  rdr::U8 maskBytes[16];
+  uint8x16_t mask;
+  int i;
+
+  for (i = 0;i < 16;i++)
+    maskBytes[i] = (i & ~3) + order[i & 3];
+  mask = vld1q_u8(maskBytes);
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 4 <= w;x += 4)
+      vst1q_u8(dst + x * 4, vqtbl1q_u8(vld1q_u8(src + x * 4), mask));
+
+    shuffle32Tail(dst + x * 4, src + x * 4, w - x, order);
+
+    dst += dstStride * 4;
+    src += srcStride * 4;
+  }
+}
+
+static void expandRGBNEON(rdr::U8* dst, const rdr::U8* src,
+                          int w, int h, int dstStride, int srcStride,
+                          const rdr::U8 order[4])
+{
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 16 <= w;x += 16) {
+      uint8x16x3_t s;
+      uint8x16x4_t d;
+      int i;
+
+      s = vld3q_u8(src + x * 3);
+      for (i = 0;i < 4;i++) {
+        if (order[i] == 0xff)
+          d.val[i] = vdupq_n_u8(0);
+        else
+          d.val[i] = s.val[order[i]];
+      }
+      vst4q_u8(dst + x * 4, d);
+    }
+
+    expandRGBTail(dst + x * 4, src + x * 3, w - x, order);
+
+    dst += dstStride * 4;
+    src += srcStride * 3;
+  }
+}
+
+static void compactRGBNEON(rdr::U8* dst, const rdr::U8* src,
+                           int w, int h, int dstStride, int srcStride,
+                           const rdr::U8 order[3])
+{
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 16 <= w;x += 16) {
+      uint8x16x4_t s;
+      uint8x16x3_t d;
+
+      s = vld4q_u8(src + x * 4);
+      d.val[0] = s.val[order[0]];
+      d.val[1] = s.val[order[1]];
+      d.val[2] = s.val[order[2]];
+      vst3q_u8(dst + x * 3, d);
+    }
+
+    compactRGBTail(dst + x * 3, src + x * 4, w - x, order);
+
+    dst += dstStride * 3;
+    src += srcStride * 4;
+  }
+}
+
+static inline uint16x8_t pack16ChannelNEON(uint8x8_t v,
+                                           const Pack16Params* params,
+                                           int channel)
+{
+  uint16x8_t x;
+
+  x = vmull_u8(v, vdup_n_u8((1 << params->bits[channel]) - 1));
+  x = vaddq_u16(x, vdupq_n_u16(128));
+
+  x = vaddq_u16(x, vshrq_n_u16(x, 8));
+  x = vaddq_u16(x, vdupq_n_u16(1));
+  x = vshrq_n_u16(x, 8);
+
+  return vshlq_u16(x, vdupq_n_s16(params->shift[channel]));
+}
+
+static void pack16NEON(rdr::U16* dst, const rdr::U8* src,
+                       int w, int h, int dstStride, int srcStride,
+                       const Pack16Params* params)
+{
+  // Local copy so the compiler knows it won't change
+  const Pack16Params p = *params;
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 8 <= w;x += 8) {
+      uint8x8x4_t s;
+      uint16x8_t d;
+
+      s = vld4_u8(src + x * 4);
+
+      d = pack16ChannelNEON(s.val[p.offset[0]], &p, 0);
+      d = vorrq_u16(d, pack16ChannelNEON(s.val[p.offset[1]], &p, 1));
+      d = vorrq_u16(d, pack16ChannelNEON(s.val[p.offset[2]], &p, 2));
+
+      if (p.swap)
+        d = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(d)));
+
+      vst1q_u16(dst + x, d);
+    }
+
+    pack16Tail(dst + x, src + x * 4, w - x, &p);
+
+    dst += dstStride;
+    src += srcStride * 4;
+  }
+}
+
+static inline uint8x8_t unpack16ChannelNEON(uint16x8_t px,
+                                            const Unpack16Params* params,
+                                            const UpconvConstants* up,
+                                            int channel)
+{
+  const UpconvConstants* c;
+  uint16x8_t v;
+
+  c = &up[channel];
+
+  v = vshlq_u16(px, vdupq_n_s16(-params->shift[channel]));
+  v = vandq_u16(v, vdupq_n_u16((1 << params->bits[channel]) - 1));
+
+  v = vmlaq_u16(vdupq_n_u16(c->add), v, vdupq_n_u16(c->mul));
+  v = vshlq_u16(v, vdupq_n_s16(-c->shift));
+
+  return vmovn_u16(v);
+}
+
+static void unpack16NEON(rdr::U8* dst, const rdr::U16* src,
+                         int w, int h, int dstStride, int srcStride,
+                         const Unpack16Params* params)
+{
+  // Local copies so the compiler knows they won't change
+  const Unpack16Params p = *params;
+  UpconvConstants up[3];
+
+  up[0] = upconv[p.bits[0]-1];
+  up[1] = upconv[p.bits[1]-1];
+  up[2] = upconv[p.bits[2]-1];
+
+  while (h--) {
+    int x;
+
+    for (x = 0;x + 8 <= w;x += 8) {
+      uint16x8_t s;
+      uint8x8x4_t d;
+
+      s = vld1q_u16(src + x);
+
+      if (p.swap)
+        s = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(s)));
+
+      d.val[0] = d.val[1] = d.val[2] = d.val[3] = vdup_n_u8(0);
+      d.val[p.offset[0]] = unpack16ChannelNEON(s, &p, up, 0);
+      d.val[p.offset[1]] = unpack16ChannelNEON(s, &p, up, 1);
+      d.val[p.offset[2]] = unpack16ChannelNEON(s, &p, up, 2);
+
+      vst4_u8(dst + x * 4, d);
+    }
+
+    unpack16Tail(dst + x * 4, src + x, w - x, &p);
+
+    dst += dstStride * 4;
+    src += srcStride;
+  }
+}
+
+#endif // HAVE_NEON_CONVERSION
+
+//
+// Kernel selection
+//
+
+static const ConversionKernels plainKernels = {
+  "plain", NULL, NULL, NULL, NULL, NULL
+};
+
+#ifdef HAVE_X86_SIMD
+static const ConversionKernels sse2Kernels = {
+  "SSE2", NULL, NULL, NULL, pack16SSE2, unpack16SSE2
+};
+static const ConversionKernels ssse3Kernels = {
+  "SSSE3", shuffle32SSSE3, expandRGBSSSE3, compactRGBSSSE3,
+  pack16SSE2, unpack16SSE2
+};
+static const ConversionKernels avx2Kernels = {
+  "AVX2", shuffle32AVX2, expandRGBAVX2, compactRGBAVX2,
+  pack16AVX2, unpack16AVX2
+};
+#endif
+
+#ifdef HAVE_NEON_CONVERSION
+static const ConversionKernels neonKernels = {
+  "NEON", shuffle32NEON, expandRGBNEON, compactRGBNEON,
+  pack16NEON, unpack16NEON
+};
+#endif
+
+static const ConversionKernels* selectKernels(unsigned features)
+{
+#ifdef HAVE_X86_SIMD
+  if (features & cpuAVX2)
+    return &avx2Kernels;
+  if (features & cpuSSSE3)
+    return &ssse3Kernels;
+  if (features & cpuSSE2)
+    return &sse2Kernels;
+#endif
+
+#ifdef HAVE_NEON_CONVERSION
+  if (features & cpuNEON)
+    return &neonKernels;
+#endif
+
+  return &plainKernels;
+}
+
+static const ConversionKernels* forcedKernels = NULL;
+
+static const ConversionKernels* initKernels()
+{
+  const ConversionKernels* kernels;
+
+  findUpconvConstants();
+
+  kernels = selectKernels(getCPUFeatures());
+  vlog.debug("Using %s pixel conversion", kernels->name);
+
+  return kernels;
+}
+
+const ConversionKernels* rfb::getConversionKernels()
+{
+  static const ConversionKernels* kernels = initKernels();
+
+  if (forcedKernels != NULL)
+    return forcedKernels;
+
+  return kernels;
+}
+
+void rfb::setConversionFeatures(unsigned features)
+{
+  // Make sure everything is set up
+  getConversionKernels();
+
+  forcedKernels = selectKernels(getCPUFeatures() & features);
+}
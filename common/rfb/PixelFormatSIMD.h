@@ -0,0 +1,102 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// PixelFormatSIMD.h - vectorised pixel conversion
+//
+// These kernels handle the most common conversions in PixelFormat.
+// The best version for the CPU is picked at run time, and a kernel is
+// NULL if there is nothing better than the generic code.
+//
+// All strides are in pixels, and the destination and source must not
+// overlap.
+//
+
+#ifndef __RFB_PIXELFORMATSIMD_H__
+#define __RFB_PIXELFORMATSIMD_H__
+
+#include <rdr/types.h>
+
+namespace rfb {
+
+  // shuffle32() rearranges the bytes of 32-bit pixels. Destination
+  // byte i is taken from source byte order[i].
+  typedef void (*Shuffle32Func)(rdr::U8* dst, const rdr::U8* src,
+                                int w, int h, int dstStride, int srcStride,
+                                const rdr::U8 order[4]);
+
+  // expandRGB() converts packed RGB to 32-bit pixels. Destination byte
+  // i is taken from source byte order[i] (0-2), or is zero if that is
+  // 0xff.
+  typedef void (*ExpandRGBFunc)(rdr::U8* dst, const rdr::U8* src,
+                                int w, int h, int dstStride, int srcStride,
+                                const rdr::U8 order[4]);
+
+  // compactRGB() converts 32-bit pixels to packed RGB. Red, green and
+  // blue are taken from source byte order[0], order[1] and order[2].
+  typedef void (*CompactRGBFunc)(rdr::U8* dst, const rdr::U8* src,
+                                 int w, int h, int dstStride, int srcStride,
+                                 const rdr::U8 order[3]);
+
+  // pack16() converts 32-bit pixels with 8 bits per channel to 16-bit
+  // pixels with at most 8 bits per channel, rounding like
+  // PixelFormat's down conversion table.
+  struct Pack16Params {
+    int offset[3];  // Source byte of red, green and blue
+    int bits[3];
+    int shift[3];
+    bool swap;      // Byte swap the result
+  };
+
+  typedef void (*Pack16Func)(rdr::U16* dst, const rdr::U8* src,
+                             int w, int h, int dstStride, int srcStride,
+                             const Pack16Params* params);
+
+  // unpack16() is the reverse of pack16(), filling in the remaining
+  // destination byte with zero.
+  struct Unpack16Params {
+    int offset[3];  // Destination byte of red, green and blue
+    int bits[3];
+    int shift[3];
+    bool swap;      // Byte swap the source
+  };
+
+  typedef void (*Unpack16Func)(rdr::U8* dst, const rdr::U16* src,
+                               int w, int h, int dstStride, int srcStride,
+                               const Unpack16Params* params);
+
+  struct ConversionKernels {
+    const char* name;
+    Shuffle32Func shuffle32;
+    ExpandRGBFunc expandRGB;
+    CompactRGBFunc compactRGB;
+    Pack16Func pack16;
+    Unpack16Func unpack16;
+  };
+
+  // getConversionKernels() returns the kernels to use on this CPU
+  const ConversionKernels* getConversionKernels();
+
+  // setConversionFeatures() limits the kernels to those that only
+  // need the given CPUFeatures. Only meant for testing and
+  // benchmarking.
+  void setConversionFeatures(unsigned features);
+
+}
+
+#endif
@@ -96,7 +96,7 @@ void RREEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
 
   bufferCopy.commitBufferRW(pb->getRect());
 
-  rdr::OutStream* os = conn->getOutStream();
+  rdr::OutStream* os = getOutStream();
   os->writeU32(nSubrects);
   os->writeBytes(mos.data(), mos.length());
   mos.clear();
@@ -108,7 +108,7 @@ void RREEncoder::writeSolidRect(int width, int height,
 {
   rdr::OutStream* os;
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU32(0);
   os->writeBytes(colour, pf.bpp/8);
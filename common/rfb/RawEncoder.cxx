@@ -49,7 +49,7 @@ void RawEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
 
   buffer = pb->getBuffer(pb->getRect(), &stride);
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   h = pb->height();
   line_bytes = pb->width() * pb->getPF().bpp/8;
@@ -67,7 +67,7 @@ void RawEncoder::writeSolidRect(int width, int height,
   rdr::OutStream* os;
   int pixels, pixel_size;
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   pixels = width*height;
   pixel_size = pf.bpp/8;
@@ -396,6 +396,15 @@ void SMsgWriter::writeCopyRect(const Rect& r, int srcX, int srcY)
   endRect();
 }
 
+void SMsgWriter::writeTileCacheRect(const Rect& r, int op, rdr::U64 key)
+{
+  startRect(r,encodingTileCache);
+  os->writeU8(op);
+  os->writeU32(key >> 32);
+  os->writeU32(key);
+  endRect();
+}
+
 void SMsgWriter::startRect(const Rect& r, int encoding)
 {
   if (++nRectsInUpdate > nRectsInHeader && nRectsInHeader)
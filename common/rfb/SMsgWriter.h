@@ -115,6 +115,9 @@ namespace rfb {
     // There is no explicit encoder for CopyRect rects.
     void writeCopyRect(const Rect& r, int srcX, int srcY);
 
+    // Nor for the tile cache, as they don't have any pixel data
+    void writeTileCacheRect(const Rect& r, int op, rdr::U64 key);
+
     // Encoders should call these to mark the start and stop of individual
     // rects.
     void startRect(const Rect& r, int enc);
@@ -63,7 +63,9 @@ SSecurityTLS::SSecurityTLS(SConnection* sc, bool _anon)
 
 void SSecurityTLS::shutdown()
 {
-  if (session) {
+  if (tlsos && tlsos->isOffloaded()) {
+    tlsos->sendCloseNotify();
+  } else if (session) {
     if (gnutls_bye(session, GNUTLS_SHUT_RDWR) != GNUTLS_E_SUCCESS) {
       /* FIXME: Treat as non-fatal error */
       vlog.error("TLS session wasn't terminated gracefully");
@@ -166,7 +168,11 @@ bool SSecurityTLS::processMsg()
   vlog.debug("TLS handshake completed with %s",
              gnutls_session_get_desc(session));
 
-  sc->setStreams(tlsis, tlsos);
+  // Let the kernel do the encryption from here on if it can
+  if (Security::TLSOffload && tlsos->offload())
+    sc->setStreams(tlsis, rawos);
+  else
+    sc->setStreams(tlsis, tlsos);
 
   return true;
 }
@@ -36,6 +36,8 @@
 #include <rdr/OutStream.h>
 #include <gnutls/gnutls.h>
 
+namespace rdr { class TLSOutStream; }
+
 namespace rfb {
 
   class SSecurityTLS : public SSecurity {
@@ -63,7 +65,7 @@ namespace rfb {
     bool anon;
 
     rdr::InStream* tlsis;
-    rdr::OutStream* tlsos;
+    rdr::TLSOutStream* tlsos;
 
     rdr::InStream* rawis;
     rdr::OutStream* rawos;
@@ -0,0 +1,226 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <string.h>
+
+#include <map>
+
+#include <rfb/PixelBuffer.h>
+#include <rfb/ScrollDetector.h>
+
+using namespace rfb;
+
+// The smallest area, in lines, that we consider worth a copy
+static const int MinCopyLines = 32;
+
+static inline rdr::U64 mix(rdr::U64 hash, rdr::U64 value)
+{
+  hash = (hash ^ value) * 0x9e3779b97f4a7c15ULL;
+  return hash ^ (hash >> 29);
+}
+
+ScrollDetector::ScrollDetector()
+{
+}
+
+ScrollDetector::~ScrollDetector()
+{
+}
+
+bool ScrollDetector::detect(const PixelBuffer* before,
+                            const PixelBuffer* after,
+                            const Rect& r, Rect* dest, Point* delta)
+{
+  int shift, start, end;
+
+  if ((r.width() < MinCopyLines) || (r.height() < MinCopyLines))
+    return false;
+
+  // Vertical scrolling is by far the most common, so check that first
+  hashRows(before, r, &beforeHashes);
+  hashRows(after, r, &afterHashes);
+
+  if (findShift(&shift, &start, &end)) {
+    *dest = Rect(r.tl.x, r.tl.y + start, r.br.x, r.tl.y + end);
+    *delta = Point(0, shift);
+    return true;
+  }
+
+  hashColumns(before, r, &beforeHashes);
+  hashColumns(after, r, &afterHashes);
+
+  if (findShift(&shift, &start, &end)) {
+    *dest = Rect(r.tl.x + start, r.tl.y, r.tl.x + end, r.br.y);
+    *delta = Point(shift, 0);
+    return true;
+  }
+
+  return false;
+}
+
+void ScrollDetector::hashRows(const PixelBuffer* pb, const Rect& r,
+                              std::vector<rdr::U64>* hashes)
+{
+  const rdr::U8* data;
+  int stride;
+  size_t rowBytes;
+
+  data = pb->getBuffer(r, &stride);
+  stride *= pb->getPF().bpp/8;
+  rowBytes = r.width() * (pb->getPF().bpp/8);
+
+  hashes->resize(r.height());
+
+  for (int y = 0; y < r.height(); y++) {
+    const rdr::U8* ptr;
+    size_t len;
+    rdr::U64 hash;
+
+    ptr = data;
+    len = rowBytes;
+
+    hash = 0;
+    while (len >= 8) {
+      rdr::U64 word;
+      memcpy(&word, ptr, 8);
+      hash = mix(hash, word);
+      ptr += 8;
+      len -= 8;
+    }
+    while (len > 0) {
+      hash = mix(hash, *ptr);
+      ptr++;
+      len--;
+    }
+
+    (*hashes)[y] = hash;
+
+    data += stride;
+  }
+}
+
+void ScrollDetector::hashColumns(const PixelBuffer* pb, const Rect& r,
+                                 std::vector<rdr::U64>* hashes)
+{
+  const rdr::U8* data;
+  int stride, bytesPerPixel;
+
+  data = pb->getBuffer(r, &stride);
+  bytesPerPixel = pb->getPF().bpp/8;
+  stride *= bytesPerPixel;
+
+  hashes->assign(r.width(), 0);
+
+  for (int y = 0; y < r.height(); y++) {
+    const rdr::U8* ptr;
+
+    ptr = data;
+    for (int x = 0; x < r.width(); x++) {
+      rdr::U32 pixel;
+
+      pixel = 0;
+      memcpy(&pixel, ptr, bytesPerPixel);
+      (*hashes)[x] = mix((*hashes)[x], pixel);
+
+      ptr += bytesPerPixel;
+    }
+
+    data += stride;
+  }
+}
+
+bool ScrollDetector::findShift(int* shift, int* start, int* end)
+{
+  std::map<rdr::U64, int> lines;
+  std::map<rdr::U64, int>::iterator line;
+  std::map<int, int> votes;
+  std::map<int, int>::iterator vote;
+  int count, bestShift, bestVotes;
+  int runStart, bestStart, bestEnd;
+
+  count = beforeHashes.size();
+
+  // Only lines that are unique can tell us how far something has
+  // moved. Blank lines and the like would just confuse things.
+  for (int i = 0; i < count; i++) {
+    line = lines.find(beforeHashes[i]);
+    if (line == lines.end())
+      lines[beforeHashes[i]] = i;
+    else
+      line->second = -1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (afterHashes[i] == beforeHashes[i])
+      continue;
+
+    line = lines.find(afterHashes[i]);
+    if ((line == lines.end()) || (line->second < 0))
+      continue;
+
+    votes[i - line->second]++;
+  }
+
+  bestShift = 0;
+  bestVotes = 0;
+  for (vote = votes.begin(); vote != votes.end(); ++vote) {
+    if (vote->second > bestVotes) {
+      bestShift = vote->first;
+      bestVotes = vote->second;
+    }
+  }
+
+  if (bestVotes == 0)
+    return false;
+
+  // Now find the largest continuous area that matches that shift
+  runStart = -1;
+  bestStart = bestEnd = 0;
+  for (int i = 0; i <= count; i++) {
+    bool match;
+
+    match = false;
+    if ((i < count) && (i - bestShift >= 0) && (i - bestShift < count))
+      match = afterHashes[i] == beforeHashes[i - bestShift];
+
+    if (match) {
+      if (runStart < 0)
+        runStart = i;
+      continue;
+    }
+
+    if (runStart < 0)
+      continue;
+
+    if (i - runStart > bestEnd - bestStart) {
+      bestStart = runStart;
+      bestEnd = i;
+    }
+
+    runStart = -1;
+  }
+
+  if (bestEnd - bestStart < MinCopyLines)
+    return false;
+
+  *shift = bestShift;
+  *start = bestStart;
+  *end = bestEnd;
+
+  return true;
+}
@@ -0,0 +1,63 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// ScrollDetector - finds areas of the framebuffer that have moved
+//
+
+#ifndef __RFB_SCROLLDETECTOR_H__
+#define __RFB_SCROLLDETECTOR_H__
+
+#include <vector>
+
+#include <rdr/types.h>
+#include <rfb/Rect.h>
+
+namespace rfb {
+
+  class PixelBuffer;
+
+  class ScrollDetector {
+  public:
+    ScrollDetector();
+    ~ScrollDetector();
+
+    // detect() checks if a part of r in the after buffer is a copy of
+    // the same area in the before buffer, shifted either horizontally
+    // or vertically. If so, the destination of that copy and the
+    // distance it was moved is returned.
+
+    bool detect(const PixelBuffer* before, const PixelBuffer* after,
+                const Rect& r, Rect* dest, Point* delta);
+
+  protected:
+    void hashRows(const PixelBuffer* pb, const Rect& r,
+                  std::vector<rdr::U64>* hashes);
+    void hashColumns(const PixelBuffer* pb, const Rect& r,
+                     std::vector<rdr::U64>* hashes);
+
+    bool findShift(int* shift, int* start, int* end);
+
+  protected:
+    std::vector<rdr::U64> beforeHashes;
+    std::vector<rdr::U64> afterHashes;
+  };
+
+}
+
+#endif
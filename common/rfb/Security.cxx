@@ -53,6 +53,10 @@ static LogWriter vlog("Security");
 StringParameter Security::GnuTLSPriority("GnuTLSPriority",
   "GnuTLS priority string that controls the TLS session’s handshake algorithms",
   "NORMAL");
+
+BoolParameter Security::TLSOffload("TLSOffload",
+  "Let the kernel encrypt outgoing data for TLS 1.2 sessions, if supported "
+  "by the system", false);
 #endif
 
 Security::Security()
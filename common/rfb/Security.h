@@ -95,6 +95,7 @@ namespace rfb {
 
 #ifdef HAVE_GNUTLS
     static StringParameter GnuTLSPriority;
+    static BoolParameter TLSOffload;
 #endif
 
   private:
@@ -51,6 +51,26 @@ rfb::IntParameter rfb::Server::frameRate
 ("FrameRate",
  "The maximum number of updates per second sent to each client",
  60);
+rfb::IntParameter rfb::Server::encodeThreads
+("EncodeThreads",
+ "The number of worker threads used to encode updates for each client "
+ "(zero means encoding on the main thread)",
+ 0, 0, 64);
+rfb::IntParameter rfb::Server::compareThreads
+("CompareThreads",
+ "The number of extra threads used to compare the framebuffer "
+ "(zero means comparing on the main thread)",
+ 0, 0);
+rfb::BoolParameter rfb::Server::compareHashes
+("CompareHashes",
+ "Compare the framebuffer using a hash of each tile instead of a full "
+ "copy of it. Uses less memory, but is less precise",
+ false);
+rfb::BoolParameter rfb::Server::detectScrolling
+("DetectScrolling",
+ "Look for areas of the framebuffer that have been scrolled or moved, "
+ "and send those as copies",
+ false);
 rfb::BoolParameter rfb::Server::protocol3_3
 ("Protocol3.3",
  "Always use protocol version 3.3 for backwards compatibility with "
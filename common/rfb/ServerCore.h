@@ -38,6 +38,10 @@ namespace rfb {
     static IntParameter maxIdleTime;
     static IntParameter compareFB;
     static IntParameter frameRate;
+    static IntParameter encodeThreads;
+    static IntParameter compareThreads;
+    static BoolParameter compareHashes;
+    static BoolParameter detectScrolling;
     static BoolParameter protocol3_3;
     static BoolParameter alwaysShared;
     static BoolParameter neverShared;
@@ -92,8 +92,7 @@ bool TightDecoder::readRect(const Rect& r, rdr::InStream* is,
     if (!is->hasDataOrRestore(3))
       return false;
 
-    len = readCompact(is);
-    os->writeOpaque32(len);
+    len = readCompact(is, os);
 
     if (!is->hasDataOrRestore(len))
       return false;
@@ -181,8 +180,7 @@ bool TightDecoder::readRect(const Rect& r, rdr::InStream* is,
     if (!is->hasDataOrRestore(3))
       return false;
 
-    len = readCompact(is);
-    os->writeOpaque32(len);
+    len = readCompact(is, os);
 
     if (!is->hasDataOrRestore(len))
       return false;
@@ -273,11 +271,7 @@ void TightDecoder::decodeRect(const Rect& r, const void* buffer,
 
     JpegDecompressor jd;
 
-    assert(buflen >= 4);
-
-    memcpy(&len, bufptr, 4);
-    bufptr += 4;
-    buflen -= 4;
+    len = readCompact(&bufptr, &buflen);
 
     // We always use direct decoding with JPEG images
     buf = pb->getBufferRW(r, &stride);
@@ -371,11 +365,7 @@ void TightDecoder::decodeRect(const Rect& r, const void* buffer,
     int streamId;
     rdr::MemInStream* ms;
 
-    assert(buflen >= 4);
-
-    memcpy(&len, bufptr, 4);
-    bufptr += 4;
-    buflen -= 4;
+    len = readCompact(&bufptr, &buflen);
 
     assert(buflen >= len);
 
@@ -487,21 +477,51 @@ void TightDecoder::decodeRect(const Rect& r, const void* buffer,
   delete [] netbuf;
 }
 
-rdr::U32 TightDecoder::readCompact(rdr::InStream* is)
+rdr::U32 TightDecoder::readCompact(rdr::InStream* is, rdr::OutStream* os)
 {
   rdr::U8 b;
   rdr::U32 result;
 
   b = is->readU8();
+  os->writeU8(b);
   result = (int)b & 0x7F;
   if (b & 0x80) {
     b = is->readU8();
+    os->writeU8(b);
     result |= ((int)b & 0x7F) << 7;
     if (b & 0x80) {
       b = is->readU8();
+      os->writeU8(b);
       result |= ((int)b & 0xFF) << 14;
     }
   }
 
   return result;
 }
+
+rdr::U32 TightDecoder::readCompact(const rdr::U8** bufptr, size_t* buflen)
+{
+  rdr::U8 b;
+  rdr::U32 result;
+  int shift;
+
+  result = 0;
+  for (shift = 0;shift <= 14;shift += 7) {
+    assert(*buflen >= 1);
+
+    b = **bufptr;
+    *bufptr += 1;
+    *buflen -= 1;
+
+    if (shift == 14) {
+      result |= (rdr::U32)b << shift;
+      break;
+    }
+
+    result |= ((rdr::U32)b & 0x7F) << shift;
+    if (!(b & 0x80))
+      break;
+  }
+
+  return result;
+}
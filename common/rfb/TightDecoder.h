@@ -45,7 +45,8 @@ namespace rfb {
                             ModifiablePixelBuffer* pb);
 
   private:
-    rdr::U32 readCompact(rdr::InStream* is);
+    rdr::U32 readCompact(rdr::InStream* is, rdr::OutStream* os);
+    rdr::U32 readCompact(const rdr::U8** bufptr, size_t* buflen);
 
     void FilterGradient24(const rdr::U8* inbuf, const PixelFormat& pf,
                           rdr::U32* outbuf, int stride, const Rect& r);
@@ -19,6 +19,8 @@
  */
 #include <assert.h>
 
+#include <os/Mutex.h>
+#include <rdr/Exception.h>
 #include <rdr/OutStream.h>
 #include <rfb/PixelBuffer.h>
 #include <rfb/Palette.h>
@@ -56,13 +58,48 @@ static const TightConf conf[10] = {
 };
 
 TightEncoder::TightEncoder(SConnection* conn) :
-  Encoder(conn, encodingTight, EncoderPlain, 256)
+  Encoder(conn, encodingTight,
+          (EncoderFlags)(EncoderOrdered | EncoderDeferred), 256),
+  currentJob(NULL), threadException(NULL)
 {
   setCompressLevel(-1);
+
+  jobMutex = new os::Mutex();
+  producerCond = new os::Condition(jobMutex);
+
+  // The threads are only started once something is deferred
+  for (int i = 0; i < 4; i++)
+    zlibThreads[i] = NULL;
 }
 
 TightEncoder::~TightEncoder()
 {
+  for (int i = 0; i < 4; i++) {
+    if (zlibThreads[i] == NULL)
+      continue;
+
+    zlibThreads[i]->stop();
+    zlibThreads[i]->wait();
+
+    while (!zlibThreads[i]->queue.empty()) {
+      freeJobs.push_back(zlibThreads[i]->queue.front());
+      zlibThreads[i]->queue.pop_front();
+    }
+
+    delete zlibThreads[i];
+  }
+
+  delete currentJob;
+
+  while (!freeJobs.empty()) {
+    delete freeJobs.back();
+    freeJobs.pop_back();
+  }
+
+  delete threadException;
+
+  delete producerCond;
+  delete jobMutex;
 }
 
 bool TightEncoder::isSupported()
@@ -103,12 +140,40 @@ void TightEncoder::writeSolidRect(int width, int height,
 {
   rdr::OutStream* os;
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU8(tightFill << 4);
   writePixels(colour, pf, 1, os);
 }
 
+void TightEncoder::waitOutStream(rdr::OutStream* os)
+{
+  jobMutex->lock();
+
+  for (int i = 0; i < 4; i++) {
+    std::list<ZlibJob*>::iterator iter;
+
+    if (zlibThreads[i] == NULL)
+      continue;
+
+    iter = zlibThreads[i]->queue.begin();
+    while (iter != zlibThreads[i]->queue.end()) {
+      if ((*iter)->os != os) {
+        ++iter;
+        continue;
+      }
+
+      // The queue might have changed whilst we were waiting
+      producerCond->wait();
+      iter = zlibThreads[i]->queue.begin();
+    }
+  }
+
+  jobMutex->unlock();
+
+  throwThreadException();
+}
+
 void TightEncoder::writeMonoRect(const PixelBuffer* pb, const Palette& palette)
 {
   const rdr::U8* buffer;
@@ -164,7 +229,7 @@ void TightEncoder::writeFullColourRect(const PixelBuffer* pb, const Palette& pal
   const rdr::U8* buffer;
   int stride, h;
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU8(streamId << 4);
 
@@ -237,11 +302,35 @@ rdr::OutStream* TightEncoder::getZlibOutStream(int streamId, int level, size_t l
   // Minimum amount of data to be compressed. This value should not be
   // changed, doing so will break compatibility with existing clients.
   if (length < 12)
-    return conn->getOutStream();
+    return getOutStream();
 
   assert(streamId >= 0);
   assert(streamId < 4);
 
+  if (isOutputDeferred()) {
+    // Collect the data here and let the stream's thread compress it
+    if (currentJob == NULL) {
+      os::AutoMutex a(jobMutex);
+
+      if (freeJobs.empty()) {
+        currentJob = new ZlibJob;
+      } else {
+        currentJob = freeJobs.front();
+        freeJobs.pop_front();
+      }
+    }
+
+    currentJob->streamId = streamId;
+    currentJob->level = level;
+    currentJob->os = getOutStream();
+    currentJob->data.clear();
+
+    return &currentJob->data;
+  }
+
+  // Earlier rects might still be using the stream
+  waitZlibStream(streamId);
+
   zlibStreams[streamId].setUnderlying(&memStream);
   zlibStreams[streamId].setCompressionLevel(level);
   zlibStreams[streamId].cork(true);
@@ -254,6 +343,25 @@ void TightEncoder::flushZlibOutStream(rdr::OutStream* os_)
   rdr::OutStream* os;
   rdr::ZlibOutStream* zos;
 
+  if ((currentJob != NULL) && (os_ == &currentJob->data)) {
+    ZlibThread* thread;
+
+    os::AutoMutex a(jobMutex);
+
+    thread = zlibThreads[currentJob->streamId];
+    if (thread == NULL) {
+      thread = new ZlibThread(this, currentJob->streamId);
+      zlibThreads[currentJob->streamId] = thread;
+    }
+
+    thread->queue.push_back(currentJob);
+    thread->consumerCond->signal();
+
+    currentJob = NULL;
+
+    return;
+  }
+
   zos = dynamic_cast<rdr::ZlibOutStream*>(os_);
   if (zos == NULL)
     return;
@@ -262,13 +370,141 @@ void TightEncoder::flushZlibOutStream(rdr::OutStream* os_)
   zos->flush();
   zos->setUnderlying(NULL);
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   writeCompact(os, memStream.length());
   os->writeBytes(memStream.data(), memStream.length());
   memStream.clear();
 }
 
+void TightEncoder::waitZlibStream(int streamId)
+{
+  os::AutoMutex a(jobMutex);
+
+  if (zlibThreads[streamId] == NULL)
+    return;
+
+  while (!zlibThreads[streamId]->queue.empty())
+    producerCond->wait();
+}
+
+void TightEncoder::setThreadException(const rdr::Exception& e)
+{
+  os::AutoMutex a(jobMutex);
+
+  if (threadException != NULL)
+    return;
+
+  threadException = new rdr::Exception("Exception on worker thread: %s", e.str());
+}
+
+void TightEncoder::throwThreadException()
+{
+  os::AutoMutex a(jobMutex);
+
+  if (threadException == NULL)
+    return;
+
+  rdr::Exception e(*threadException);
+
+  delete threadException;
+  threadException = NULL;
+
+  throw e;
+}
+
+TightEncoder::ZlibThread::ZlibThread(TightEncoder* encoder, int streamId)
+{
+  this->encoder = encoder;
+  this->streamId = streamId;
+
+  consumerCond = new os::Condition(encoder->jobMutex);
+
+  stopRequested = false;
+
+  start();
+}
+
+TightEncoder::ZlibThread::~ZlibThread()
+{
+  stop();
+  wait();
+
+  delete consumerCond;
+}
+
+void TightEncoder::ZlibThread::stop()
+{
+  os::AutoMutex a(encoder->jobMutex);
+
+  if (!isRunning())
+    return;
+
+  stopRequested = true;
+
+  consumerCond->signal();
+}
+
+void TightEncoder::ZlibThread::worker()
+{
+  encoder->jobMutex->lock();
+
+  while (!stopRequested) {
+    ZlibJob* job;
+
+    if (queue.empty()) {
+      // Wait and try again
+      consumerCond->wait();
+      continue;
+    }
+
+    // Left on the queue until done so that others can see that the
+    // stream is still busy with it
+    job = queue.front();
+
+    encoder->jobMutex->unlock();
+
+    try {
+      compress(job);
+    } catch (rdr::Exception& e) {
+      encoder->setThreadException(e);
+    } catch(...) {
+      assert(false);
+    }
+
+    encoder->jobMutex->lock();
+
+    queue.pop_front();
+    encoder->freeJobs.push_back(job);
+
+    // Several threads might be waiting for different things
+    encoder->producerCond->broadcast();
+  }
+
+  encoder->jobMutex->unlock();
+}
+
+void TightEncoder::ZlibThread::compress(ZlibJob* job)
+{
+  rdr::ZlibOutStream* zos;
+
+  zos = &encoder->zlibStreams[streamId];
+
+  zos->setUnderlying(&memStream);
+  zos->setCompressionLevel(job->level);
+  zos->cork(true);
+
+  zos->writeBytes(job->data.data(), job->data.length());
+
+  zos->cork(false);
+  zos->flush();
+  zos->setUnderlying(NULL);
+
+  encoder->writeCompact(job->os, memStream.length());
+  job->os->writeBytes(memStream.data(), memStream.length());
+  memStream.clear();
+}
+
 //
 // Including BPP-dependent implementation of the encoder.
 //
@@ -20,10 +20,20 @@
 #ifndef __RFB_TIGHTENCODER_H__
 #define __RFB_TIGHTENCODER_H__
 
+#include <list>
+
+#include <os/Thread.h>
 #include <rdr/MemOutStream.h>
 #include <rdr/ZlibOutStream.h>
 #include <rfb/Encoder.h>
 
+namespace os {
+  class Condition;
+  class Mutex;
+}
+
+namespace rdr { class Exception; }
+
 namespace rfb {
 
   class TightEncoder : public Encoder {
@@ -40,6 +50,8 @@ namespace rfb {
                                 const PixelFormat& pf,
                                 const rdr::U8* colour);
 
+    virtual void waitOutStream(rdr::OutStream* os);
+
   protected:
     void writeMonoRect(const PixelBuffer* pb, const Palette& palette);
     void writeIndexedRect(const PixelBuffer* pb, const Palette& palette);
@@ -76,6 +88,58 @@ namespace rfb {
     rdr::MemOutStream memStream;
 
     int idxZlibLevel, monoZlibLevel, rawZlibLevel;
+
+  private:
+    // Deferred compression. Each zlib stream gets its own thread, so
+    // rects using different streams are compressed concurrently. The
+    // jobs for a stream are compressed in the order they are queued,
+    // and the result is appended to the stream the rect was being
+    // written to.
+
+    struct ZlibJob {
+      int streamId;
+      int level;
+      rdr::OutStream* os;
+      rdr::MemOutStream data;
+    };
+
+    void waitZlibStream(int streamId);
+
+    void setThreadException(const rdr::Exception& e);
+    void throwThreadException();
+
+    ZlibJob* currentJob;
+    std::list<ZlibJob*> freeJobs;
+
+    os::Mutex* jobMutex;
+    os::Condition* producerCond;
+
+    class ZlibThread : public os::Thread {
+    public:
+      ZlibThread(TightEncoder* encoder, int streamId);
+      ~ZlibThread();
+
+      void stop();
+
+      // Includes the job currently being compressed
+      std::list<ZlibJob*> queue;
+      os::Condition* consumerCond;
+
+    protected:
+      void worker();
+      void compress(ZlibJob* job);
+
+    private:
+      TightEncoder* encoder;
+      int streamId;
+
+      rdr::MemOutStream memStream;
+
+      bool stopRequested;
+    };
+
+    ZlibThread* zlibThreads[4];
+    rdr::Exception* threadException;
   };
 
 }
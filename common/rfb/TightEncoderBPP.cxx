@@ -38,7 +38,7 @@ void TightEncoder::writeMonoRect(int width, int height,
 
   assert(palette.size() == 2);
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU8((streamId | tightExplicitFilter) << 4);
   os->writeU8(tightFilterPalette);
@@ -125,7 +125,7 @@ void TightEncoder::writeIndexedRect(int width, int height,
   assert(palette.size() > 0);
   assert(palette.size() <= 256);
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU8((streamId | tightExplicitFilter) << 4);
   os->writeU8(tightFilterPalette);
@@ -136,12 +136,12 @@ void TightJPEGEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
   jc.compress(buffer, stride, pb->getRect(),
               pb->getPF(), quality, subsampling);
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU8(tightJpeg << 4);
 
   writeCompact(jc.length(), os);
-  os->writeBytes(jc.data(), jc.length());
+  jc.writeTo(os);
 }
 
 void TightJPEGEncoder::writeSolidRect(int width, int height,
@@ -0,0 +1,208 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <string.h>
+
+#include <rfb/PixelBuffer.h>
+#include <rfb/TileCache.h>
+
+using namespace rfb;
+
+TileCache::TileCache() : usedPixels(0)
+{
+}
+
+TileCache::~TileCache()
+{
+  clear();
+}
+
+void TileCache::clear()
+{
+  while (!entries.empty())
+    remove(entries.begin());
+}
+
+bool TileCache::lookup(rdr::U64 key, int width, int height,
+                       const PixelBuffer** pixels)
+{
+  std::map<rdr::U64, EntryList::iterator>::iterator iter;
+  Entry* entry;
+
+  iter = index.find(key);
+  if (iter == index.end())
+    return false;
+
+  entry = *iter->second;
+  if ((entry->width != width) || (entry->height != height))
+    return false;
+
+  // Most recently used entries are kept at the front
+  entries.splice(entries.begin(), entries, iter->second);
+
+  if (pixels != NULL)
+    *pixels = entry->pixels;
+
+  return true;
+}
+
+bool TileCache::lookupRect(rdr::U64 key, const PixelBuffer* pb,
+                           const Rect& rect)
+{
+  std::map<rdr::U64, EntryList::iterator>::iterator iter;
+  Entry* entry;
+
+  const rdr::U8 *data, *stored;
+  int stride, storedStride;
+  size_t rowBytes;
+
+  iter = index.find(key);
+  if (iter == index.end())
+    return false;
+
+  entry = *iter->second;
+  if ((entry->width != rect.width()) || (entry->height != rect.height()))
+    return false;
+
+  // The key is only a hash, so make sure this isn't a collision
+  if (entry->pixels == NULL)
+    return false;
+  if (!entry->pixels->getPF().equal(pb->getPF()))
+    return false;
+
+  data = pb->getBuffer(rect, &stride);
+  stored = entry->pixels->getBuffer(entry->pixels->getRect(), &storedStride);
+
+  rowBytes = rect.width() * (pb->getPF().bpp/8);
+  stride *= pb->getPF().bpp/8;
+  storedStride *= pb->getPF().bpp/8;
+
+  for (int y = 0; y < rect.height(); y++) {
+    if (memcmp(data, stored, rowBytes) != 0)
+      return false;
+    data += stride;
+    stored += storedStride;
+  }
+
+  entries.splice(entries.begin(), entries, iter->second);
+
+  return true;
+}
+
+void TileCache::insert(rdr::U64 key, int width, int height,
+                       const PixelBuffer* pb, const Rect& rect)
+{
+  std::map<rdr::U64, EntryList::iterator>::iterator iter;
+  Entry* entry;
+
+  if ((size_t)width * height > MaxPixels)
+    return;
+
+  iter = index.find(key);
+  if (iter != index.end())
+    remove(iter->second);
+
+  while (usedPixels + (size_t)width * height > MaxPixels)
+    remove(--entries.end());
+
+  entry = new Entry;
+  entry->key = key;
+  entry->width = width;
+  entry->height = height;
+  entry->pixels = NULL;
+
+  if (pb != NULL) {
+    const rdr::U8* data;
+    int stride;
+
+    entry->pixels = new ManagedPixelBuffer(pb->getPF(), width, height);
+    data = pb->getBuffer(rect, &stride);
+    entry->pixels->imageRect(entry->pixels->getRect(), data, stride);
+  }
+
+  entries.push_front(entry);
+  index[key] = entries.begin();
+
+  usedPixels += (size_t)width * height;
+}
+
+rdr::U64 TileCache::hashRect(const PixelBuffer* pb, const Rect& r,
+                             rdr::U64 seed)
+{
+  const rdr::U8* data;
+  int stride;
+  size_t rowBytes;
+  rdr::U64 hash;
+
+  data = pb->getBuffer(r, &stride);
+  stride *= pb->getPF().bpp/8;
+  rowBytes = r.width() * (pb->getPF().bpp/8);
+
+  // Collisions are caught by lookupRect(), but they are expensive as
+  // the rect then has to be sent again, so this mixes things more
+  // thoroughly than the hashes used to spot changes
+  hash = seed ^ ((rdr::U64)r.width() << 32 | r.height());
+  for (int y = 0; y < r.height(); y++) {
+    const rdr::U8* ptr;
+    size_t len;
+
+    ptr = data;
+    len = rowBytes;
+
+    while (len > 0) {
+      rdr::U64 word;
+      size_t n;
+
+      n = len < 8 ? len : 8;
+
+      word = 0;
+      memcpy(&word, ptr, n);
+
+      hash ^= word;
+      hash *= 0xff51afd7ed558ccdULL;
+      hash ^= hash >> 33;
+      hash += 0x9e3779b97f4a7c15ULL;
+
+      ptr += n;
+      len -= n;
+    }
+
+    data += stride;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+
+  return hash;
+}
+
+void TileCache::remove(EntryList::iterator iter)
+{
+  Entry* entry;
+
+  entry = *iter;
+
+  usedPixels -= (size_t)entry->width * entry->height;
+
+  index.erase(entry->key);
+  entries.erase(iter);
+
+  delete entry->pixels;
+  delete entry;
+}
@@ -0,0 +1,99 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// TileCache - a cache of rects that the client has been asked to keep
+//
+// The server and the client both keep an instance of this, and it is
+// essential that they perform the exact same operations in the same
+// order so that they agree on what is in the cache. Both ends store the
+// pixels; the client to draw them, and the server to make sure that a
+// matching key really is the same content before referring to it.
+//
+
+#ifndef __RFB_TILECACHE_H__
+#define __RFB_TILECACHE_H__
+
+#include <list>
+#include <map>
+
+#include <rdr/types.h>
+#include <rfb/Rect.h>
+
+namespace rfb {
+
+  class PixelBuffer;
+  class ManagedPixelBuffer;
+
+  // Operations for encodingTileCache rects
+  enum TileCacheOp {
+    tileCacheStore = 0,
+    tileCacheRef = 1,
+  };
+
+  class TileCache {
+  public:
+    TileCache();
+    ~TileCache();
+
+    void clear();
+
+    // lookup() finds a tile with the given key and size, marking it as
+    // recently used. The stored pixels are returned if there are any.
+    bool lookup(rdr::U64 key, int width, int height,
+                const PixelBuffer** pixels=NULL);
+
+    // lookupRect() is like lookup(), but also requires that the stored
+    // pixels are identical to the given rect of pb. Nothing is marked as
+    // recently used if they are not.
+    bool lookupRect(rdr::U64 key, const PixelBuffer* pb, const Rect& rect);
+
+    // insert() adds a tile, replacing any previous one with the same
+    // key. The pixels are copied from the given rect of pb if it is
+    // not NULL.
+    void insert(rdr::U64 key, int width, int height,
+                const PixelBuffer* pb=NULL,
+                const Rect& rect=Rect(0, 0, 0, 0));
+
+    // hashRect() computes a key for the contents of the given rect
+    static rdr::U64 hashRect(const PixelBuffer* pb, const Rect& r,
+                             rdr::U64 seed);
+
+  public:
+    // Both ends must use the same limit or they will get out of sync
+    static const size_t MaxPixels = 4 * 1024 * 1024;
+
+  protected:
+    struct Entry {
+      rdr::U64 key;
+      int width, height;
+      ManagedPixelBuffer* pixels;
+    };
+
+    typedef std::list<Entry*> EntryList;
+
+    void remove(EntryList::iterator iter);
+
+    size_t usedPixels;
+    EntryList entries;
+    std::map<rdr::U64, EntryList::iterator> index;
+  };
+
+}
+
+#endif
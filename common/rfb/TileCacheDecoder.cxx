@@ -0,0 +1,74 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+#include <rdr/MemInStream.h>
+#include <rdr/OutStream.h>
+#include <rfb/Exception.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/TileCacheDecoder.h>
+
+using namespace rfb;
+
+// Operations need to be done in order so that we stay in sync with
+// the server's idea of what is in the cache
+TileCacheDecoder::TileCacheDecoder() : Decoder(DecoderOrdered)
+{
+}
+
+TileCacheDecoder::~TileCacheDecoder()
+{
+}
+
+bool TileCacheDecoder::readRect(const Rect& r, rdr::InStream* is,
+                                const ServerParams& server,
+                                rdr::OutStream* os)
+{
+  if (!is->hasData(1 + 8))
+    return false;
+  os->copyBytes(is, 1 + 8);
+  return true;
+}
+
+void TileCacheDecoder::decodeRect(const Rect& r, const void* buffer,
+                                  size_t buflen, const ServerParams& server,
+                                  ModifiablePixelBuffer* pb)
+{
+  rdr::MemInStream is(buffer, buflen);
+  rdr::U8 op;
+  rdr::U64 key;
+  const PixelBuffer* pixels;
+  const rdr::U8* data;
+  int stride;
+
+  op = is.readU8();
+  key = (rdr::U64)is.readU32() << 32;
+  key |= is.readU32();
+
+  switch (op) {
+  case tileCacheStore:
+    cache.insert(key, r.width(), r.height(), pb, r);
+    break;
+  case tileCacheRef:
+    if (!cache.lookup(key, r.width(), r.height(), &pixels))
+      throw Exception("Unknown tile cache entry");
+    data = pixels->getBuffer(pixels->getRect(), &stride);
+    pb->imageRect(pixels->getPF(), r, data, stride);
+    break;
+  default:
+    throw Exception("Unknown tile cache operation %d", (int)op);
+  }
+}
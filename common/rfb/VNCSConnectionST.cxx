@@ -51,10 +51,11 @@ VNCSConnectionST::VNCSConnectionST(VNCServerST* server_, network::Socket *s,
     fenceDataLen(0), fenceData(NULL), congestionTimer(this),
     losslessTimer(this), server(server_),
     updateRenderedCursor(false), removeRenderedCursor(false),
-    continuousUpdates(false), encodeManager(this), idleTimer(this),
+    continuousUpdates(false),
+    encodeManager(this, server_->getEncodeCache()), idleTimer(this),
     pointerEventTime(0), clientHasCursor(false)
 {
-  setStreams(&sock->inStream(), &sock->outStream());
+  setStreams(&sock->dataInStream(), &sock->dataOutStream());
   peerEndpoint.buf = sock->getPeerEndpoint();
 
   // Kick off the idle timer
@@ -114,10 +115,15 @@ void VNCSConnectionST::close(const char* reason)
     vlog.debug("second close: %s (%s)", peerEndpoint.buf, reason);
 
   try {
-    if (sock->outStream().hasBufferedData()) {
-      sock->outStream().cork(false);
-      sock->outStream().flush();
-      if (sock->outStream().hasBufferedData())
+    // Take back what a send thread hasn't got to yet, and don't wait
+    // for any batch, as the socket is going away below
+    sock->outStream().setSendThread(NULL);
+    sock->outStream().setBatch(NULL);
+
+    if (sock->hasBufferedData()) {
+      sock->dataOutStream().cork(false);
+      sock->dataOutStream().flush();
+      if (sock->hasBufferedData())
         vlog.error("Failed to flush remaining socket data on close");
     }
   } catch (rdr::Exception& e) {
@@ -189,10 +195,10 @@ void VNCSConnectionST::flushSocket()
 {
   if (state() == RFBSTATE_CLOSING) return;
   try {
-    sock->outStream().flush();
+    sock->dataOutStream().flush();
     // Flushing the socket might release an update that was previously
     // delayed because of congestion.
-    if (!sock->outStream().hasBufferedData())
+    if (!sock->hasBufferedData())
       writeFramebufferUpdate();
   } catch (rdr::Exception &e) {
     close(e.str());
@@ -814,7 +820,7 @@ void VNCSConnectionST::writeRTTPing()
   if (!client.supportsFence())
     return;
 
-  congestion.updatePosition(sock->outStream().length());
+  congestion.updatePosition(sock->dataOutStream().length());
 
   // We need to make sure any old update are already processed by the
   // time we get the response back. This allows us to reliably throttle
@@ -833,15 +839,15 @@ bool VNCSConnectionST::isCongested()
   congestionTimer.stop();
 
   // Stuff still waiting in the send buffer?
-  sock->outStream().flush();
+  sock->dataOutStream().flush();
   congestion.debugTrace("congestion-trace.csv", sock->getFd());
-  if (sock->outStream().hasBufferedData())
+  if (sock->hasBufferedData())
     return true;
 
   if (!client.supportsFence())
     return false;
 
-  congestion.updatePosition(sock->outStream().length());
+  congestion.updatePosition(sock->dataOutStream().length());
   if (!congestion.isCongested())
     return false;
 
@@ -855,7 +861,7 @@ bool VNCSConnectionST::isCongested()
 
 void VNCSConnectionST::writeFramebufferUpdate()
 {
-  congestion.updatePosition(sock->outStream().length());
+  congestion.updatePosition(sock->dataOutStream().length());
 
   // We're in the middle of processing a command that's supposed to be
   // synchronised. Allowing an update to slip out right now might violate
@@ -894,7 +900,7 @@ void VNCSConnectionST::writeFramebufferUpdate()
 
   getOutStream()->cork(false);
 
-  congestion.updatePosition(sock->outStream().length());
+  congestion.updatePosition(sock->dataOutStream().length());
 }
 
 void VNCSConnectionST::writeNoDataUpdate()
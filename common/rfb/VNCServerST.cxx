@@ -132,15 +132,22 @@ void VNCServerST::addSocket(network::Socket* sock, bool outgoing)
   if (blHosts->isBlackmarked(address.buf)) {
     connectionsLog.error("blacklisted: %s", address.buf);
     try {
-      rdr::OutStream& os = sock->outStream();
-
-      // Shortest possible way to tell a client it is not welcome
-      os.writeBytes("RFB 003.003\n", 12);
-      os.writeU32(0);
-      const char* reason = "Too many security failures";
-      os.writeU32(strlen(reason));
-      os.writeBytes(reason, strlen(reason));
-      os.flush();
+      rdr::OutStream& os = sock->dataOutStream();
+
+      // The socket is shut down below, so this can't wait for a batch
+      sock->outStream().setBatch(NULL);
+
+      // Shortest possible way to tell a client it is not welcome. A
+      // wrapped stream (i.e. WebSocket) would need a handshake first,
+      // so such clients simply get disconnected.
+      if (&os == &sock->outStream()) {
+        os.writeBytes("RFB 003.003\n", 12);
+        os.writeU32(0);
+        const char* reason = "Too many security failures";
+        os.writeU32(strlen(reason));
+        os.writeBytes(reason, strlen(reason));
+        os.flush();
+      }
     } catch (rdr::Exception&) {
     }
     sock->shutdown();
@@ -183,12 +190,15 @@ void VNCServerST::removeSocket(network::Socket* sock) {
 
       connectionsLog.status("closed: %s", name.buf);
 
+      encodeCache.setEnabled(authClientCount() > 1);
+
       // - Check that the desktop object is still required
       if (authClientCount() == 0)
         stopDesktop();
 
       if (comparer)
         comparer->logStats();
+      encodeCache.logStats();
 
       // Adjust the exit timers
       connectTimer.stop();
@@ -260,6 +270,8 @@ void VNCServerST::setPixelBuffer(PixelBuffer* pb_, const ScreenSet& layout)
   delete comparer;
   comparer = 0;
 
+  encodeCache.setPixelBuffer(pb);
+
   if (!pb) {
     screenLayout = ScreenSet();
 
@@ -400,6 +412,7 @@ void VNCServerST::add_changed(const Region& region)
     return;
 
   comparer->add_changed(region);
+  encodeCache.invalidate(region);
   startFrameClock();
 }
 
@@ -409,6 +422,7 @@ void VNCServerST::add_copied(const Region& dest, const Point& delta)
     return;
 
   comparer->add_copied(dest, delta);
+  encodeCache.invalidate(dest);
   startFrameClock();
 }
 
@@ -696,6 +710,9 @@ void VNCServerST::clientReady(VNCSConnectionST* client, bool shared)
       }
     }
   }
+
+  // Only clients that get updates can share the encoded data
+  encodeCache.setEnabled(authClientCount() > 1);
 }
 
 // -=- Internal methods
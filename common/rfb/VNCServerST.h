@@ -30,6 +30,7 @@
 #include <rfb/VNCServer.h>
 #include <rfb/Blacklist.h>
 #include <rfb/Cursor.h>
+#include <rfb/EncodeCache.h>
 #include <rfb/Timer.h>
 #include <rfb/ScreenSet.h>
 
@@ -148,6 +149,9 @@ namespace rfb {
     // ready to be sent to clients
     Region getPendingRegion();
 
+    // Encoded data that can be shared between clients
+    EncodeCache* getEncodeCache() { return &encodeCache; }
+
     // getRenderedCursor() returns an up to date version of the server
     // side rendered cursor buffer
     const RenderedCursor* getRenderedCursor();
@@ -192,6 +196,7 @@ namespace rfb {
     std::list<network::Socket*> closingSockets;
 
     ComparingUpdateTracker* comparer;
+    EncodeCache encodeCache;
 
     Point cursorPos;
     Cursor* cursor;
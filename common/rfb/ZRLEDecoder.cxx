@@ -23,6 +23,7 @@
 
 #include <rfb/Exception.h>
 #include <rfb/ServerParams.h>
+#include <rfb/encodings.h>
 #include <rfb/PixelBuffer.h>
 #include <rfb/ZRLEDecoder.h>
 
@@ -46,7 +47,7 @@ static inline rdr::U32 readOpaque24B(rdr::InStream* is)
   return r;
 }
 
-static inline void zlibHasData(rdr::ZlibInStream* zis, size_t length)
+static inline void zrleHasData(rdr::InStream* zis, size_t length)
 {
   if (!zis->hasData(length))
     throw Exception("ZRLE decode error");
@@ -68,7 +69,8 @@ static inline void zlibHasData(rdr::ZlibInStream* zis, size_t length)
 #undef CPIXEL
 #undef BPP
 
-ZRLEDecoder::ZRLEDecoder() : Decoder(DecoderOrdered)
+ZRLEDecoder::ZRLEDecoder(int encoding_)
+  : Decoder(DecoderOrdered), encoding(encoding_)
 {
 }
 
@@ -105,9 +107,25 @@ void ZRLEDecoder::decodeRect(const Rect& r, const void* buffer,
 {
   rdr::MemInStream is(buffer, buflen);
   const rfb::PixelFormat& pf = server.pf();
+  rdr::U32 length;
+  rdr::InStream* zis;
+
+  length = is.readU32();
+
+#ifdef HAVE_ZSTD
+  if (encoding == encodingZstdRLE) {
+    zstdis.setUnderlying(&is, length);
+    zis = &zstdis;
+  } else
+#endif
+  {
+    zlibis.setUnderlying(&is, length);
+    zis = &zlibis;
+  }
+
   switch (pf.bpp) {
-  case 8:  zrleDecode8 (r, &is, &zis, pf, pb); break;
-  case 16: zrleDecode16(r, &is, &zis, pf, pb); break;
+  case 8:  zrleDecode8(r, zis, pf, pb); break;
+  case 16: zrleDecode16(r, zis, pf, pb); break;
   case 32:
     {
       if (pf.depth <= 24) {
@@ -118,20 +136,29 @@ void ZRLEDecoder::decodeRect(const Rect& r, const void* buffer,
         if ((fitsInLS3Bytes && pf.isLittleEndian()) ||
             (fitsInMS3Bytes && pf.isBigEndian()))
         {
-          zrleDecode24A(r, &is, &zis, pf, pb);
+          zrleDecode24A(r, zis, pf, pb);
           break;
         }
 
         if ((fitsInLS3Bytes && pf.isBigEndian()) ||
             (fitsInMS3Bytes && pf.isLittleEndian()))
         {
-          zrleDecode24B(r, &is, &zis, pf, pb);
+          zrleDecode24B(r, zis, pf, pb);
           break;
         }
       }
 
-      zrleDecode32(r, &is, &zis, pf, pb);
+      zrleDecode32(r, zis, pf, pb);
       break;
     }
   }
+
+#ifdef HAVE_ZSTD
+  if (encoding == encodingZstdRLE) {
+    zstdis.flushUnderlying();
+    return;
+  }
+#endif
+
+  zlibis.flushUnderlying();
 }
@@ -19,13 +19,17 @@
 #define __RFB_ZRLEDECODER_H__
 
 #include <rdr/ZlibInStream.h>
+#ifdef HAVE_ZSTD
+#include <rdr/ZstdInStream.h>
+#endif
 #include <rfb/Decoder.h>
+#include <rfb/encodings.h>
 
 namespace rfb {
 
   class ZRLEDecoder : public Decoder {
   public:
-    ZRLEDecoder();
+    ZRLEDecoder(int encoding=encodingZRLE);
     virtual ~ZRLEDecoder();
     virtual bool readRect(const Rect& r, rdr::InStream* is,
                           const ServerParams& server, rdr::OutStream* os);
@@ -33,7 +37,11 @@ namespace rfb {
                             size_t buflen, const ServerParams& server,
                             ModifiablePixelBuffer* pb);
   private:
-    rdr::ZlibInStream zis;
+    const int encoding;
+    rdr::ZlibInStream zlibis;
+#ifdef HAVE_ZSTD
+    rdr::ZstdInStream zstdis;
+#endif
   };
 }
 #endif
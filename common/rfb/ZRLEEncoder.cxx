@@ -27,22 +27,47 @@
 using namespace rfb;
 
 IntParameter zlibLevel("ZlibLevel","Zlib compression level",-1);
-
-ZRLEEncoder::ZRLEEncoder(SConnection* conn)
-  : Encoder(conn, encodingZRLE, EncoderPlain, 127),
-  zos(0,zlibLevel), mos(129*1024)
+#ifdef HAVE_ZSTD
+IntParameter zstdLevel("ZstdLevel","Zstandard compression level",1,1,22);
+#endif
+
+ZRLEEncoder::ZRLEEncoder(SConnection* conn, int encoding)
+  : Encoder(conn, encoding, EncoderOrdered, 127),
+  zlibos(0,zlibLevel),
+#ifdef HAVE_ZSTD
+  zstdos(0,zstdLevel),
+#endif
+  mos(129*1024)
 {
-  zos.setUnderlying(&mos);
+  // The data is identical to ZRLE, only the compression differs
+#ifdef HAVE_ZSTD
+  if (encoding == encodingZstdRLE) {
+    zstdos.setUnderlying(&mos);
+    zos = &zstdos;
+    return;
+  }
+#endif
+
+  zlibos.setUnderlying(&mos);
+  zos = &zlibos;
 }
 
 ZRLEEncoder::~ZRLEEncoder()
 {
-  zos.setUnderlying(NULL);
+  zlibos.setUnderlying(NULL);
+#ifdef HAVE_ZSTD
+  zstdos.setUnderlying(NULL);
+#endif
 }
 
 bool ZRLEEncoder::isSupported()
 {
-  return conn->client.supportsEncoding(encodingZRLE);
+#ifndef HAVE_ZSTD
+  if (encoding == encodingZstdRLE)
+    return false;
+#endif
+
+  return conn->client.supportsEncoding(encoding);
 }
 
 void ZRLEEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
@@ -79,9 +104,9 @@ void ZRLEEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
     }
   }
 
-  zos.flush();
+  zos->flush();
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU32(mos.length());
   os->writeBytes(mos.data(), mos.length());
@@ -100,13 +125,13 @@ void ZRLEEncoder::writeSolidRect(int width, int height,
   tiles = ((width + 63)/64) * ((height + 63)/64);
 
   while (tiles--) {
-    zos.writeU8(1);
+    zos->writeU8(1);
     writePixels(colour, pf, 1);
   }
 
-  zos.flush();
+  zos->flush();
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU32(mos.length());
   os->writeBytes(mos.data(), mos.length());
@@ -176,7 +201,7 @@ void ZRLEEncoder::writeRawTile(const Rect& tile, const PixelBuffer* pb,
 
   buffer = pb->getBuffer(tile, &stride);
 
-  zos.writeU8(0); // Empty palette (i.e. raw pixels)
+  zos->writeU8(0); // Empty palette (i.e. raw pixels)
 
   w = tile.width();
   h = tile.height();
@@ -222,7 +247,7 @@ void ZRLEEncoder::writePixels(const rdr::U8* buffer, const PixelFormat& pf,
   pf.bufferFromPixel(pixBuf, maxPixel);
 
   if ((pf.bpp != 32) || ((pixBuf[0] != 0) && (pixBuf[3] != 0))) {
-    zos.writeBytes(buffer, count * (pf.bpp/8));
+    zos->writeBytes(buffer, count * (pf.bpp/8));
     return;
   }
 
@@ -230,7 +255,7 @@ void ZRLEEncoder::writePixels(const rdr::U8* buffer, const PixelFormat& pf,
     buffer++;
 
   while (count--) {
-    zos.writeBytes(buffer, 3);
+    zos->writeBytes(buffer, 3);
     buffer += 4;
   }
 }
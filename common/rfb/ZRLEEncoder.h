@@ -21,13 +21,17 @@
 
 #include <rdr/MemOutStream.h>
 #include <rdr/ZlibOutStream.h>
+#ifdef HAVE_ZSTD
+#include <rdr/ZstdOutStream.h>
+#endif
 #include <rfb/Encoder.h>
+#include <rfb/encodings.h>
 
 namespace rfb {
 
   class ZRLEEncoder : public Encoder {
   public:
-    ZRLEEncoder(SConnection* conn);
+    ZRLEEncoder(SConnection* conn, int encoding=encodingZRLE);
     virtual ~ZRLEEncoder();
 
     virtual bool isSupported();
@@ -74,7 +78,11 @@ namespace rfb {
                              const PixelFormat& pf, const Palette& palette);
 
   protected:
-    rdr::ZlibOutStream zos;
+    rdr::ZlibOutStream zlibos;
+#ifdef HAVE_ZSTD
+    rdr::ZstdOutStream zstdos;
+#endif
+    rdr::OutStream* zos;
     rdr::MemOutStream mos;
   };
 }
@@ -36,7 +36,7 @@ void ZRLEEncoder::writePaletteTile(int width, int height,
   assert(palette.size() > 1);
   assert(palette.size() <= 16);
 
-  zos.writeU8(palette.size());
+  zos->writeU8(palette.size());
   writePalette(pf, palette);
 
   bppp = bitsPerPackedPixel[palette.size()-1];
@@ -55,13 +55,13 @@ void ZRLEEncoder::writePaletteTile(int width, int height,
       byte = (byte << bppp) | index;
       nbits += bppp;
       if (nbits >= 8) {
-        zos.writeU8(byte);
+        zos->writeU8(byte);
         nbits = 0;
       }
     }
     if (nbits > 0) {
       byte <<= 8 - nbits;
-      zos.writeU8(byte);
+      zos->writeU8(byte);
     }
 
     buffer += pad;
@@ -81,7 +81,7 @@ void ZRLEEncoder::writePaletteRLETile(int width, int height,
   assert(palette.size() > 1);
   assert(palette.size() <= 127);
 
-  zos.writeU8(palette.size() | 0x80);
+  zos->writeU8(palette.size() | 0x80);
   writePalette(pf, palette);
 
   pad = stride - width;
@@ -94,15 +94,15 @@ void ZRLEEncoder::writePaletteRLETile(int width, int height,
     while (w--) {
       if (prevColour != *buffer) {
         if (runLength == 1)
-          zos.writeU8(palette.lookup(prevColour));
+          zos->writeU8(palette.lookup(prevColour));
         else {
-          zos.writeU8(palette.lookup(prevColour) | 0x80);
+          zos->writeU8(palette.lookup(prevColour) | 0x80);
 
           while (runLength > 255) {
-            zos.writeU8(255);
+            zos->writeU8(255);
             runLength -= 255;
           }
-          zos.writeU8(runLength - 1);
+          zos->writeU8(runLength - 1);
         }
 
         prevColour = *buffer;
@@ -115,14 +115,14 @@ void ZRLEEncoder::writePaletteRLETile(int width, int height,
     buffer += pad;
   }
   if (runLength == 1)
-    zos.writeU8(palette.lookup(prevColour));
+    zos->writeU8(palette.lookup(prevColour));
   else {
-    zos.writeU8(palette.lookup(prevColour) | 0x80);
+    zos->writeU8(palette.lookup(prevColour) | 0x80);
 
     while (runLength > 255) {
-      zos.writeU8(255);
+      zos->writeU8(255);
       runLength -= 255;
     }
-    zos.writeU8(runLength - 1);
+    zos->writeU8(runLength - 1);
   }
 }
@@ -0,0 +1,53 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <rfb/cpuFeatures.h>
+
+using namespace rfb;
+
+static unsigned detectCPUFeatures()
+{
+  unsigned features;
+
+  features = 0;
+
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("sse2"))
+    features |= cpuSSE2;
+  if (__builtin_cpu_supports("ssse3"))
+    features |= cpuSSSE3;
+  if (__builtin_cpu_supports("avx2"))
+    features |= cpuAVX2;
+#endif
+
+#ifdef HAVE_NEON_SIMD
+  // NEON is a compile time decision, so no need to check the CPU
+  features |= cpuNEON;
+#endif
+
+  return features;
+}
+
+unsigned rfb::getCPUFeatures()
+{
+  static unsigned features = detectCPUFeatures();
+
+  return features;
+}
@@ -0,0 +1,56 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// cpuFeatures.h - run time detection of instruction set extensions
+//
+// Code that wants to use a specific extension should be put in a
+// function marked with the corresponding __target_*_attr and only be
+// called if getCPUFeatures() says that the CPU supports it.
+//
+
+#ifndef __RFB_CPUFEATURES_H__
+#define __RFB_CPUFEATURES_H__
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#  define HAVE_X86_SIMD 1
+#  define __target_sse2_attr __attribute__((__target__("sse2")))
+#  define __target_ssse3_attr __attribute__((__target__("ssse3")))
+#  define __target_avx2_attr __attribute__((__target__("avx2")))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define HAVE_NEON_SIMD 1
+#endif
+
+namespace rfb {
+
+  enum CPUFeatures {
+    cpuSSE2 = 1 << 0,
+    cpuSSSE3 = 1 << 1,
+    cpuAVX2 = 1 << 2,
+    cpuNEON = 1 << 3,
+  };
+
+  // getCPUFeatures() returns a mask of the CPUFeatures that are both
+  // supported by the CPU and that we have code for
+  unsigned getCPUFeatures();
+
+}
+
+#endif
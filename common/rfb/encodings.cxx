@@ -28,6 +28,8 @@ int rfb::encodingNum(const char* name)
   if (strcasecmp(name, "hextile") == 0)  return encodingHextile;
   if (strcasecmp(name, "ZRLE") == 0)     return encodingZRLE;
   if (strcasecmp(name, "Tight") == 0)    return encodingTight;
+  if (strcasecmp(name, "H.264") == 0)    return encodingH264;
+  if (strcasecmp(name, "ZstdRLE") == 0)  return encodingZstdRLE;
   return -1;
 }
 
@@ -41,6 +43,9 @@ const char* rfb::encodingName(int num)
   case encodingHextile:  return "hextile";
   case encodingZRLE:     return "ZRLE";
   case encodingTight:    return "Tight";
+  case encodingH264:     return "H.264";
+  case encodingTileCache: return "TileCache";
+  case encodingZstdRLE:  return "ZstdRLE";
   default:               return "[unknown encoding]";
   }
 }
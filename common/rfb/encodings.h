@@ -28,6 +28,13 @@ namespace rfb {
   const int encodingHextile = 5;
   const int encodingTight = 7;
   const int encodingZRLE = 16;
+  const int encodingH264 = 50;
+
+  // TigerVNC-specific and experimental. These numbers have not been
+  // registered, so they may collide with other implementations and
+  // may change in future versions.
+  const int encodingTileCache = 96;
+  const int encodingZstdRLE = 97;
 
   const int encodingMax = 255;
 
@@ -41,12 +41,9 @@ namespace rfb {
 #define ZRLE_DECODE CONCAT2E(zrleDecode,BPP)
 #endif
 
-void ZRLE_DECODE (const Rect& r, rdr::InStream* is,
-                  rdr::ZlibInStream* zis,
+void ZRLE_DECODE (const Rect& r, rdr::InStream* zis,
                   const PixelFormat& pf, ModifiablePixelBuffer* pb)
 {
-  int length = is->readU32();
-  zis->setUnderlying(is, length);
   Rect t;
   PIXEL_T buf[64 * 64];
 
@@ -58,16 +55,16 @@ void ZRLE_DECODE (const Rect& r, rdr::InStream* is,
 
       t.br.x = __rfbmin(r.br.x, t.tl.x + 64);
 
-      zlibHasData(zis, 1);
+      zrleHasData(zis, 1);
       int mode = zis->readU8();
       bool rle = mode & 128;
       int palSize = mode & 127;
       PIXEL_T palette[128];
 
 #ifdef CPIXEL
-      zlibHasData(zis, 3 * palSize);
+      zrleHasData(zis, 3 * palSize);
 #else
-      zlibHasData(zis, BPP/8 * palSize);
+      zrleHasData(zis, BPP/8 * palSize);
 #endif
       for (int i = 0; i < palSize; i++) {
         palette[i] = READ_PIXEL(zis);
@@ -85,12 +82,12 @@ void ZRLE_DECODE (const Rect& r, rdr::InStream* is,
           // raw
 
 #ifdef CPIXEL
-          zlibHasData(zis, 3 * t.area());
+          zrleHasData(zis, 3 * t.area());
           for (PIXEL_T* ptr = buf; ptr < buf+t.area(); ptr++) {
             *ptr = READ_PIXEL(zis);
           }
 #else
-          zlibHasData(zis, BPP/8 * t.area());
+          zrleHasData(zis, BPP/8 * t.area());
           zis->readBytes(buf, t.area() * (BPP / 8));
 #endif
 
@@ -109,7 +106,7 @@ void ZRLE_DECODE (const Rect& r, rdr::InStream* is,
 
             while (ptr < eol) {
               if (nbits == 0) {
-                zlibHasData(zis, 1);
+                zrleHasData(zis, 1);
                 byte = zis->readU8();
                 nbits = 8;
               }
@@ -130,15 +127,15 @@ void ZRLE_DECODE (const Rect& r, rdr::InStream* is,
           PIXEL_T* end = ptr + t.area();
           while (ptr < end) {
 #ifdef CPIXEL
-            zlibHasData(zis, 3);
+            zrleHasData(zis, 3);
 #else
-            zlibHasData(zis, BPP/8);
+            zrleHasData(zis, BPP/8);
 #endif
             PIXEL_T pix = READ_PIXEL(zis);
             int len = 1;
             int b;
             do {
-              zlibHasData(zis, 1);
+              zrleHasData(zis, 1);
               b = zis->readU8();
               len += b;
             } while (b == 255);
@@ -157,13 +154,13 @@ void ZRLE_DECODE (const Rect& r, rdr::InStream* is,
           PIXEL_T* ptr = buf;
           PIXEL_T* end = ptr + t.area();
           while (ptr < end) {
-            zlibHasData(zis, 1);
+            zrleHasData(zis, 1);
             int index = zis->readU8();
             int len = 1;
             if (index & 128) {
               int b;
               do {
-                zlibHasData(zis, 1);
+                zrleHasData(zis, 1);
                 b = zis->readU8();
                 len += b;
               } while (b == 255);
@@ -185,9 +182,6 @@ void ZRLE_DECODE (const Rect& r, rdr::InStream* is,
       pb->imageRect(pf, t, buf);
     }
   }
-
-  zis->flushUnderlying();
-  zis->setUnderlying(NULL, 0);
 }
 
 #undef ZRLE_DECODE
@@ -22,6 +22,8 @@
 #include <time.h>
 
 #include <rfb/PixelFormat.h>
+#include <rfb/PixelFormatSIMD.h>
+#include <rfb/cpuFeatures.h>
 
 #include "util.h"
 
@@ -116,41 +118,8 @@ static void doTests(rfb::PixelFormat &dstpf, rfb::PixelFormat &srcpf)
   printf("\n");
 }
 
-int main(int argc, char **argv)
+static void doAllTests()
 {
-  size_t bufsize;
-
-  time_t t;
-  char datebuffer[256];
-
-  size_t i;
-
-  bufsize = fbsize * fbsize * 4;
-
-  fb1 = new rdr::U8[bufsize];
-  fb2 = new rdr::U8[bufsize];
-
-  for (i = 0;i < bufsize;i++) {
-    fb1[i] = rand();
-    fb2[i] = rand();
-  }
-
-  time(&t);
-  strftime(datebuffer, sizeof(datebuffer), "%Y-%m-%d %H:%M UTC", gmtime(&t));
-
-  printf("# Pixel Conversion Performance Test %s\n", datebuffer);
-  printf("#\n");
-  printf("# Frame buffer: %dx%d pixels\n", fbsize, fbsize);
-  printf("# Tile size: %dx%d pixels\n", tile, tile);
-  printf("#\n");
-  printf("# Note: Results are Mpixels/sec\n");
-  printf("#\n");
-
-  printf("Source format,Destination Format");
-  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++)
-    printf(",%s", tests[i].label);
-  printf("\n");
-
   rfb::PixelFormat dstpf, srcpf;
 
   /* rgb888 targets */
@@ -168,6 +137,9 @@ int main(int argc, char **argv)
   srcpf.parse("rgb565");
   doTests(dstpf, srcpf);
 
+  srcpf.parse("rgb555");
+  doTests(dstpf, srcpf);
+
   srcpf.parse("rgb232");
   doTests(dstpf, srcpf);
 
@@ -186,6 +158,15 @@ int main(int argc, char **argv)
   srcpf.parse("rgb232");
   doTests(dstpf, srcpf);
 
+  /* rgb555 targets */
+
+  printf("\n");
+
+  dstpf.parse("rgb555");
+
+  srcpf.parse("rgb888");
+  doTests(dstpf, srcpf);
+
   /* rgb232 targets */
 
   printf("\n");
@@ -218,6 +199,65 @@ int main(int argc, char **argv)
   doTests(srcpf, dstpf);
 
   doTests(dstpf, srcpf);
+}
+
+static const unsigned kernelFeatures[] = {
+  0,
+  rfb::cpuSSE2,
+  rfb::cpuSSE2 | rfb::cpuSSSE3,
+  rfb::cpuSSE2 | rfb::cpuSSSE3 | rfb::cpuAVX2,
+  rfb::cpuNEON,
+};
+
+int main(int argc, char **argv)
+{
+  size_t bufsize;
+
+  time_t t;
+  char datebuffer[256];
+
+  size_t i;
+
+  bufsize = fbsize * fbsize * 4;
+
+  fb1 = new rdr::U8[bufsize];
+  fb2 = new rdr::U8[bufsize];
+
+  for (i = 0;i < bufsize;i++) {
+    fb1[i] = rand();
+    fb2[i] = rand();
+  }
+
+  time(&t);
+  strftime(datebuffer, sizeof(datebuffer), "%Y-%m-%d %H:%M UTC", gmtime(&t));
+
+  printf("# Pixel Conversion Performance Test %s\n", datebuffer);
+  printf("#\n");
+  printf("# Frame buffer: %dx%d pixels\n", fbsize, fbsize);
+  printf("# Tile size: %dx%d pixels\n", tile, tile);
+  printf("#\n");
+  printf("# Note: Results are Mpixels/sec\n");
+  printf("#\n");
+
+  printf("Source format,Destination Format");
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++)
+    printf(",%s", tests[i].label);
+  printf("\n");
+
+  // Go through every set of kernels this CPU can run
+  for (i = 0;i < sizeof(kernelFeatures)/sizeof(kernelFeatures[0]);i++) {
+    const rfb::ConversionKernels* kernels;
+
+    if ((rfb::getCPUFeatures() & kernelFeatures[i]) != kernelFeatures[i])
+      continue;
+
+    rfb::setConversionFeatures(kernelFeatures[i]);
+    kernels = rfb::getConversionKernels();
+
+    printf("\n# Kernels: %s\n", kernels->name);
+
+    doAllTests();
+  }
 
   return 0;
 }
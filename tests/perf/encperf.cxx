@@ -33,6 +33,8 @@
 #include <math.h>
 #include <sys/time.h>
 
+#include <vector>
+
 #include <rdr/Exception.h>
 #include <rdr/OutStream.h>
 #include <rdr/FileInStream.h>
@@ -47,6 +49,7 @@
 #include <rfb/EncodeManager.h>
 #include <rfb/SConnection.h>
 #include <rfb/SMsgWriter.h>
+#include <rfb/encodings.h>
 
 #include "util.h"
 
@@ -55,6 +58,7 @@ static rfb::IntParameter height("height", "Frame buffer height", 0);
 static rfb::IntParameter count("count", "Number of benchmark iterations", 9);
 
 static rfb::StringParameter format("format", "Pixel format (e.g. bgr888)", "");
+static rfb::StringParameter encoding("encoding", "Preferred encoding", "Tight");
 
 static rfb::BoolParameter translate("translate",
                                     "Translate 8-bit and 16-bit datasets into 24-bit",
@@ -66,7 +70,8 @@ static const rfb::PixelFormat fbPF(32, 24, false, true, 255, 255, 255, 0, 8, 16)
 // Encodings to use
 static const rdr::S32 encodings[] = {
   rfb::encodingTight, rfb::encodingCopyRect, rfb::encodingRRE,
-  rfb::encodingHextile, rfb::encodingZRLE, rfb::pseudoEncodingLastRect,
+  rfb::encodingHextile, rfb::encodingZRLE, rfb::encodingZstdRLE,
+  rfb::pseudoEncodingLastRect,
   rfb::pseudoEncodingQualityLevel0 + 8,
   rfb::pseudoEncodingCompressLevel0 + 2};
 
@@ -188,7 +193,22 @@ CConn::CConn(const char *filename)
 
   sc = new SConn();
   sc->client.setPF((bool)translate ? fbPF : pf);
-  sc->setEncodings(sizeof(encodings) / sizeof(*encodings), encodings);
+
+  // The first encoding in the list is the preferred one
+  std::vector<rdr::S32> encs;
+  int preferred;
+
+  preferred = rfb::encodingNum(encoding);
+  if (preferred < 0)
+    throw rdr::Exception("Unknown encoding");
+
+  encs.push_back(preferred);
+  for (size_t i = 0; i < sizeof(encodings) / sizeof(*encodings); i++) {
+    if (encodings[i] != preferred)
+      encs.push_back(encodings[i]);
+  }
+
+  sc->setEncodings(encs.size(), &encs[0]);
 }
 
 CConn::~CConn()
@@ -0,0 +1,299 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include <rdr/BufferedInStream.h>
+
+static rdr::U8 byteAt(size_t pos)
+{
+  return (pos * 7 + (pos >> 9)) & 0xff;
+}
+
+// Produces a known sequence of bytes, a limited amount at a time
+class ChunkInStream : public rdr::BufferedInStream {
+public:
+  ChunkInStream(size_t chunk_, size_t limit_=(size_t)-1)
+    : chunk(chunk_), limit(limit_), produced(0) {}
+
+  void setLimit(size_t limit_) { limit = limit_; }
+
+private:
+  virtual bool fillBuffer(size_t maxSize) {
+    size_t n;
+
+    n = chunk;
+    if (n > maxSize)
+      n = maxSize;
+    if (n > limit - produced)
+      n = limit - produced;
+    if (n == 0)
+      return false;
+
+    for (size_t i = 0; i < n; i++)
+      ((rdr::U8*)end)[i] = byteAt(produced + i);
+
+    produced += n;
+    end += n;
+
+    return true;
+  }
+
+  size_t chunk;
+  size_t limit;
+  size_t produced;
+};
+
+static bool check(const rdr::U8* data, size_t pos, size_t length)
+{
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] != byteAt(pos + i))
+      return false;
+  }
+
+  return true;
+}
+
+// Reads in small pieces, like a protocol reader would
+static bool consume(rdr::InStream* is, size_t length)
+{
+  while (length > 0) {
+    size_t n;
+
+    n = length < 100 ? length : 100;
+    if (!is->hasData(n))
+      return false;
+
+    if (!check(is->getptr(n), is->pos(), n))
+      return false;
+    is->setptr(n);
+
+    length -= n;
+  }
+
+  return true;
+}
+
+static bool testRetain()
+{
+  ChunkInStream is(1000);
+  const rdr::U8* start;
+  const rdr::U8* data;
+  size_t length;
+  void* handle;
+
+  is.hasData(100);
+  is.skip(10);
+
+  start = is.getptr(0);
+  is.setRetainPoint();
+  if (!consume(&is, 500))
+    return false;
+
+  data = is.retainData(&length, &handle);
+  if (length != 500)
+    return false;
+  if (data != start)
+    return false;
+
+  // Plenty of refills and compactions, which mustn't disturb the
+  // retained data
+  if (!consume(&is, 100000))
+    return false;
+  if (!check(data, 10, length))
+    return false;
+
+  rdr::BufferedInStream::releaseData(handle);
+
+  return true;
+}
+
+static bool testRefill()
+{
+  ChunkInStream is(1000);
+  const rdr::U8* data;
+  size_t length;
+  void* handle;
+
+  consume(&is, 1234);
+
+  // Spans several buffer compactions
+  is.setRetainPoint();
+  if (!consume(&is, 20000))
+    return false;
+
+  data = is.retainData(&length, &handle);
+  if (length != 20000)
+    return false;
+  if (!check(data, 1234, length))
+    return false;
+
+  if (!consume(&is, 50000))
+    return false;
+  if (!check(data, 1234, length))
+    return false;
+
+  rdr::BufferedInStream::releaseData(handle);
+
+  // Also when the buffer has to grow
+  is.setRetainPoint();
+  if (!consume(&is, 10) || !is.hasData(50000) || !consume(&is, 50000))
+    return false;
+
+  data = is.retainData(&length, &handle);
+  if ((length != 50010) || !check(data, 1234 + 20000 + 50000, length))
+    return false;
+
+  rdr::BufferedInStream::releaseData(handle);
+
+  return true;
+}
+
+static bool testIncomplete()
+{
+  ChunkInStream is(1000, 5000);
+  const rdr::U8* data;
+  size_t length;
+  void* handle;
+
+  consume(&is, 4000);
+
+  // Not all there yet, so the reader gives up and tries again later
+  is.setRetainPoint();
+  is.setRestorePoint();
+  if (!consume(&is, 500) || is.hasDataOrRestore(6000))
+    return false;
+  is.clearRetainPoint();
+
+  if (is.pos() != 4000)
+    return false;
+
+  is.setLimit(20000);
+
+  is.setRetainPoint();
+  if (!consume(&is, 7000))
+    return false;
+
+  data = is.retainData(&length, &handle);
+  if ((length != 7000) || !check(data, 4000, length))
+    return false;
+
+  rdr::BufferedInStream::releaseData(handle);
+
+  return true;
+}
+
+// Finds out where the stream compacts its data to
+static const rdr::U8* compact(rdr::InStream* is)
+{
+  // Read up to the end of the current buffer, so there is no room
+  // for anything more
+  while (is->avail() > 0)
+    is->skip(is->avail() > 100 ? 100 : is->avail());
+  is->hasData(1);
+
+  return is->getptr(0);
+}
+
+static bool testRelease()
+{
+  ChunkInStream is(100000);
+  const rdr::U8* base;
+  const rdr::U8* data;
+  size_t pos, length;
+  void* handle;
+
+  base = compact(&is);
+
+  // Nothing retained, so the buffer is reused
+  if (compact(&is) != base)
+    return false;
+
+  // Retained, so it must be left alone
+  pos = is.pos();
+  is.setRetainPoint();
+  consume(&is, 100);
+  data = is.retainData(&length, &handle);
+
+  if (compact(&is) == base)
+    return false;
+  if ((length != 100) || !check(data, pos, length))
+    return false;
+
+  // Released, so the current buffer can be reused again
+  rdr::BufferedInStream::releaseData(handle);
+
+  base = compact(&is);
+  if (compact(&is) != base)
+    return false;
+
+  // Clearing a retain point must also let go of the buffers
+  is.setRetainPoint();
+  consume(&is, 100);
+  compact(&is);
+  consume(&is, 100);
+  compact(&is);
+  is.clearRetainPoint();
+
+  base = compact(&is);
+  if (compact(&is) != base)
+    return false;
+
+  return true;
+}
+
+typedef bool (*testfn) ();
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+struct TestEntry tests[] = {
+  {"Retain", testRetain},
+  {"Refill", testRefill},
+  {"Incomplete data", testIncomplete},
+  {"Release", testRelease},
+};
+
+int main(int argc, char** argv)
+{
+  size_t i;
+  int failures;
+
+  printf("Buffered Input Stream Test\n");
+  printf("\n");
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn()) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,315 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include <rdr/BufferedOutStream.h>
+#include <rdr/MemOutStream.h>
+
+// Sends at most the given number of bytes and segments at a time,
+// like a socket that is running out of room would
+class ChainOutStream : public rdr::BufferedOutStream {
+public:
+  ChainOutStream(size_t maxWrite_=0, size_t maxSegments_=16,
+                 bool chain=true)
+    : maxWrite(maxWrite_), maxSegments(maxSegments_), blocked(false),
+      released(0) {
+    chainBuffers = chain;
+  }
+
+  size_t maxWrite;
+  size_t maxSegments;
+  bool blocked;
+
+  std::string sent;
+  size_t released;
+
+private:
+  virtual bool flushBuffer() {
+    Segment segments[16];
+    size_t count, length;
+
+    if (blocked)
+      return false;
+
+    count = getPending(segments, maxSegments);
+    if (count == 0)
+      return false;
+
+    length = 0;
+    for (size_t i = 0; i < count; i++) {
+      size_t n;
+
+      n = segments[i].length;
+      if ((maxWrite != 0) && (n > maxWrite - length))
+        n = maxWrite - length;
+
+      sent.append((const char*)segments[i].data, n);
+      length += n;
+
+      if (length == maxWrite)
+        break;
+    }
+
+    markSent(length);
+
+    return true;
+  }
+
+  virtual void releaseBuffer(rdr::U8* data) {
+    released++;
+    delete [] data;
+  }
+};
+
+static std::string makeData(size_t length, int seed)
+{
+  std::string data;
+
+  for (size_t i = 0; i < length; i++)
+    data += (char)(i * 7 + i / 251 + seed);
+
+  return data;
+}
+
+static void adopt(rdr::OutStream* os, const std::string& data)
+{
+  rdr::U8* buffer;
+
+  buffer = new rdr::U8[data.size()];
+  memcpy(buffer, data.data(), data.size());
+  os->adoptBuffer(buffer, data.size());
+}
+
+// Writes a mix of small writes and adopted buffers, returning what
+// should come out at the other end
+static std::string writeMix(rdr::OutStream* os, int seed)
+{
+  std::string data, all;
+
+  data = makeData(100, seed);
+  os->writeBytes(data.data(), data.size());
+  all += data;
+
+  data = makeData(10000, seed + 1);
+  adopt(os, data);
+  all += data;
+
+  data = makeData(3, seed + 2);
+  os->writeBytes(data.data(), data.size());
+  all += data;
+
+  // Back to back
+  data = makeData(20000, seed + 3);
+  adopt(os, data);
+  all += data;
+  data = makeData(9000, seed + 4);
+  adopt(os, data);
+  all += data;
+
+  data = makeData(5000, seed + 5);
+  os->writeBytes(data.data(), data.size());
+  all += data;
+
+  return all;
+}
+
+static bool testOrder()
+{
+  ChainOutStream os;
+  std::string expected;
+
+  expected = writeMix(&os, 0);
+
+  if (os.length() != expected.size())
+    return false;
+
+  os.flush();
+
+  if (os.sent != expected)
+    return false;
+  if (os.hasBufferedData())
+    return false;
+  if (os.released != 3)
+    return false;
+  if (os.length() != expected.size())
+    return false;
+
+  return true;
+}
+
+static bool testShortWrites()
+{
+  static const size_t maxWrites[] = { 1, 7, 100, 4096, 9999, 15000 };
+
+  for (size_t i = 0; i < sizeof(maxWrites)/sizeof(maxWrites[0]); i++) {
+    for (size_t segments = 1; segments <= 3; segments++) {
+      ChainOutStream os(maxWrites[i], segments);
+      std::string expected;
+
+      // Partly sent data, both ours and adopted, when more is added
+      expected = writeMix(&os, 0);
+      os.flush();
+      expected += writeMix(&os, 10);
+      os.flush();
+
+      while (os.hasBufferedData())
+        os.flush();
+
+      if (os.sent != expected)
+        return false;
+      if (os.released != 6)
+        return false;
+      if (os.length() != expected.size())
+        return false;
+    }
+  }
+
+  return true;
+}
+
+static bool testBlocked()
+{
+  ChainOutStream os(5000);
+  std::string expected, data;
+
+  // Nothing gets sent, so the buffer has to move and grow whilst the
+  // adopted buffers are waiting
+  os.blocked = true;
+
+  expected = writeMix(&os, 0);
+  for (int i = 0; i < 10; i++) {
+    data = makeData(10000, i);
+    os.writeBytes(data.data(), data.size());
+    expected += data;
+    expected += writeMix(&os, i);
+  }
+
+  if (os.length() != expected.size())
+    return false;
+
+  os.blocked = false;
+  while (os.hasBufferedData())
+    os.flush();
+
+  if (os.sent != expected)
+    return false;
+  if (os.released != 33)
+    return false;
+
+  return true;
+}
+
+static bool testCopied()
+{
+  ChainOutStream os(0, 16, false), small;
+  std::string expected, data;
+
+  // Streams that can't chain buffers get a copy
+  expected = writeMix(&os, 0);
+  os.flush();
+
+  if ((os.sent != expected) || (os.released != 0))
+    return false;
+
+  // As does everyone for small buffers
+  data = makeData(100, 0);
+  adopt(&small, data);
+  small.flush();
+
+  if ((small.sent != data) || (small.released != 0))
+    return false;
+
+  return true;
+}
+
+static bool testHandOver()
+{
+  ChainOutStream os(3000);
+  rdr::MemOutStream ms(1024);
+  std::string expected, data;
+
+  for (int i = 0; i < 3; i++) {
+    data = makeData(20000, i);
+    ms.writeBytes(data.data(), data.size());
+    ms.writeTo(&os);
+    expected += data;
+
+    if (ms.length() != 0)
+      return false;
+
+    // Too small to hand over
+    data = makeData(50, i);
+    ms.writeBytes(data.data(), data.size());
+    ms.writeTo(&os);
+    expected += data;
+  }
+
+  while (os.hasBufferedData())
+    os.flush();
+
+  if (os.sent != expected)
+    return false;
+  if (os.released != 3)
+    return false;
+
+  return true;
+}
+
+typedef bool (*testfn) ();
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+struct TestEntry tests[] = {
+  {"Adopted buffer order", testOrder},
+  {"Short writes", testShortWrites},
+  {"Blocked output", testBlocked},
+  {"Copied buffers", testCopied},
+  {"Memory stream hand over", testHandOver},
+};
+
+int main(int argc, char** argv)
+{
+  size_t i;
+  int failures;
+
+  printf("Buffered Output Stream Test\n");
+  printf("\n");
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn()) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,473 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <rfb/ComparingUpdateTracker.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/ServerCore.h>
+#include <rfb/cpuFeatures.h>
+
+// Odd sizes, so that rows and blocks don't fill whole vectors
+static const int fbWidth = 203;
+static const int fbHeight = 150;
+
+static const int blockSize = 64;
+
+typedef bool (*testfn) (const rfb::PixelFormat&);
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+static int failures = 0;
+
+// Keeps track of what the framebuffer looked like at the last
+// comparison, in order to work out what the tracker should find
+class TestFramebuffer : public rfb::ManagedPixelBuffer {
+public:
+  TestFramebuffer(const rfb::PixelFormat& pf)
+    : rfb::ManagedPixelBuffer(pf, fbWidth, fbHeight) {
+    rdr::U8* data;
+    int stride;
+
+    data = getBufferRW(getRect(), &stride);
+    for (int i = 0; i < stride * fbHeight * bpp(); i++)
+      data[i] = rand();
+    commitBufferRW(getRect());
+
+    saved.resize(fbWidth * fbHeight * bpp());
+    save(getRect());
+  }
+
+  int bpp() { return getPF().bpp/8; }
+
+  // Changes a single byte of the given pixel
+  void change(int x, int y, int byte) {
+    rdr::U8* data;
+    int stride;
+
+    data = getBufferRW(rfb::Rect(x, y, x + 1, y + 1), &stride);
+    data[byte] ^= 1 << (rand() % 8);
+    commitBufferRW(rfb::Rect(x, y, x + 1, y + 1));
+  }
+
+  void changeRandom() {
+    change(rand() % fbWidth, rand() % fbHeight, rand() % bpp());
+  }
+
+  // Each block of the compared area should give the bounds of what
+  // has changed within it
+  rfb::Region expected(const rfb::Rect& r) {
+    rfb::Region changes;
+
+    for (int by = r.tl.y; by < r.br.y; by += blockSize) {
+      for (int bx = r.tl.x; bx < r.br.x; bx += blockSize) {
+        rfb::Rect block, bounds;
+
+        block.setXYWH(bx, by, blockSize, blockSize);
+        block = block.intersect(r);
+
+        for (int y = block.tl.y; y < block.br.y; y++) {
+          for (int x = block.tl.x; x < block.br.x; x++) {
+            if (!differs(x, y))
+              continue;
+            bounds = bounds.union_boundary(rfb::Rect(x, y, x + 1, y + 1));
+          }
+        }
+
+        changes.assign_union(bounds);
+      }
+    }
+
+    return changes;
+  }
+
+  bool differs(const rfb::Rect& r) {
+    for (int y = r.tl.y; y < r.br.y; y++) {
+      for (int x = r.tl.x; x < r.br.x; x++) {
+        if (differs(x, y))
+          return true;
+      }
+    }
+
+    return false;
+  }
+
+  void save(const rfb::Rect& r) {
+    for (int y = r.tl.y; y < r.br.y; y++) {
+      for (int x = r.tl.x; x < r.br.x; x++)
+        memcpy(&saved[(x + y * fbWidth) * bpp()], pixel(x, y), bpp());
+    }
+  }
+
+private:
+  const rdr::U8* pixel(int x, int y) {
+    int stride;
+    return getBuffer(rfb::Rect(x, y, x + 1, y + 1), &stride);
+  }
+
+  bool differs(int x, int y) {
+    return memcmp(&saved[(x + y * fbWidth) * bpp()],
+                  pixel(x, y), bpp()) != 0;
+  }
+
+  std::vector<rdr::U8> saved;
+};
+
+// Runs a comparison of the given area, and checks that exactly the
+// expected changes are reported
+static bool checkCompare(rfb::ComparingUpdateTracker* tracker,
+                         TestFramebuffer* fb, const rfb::Region& damage)
+{
+  std::vector<rfb::Rect> rects;
+  std::vector<rfb::Rect>::const_iterator iter;
+  rfb::UpdateInfo info;
+  rfb::Region expected;
+
+  // The tracker compares each rect of the damage on its own
+  damage.get_rects(&rects);
+  for (iter = rects.begin(); iter != rects.end(); ++iter)
+    expected.assign_union(fb->expected(*iter));
+
+  tracker->clear();
+  tracker->add_changed(damage);
+  tracker->compare();
+
+  tracker->getUpdateInfo(&info, fb->getRect());
+  tracker->clear();
+
+  for (iter = rects.begin(); iter != rects.end(); ++iter)
+    fb->save(*iter);
+
+  return info.changed.equals(expected);
+}
+
+// Same as checkCompare(), but for when only hashes of each tile are
+// kept. Any damage in a tile that has changed is then reported.
+static bool checkHashCompare(rfb::ComparingUpdateTracker* tracker,
+                             TestFramebuffer* fb, const rfb::Region& damage)
+{
+  rfb::UpdateInfo info;
+  rfb::Region expected;
+
+  for (int y = 0; y < fbHeight; y += blockSize) {
+    for (int x = 0; x < fbWidth; x += blockSize) {
+      rfb::Rect tile;
+
+      tile.setXYWH(x, y, blockSize, blockSize);
+      tile = tile.intersect(fb->getRect());
+
+      if (damage.intersect(tile).is_empty())
+        continue;
+
+      if (fb->differs(tile)) {
+        expected.assign_union(damage.intersect(tile));
+        fb->save(tile);
+      }
+    }
+  }
+
+  tracker->clear();
+  tracker->add_changed(damage);
+  tracker->compare();
+
+  tracker->getUpdateInfo(&info, fb->getRect());
+  tracker->clear();
+
+  return info.changed.equals(expected);
+}
+
+static rfb::Rect randomRect()
+{
+  rfb::Rect r;
+
+  r.tl.x = rand() % fbWidth;
+  r.tl.y = rand() % fbHeight;
+  r.br.x = r.tl.x + 1 + rand() % (fbWidth - r.tl.x);
+  r.br.y = r.tl.y + 1 + rand() % (fbHeight - r.tl.y);
+
+  return r;
+}
+
+static bool testUnchanged(const rfb::PixelFormat& pf)
+{
+  TestFramebuffer fb(pf);
+  rfb::ComparingUpdateTracker tracker(&fb);
+
+  tracker.compare();
+
+  if (!checkCompare(&tracker, &fb, fb.getRect()))
+    return false;
+
+  return true;
+}
+
+static bool testSingle(const rfb::PixelFormat& pf)
+{
+  static const int xs[] = { 0, 1, 15, 16, 31, 32, 63, 64, 65, 127, 128,
+                            191, 192, 201, 202 };
+  static const int ys[] = { 0, 63, 64, 149 };
+
+  TestFramebuffer fb(pf);
+  rfb::ComparingUpdateTracker tracker(&fb);
+
+  tracker.compare();
+
+  for (size_t i = 0; i < sizeof(xs)/sizeof(xs[0]); i++) {
+    for (size_t j = 0; j < sizeof(ys)/sizeof(ys[0]); j++) {
+      for (int byte = 0; byte < fb.bpp(); byte++) {
+        rfb::Region expected(rfb::Rect(xs[i], ys[j], xs[i] + 1, ys[j] + 1));
+
+        fb.change(xs[i], ys[j], byte);
+        if (!fb.expected(fb.getRect()).equals(expected))
+          return false;
+
+        if (!checkCompare(&tracker, &fb, fb.getRect()))
+          return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static bool testScattered(const rfb::PixelFormat& pf)
+{
+  TestFramebuffer fb(pf);
+  rfb::ComparingUpdateTracker tracker(&fb);
+
+  tracker.compare();
+
+  for (int round = 0; round < 50; round++) {
+    int count;
+
+    count = rand() % 40;
+    for (int i = 0; i < count; i++)
+      fb.changeRandom();
+
+    if (!checkCompare(&tracker, &fb, fb.getRect()))
+      return false;
+  }
+
+  return true;
+}
+
+static bool testPartial(const rfb::PixelFormat& pf)
+{
+  TestFramebuffer fb(pf);
+  rfb::ComparingUpdateTracker tracker(&fb);
+
+  tracker.compare();
+
+  for (int round = 0; round < 50; round++) {
+    int count;
+
+    count = rand() % 40;
+    for (int i = 0; i < count; i++)
+      fb.changeRandom();
+
+    // Changes outside the damage are left for later
+    if (!checkCompare(&tracker, &fb, randomRect()))
+      return false;
+  }
+
+  if (!checkCompare(&tracker, &fb, fb.getRect()))
+    return false;
+
+  return true;
+}
+
+static bool testThreads(const rfb::PixelFormat& pf)
+{
+  TestFramebuffer fb(pf);
+
+  rfb::Server::compareThreads.setParam(3);
+  rfb::ComparingUpdateTracker tracker(&fb);
+  rfb::Server::compareThreads.setParam(0);
+
+  tracker.compare();
+
+  // Several bands and rects for the threads to share, and the result
+  // must be the same as when comparing them one by one
+  for (int round = 0; round < 50; round++) {
+    rfb::Region damage;
+    int count;
+
+    count = rand() % 200;
+    for (int i = 0; i < count; i++)
+      fb.changeRandom();
+
+    count = 1 + rand() % 4;
+    for (int i = 0; i < count; i++)
+      damage.assign_union(randomRect());
+
+    if (!checkCompare(&tracker, &fb, damage))
+      return false;
+  }
+
+  if (!checkCompare(&tracker, &fb, fb.getRect()))
+    return false;
+
+  return true;
+}
+
+static bool testHashes(const rfb::PixelFormat& pf)
+{
+  for (int threads = 0; threads <= 3; threads += 3) {
+    TestFramebuffer fb(pf);
+    rfb::UpdateInfo info;
+
+    rfb::Server::compareHashes.setParam(true);
+    rfb::Server::compareThreads.setParam(threads);
+    rfb::ComparingUpdateTracker tracker(&fb);
+    rfb::Server::compareHashes.setParam(false);
+    rfb::Server::compareThreads.setParam(0);
+
+    tracker.compare();
+
+    if (!checkHashCompare(&tracker, &fb, fb.getRect()))
+      return false;
+
+    // A single changed byte must be enough to change the hash
+    for (int byte = 0; byte < fb.bpp(); byte++) {
+      fb.change(70, 80, byte);
+      if (!checkHashCompare(&tracker, &fb, rfb::Rect(64, 64, 66, 66)))
+        return false;
+    }
+
+    for (int round = 0; round < 50; round++) {
+      rfb::Region damage;
+      int count;
+
+      count = rand() % 10;
+      for (int i = 0; i < count; i++)
+        fb.changeRandom();
+
+      // Tiles outside the damage are left for later
+      count = 1 + rand() % 4;
+      for (int i = 0; i < count; i++)
+        damage.assign_union(randomRect());
+
+      if (!checkHashCompare(&tracker, &fb, damage))
+        return false;
+    }
+
+    if (!checkHashCompare(&tracker, &fb, fb.getRect()))
+      return false;
+
+    // Copied tiles get new hashes, so the copy itself isn't a change
+    fb.copyRect(rfb::Rect(0, 0, 100, 100), rfb::Point(-100, 0));
+    tracker.add_copied(rfb::Rect(0, 0, 100, 100), rfb::Point(-100, 0));
+    tracker.compare();
+    tracker.getUpdateInfo(&info, fb.getRect());
+    tracker.clear();
+    if (!info.changed.is_empty())
+      return false;
+    if (!info.copied.equals(rfb::Rect(0, 0, 100, 100)))
+      return false;
+
+    fb.save(fb.getRect());
+
+    if (!checkHashCompare(&tracker, &fb, fb.getRect()))
+      return false;
+  }
+
+  return true;
+}
+
+struct TestEntry tests[] = {
+  {"Unchanged", testUnchanged},
+  {"Single pixels", testSingle},
+  {"Scattered pixels", testScattered},
+  {"Partial damage", testPartial},
+  {"Threads", testThreads},
+  {"Hashes", testHashes},
+};
+
+static void doTests(const rfb::PixelFormat &pf)
+{
+  size_t i;
+  char desc[256];
+
+  pf.print(desc, sizeof(desc));
+
+  printf("\n");
+  printf("%s\n", desc);
+  printf("\n");
+
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn(pf)) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+}
+
+static const struct {
+  const char* name;
+  unsigned features;
+} kernels[] = {
+  { "plain", 0 },
+  { "SSE2", rfb::cpuSSE2 },
+  { "AVX2", rfb::cpuSSE2 | rfb::cpuAVX2 },
+  { "NEON", rfb::cpuNEON },
+};
+
+int main(int argc, char **argv)
+{
+  size_t i;
+  rfb::PixelFormat pf;
+
+  // Found copies would hide changes
+  rfb::Server::detectScrolling.setParam(false);
+
+  printf("Framebuffer Comparison Test\n");
+
+  // Check every kernel this CPU can run
+  for (i = 0;i < sizeof(kernels)/sizeof(kernels[0]);i++) {
+    if ((rfb::getCPUFeatures() & kernels[i].features) != kernels[i].features)
+      continue;
+
+    rfb::ComparingUpdateTracker::setCompareFeatures(kernels[i].features);
+
+    printf("\n");
+    printf("Kernel: %s\n", kernels[i].name);
+
+    pf.parse("rgb888");
+    doTests(pf);
+
+    pf.parse("rgb565");
+    doTests(pf);
+
+    pf.parse("rgb332");
+    doTests(pf);
+  }
+
+  return failures ? 1 : 0;
+}
@@ -21,6 +21,8 @@
 #include <string.h>
 
 #include <rfb/PixelFormat.h>
+#include <rfb/PixelFormatSIMD.h>
+#include <rfb/cpuFeatures.h>
 
 static const rdr::U8 pixelRed = 0xf1;
 static const rdr::U8 pixelGreen = 0xc3;
@@ -32,6 +34,11 @@ static const int fbArea = fbWidth * fbHeight;
 // Maximum bpp, plus some room for unaligned fudging
 static const int fbMalloc = (fbArea * 4) + 4;
 
+// The kernels currently being tested
+static unsigned kernelFeatures;
+
+static int failures;
+
 typedef bool (*testfn) (const rfb::PixelFormat&, const rfb::PixelFormat&);
 
 struct TestEntry {
@@ -256,11 +263,69 @@ static bool testPixelRGB(const rfb::PixelFormat &dstpf,
   return true;
 }
 
+// A single colour won't catch every mistake in the vectorised kernels,
+// so also check that they give exactly the same result as the plain
+// ones for random data
+
+static bool testKernels(const rfb::PixelFormat &dstpf,
+                        const rfb::PixelFormat &srcpf)
+{
+  static const int widths[] = { 1, 3, 7, 16, 33, fbWidth };
+  int i, unaligned;
+  size_t w;
+  rdr::U8 bufIn[fbMalloc];
+  rdr::U8 bufOut[fbMalloc], bufRGB[fbMalloc], bufRGBOut[fbMalloc];
+  rdr::U8 refOut[fbMalloc], refRGB[fbMalloc], refRGBOut[fbMalloc];
+
+  for (unaligned = 0;unaligned < 2;unaligned++) {
+    for (w = 0;w < sizeof(widths)/sizeof(widths[0]);w++) {
+      for (i = 0;i < fbMalloc;i++)
+        bufIn[i] = rand();
+
+      memset(bufOut, 0, sizeof(bufOut));
+      memset(bufRGB, 0, sizeof(bufRGB));
+      memset(bufRGBOut, 0, sizeof(bufRGBOut));
+
+      dstpf.bufferFromBuffer(bufOut + unaligned, srcpf, bufIn + unaligned,
+                             widths[w], fbHeight, fbWidth, fbWidth);
+      srcpf.rgbFromBuffer(bufRGB + unaligned, bufIn + unaligned,
+                          widths[w], fbWidth, fbHeight);
+      dstpf.bufferFromRGB(bufRGBOut + unaligned, bufRGB + unaligned,
+                          widths[w], fbWidth, fbHeight);
+
+      rfb::setConversionFeatures(0);
+
+      memset(refOut, 0, sizeof(refOut));
+      memset(refRGB, 0, sizeof(refRGB));
+      memset(refRGBOut, 0, sizeof(refRGBOut));
+
+      dstpf.bufferFromBuffer(refOut + unaligned, srcpf, bufIn + unaligned,
+                             widths[w], fbHeight, fbWidth, fbWidth);
+      srcpf.rgbFromBuffer(refRGB + unaligned, bufIn + unaligned,
+                          widths[w], fbWidth, fbHeight);
+      dstpf.bufferFromRGB(refRGBOut + unaligned, refRGB + unaligned,
+                          widths[w], fbWidth, fbHeight);
+
+      rfb::setConversionFeatures(kernelFeatures);
+
+      if (memcmp(bufOut, refOut, sizeof(bufOut)) != 0)
+        return false;
+      if (memcmp(bufRGB, refRGB, sizeof(bufRGB)) != 0)
+        return false;
+      if (memcmp(bufRGBOut, refRGBOut, sizeof(bufRGBOut)) != 0)
+        return false;
+    }
+  }
+
+  return true;
+}
+
 struct TestEntry tests[] = {
   {"Pixel from pixel", testPixel},
   {"Buffer from buffer", testBuffer},
   {"Buffer to/from RGB", testRGB},
   {"Pixel to/from RGB", testPixelRGB},
+  {"Same as plain kernels", testKernels},
 };
 
 static void doTests(const rfb::PixelFormat &dstpf,
@@ -279,20 +344,20 @@ static void doTests(const rfb::PixelFormat &dstpf,
   for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
     printf("    %s: ", tests[i].label);
     fflush(stdout);
-    if (tests[i].fn(dstpf, srcpf))
+    if (tests[i].fn(dstpf, srcpf)) {
       printf("OK");
-    else
+    } else {
       printf("FAILED");
+      failures++;
+    }
     printf("\n");
   }
 }
 
-int main(int argc, char **argv)
+static void doAllTests()
 {
   rfb::PixelFormat dstpf, srcpf;
 
-  printf("Pixel Conversion Correctness Test\n");
-
   /* rgb888 targets */
 
   dstpf.parse("rgb888");
@@ -306,6 +371,9 @@ int main(int argc, char **argv)
   srcpf.parse("rgb565");
   doTests(dstpf, srcpf);
 
+  srcpf.parse("rgb555");
+  doTests(dstpf, srcpf);
+
   srcpf.parse("rgb232");
   doTests(dstpf, srcpf);
 
@@ -322,6 +390,13 @@ int main(int argc, char **argv)
   srcpf.parse("rgb232");
   doTests(dstpf, srcpf);
 
+  /* rgb555 targets */
+
+  dstpf.parse("rgb555");
+
+  srcpf.parse("rgb888");
+  doTests(dstpf, srcpf);
+
   /* rgb232 targets */
 
   dstpf.parse("rgb232");
@@ -359,3 +434,36 @@ int main(int argc, char **argv)
 
   doTests(srcpf, dstpf);
 }
+
+static const unsigned allKernelFeatures[] = {
+  0,
+  rfb::cpuSSE2,
+  rfb::cpuSSE2 | rfb::cpuSSSE3,
+  rfb::cpuSSE2 | rfb::cpuSSSE3 | rfb::cpuAVX2,
+  rfb::cpuNEON,
+};
+
+int main(int argc, char **argv)
+{
+  size_t i;
+
+  printf("Pixel Conversion Correctness Test\n");
+
+  failures = 0;
+
+  // Check every set of kernels this CPU can run
+  for (i = 0;i < sizeof(allKernelFeatures)/sizeof(allKernelFeatures[0]);i++) {
+    if ((rfb::getCPUFeatures() & allKernelFeatures[i]) != allKernelFeatures[i])
+      continue;
+
+    kernelFeatures = allKernelFeatures[i];
+    rfb::setConversionFeatures(kernelFeatures);
+
+    printf("\n");
+    printf("Kernels: %s\n", rfb::getConversionKernels()->name);
+
+    doAllTests();
+  }
+
+  return failures ? 1 : 0;
+}
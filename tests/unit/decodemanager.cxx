@@ -0,0 +1,405 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <rdr/BufferedInStream.h>
+#include <rdr/MemInStream.h>
+#include <rdr/MemOutStream.h>
+#include <rdr/ZlibOutStream.h>
+
+#include <rfb/CConnection.h>
+#include <rfb/DecodeManager.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/encodings.h>
+
+static const rfb::PixelFormat fbPF(32, 24, false, true,
+                                   255, 255, 255, 16, 8, 0);
+
+// Only gives out what has been fed to it so far, like a socket would
+class FeedInStream : public rdr::BufferedInStream {
+public:
+  FeedInStream() : fed(0) {}
+
+  void feed(const std::string& data) { pending.append(data); }
+
+private:
+  virtual bool fillBuffer(size_t maxSize) {
+    size_t n;
+
+    n = pending.size() - fed;
+    if (n > maxSize)
+      n = maxSize;
+    if (n == 0)
+      return false;
+
+    memcpy((rdr::U8*)end, pending.data() + fed, n);
+    fed += n;
+    end += n;
+
+    return true;
+  }
+
+  std::string pending;
+  size_t fed;
+};
+
+class TestConnection : public rfb::CConnection {
+public:
+  TestConnection(rdr::InStream* is) {
+    setStreams(is, &out);
+    server.setPF(fbPF);
+  }
+
+  virtual void initDone() {}
+  virtual void setCursor(int, int, const rfb::Point&, const rdr::U8*) {}
+  virtual void setCursorPos(const rfb::Point&) {}
+  virtual void setColourMapEntries(int, int, rdr::U16*) {}
+  virtual void bell() {}
+
+private:
+  rdr::MemOutStream out;
+};
+
+struct TestRect {
+  const char* name;
+  int encoding;
+  rfb::Rect rect;
+  std::string data;
+  std::vector<rdr::U32> pixels;
+};
+
+static rdr::U32 randomPixel()
+{
+  static rdr::U32 seed = 1;
+
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 4) & 0xffffff;
+}
+
+static std::string toString(rdr::MemOutStream* mos)
+{
+  return std::string((const char*)mos->data(), mos->length());
+}
+
+static void writePixel(rdr::OutStream* os, rdr::U32 pixel)
+{
+  os->writeOpaque32(pixel);
+}
+
+static void writeTightPixel(rdr::OutStream* os, rdr::U32 pixel)
+{
+  os->writeU8(pixel >> 16);
+  os->writeU8(pixel >> 8);
+  os->writeU8(pixel);
+}
+
+static void writeCompactLength(rdr::OutStream* os, size_t length)
+{
+  os->writeU8((length & 0x7f) | (length > 0x7f ? 0x80 : 0));
+  if (length > 0x7f) {
+    os->writeU8(((length >> 7) & 0x7f) | (length > 0x3fff ? 0x80 : 0));
+    if (length > 0x3fff)
+      os->writeU8(length >> 14);
+  }
+}
+
+static TestRect makeRaw()
+{
+  TestRect tr;
+  rdr::MemOutStream mos;
+
+  tr.name = "Raw";
+  tr.encoding = rfb::encodingRaw;
+  tr.rect.setXYWH(3, 5, 21, 13);
+
+  for (int i = 0; i < tr.rect.area(); i++) {
+    tr.pixels.push_back(randomPixel());
+    writePixel(&mos, tr.pixels.back());
+  }
+
+  tr.data = toString(&mos);
+
+  return tr;
+}
+
+static TestRect makeRRE()
+{
+  TestRect tr;
+  rdr::MemOutStream mos;
+  rdr::U32 bg, fg[2];
+
+  tr.name = "RRE";
+  tr.encoding = rfb::encodingRRE;
+  tr.rect.setXYWH(40, 10, 30, 20);
+
+  bg = randomPixel();
+  fg[0] = randomPixel();
+  fg[1] = randomPixel();
+
+  mos.writeU32(2);
+  writePixel(&mos, bg);
+
+  writePixel(&mos, fg[0]);
+  mos.writeU16(1);
+  mos.writeU16(2);
+  mos.writeU16(10);
+  mos.writeU16(5);
+
+  writePixel(&mos, fg[1]);
+  mos.writeU16(5);
+  mos.writeU16(4);
+  mos.writeU16(20);
+  mos.writeU16(16);
+
+  for (int y = 0; y < tr.rect.height(); y++) {
+    for (int x = 0; x < tr.rect.width(); x++) {
+      if ((x >= 5) && (x < 25) && (y >= 4))
+        tr.pixels.push_back(fg[1]);
+      else if ((x >= 1) && (x < 11) && (y >= 2) && (y < 7))
+        tr.pixels.push_back(fg[0]);
+      else
+        tr.pixels.push_back(bg);
+    }
+  }
+
+  tr.data = toString(&mos);
+
+  return tr;
+}
+
+static TestRect makeTightFill()
+{
+  TestRect tr;
+  rdr::MemOutStream mos;
+  rdr::U32 colour;
+
+  tr.name = "Tight fill";
+  tr.encoding = rfb::encodingTight;
+  tr.rect.setXYWH(100, 0, 16, 16);
+
+  colour = randomPixel();
+
+  mos.writeU8(0x80);
+  writeTightPixel(&mos, colour);
+
+  tr.pixels.assign(tr.rect.area(), colour);
+
+  tr.data = toString(&mos);
+
+  return tr;
+}
+
+static TestRect makeTightSmall()
+{
+  TestRect tr;
+  rdr::MemOutStream mos;
+
+  tr.name = "Tight uncompressed";
+  tr.encoding = rfb::encodingTight;
+  tr.rect.setXYWH(120, 0, 3, 1);
+
+  // Small enough to be sent without compression
+  mos.writeU8(0x00);
+  for (int i = 0; i < tr.rect.area(); i++) {
+    tr.pixels.push_back(randomPixel());
+    writeTightPixel(&mos, tr.pixels.back());
+  }
+
+  tr.data = toString(&mos);
+
+  return tr;
+}
+
+static TestRect makeTightZlib()
+{
+  TestRect tr;
+  rdr::MemOutStream mos, compressed;
+  rdr::ZlibOutStream zos(&compressed, 1);
+
+  tr.name = "Tight zlib";
+  tr.encoding = rfb::encodingTight;
+  tr.rect.setXYWH(0, 100, 50, 40);
+
+  // Random data, so the compact length needs more than one byte
+  for (int i = 0; i < tr.rect.area(); i++) {
+    tr.pixels.push_back(randomPixel());
+    writeTightPixel(&zos, tr.pixels.back());
+  }
+  zos.flush();
+
+  // Each rect is its own zlib stream, so reset the decoder's
+  mos.writeU8(0x01);
+  writeCompactLength(&mos, compressed.length());
+  mos.writeBytes(compressed.data(), compressed.length());
+
+  tr.data = toString(&mos);
+
+  return tr;
+}
+
+static bool checkPixels(const rfb::PixelBuffer* pb, const TestRect& tr)
+{
+  const rdr::U32* data;
+  int stride;
+
+  data = (const rdr::U32*)pb->getBuffer(tr.rect, &stride);
+  for (int y = 0; y < tr.rect.height(); y++) {
+    if (memcmp(data, &tr.pixels[y * tr.rect.width()],
+               tr.rect.width() * 4) != 0)
+      return false;
+    data += stride;
+  }
+
+  return true;
+}
+
+// Decodes the rects with the data arriving in pieces of the given
+// size, or all at once from a plain memory stream if zero
+static bool decode(const std::vector<TestRect>& rects, size_t chunk)
+{
+  std::vector<TestRect>::const_iterator iter;
+  std::string all;
+
+  for (iter = rects.begin(); iter != rects.end(); ++iter)
+    all += iter->data;
+
+  rfb::ManagedPixelBuffer pb(fbPF, 256, 256);
+
+  if (chunk == 0) {
+    rdr::MemInStream mis(all.data(), all.size());
+    TestConnection conn(&mis);
+    rfb::DecodeManager dm(&conn);
+
+    for (iter = rects.begin(); iter != rects.end(); ++iter) {
+      if (!dm.decodeRect(iter->rect, iter->encoding, &pb))
+        return false;
+    }
+    dm.flush();
+
+    if (mis.avail() != 0)
+      return false;
+  } else {
+    FeedInStream fis;
+    TestConnection conn(&fis);
+    rfb::DecodeManager dm(&conn);
+    size_t fed;
+
+    fed = 0;
+    for (iter = rects.begin(); iter != rects.end(); ++iter) {
+      while (!dm.decodeRect(iter->rect, iter->encoding, &pb)) {
+        if (fed >= all.size())
+          return false;
+        fis.feed(all.substr(fed, chunk));
+        fed += chunk;
+      }
+    }
+    dm.flush();
+
+    if ((fed < all.size()) || fis.hasData(1))
+      return false;
+  }
+
+  for (iter = rects.begin(); iter != rects.end(); ++iter) {
+    if (!checkPixels(&pb, *iter))
+      return false;
+  }
+
+  return true;
+}
+
+static bool testRect(const TestRect& rect)
+{
+  std::vector<TestRect> single(1, rect);
+
+  // Copied out of a plain stream, left in the buffer when it is all
+  // there, and pieced together when it arrives bit by bit
+  if (!decode(single, 0))
+    return false;
+  if (!decode(single, 100000))
+    return false;
+  if (!decode(single, 7))
+    return false;
+
+  return true;
+}
+
+static bool testSequence(const std::vector<TestRect>& rects)
+{
+  std::vector<TestRect> sequence;
+
+  // Enough data that the stream's buffer has to be reused and
+  // replaced whilst earlier rects are still being held on to
+  for (int i = 0; i < 20; i++)
+    sequence.insert(sequence.end(), rects.begin(), rects.end());
+
+  if (!decode(sequence, 0))
+    return false;
+  if (!decode(sequence, 1000))
+    return false;
+  if (!decode(sequence, 8191))
+    return false;
+
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<TestRect> rects;
+  std::vector<TestRect>::const_iterator iter;
+  int failures;
+
+  rects.push_back(makeRaw());
+  rects.push_back(makeRRE());
+  rects.push_back(makeTightFill());
+  rects.push_back(makeTightSmall());
+  rects.push_back(makeTightZlib());
+
+  printf("Decode Manager Test\n");
+  printf("\n");
+
+  failures = 0;
+
+  for (iter = rects.begin(); iter != rects.end(); ++iter) {
+    printf("    %s: ", iter->name);
+    fflush(stdout);
+    if (testRect(*iter)) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  printf("    Sequence: ");
+  fflush(stdout);
+  if (testSequence(rects)) {
+    printf("OK");
+  } else {
+    printf("FAILED");
+    failures++;
+  }
+  printf("\n");
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,414 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <rdr/MemOutStream.h>
+#include <rfb/EncodeManager.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/SConnection.h>
+#include <rfb/SMsgWriter.h>
+#include <rfb/ServerCore.h>
+#include <rfb/UpdateTracker.h>
+#include <rfb/cpuFeatures.h>
+#include <rfb/encodings.h>
+
+static const int fbWidth = 333;
+static const int fbHeight = 200;
+
+// The kernels currently being tested
+static unsigned kernelFeatures;
+
+static int failures = 0;
+
+// The rect analysis decides how each rect is encoded, so any mistake
+// in the kernels shows up as a different update than the one the
+// plain kernels give
+
+class TestConnection : public rfb::SConnection {
+public:
+  TestConnection(const rdr::S32* encodings, int count,
+                 const rfb::PixelFormat& pf)
+  {
+    setStreams(NULL, &out);
+    setWriter(new rfb::SMsgWriter(&client, &out));
+    client.setPF(pf);
+    setEncodings(count, encodings);
+    manager = new rfb::EncodeManager(this);
+  }
+
+  ~TestConnection()
+  {
+    delete manager;
+  }
+
+  virtual void setDesktopSize(int fb_width, int fb_height,
+                              const rfb::ScreenSet& layout) {}
+
+  rdr::MemOutStream out;
+  rfb::EncodeManager* manager;
+};
+
+static const rdr::S32 tightEncodings[] = {
+  rfb::encodingTight, rfb::pseudoEncodingLastRect,
+};
+
+static const rdr::S32 zrleEncodings[] = {
+  rfb::encodingZRLE, rfb::pseudoEncodingLastRect,
+};
+
+static const rdr::S32 hextileEncodings[] = {
+  rfb::encodingHextile,
+};
+
+static const struct {
+  const rdr::S32* encodings;
+  int count;
+} encodingSets[] = {
+  { tightEncodings, sizeof(tightEncodings)/sizeof(tightEncodings[0]) },
+  { zrleEncodings, sizeof(zrleEncodings)/sizeof(zrleEncodings[0]) },
+  { hextileEncodings, sizeof(hextileEncodings)/sizeof(hextileEncodings[0]) },
+};
+
+static std::string encode(const rdr::S32* encodings, int count,
+                          const rfb::PixelBuffer* pb,
+                          const rfb::Region& changed, unsigned features)
+{
+  rfb::UpdateInfo ui;
+
+  rfb::EncodeManager::setAnalysisFeatures(features);
+
+  TestConnection conn(encodings, count, pb->getPF());
+
+  ui.changed = changed;
+  conn.manager->writeUpdate(ui, pb, NULL);
+
+  return std::string((const char*)conn.out.data(), conn.out.length());
+}
+
+static bool checkEncode(const rfb::PixelBuffer* pb,
+                        const rfb::Region& changed)
+{
+  size_t i;
+  bool ret;
+
+  ret = true;
+  for (i = 0;i < sizeof(encodingSets)/sizeof(encodingSets[0]);i++) {
+    std::string expected, actual;
+
+    expected = encode(encodingSets[i].encodings, encodingSets[i].count,
+                      pb, changed, 0);
+    actual = encode(encodingSets[i].encodings, encodingSets[i].count,
+                    pb, changed, kernelFeatures);
+
+    if (actual != expected)
+      ret = false;
+  }
+
+  rfb::EncodeManager::setAnalysisFeatures(kernelFeatures);
+
+  return ret;
+}
+
+class TestFramebuffer : public rfb::ManagedPixelBuffer {
+public:
+  TestFramebuffer(const rfb::PixelFormat& pf)
+    : rfb::ManagedPixelBuffer(pf, fbWidth, fbHeight) {}
+
+  // Picks the given number of random colours
+  void makeColours(int count) {
+    colours.resize(count);
+    for (int i = 0; i < count; i++) {
+      for (int j = 0; j < 4; j++)
+        colours[i].bytes[j] = rand();
+    }
+  }
+
+  // Fills the framebuffer with runs of random length of the colours
+  void fillRuns(int maxRun) {
+    rdr::U8* buffer;
+    int stride, bytes;
+    int left, colour;
+
+    buffer = getBufferRW(getRect(), &stride);
+    bytes = format.bpp/8;
+
+    left = 0;
+    colour = 0;
+    for (int y = 0; y < height(); y++) {
+      for (int x = 0; x < width(); x++) {
+        if (left == 0) {
+          colour = rand() % colours.size();
+          left = 1 + rand() % maxRun;
+        }
+        memcpy(buffer + (x + y * stride) * bytes,
+               colours[colour].bytes, bytes);
+        left--;
+      }
+    }
+
+    commitBufferRW(getRect());
+  }
+
+  // Fills the rect with one of the colours
+  void fillRect(const rfb::Rect& r, int colour) {
+    rdr::U8* buffer;
+    int stride, bytes;
+
+    buffer = getBufferRW(r, &stride);
+    bytes = format.bpp/8;
+
+    for (int y = 0; y < r.height(); y++) {
+      for (int x = 0; x < r.width(); x++)
+        memcpy(buffer + (x + y * stride) * bytes,
+               colours[colour].bytes, bytes);
+    }
+
+    commitBufferRW(r);
+  }
+
+  // Changes a single byte of a random pixel
+  void changeRandom() {
+    rfb::Rect r;
+    rdr::U8* buffer;
+    int stride;
+
+    r.setXYWH(rand() % width(), rand() % height(), 1, 1);
+
+    buffer = getBufferRW(r, &stride);
+    buffer[rand() % (format.bpp/8)] ^= 1 << (rand() % 8);
+    commitBufferRW(r);
+  }
+
+  struct Colour {
+    rdr::U8 bytes[4];
+  };
+
+  std::vector<Colour> colours;
+};
+
+// Rects of many different widths, so that the vectors end at every
+// possible place
+static rfb::Region narrowRects()
+{
+  rfb::Region region;
+  int x;
+
+  x = 0;
+  for (int w = 1; x + w <= fbWidth; w += 3) {
+    region.assign_union(rfb::Region(rfb::Rect(x, w % 7, x + w,
+                                              fbHeight - w % 5)));
+    x += w + 1;
+  }
+
+  return region;
+}
+
+static bool testRuns(const rfb::PixelFormat &pf)
+{
+  static const int colourCounts[] = { 2, 5, 20, 200, 300 };
+  static const int maxRuns[] = { 2, 10, 70 };
+
+  TestFramebuffer fb(pf);
+
+  for (size_t i = 0;i < sizeof(colourCounts)/sizeof(colourCounts[0]);i++) {
+    for (size_t j = 0;j < sizeof(maxRuns)/sizeof(maxRuns[0]);j++) {
+      fb.makeColours(colourCounts[i]);
+      fb.fillRuns(maxRuns[j]);
+
+      if (!checkEncode(&fb, fb.getRect()))
+        return false;
+      if (!checkEncode(&fb, narrowRects()))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+static bool testNearMatch(const rfb::PixelFormat &pf)
+{
+  TestFramebuffer fb(pf);
+
+  // Colours that only differ in a single byte, so that runs end in
+  // the middle of a pixel
+  fb.makeColours(1);
+  for (int i = 0; i < pf.bpp/8; i++) {
+    TestFramebuffer::Colour colour;
+
+    colour = fb.colours[0];
+    colour.bytes[i] ^= 0x10;
+    fb.colours.push_back(colour);
+  }
+
+  for (int i = 0; i < 5; i++) {
+    fb.fillRuns(100);
+
+    if (!checkEncode(&fb, fb.getRect()))
+      return false;
+    if (!checkEncode(&fb, narrowRects()))
+      return false;
+  }
+
+  return true;
+}
+
+static rfb::Rect randomRect()
+{
+  int x, y;
+
+  x = rand() % fbWidth;
+  y = rand() % fbHeight;
+
+  return rfb::Rect(x, y, x + 1 + rand() % (fbWidth - x),
+                   y + 1 + rand() % (fbHeight - y));
+}
+
+static bool testSolid(const rfb::PixelFormat &pf)
+{
+  TestFramebuffer fb(pf);
+
+  fb.makeColours(4);
+
+  for (int i = 0; i < 10; i++) {
+    fb.fillRect(fb.getRect(), 0);
+    for (int j = 0; j < 1 + i % 4; j++)
+      fb.fillRect(randomRect(), 1 + rand() % 3);
+
+    if (!checkEncode(&fb, fb.getRect()))
+      return false;
+    if (!checkEncode(&fb, narrowRects()))
+      return false;
+  }
+
+  return true;
+}
+
+static bool testNearlySolid(const rfb::PixelFormat &pf)
+{
+  static const int changes[] = { 1, 2, 5, 20 };
+
+  TestFramebuffer fb(pf);
+
+  fb.makeColours(1);
+
+  // Single odd bytes should break up the areas at every possible
+  // position in a vector
+  for (size_t i = 0;i < sizeof(changes)/sizeof(changes[0]);i++) {
+    for (int j = 0; j < 5; j++) {
+      fb.fillRect(fb.getRect(), 0);
+      for (int k = 0; k < changes[i]; k++)
+        fb.changeRandom();
+
+      if (!checkEncode(&fb, fb.getRect()))
+        return false;
+      if (!checkEncode(&fb, narrowRects()))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+typedef bool (*testfn) (const rfb::PixelFormat&);
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+struct TestEntry tests[] = {
+  {"Colour runs", testRuns},
+  {"Nearly matching colours", testNearMatch},
+  {"Solid areas", testSolid},
+  {"Nearly solid areas", testNearlySolid},
+};
+
+static void doTests(const rfb::PixelFormat &pf)
+{
+  size_t i;
+  char desc[256];
+
+  pf.print(desc, sizeof(desc));
+
+  printf("\n");
+  printf("%s\n", desc);
+  printf("\n");
+
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn(pf)) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+}
+
+static const struct {
+  const char* name;
+  unsigned features;
+} kernels[] = {
+  { "SSE2", rfb::cpuSSE2 },
+  { "AVX2", rfb::cpuSSE2 | rfb::cpuAVX2 },
+  { "NEON", rfb::cpuNEON },
+};
+
+int main(int argc, char **argv)
+{
+  size_t i;
+  rfb::PixelFormat pf;
+
+  // Keep the output predictable
+  rfb::Server::encodeThreads.setParam(0);
+
+  printf("Rect Analysis Test\n");
+
+  srand(1);
+
+  // Check every kernel this CPU can run against the plain one
+  for (i = 0;i < sizeof(kernels)/sizeof(kernels[0]);i++) {
+    if ((rfb::getCPUFeatures() & kernels[i].features) != kernels[i].features)
+      continue;
+
+    kernelFeatures = kernels[i].features;
+    rfb::EncodeManager::setAnalysisFeatures(kernelFeatures);
+
+    printf("\n");
+    printf("Kernel: %s\n", kernels[i].name);
+
+    pf.parse("rgb888");
+    doTests(pf);
+
+    pf.parse("rgb565");
+    doTests(pf);
+
+    pf.parse("rgb332");
+    doTests(pf);
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,236 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <rdr/MemInStream.h>
+#include <rdr/MemOutStream.h>
+
+#include <rfb/Exception.h>
+#include <rfb/H264Constants.h>
+#include <rfb/H264Decoder.h>
+#include <rfb/H264Encoder.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/ServerParams.h>
+
+static const rfb::PixelFormat fbPF(32, 24, false, true,
+                                   255, 255, 255, 0, 8, 16);
+
+static void fill(rfb::ManagedPixelBuffer* pb, int frame)
+{
+  rdr::U32* data;
+  int stride;
+
+  // Smooth content that a lossy codec should reproduce closely
+  data = (rdr::U32*)pb->getBufferRW(pb->getRect(), &stride);
+  for (int y = 0; y < pb->height(); y++) {
+    for (int x = 0; x < pb->width(); x++) {
+      rdr::U8 r, g, b;
+      r = (x + frame * 4) * 255 / (pb->width() + 64);
+      g = y * 255 / pb->height();
+      b = 128;
+      data[x] = r | g << 8 | b << 16;
+    }
+    data += stride;
+  }
+  pb->commitBufferRW(pb->getRect());
+}
+
+static bool matches(const rfb::PixelBuffer* a, const rfb::PixelBuffer* b,
+                    const rfb::Rect& r)
+{
+  const rdr::U8 *pa, *pb;
+  int strideA, strideB;
+  long long diff;
+
+  pa = a->getBuffer(r, &strideA);
+  pb = b->getBuffer(r, &strideB);
+
+  diff = 0;
+  for (int y = 0; y < r.height(); y++) {
+    for (int x = 0; x < r.width() * 4; x++) {
+      if ((x % 4) == 3)
+        continue;
+      diff += abs(pa[y * strideA * 4 + x] - pb[y * strideB * 4 + x]);
+    }
+  }
+
+  // Average error per channel
+  return diff / ((long long)r.area() * 3) < 8;
+}
+
+static bool encode(rfb::H264Encoder* encoder, const rfb::Rect& r,
+                   const rfb::PixelBuffer* pb, rfb::H264Decoder* decoder,
+                   rfb::ModifiablePixelBuffer* client, rdr::U32* flags)
+{
+  rdr::MemOutStream out, buf;
+  rfb::ServerParams server;
+  rdr::U32 length;
+
+  encoder->writeRect(r, pb, &out);
+
+  rdr::MemInStream in(out.data(), out.length());
+  if (!decoder->readRect(r, &in, server, &buf))
+    return false;
+  if (in.avail() != 0)
+    return false;
+
+  rdr::MemInStream header(buf.data(), buf.length());
+  length = header.readU32();
+  *flags = header.readU32();
+
+  decoder->decodeRect(r, buf.data(), buf.length(), server, client);
+
+  return length != 0;
+}
+
+static bool testStreamRect()
+{
+  rfb::H264Encoder encoder;
+  rfb::Rect bounds(0, 0, 1024, 768);
+  rfb::Rect r;
+
+  r = encoder.streamRect(rfb::Rect(64, 64, 448, 320), bounds);
+  if (!r.equals(rfb::Rect(64, 64, 448, 320)))
+    return false;
+
+  // Flickering edges must not change the stream
+  r = encoder.streamRect(rfb::Rect(64, 128, 384, 320), bounds);
+  if (!r.equals(rfb::Rect(64, 64, 448, 320)))
+    return false;
+
+  // Growing covers both
+  r = encoder.streamRect(rfb::Rect(128, 64, 512, 384), bounds);
+  if (!r.equals(rfb::Rect(64, 64, 512, 384)))
+    return false;
+
+  // Much smaller starts over
+  r = encoder.streamRect(rfb::Rect(64, 64, 192, 192), bounds);
+  if (!r.equals(rfb::Rect(64, 64, 192, 192)))
+    return false;
+
+  // So does moving away
+  r = encoder.streamRect(rfb::Rect(512, 512, 640, 640), bounds);
+  if (!r.equals(rfb::Rect(512, 512, 640, 640)))
+    return false;
+
+  // Clipped, and with even dimensions
+  r = encoder.streamRect(rfb::Rect(900, 700, 1101, 801),
+                         rfb::Rect(0, 0, 1001, 767));
+  if (!r.equals(rfb::Rect(900, 700, 1000, 766)))
+    return false;
+
+  return true;
+}
+
+static bool testRoundTrip()
+{
+  rfb::H264Encoder encoder;
+  rfb::H264Decoder decoder;
+  rfb::ManagedPixelBuffer pb(fbPF, 320, 240);
+  rfb::ManagedPixelBuffer client(fbPF, 320, 240);
+  rfb::Rect r(32, 16, 288, 208);
+  rdr::U32 flags;
+  bool started;
+
+  started = false;
+  for (int frame = 0; frame < 10; frame++) {
+    fill(&pb, frame);
+
+    if (!encode(&encoder, r, &pb, &decoder, &client, &flags))
+      continue;
+
+    if (!started && !(flags & rfb::h264ResetContext))
+      return false;
+    if (started && (flags & rfb::h264ResetContext))
+      return false;
+
+    started = true;
+  }
+
+  if (!started)
+    return false;
+
+  if (!matches(&pb, &client, r))
+    return false;
+
+  // A new quality means starting over everywhere
+  encoder.setQualityLevel(2);
+  fill(&pb, 20);
+  if (encode(&encoder, r, &pb, &decoder, &client, &flags) &&
+      !(flags & rfb::h264ResetAllContexts)) {
+    return false;
+  }
+
+  return true;
+}
+
+static bool testOddSize()
+{
+  rfb::H264Encoder encoder;
+  rfb::ManagedPixelBuffer pb(fbPF, 64, 64);
+  rdr::MemOutStream out;
+
+  fill(&pb, 0);
+
+  try {
+    encoder.writeRect(rfb::Rect(0, 0, 63, 64), &pb, &out);
+  } catch (rfb::Exception& e) {
+    return true;
+  }
+
+  return false;
+}
+
+typedef bool (*testfn) ();
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+struct TestEntry tests[] = {
+  {"Stream rect", testStreamRect},
+  {"Round trip", testRoundTrip},
+  {"Odd size", testOddSize},
+};
+
+int main(int argc, char** argv)
+{
+  size_t i;
+  int failures;
+
+  printf("H.264 Encoding Test\n");
+  printf("\n");
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn()) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  return failures ? 1 : 0;
+}
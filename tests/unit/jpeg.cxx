@@ -0,0 +1,249 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+#include <rfb/ClientParams.h>
+#include <rfb/JpegCompressor.h>
+#include <rfb/PixelFormat.h>
+#include <rfb/Rect.h>
+
+// The straightforward way of compressing, by letting libjpeg do the
+// colour conversion and downsampling. JpegCompressor does those
+// itself, and must give exactly the same result.
+
+static void referenceInit(j_compress_ptr cinfo)
+{
+  std::vector<JOCTET>* out = (std::vector<JOCTET>*)cinfo->client_data;
+
+  out->resize(65536);
+  cinfo->dest->next_output_byte = &(*out)[0];
+  cinfo->dest->free_in_buffer = out->size();
+}
+
+static boolean referenceEmpty(j_compress_ptr cinfo)
+{
+  std::vector<JOCTET>* out = (std::vector<JOCTET>*)cinfo->client_data;
+  size_t used;
+
+  used = out->size();
+  out->resize(used * 2);
+  cinfo->dest->next_output_byte = &(*out)[used];
+  cinfo->dest->free_in_buffer = out->size() - used;
+
+  return TRUE;
+}
+
+static void referenceTerm(j_compress_ptr cinfo)
+{
+  std::vector<JOCTET>* out = (std::vector<JOCTET>*)cinfo->client_data;
+
+  out->resize(out->size() - cinfo->dest->free_in_buffer);
+}
+
+static void referenceCompress(const rdr::U8* buf, int stride,
+                              const rfb::Rect& r,
+                              const rfb::PixelFormat& pf,
+                              int quality, int subsamp,
+                              std::vector<JOCTET>* out)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  struct jpeg_destination_mgr dest;
+  std::vector<rdr::U8> rgb;
+  std::vector<JSAMPROW> rows;
+  int w, h;
+
+  w = r.width();
+  h = r.height();
+
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+
+  dest.init_destination = referenceInit;
+  dest.empty_output_buffer = referenceEmpty;
+  dest.term_destination = referenceTerm;
+  cinfo.dest = &dest;
+  cinfo.client_data = out;
+
+  rgb.resize(w * h * 3);
+  pf.rgbFromBuffer(&rgb[0], buf, w, stride, h);
+
+  cinfo.image_width = w;
+  cinfo.image_height = h;
+  cinfo.in_color_space = JCS_RGB;
+  cinfo.input_components = 3;
+
+  jpeg_set_defaults(&cinfo);
+
+  if (quality >= 1 && quality <= 100) {
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    if (quality >= 96)
+      cinfo.dct_method = JDCT_ISLOW;
+    else
+      cinfo.dct_method = JDCT_FASTEST;
+  }
+
+  switch (subsamp) {
+  case rfb::subsample16X:
+  case rfb::subsample8X:
+  case rfb::subsample4X:
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 2;
+    break;
+  case rfb::subsample2X:
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 1;
+    break;
+  case rfb::subsampleGray:
+    jpeg_set_colorspace(&cinfo, JCS_GRAYSCALE);
+    /* fall through */
+  default:
+    cinfo.comp_info[0].h_samp_factor = 1;
+    cinfo.comp_info[0].v_samp_factor = 1;
+  }
+
+  for (int y = 0; y < h; y++)
+    rows.push_back(&rgb[y * w * 3]);
+
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height)
+    jpeg_write_scanlines(&cinfo, &rows[cinfo.next_scanline],
+                         cinfo.image_height - cinfo.next_scanline);
+  jpeg_finish_compress(&cinfo);
+
+  jpeg_destroy_compress(&cinfo);
+}
+
+static const struct {
+  const char* name;
+  rfb::PixelFormat pf;
+} formats[] = {
+  { "BGRX", rfb::PixelFormat(32, 24, false, true, 255, 255, 255, 16, 8, 0) },
+  { "RGBX", rfb::PixelFormat(32, 24, false, true, 255, 255, 255, 0, 8, 16) },
+  { "XRGB", rfb::PixelFormat(32, 24, false, true, 255, 255, 255, 24, 16, 8) },
+  { "BGRX BE", rfb::PixelFormat(32, 24, true, true, 255, 255, 255, 16, 8, 0) },
+  { "RGB565", rfb::PixelFormat(16, 16, false, true, 31, 63, 31, 11, 5, 0) },
+  { "RGB555 BE", rfb::PixelFormat(16, 15, true, true, 31, 31, 31, 10, 5, 0) },
+  { "BGR233", rfb::PixelFormat(8, 8, false, true, 7, 7, 3, 0, 3, 6) },
+};
+
+static const struct {
+  const char* name;
+  int subsamp;
+} subsamplings[] = {
+  { "none", rfb::subsampleNone },
+  { "2X", rfb::subsample2X },
+  { "4X", rfb::subsample4X },
+  { "8X", rfb::subsample8X },
+  { "16X", rfb::subsample16X },
+  { "gray", rfb::subsampleGray },
+};
+
+// Odd sizes make sure the edges are padded the same way
+static const int sizes[][2] = {
+  { 1, 1 }, { 2, 2 }, { 7, 3 }, { 8, 8 }, { 15, 17 }, { 16, 16 },
+  { 17, 9 }, { 33, 31 }, { 64, 64 }, { 129, 71 },
+};
+
+static const int qualities[] = { -1, 15, 62, 92, 100 };
+
+static void fillImage(std::vector<rdr::U8>* image)
+{
+  srand(7);
+
+  // A mix of noise and smooth areas
+  for (size_t i = 0; i < image->size(); i++) {
+    if ((i % 97) < 50)
+      (*image)[i] = rand();
+    else
+      (*image)[i] = (i / 13) & 0xff;
+  }
+}
+
+static bool testFormat(const rfb::PixelFormat& pf, int subsamp,
+                       const std::vector<rdr::U8>& image)
+{
+  rfb::JpegCompressor jc;
+
+  for (size_t si = 0; si < sizeof(sizes)/sizeof(*sizes); si++) {
+    for (size_t qi = 0; qi < sizeof(qualities)/sizeof(*qualities); qi++) {
+      rfb::Rect r(0, 0, sizes[si][0], sizes[si][1]);
+      std::vector<JOCTET> expected;
+      const rdr::U8* buf;
+      int stride;
+
+      // A stride wider than the rect, and not aligned
+      stride = r.width() + 3;
+      buf = &image[5 * (pf.bpp/8)];
+
+      referenceCompress(buf, stride, r, pf, qualities[qi], subsamp,
+                        &expected);
+
+      jc.clear();
+      jc.compress(buf, stride, r, pf, qualities[qi], subsamp);
+
+      if (jc.length() != expected.size())
+        return false;
+      if (memcmp(jc.data(), &expected[0], expected.size()) != 0)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<rdr::U8> image(256 * 256 * 4);
+  int failures;
+
+  fillImage(&image);
+
+  printf("JPEG Compression Test\n");
+
+  failures = 0;
+
+  for (size_t ss = 0; ss < sizeof(subsamplings)/sizeof(*subsamplings); ss++) {
+    printf("\n");
+    printf("Subsampling %s\n", subsamplings[ss].name);
+    printf("\n");
+
+    for (size_t fi = 0; fi < sizeof(formats)/sizeof(*formats); fi++) {
+      printf("    %s: ", formats[fi].name);
+      fflush(stdout);
+      if (testFormat(formats[fi].pf, subsamplings[ss].subsamp, image)) {
+        printf("OK");
+      } else {
+        printf("FAILED");
+        failures++;
+      }
+      printf("\n");
+    }
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,278 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <list>
+#include <vector>
+
+#include <network/QuicSocket.h>
+#include <rdr/Exception.h>
+#include <rfb/Configuration.h>
+
+static struct sockaddr_in makeAddr(const char* ip, int port)
+{
+  struct sockaddr_in sin;
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(port);
+  inet_pton(AF_INET, ip, &sin.sin_addr);
+
+  return sin;
+}
+
+static bool testToken()
+{
+  network::QuicTokenSigner signer, other;
+  struct sockaddr_in peer, wrongPort, wrongHost;
+  const struct sockaddr* sa;
+  uint8_t odcid[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+  uint8_t token[256], copy[256];
+  uint8_t out[20];
+  size_t len, outLen;
+  const uint64_t now = 1000;
+
+  peer = makeAddr("192.0.2.1", 5900);
+  wrongPort = makeAddr("192.0.2.1", 5901);
+  wrongHost = makeAddr("192.0.2.2", 5900);
+  sa = (const struct sockaddr*)&peer;
+
+  len = signer.create(sa, sizeof(peer), odcid, sizeof(odcid), now,
+                      token, sizeof(token));
+  if (len == 0)
+    return false;
+
+  if (!signer.validate(token, len, sa, sizeof(peer), now, out, &outLen) ||
+      (outLen != sizeof(odcid)) || (memcmp(out, odcid, outLen) != 0)) {
+    return false;
+  }
+
+  if (signer.validate(token, len, (const struct sockaddr*)&wrongPort,
+                      sizeof(wrongPort), now, out, &outLen) ||
+      signer.validate(token, len, (const struct sockaddr*)&wrongHost,
+                      sizeof(wrongHost), now, out, &outLen)) {
+    return false;
+  }
+
+  if (other.validate(token, len, sa, sizeof(peer), now, out, &outLen))
+    return false;
+
+  for (size_t i = 0; i < len; i++) {
+    memcpy(copy, token, len);
+    copy[i] ^= 0x01;
+    if (signer.validate(copy, len, sa, sizeof(peer), now, out, &outLen))
+      return false;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    if (signer.validate(token, i, sa, sizeof(peer), now, out, &outLen))
+      return false;
+  }
+
+  if (!signer.validate(token, len, sa, sizeof(peer),
+                       now + network::QuicTokenSigner::Lifetime,
+                       out, &outLen)) {
+    return false;
+  }
+  if (signer.validate(token, len, sa, sizeof(peer),
+                      now + network::QuicTokenSigner::Lifetime + 1,
+                      out, &outLen)) {
+    return false;
+  }
+  if (signer.validate(token, len, sa, sizeof(peer), now - 1,
+                      out, &outLen)) {
+    return false;
+  }
+
+  if (signer.create(sa, sizeof(peer), odcid, sizeof(odcid), now,
+                    token, len - 1) != 0) {
+    return false;
+  }
+
+  return true;
+}
+
+static bool transfer(int a, int b, size_t size)
+{
+  std::vector<unsigned char> data, received[2];
+  size_t sent[2];
+
+  data.resize(size);
+  for (size_t i = 0; i < size; i++)
+    data[i] = i * 7 + i / 251;
+
+  sent[0] = sent[1] = 0;
+
+  while ((received[0].size() < size) || (received[1].size() < size)) {
+    struct pollfd fds[2];
+    int ret;
+
+    fds[0].fd = a;
+    fds[1].fd = b;
+    for (int i = 0; i < 2; i++) {
+      fds[i].events = POLLIN;
+      if (sent[i] < size)
+        fds[i].events |= POLLOUT;
+    }
+
+    ret = poll(fds, 2, 10000);
+    if (ret <= 0)
+      return false;
+
+    for (int i = 0; i < 2; i++) {
+      unsigned char buf[65536];
+      ssize_t len;
+
+      if (fds[i].revents & POLLOUT) {
+        len = write(fds[i].fd, &data[sent[i]], size - sent[i]);
+        if (len > 0)
+          sent[i] += len;
+        else if ((len < 0) && (errno != EAGAIN))
+          return false;
+      }
+
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        len = read(fds[i].fd, buf, sizeof(buf));
+        if (len <= 0)
+          return false;
+        received[i].insert(received[i].end(), buf, buf + len);
+      }
+    }
+  }
+
+  return (received[0] == data) && (received[1] == data);
+}
+
+static bool testConnection()
+{
+  std::list<network::SocketListener*> listeners;
+  network::SocketListener* listener;
+  network::Socket* client;
+  network::Socket* server;
+  struct pollfd pfd;
+  char cert[1024], key[1024];
+
+  snprintf(cert, sizeof(cert), "%s/quic-cert.pem", TEST_DIR);
+  snprintf(key, sizeof(key), "%s/quic-key.pem", TEST_DIR);
+
+  rfb::Configuration::setParam("QUICCert", cert);
+  rfb::Configuration::setParam("QUICKey", key);
+
+  try {
+    network::createQuicListeners(&listeners, "127.0.0.1", 0);
+  } catch (rdr::Exception& e) {
+    return false;
+  }
+
+  listener = listeners.front();
+
+  // The handshake includes a Retry, so this also checks that the
+  // server accepts its own tokens
+  try {
+    client = new network::QuicSocket("127.0.0.1", listener->getMyPort());
+  } catch (rdr::Exception& e) {
+    delete listener;
+    return false;
+  }
+
+  pfd.fd = listener->getFd();
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 10000) != 1) {
+    delete client;
+    delete listener;
+    return false;
+  }
+
+  server = listener->accept();
+  if (server == NULL) {
+    delete client;
+    delete listener;
+    return false;
+  }
+
+  // More than the flow control windows, to make sure data keeps
+  // flowing in both directions
+  if (!transfer(client->getFd(), server->getFd(), 20 * 1024 * 1024)) {
+    delete server;
+    delete client;
+    delete listener;
+    return false;
+  }
+
+  delete client;
+
+  // The server should see the connection go away
+  pfd.fd = server->getFd();
+  pfd.events = POLLIN;
+  if ((poll(&pfd, 1, 10000) != 1) ||
+      (read(server->getFd(), &pfd, 1) != 0)) {
+    delete server;
+    delete listener;
+    return false;
+  }
+
+  delete server;
+  delete listener;
+
+  return true;
+}
+
+typedef bool (*testfn) ();
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+struct TestEntry tests[] = {
+  {"Token", testToken},
+  {"Connection", testConnection},
+};
+
+int main(int argc, char** argv)
+{
+  size_t i;
+  int failures;
+
+  rfb::Configuration::enableServerParams();
+
+  printf("QUIC Transport Test\n");
+  printf("\n");
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn()) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,250 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <string>
+
+#include <rdr/Exception.h>
+#include <rdr/FdOutStream.h>
+#include <rdr/SendBatch.h>
+
+typedef bool (*testfn) (rdr::SendBatch*);
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+struct Connection {
+  Connection(rdr::SendBatch* batch) : os(NULL) {
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+      throw rdr::SystemException("socketpair", errno);
+
+    os = new rdr::FdOutStream(fds[0]);
+    peer = fds[1];
+
+    os->setBatch(batch);
+  }
+
+  ~Connection() {
+    int fd;
+
+    fd = os->getFd();
+    delete os;
+    close(fd);
+    if (peer != -1)
+      close(peer);
+  }
+
+  // Everything the other end has got so far
+  std::string received() {
+    std::string data;
+    char buffer[4096];
+    ssize_t len;
+
+    while ((len = recv(peer, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+      data.append(buffer, len);
+
+    return data;
+  }
+
+  rdr::FdOutStream* os;
+  int peer;
+};
+
+static std::string makeData(size_t length)
+{
+  std::string data;
+
+  for (size_t i = 0; i < length; i++)
+    data += (char)(i * 7 + i / 251);
+
+  return data;
+}
+
+static bool testFlush(rdr::SendBatch* batch)
+{
+  Connection a(batch), b(batch);
+  std::string dataA, dataB;
+
+  dataA = makeData(1000);
+  dataB = makeData(3000);
+
+  a.os->writeBytes(dataA.data(), dataA.size());
+  a.os->flush();
+  b.os->cork(true);
+  b.os->writeBytes(dataB.data(), dataB.size());
+  b.os->cork(false);
+  b.os->flush();
+
+  // Nothing may be sent until the batch is
+  if (!a.received().empty() || !b.received().empty())
+    return false;
+  if (!a.os->hasBufferedData() || !b.os->hasBufferedData())
+    return false;
+
+  batch->flush();
+
+  if (a.received() != dataA)
+    return false;
+  if (b.received() != dataB)
+    return false;
+  if (a.os->hasBufferedData() || b.os->hasBufferedData())
+    return false;
+
+  return true;
+}
+
+static bool testOrder(rdr::SendBatch* batch)
+{
+  Connection conn(batch);
+  std::string data, got;
+
+  data = makeData(5000);
+
+  for (size_t i = 0; i < data.size(); i += 500) {
+    conn.os->writeBytes(data.data() + i, 500);
+    conn.os->flush();
+    if (i % 1500 == 0)
+      batch->flush();
+    got += conn.received();
+  }
+
+  batch->flush();
+  got += conn.received();
+
+  return got == data;
+}
+
+static bool testOverrun(rdr::SendBatch* batch)
+{
+  Connection conn(batch);
+  std::string data, got;
+
+  // Much more than fits in the buffer
+  data = makeData(100000);
+
+  conn.os->writeBytes(data.data(), data.size());
+
+  // A full buffer must not wait for the batch
+  got = conn.received();
+  if (got.empty())
+    return false;
+
+  conn.os->flush();
+  while (conn.os->hasBufferedData()) {
+    batch->flush();
+    got += conn.received();
+  }
+
+  return got == data;
+}
+
+static bool testDetach(rdr::SendBatch* batch)
+{
+  Connection conn(batch);
+  std::string data;
+
+  data = makeData(2000);
+
+  conn.os->writeBytes(data.data(), data.size());
+  conn.os->flush();
+
+  // Detaching is how the data is sent right away, e.g. on close
+  conn.os->setBatch(NULL);
+  conn.os->flush();
+
+  if (conn.received() != data)
+    return false;
+
+  // Nothing left for the batch
+  batch->flush();
+  if (!conn.received().empty())
+    return false;
+
+  return true;
+}
+
+static bool testError(rdr::SendBatch* batch)
+{
+  Connection conn(batch);
+  std::string data;
+
+  data = makeData(1000);
+
+  close(conn.peer);
+  conn.peer = -1;
+
+  conn.os->writeBytes(data.data(), data.size());
+  conn.os->flush();
+
+  batch->flush();
+
+  // The batch has nobody to report to, so it is up to the next flush
+  try {
+    conn.os->flush();
+  } catch (rdr::SystemException& e) {
+    return e.err == EPIPE;
+  }
+
+  return false;
+}
+
+struct TestEntry tests[] = {
+  {"Flush waits for batch", testFlush},
+  {"Data order", testOrder},
+  {"Full buffer", testOverrun},
+  {"Detached stream", testDetach},
+  {"Send error", testError},
+};
+
+int main(int argc, char** argv)
+{
+  rdr::SendBatch batch;
+  size_t i;
+  int failures;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("Send Batch Test\n");
+  printf("\n");
+  printf("io_uring: %s\n", batch.hasRing() ? "yes" : "no");
+  printf("\n");
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn(&batch)) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  return failures ? 1 : 0;
+}
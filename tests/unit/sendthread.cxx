@@ -0,0 +1,335 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <string>
+
+#include <rdr/Exception.h>
+#include <rdr/FdOutStream.h>
+#include <rdr/MemOutStream.h>
+#include <rdr/SendThread.h>
+
+typedef bool (*testfn) (rdr::SendThread*);
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+struct Connection {
+  Connection(rdr::SendThread* thread) : os(NULL) {
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+      throw rdr::SystemException("socketpair", errno);
+
+    os = new rdr::FdOutStream(fds[0]);
+    peer = fds[1];
+
+    os->setSendThread(thread);
+  }
+
+  ~Connection() {
+    int fd;
+
+    fd = os->getFd();
+    delete os;
+    close(fd);
+    if (peer != -1)
+      close(peer);
+  }
+
+  // Everything the other end has got so far
+  std::string received() {
+    std::string data;
+    char buffer[65536];
+    ssize_t len;
+
+    while ((len = recv(peer, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+      data.append(buffer, len);
+
+    return data;
+  }
+
+  // Reads until the given amount of data has arrived, or nothing has
+  // happened for a while
+  std::string receive(std::string got, size_t length) {
+    while (got.size() < length) {
+      struct pollfd pfd;
+
+      pfd.fd = peer;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, 1000) <= 0)
+        break;
+
+      got += received();
+    }
+
+    return got;
+  }
+
+  rdr::FdOutStream* os;
+  int peer;
+};
+
+static std::string makeData(size_t length, int seed)
+{
+  std::string data;
+
+  for (size_t i = 0; i < length; i++)
+    data += (char)(i * 7 + i / 251 + seed);
+
+  return data;
+}
+
+static void writeLarge(rdr::OutStream* os, const std::string& data)
+{
+  rdr::MemOutStream ms;
+
+  ms.writeBytes(data.data(), data.size());
+  ms.writeTo(os);
+}
+
+// Waits for the thread to say that it is done with something
+static bool waitNotify(rdr::SendThread* thread)
+{
+  struct pollfd pfd;
+
+  pfd.fd = thread->getNotifyFd();
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 1000) <= 0)
+    return false;
+
+  thread->clearNotify();
+
+  return true;
+}
+
+static bool testHandOver(rdr::SendThread* thread)
+{
+  Connection conn(thread);
+  std::string data;
+
+  data = makeData(5000, 0);
+
+  conn.os->writeBytes(data.data(), data.size());
+  conn.os->flush();
+
+  if (conn.receive("", data.size()) != data)
+    return false;
+
+  // Sent everything, so we should hear about it
+  if (!waitNotify(thread))
+    return false;
+  if (conn.os->hasBufferedData())
+    return false;
+
+  return true;
+}
+
+static bool testOrder(rdr::SendThread* thread)
+{
+  Connection conn(thread);
+  std::string expected, got, data;
+
+  srand(1);
+
+  for (int i = 0; i < 500; i++) {
+    conn.os->cork(true);
+    if (rand() % 4 == 0) {
+      data = makeData(rand() % 100000, i);
+      writeLarge(conn.os, data);
+    } else {
+      data = makeData(rand() % 300, i);
+      conn.os->writeBytes(data.data(), data.size());
+    }
+    expected += data;
+    conn.os->cork(false);
+
+    if (conn.os->length() != expected.size())
+      return false;
+
+    if (rand() % 3 == 0)
+      got += conn.received();
+  }
+
+  conn.os->flush();
+
+  return conn.receive(got, expected.size()) == expected;
+}
+
+static bool testStreams(rdr::SendThread* thread)
+{
+  static const int count = 10;
+  Connection* conns[count];
+  std::string expected[count], got[count];
+  bool ok;
+
+  for (int i = 0; i < count; i++)
+    conns[i] = new Connection(thread);
+
+  for (int i = 0; i < 200; i++) {
+    std::string data;
+    int n;
+
+    n = i % count;
+
+    data = makeData(10 + i * 97 % 20000, i);
+    conns[n]->os->writeBytes(data.data(), data.size());
+    conns[n]->os->flush();
+    expected[n] += data;
+
+    got[(i * 3) % count] += conns[(i * 3) % count]->received();
+  }
+
+  ok = true;
+  for (int i = 0; i < count; i++) {
+    if (conns[i]->receive(got[i], expected[i].size()) != expected[i])
+      ok = false;
+  }
+
+  for (int i = 0; i < count; i++)
+    delete conns[i];
+
+  return ok;
+}
+
+static bool testTakeBack(rdr::SendThread* thread)
+{
+  Connection conn(thread);
+  std::string expected, got, data;
+
+  // Far more than the socket can hold, so the thread gets stuck
+  for (int i = 0; i < 10; i++) {
+    data = makeData(500000, i);
+    writeLarge(conn.os, data);
+    expected += data;
+    data = makeData(100, i);
+    conn.os->writeBytes(data.data(), data.size());
+    expected += data;
+    conn.os->flush();
+  }
+
+  usleep(10000);
+
+  // Whatever the thread didn't get to comes back to us
+  conn.os->setSendThread(NULL);
+  if (!conn.os->hasBufferedData())
+    return false;
+
+  data = makeData(1000, 99);
+  conn.os->writeBytes(data.data(), data.size());
+  expected += data;
+
+  while (conn.os->hasBufferedData() || (got.size() < expected.size())) {
+    struct pollfd pfds[2];
+
+    conn.os->flush();
+    got += conn.received();
+
+    if (!conn.os->hasBufferedData() && (got.size() >= expected.size()))
+      break;
+
+    pfds[0].fd = conn.peer;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = conn.os->getFd();
+    pfds[1].events = conn.os->hasBufferedData() ? POLLOUT : 0;
+    if (poll(pfds, 2, 1000) <= 0)
+      break;
+  }
+
+  return got == expected;
+}
+
+static bool testError(rdr::SendThread* thread)
+{
+  Connection conn(thread);
+  std::string data;
+
+  data = makeData(1000, 0);
+
+  close(conn.peer);
+  conn.peer = -1;
+
+  // The thread might fail before we are done handing over, otherwise
+  // it can only tell us that something happened and leave it to our
+  // next flush
+  try {
+    conn.os->writeBytes(data.data(), data.size());
+    conn.os->flush();
+
+    if (!waitNotify(thread))
+      return false;
+    if (!conn.os->hasBufferedData())
+      return false;
+
+    conn.os->flush();
+  } catch (rdr::SystemException& e) {
+    return e.err == EPIPE;
+  }
+
+  return false;
+}
+
+struct TestEntry tests[] = {
+  {"Hand over", testHandOver},
+  {"Data order", testOrder},
+  {"Several streams", testStreams},
+  {"Taken back", testTakeBack},
+  {"Send error", testError},
+};
+
+int main(int argc, char** argv)
+{
+  rdr::SendThread* thread;
+  size_t i;
+  int failures;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("Send Thread Test\n");
+  printf("\n");
+
+  thread = new rdr::SendThread();
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn(thread)) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+
+    thread->clearNotify();
+  }
+
+  delete thread;
+
+  return failures ? 1 : 0;
+}
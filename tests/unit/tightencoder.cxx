@@ -0,0 +1,328 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include <rdr/MemOutStream.h>
+#include <rfb/EncodeCache.h>
+#include <rfb/EncodeManager.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/SConnection.h>
+#include <rfb/SMsgWriter.h>
+#include <rfb/ServerCore.h>
+#include <rfb/UpdateTracker.h>
+#include <rfb/encodings.h>
+
+static const int fbWidth = 1000;
+static const int fbHeight = 700;
+
+// The zlib streams carry state from one rect to the next, so the
+// threaded compression is only correct if it gives exactly the same
+// bytes as doing everything in order on a single thread
+
+class TestConnection : public rfb::SConnection {
+public:
+  TestConnection(const rdr::S32* encodings, int count,
+                 const rfb::PixelFormat& pf,
+                 rfb::EncodeCache* cache=NULL)
+  {
+    setStreams(NULL, &out);
+    setWriter(new rfb::SMsgWriter(&client, &out));
+    client.setPF(pf);
+    setEncodings(count, encodings);
+    manager = new rfb::EncodeManager(this, cache);
+  }
+
+  ~TestConnection()
+  {
+    delete manager;
+  }
+
+  virtual void setDesktopSize(int fb_width, int fb_height,
+                              const rfb::ScreenSet& layout) {}
+
+  std::string data() {
+    return std::string((const char*)out.data(), out.length());
+  }
+
+  rdr::MemOutStream out;
+  rfb::EncodeManager* manager;
+};
+
+static const rdr::S32 losslessEncodings[] = {
+  rfb::encodingTight, rfb::pseudoEncodingCompressLevel0 + 2,
+  rfb::pseudoEncodingLastRect,
+};
+
+static const rdr::S32 jpegEncodings[] = {
+  rfb::encodingTight, rfb::pseudoEncodingQualityLevel0 + 6,
+  rfb::pseudoEncodingCompressLevel0 + 1, rfb::pseudoEncodingLastRect,
+};
+
+static const rdr::S32 highLevelEncodings[] = {
+  rfb::encodingTight, rfb::pseudoEncodingCompressLevel0 + 9,
+};
+
+static const struct {
+  const char* name;
+  const rdr::S32* encodings;
+  int count;
+} encodingSets[] = {
+  { "Lossless", losslessEncodings,
+    sizeof(losslessEncodings)/sizeof(losslessEncodings[0]) },
+  { "JPEG", jpegEncodings,
+    sizeof(jpegEncodings)/sizeof(jpegEncodings[0]) },
+  { "Compression level 9", highLevelEncodings,
+    sizeof(highLevelEncodings)/sizeof(highLevelEncodings[0]) },
+};
+
+class TestFramebuffer : public rfb::ManagedPixelBuffer {
+public:
+  TestFramebuffer()
+    : rfb::ManagedPixelBuffer(rfb::PixelFormat(32, 24, false, true,
+                                               255, 255, 255, 16, 8, 0),
+                              fbWidth, fbHeight) {}
+
+  // Content that makes Tight use all of its zlib streams: solid
+  // areas, two colour text, indexed colours, gradients and noise
+  void fill(int seed) {
+    rdr::U32* buffer;
+    int stride;
+
+    buffer = (rdr::U32*)getBufferRW(getRect(), &stride);
+
+    srand(seed);
+
+    for (int y = 0; y < height(); y++) {
+      for (int x = 0; x < width(); x++) {
+        rdr::U32 pixel;
+
+        if (y < height() / 5)
+          pixel = 0x336699;
+        else if (y < height() * 2 / 5)
+          pixel = ((x / 7 + y / 5 + seed) % 3) ? 0xffffff : 0x000000;
+        else if (y < height() * 3 / 5)
+          pixel = 0x102030 * ((x / 3 + y / 4 + seed) % 9);
+        else if (y < height() * 4 / 5)
+          pixel = ((x * 255 / width()) << 16) |
+                  ((y * 255 / height()) << 8) | (seed * 37 & 0xff);
+        else
+          pixel = rand() & 0xffffff;
+
+        buffer[x + y * stride] = pixel;
+      }
+    }
+
+    commitBufferRW(getRect());
+  }
+};
+
+static rfb::Region changedRegion(int update)
+{
+  switch (update % 3) {
+  case 0:
+    return rfb::Region(rfb::Rect(0, 0, fbWidth, fbHeight));
+  case 1:
+    return rfb::Region(rfb::Rect(13, 17, 800, 600));
+  default:
+    rfb::Region region;
+    for (int i = 0; i < 10; i++)
+      region.assign_union(rfb::Region(rfb::Rect(i * 97, i * 61,
+                                                i * 97 + 50 + i * 3,
+                                                i * 61 + 40 + i * 5)));
+    return region;
+  }
+}
+
+// Runs a series of updates and gives back everything that was sent
+static std::string encode(const rdr::S32* encodings, int count,
+                          const rfb::PixelFormat& pf, int threads,
+                          int updates, bool refresh)
+{
+  TestFramebuffer fb;
+
+  rfb::Server::encodeThreads.setParam(threads);
+
+  TestConnection conn(encodings, count, pf);
+
+  for (int i = 0; i < updates; i++) {
+    rfb::UpdateInfo ui;
+
+    fb.fill(i);
+
+    ui.changed = changedRegion(i);
+    conn.manager->writeUpdate(ui, &fb, NULL);
+  }
+
+  if (refresh)
+    conn.manager->writeLosslessRefresh(fb.getRect(), &fb, NULL, 2000000);
+
+  return conn.data();
+}
+
+// Same thing, but for two clients sharing an encode cache
+static std::string encodeCached(const rdr::S32* encodings, int count,
+                                const rfb::PixelFormat& pf, int threads,
+                                int updates)
+{
+  TestFramebuffer fb;
+  rfb::EncodeCache cache;
+
+  rfb::Server::encodeThreads.setParam(threads);
+
+  cache.setPixelBuffer(&fb);
+  cache.setEnabled(true);
+
+  TestConnection first(encodings, count, pf, &cache);
+  TestConnection second(encodings, count, pf, &cache);
+
+  for (int i = 0; i < updates; i++) {
+    rfb::UpdateInfo ui;
+
+    fb.fill(i);
+    cache.invalidate(fb.getRect());
+
+    ui.changed = changedRegion(i);
+    first.manager->writeUpdate(ui, &fb, NULL);
+    second.manager->writeUpdate(ui, &fb, NULL);
+  }
+
+  if (first.data() != second.data())
+    return "";
+
+  return second.data();
+}
+
+static bool checkEncode(const rfb::PixelFormat& pf, int updates,
+                        bool refresh)
+{
+  for (size_t i = 0;i < sizeof(encodingSets)/sizeof(encodingSets[0]);i++) {
+    std::string expected;
+
+    expected = encode(encodingSets[i].encodings, encodingSets[i].count,
+                      pf, 0, updates, refresh);
+
+    for (int threads = 1; threads <= 4; threads++) {
+      if (encode(encodingSets[i].encodings, encodingSets[i].count,
+                 pf, threads, updates, refresh) != expected)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+static bool testSingle(const rfb::PixelFormat& pf)
+{
+  return checkEncode(pf, 1, false);
+}
+
+static bool testSeries(const rfb::PixelFormat& pf)
+{
+  // The stream state has to survive from one update to the next
+  return checkEncode(pf, 6, false);
+}
+
+static bool testRefresh(const rfb::PixelFormat& pf)
+{
+  return checkEncode(pf, 2, true);
+}
+
+static bool testCache(const rfb::PixelFormat& pf)
+{
+  for (size_t i = 0;i < sizeof(encodingSets)/sizeof(encodingSets[0]);i++) {
+    std::string expected;
+
+    expected = encode(encodingSets[i].encodings, encodingSets[i].count,
+                      pf, 0, 4, false);
+
+    for (int threads = 0; threads <= 2; threads++) {
+      if (encodeCached(encodingSets[i].encodings, encodingSets[i].count,
+                       pf, threads, 4) != expected)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+typedef bool (*testfn) (const rfb::PixelFormat&);
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+struct TestEntry tests[] = {
+  {"Single update", testSingle},
+  {"Several updates", testSeries},
+  {"Lossless refresh", testRefresh},
+  {"Shared encode cache", testCache},
+};
+
+static int doTests(const rfb::PixelFormat &pf)
+{
+  size_t i;
+  char desc[256];
+  int failures;
+
+  pf.print(desc, sizeof(desc));
+
+  printf("\n");
+  printf("%s\n", desc);
+  printf("\n");
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn(pf)) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  return failures;
+}
+
+int main(int argc, char **argv)
+{
+  rfb::PixelFormat pf;
+  int failures;
+
+  printf("Threaded Tight Encoder Test\n");
+
+  failures = 0;
+
+  pf.parse("rgb888");
+  failures += doTests(pf);
+
+  pf.parse("rgb565");
+  failures += doTests(pf);
+
+  pf.parse("rgb332");
+  failures += doTests(pf);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <rfb/PixelBuffer.h>
+#include <rfb/TileCache.h>
+
+static const rfb::PixelFormat fbPF(32, 24, false, true,
+                                   255, 255, 255, 0, 8, 16);
+
+static void fill(rfb::ManagedPixelBuffer* pb, const rfb::Rect& r,
+                 rdr::U32 seed)
+{
+  rdr::U32* data;
+  int stride;
+
+  data = (rdr::U32*)pb->getBufferRW(r, &stride);
+  for (int y = 0; y < r.height(); y++) {
+    for (int x = 0; x < r.width(); x++) {
+      seed = seed * 1103515245 + 12345;
+      data[x] = seed >> 8;
+    }
+    data += stride;
+  }
+  pb->commitBufferRW(r);
+}
+
+static bool testHit()
+{
+  rfb::ManagedPixelBuffer pb(fbPF, 256, 256);
+  rfb::TileCache cache;
+  rfb::Rect r(10, 20, 74, 84);
+  rdr::U64 key;
+  const rfb::PixelBuffer* stored;
+
+  fill(&pb, pb.getRect(), 1);
+
+  key = rfb::TileCache::hashRect(&pb, r, 0);
+  cache.insert(key, r.width(), r.height(), &pb, r);
+
+  if (!cache.lookupRect(key, &pb, r))
+    return false;
+
+  // Same content elsewhere must give the same key and match
+  pb.copyRect(rfb::Rect(100, 100, 164, 164), rfb::Point(90, 80));
+  if (rfb::TileCache::hashRect(&pb, rfb::Rect(100, 100, 164, 164), 0) != key)
+    return false;
+  if (!cache.lookupRect(key, &pb, rfb::Rect(100, 100, 164, 164)))
+    return false;
+
+  stored = NULL;
+  if (!cache.lookup(key, r.width(), r.height(), &stored) || (stored == NULL))
+    return false;
+
+  for (int y = 0; y < r.height(); y++) {
+    const rdr::U8 *a, *b;
+    int strideA, strideB;
+
+    a = pb.getBuffer(rfb::Rect(r.tl.x, r.tl.y + y, r.br.x, r.tl.y + y + 1),
+                     &strideA);
+    b = stored->getBuffer(rfb::Rect(0, y, r.width(), y + 1), &strideB);
+    if (memcmp(a, b, r.width() * 4) != 0)
+      return false;
+  }
+
+  return true;
+}
+
+static bool testMiss()
+{
+  rfb::ManagedPixelBuffer pb(fbPF, 256, 256);
+  rfb::TileCache cache;
+  rfb::Rect r(0, 0, 64, 64);
+  rdr::U64 key;
+
+  fill(&pb, pb.getRect(), 2);
+
+  key = rfb::TileCache::hashRect(&pb, r, 0);
+
+  if (cache.lookupRect(key, &pb, r))
+    return false;
+
+  cache.insert(key, r.width(), r.height(), &pb, r);
+
+  if (cache.lookup(key, 64, 32))
+    return false;
+  if (cache.lookupRect(key, &pb, rfb::Rect(0, 0, 64, 32)))
+    return false;
+  if (cache.lookupRect(key + 1, &pb, r))
+    return false;
+  if (rfb::TileCache::hashRect(&pb, r, 1) == key)
+    return false;
+
+  return true;
+}
+
+static bool testCollision()
+{
+  rfb::ManagedPixelBuffer pb(fbPF, 256, 256);
+  rfb::TileCache cache;
+  rfb::Rect r(0, 0, 64, 64);
+  rdr::U64 key;
+
+  fill(&pb, pb.getRect(), 3);
+
+  key = rfb::TileCache::hashRect(&pb, r, 0);
+  cache.insert(key, r.width(), r.height(), &pb, r);
+
+  // Pretend that different content ended up with the same key
+  if (cache.lookupRect(key, &pb, rfb::Rect(64, 0, 128, 64)))
+    return false;
+
+  // A single changed pixel must also be caught
+  fill(&pb, rfb::Rect(63, 63, 64, 64), 4);
+  if (cache.lookupRect(key, &pb, r))
+    return false;
+
+  // The new content replaces the entry, as it would after a store
+  cache.insert(key, r.width(), r.height(), &pb, r);
+  if (!cache.lookupRect(key, &pb, r))
+    return false;
+
+  // Entries without pixels can never be verified
+  cache.insert(key, r.width(), r.height());
+  if (cache.lookupRect(key, &pb, r))
+    return false;
+
+  return true;
+}
+
+static bool testEviction()
+{
+  rfb::ManagedPixelBuffer pb(fbPF, 1024, 1024);
+  rfb::TileCache cache;
+  rfb::Rect r(0, 0, 1024, 1024);
+  size_t count;
+
+  fill(&pb, r, 5);
+
+  count = rfb::TileCache::MaxPixels / r.area();
+
+  // Fill the cache exactly
+  for (size_t i = 0; i < count; i++)
+    cache.insert(i, r.width(), r.height(), &pb, r);
+
+  for (size_t i = 0; i < count; i++) {
+    if (!cache.lookupRect(i, &pb, r))
+      return false;
+  }
+
+  // Touch the oldest so that the second oldest goes first
+  cache.lookupRect(0, &pb, r);
+  cache.insert(count, r.width(), r.height(), &pb, r);
+
+  if (!cache.lookupRect(0, &pb, r))
+    return false;
+  if (cache.lookupRect(1, &pb, r))
+    return false;
+  if (!cache.lookupRect(count, &pb, r))
+    return false;
+
+  // A failed verification must not count as a use, or the two ends
+  // would disagree on what to evict next
+  fill(&pb, rfb::Rect(0, 0, 1, 1), 6);
+  cache.lookupRect(2, &pb, r);
+  cache.insert(count + 1, r.width(), r.height());
+  if (cache.lookup(2, r.width(), r.height()))
+    return false;
+
+  // Too large to ever fit
+  cache.insert(count + 2, 4096, 2048);
+  if (cache.lookup(count + 2, 4096, 2048))
+    return false;
+  if (!cache.lookup(0, r.width(), r.height()))
+    return false;
+
+  return true;
+}
+
+typedef bool (*testfn) ();
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+struct TestEntry tests[] = {
+  {"Hit", testHit},
+  {"Miss", testMiss},
+  {"Collision", testCollision},
+  {"Eviction", testEviction},
+};
+
+int main(int argc, char** argv)
+{
+  size_t i;
+  int failures;
+
+  printf("Tile Cache Test\n");
+  printf("\n");
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn()) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,409 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <string>
+
+#include <gnutls/gnutls.h>
+
+#include <rdr/Exception.h>
+#include <rdr/FdInStream.h>
+#include <rdr/FdOutStream.h>
+#include <rdr/MemOutStream.h>
+#include <rdr/TLSInStream.h>
+#include <rdr/TLSOutStream.h>
+#include <rfb/Security.h>
+
+typedef bool (*testfn) ();
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+// Anonymous credentials aren't allowed with TLS 1.3, so use a
+// pre-shared key for both versions
+static const char* tls12 = "NORMAL:-VERS-ALL:+VERS-TLS1.2:+ECDHE-PSK:+PSK";
+static const char* tls13 = "NORMAL:-VERS-ALL:+VERS-TLS1.3:+ECDHE-PSK:+PSK";
+
+static unsigned char pskData[] = "not very secret";
+static const gnutls_datum_t psk = { pskData, sizeof(pskData) - 1 };
+
+static int serverPSK(gnutls_session_t session, const char* username,
+                     gnutls_datum_t* key)
+{
+  key->data = (unsigned char*)gnutls_malloc(psk.size);
+  if (key->data == NULL)
+    return -1;
+  memcpy(key->data, psk.data, psk.size);
+  key->size = psk.size;
+  return 0;
+}
+
+struct Endpoint {
+  Endpoint(int fd_, bool server) : fd(fd_) {
+    gnutls_init(&session, server ? GNUTLS_SERVER : GNUTLS_CLIENT);
+
+    if (server) {
+      gnutls_psk_allocate_server_credentials(&serverCred);
+      gnutls_psk_set_server_credentials_function(serverCred, serverPSK);
+      gnutls_credentials_set(session, GNUTLS_CRD_PSK, serverCred);
+    } else {
+      gnutls_psk_allocate_client_credentials(&clientCred);
+      gnutls_psk_set_client_credentials(clientCred, "test", &psk,
+                                        GNUTLS_PSK_KEY_RAW);
+      gnutls_credentials_set(session, GNUTLS_CRD_PSK, clientCred);
+    }
+
+    fis = new rdr::FdInStream(fd);
+    fos = new rdr::FdOutStream(fd);
+    is = new rdr::TLSInStream(fis, session);
+    os = new rdr::TLSOutStream(fos, session);
+
+    this->server = server;
+  }
+
+  ~Endpoint() {
+    delete os;
+    delete is;
+    delete fos;
+    delete fis;
+    gnutls_deinit(session);
+    if (server)
+      gnutls_psk_free_server_credentials(serverCred);
+    else
+      gnutls_psk_free_client_credentials(clientCred);
+    close(fd);
+  }
+
+  int fd;
+  bool server;
+  gnutls_session_t session;
+  gnutls_psk_server_credentials_t serverCred;
+  gnutls_psk_client_credentials_t clientCred;
+  rdr::FdInStream* fis;
+  rdr::FdOutStream* fos;
+  rdr::TLSInStream* is;
+  rdr::TLSOutStream* os;
+};
+
+// The kernel only does TLS for TCP, so talk over loopback
+struct Connection {
+  Connection(const char* priority) {
+    struct sockaddr_in addr;
+    socklen_t addrlen;
+    int listener, fd, peer;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0)
+      throw rdr::SystemException("socket", errno);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    addrlen = sizeof(addr);
+    if ((bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+        (getsockname(listener, (struct sockaddr*)&addr, &addrlen) < 0) ||
+        (listen(listener, 1) < 0))
+      throw rdr::SystemException("listen", errno);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+      throw rdr::SystemException("socket", errno);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+      throw rdr::SystemException("connect", errno);
+
+    peer = accept(listener, NULL, NULL);
+    if (peer < 0)
+      throw rdr::SystemException("accept", errno);
+
+    close(listener);
+
+    server = new Endpoint(peer, true);
+    client = new Endpoint(fd, false);
+
+    gnutls_priority_set_direct(server->session, priority, NULL);
+    gnutls_priority_set_direct(client->session, priority, NULL);
+  }
+
+  ~Connection() {
+    delete client;
+    delete server;
+  }
+
+  // Both ends are non-blocking, so take turns until both are done
+  bool handshake() {
+    bool serverDone, clientDone;
+
+    serverDone = clientDone = false;
+    for (int i = 0; i < 10000; i++) {
+      int ret;
+
+      if (!serverDone) {
+        ret = gnutls_handshake(server->session);
+        if (ret == GNUTLS_E_SUCCESS)
+          serverDone = true;
+        else if (gnutls_error_is_fatal(ret))
+          return false;
+      }
+
+      if (!clientDone) {
+        ret = gnutls_handshake(client->session);
+        if (ret == GNUTLS_E_SUCCESS)
+          clientDone = true;
+        else if (gnutls_error_is_fatal(ret))
+          return false;
+      }
+
+      if (serverDone && clientDone)
+        return true;
+
+      usleep(100);
+    }
+
+    return false;
+  }
+
+  // Everything the client can decrypt so far
+  std::string received() {
+    std::string data;
+
+    while (client->is->hasData(1)) {
+      size_t n;
+
+      n = client->is->avail();
+      data.append((const char*)client->is->getptr(n), n);
+      client->is->setptr(n);
+    }
+
+    return data;
+  }
+
+  // Sends the data from the server, either through TLS or straight to
+  // the socket if the kernel does the encryption, and returns what
+  // the client got
+  std::string transfer(const std::string& data) {
+    rdr::OutStream* os;
+    std::string got;
+
+    if (server->os->isOffloaded())
+      os = server->fos;
+    else
+      os = server->os;
+
+    for (size_t i = 0; i < data.size(); ) {
+      size_t len;
+
+      len = 1000 + i % 7000;
+      if (len > data.size() - i)
+        len = data.size() - i;
+
+      os->writeBytes(data.data() + i, len);
+      os->flush();
+      i += len;
+
+      got += received();
+    }
+
+    for (int i = 0; i < 10000; i++) {
+      if (!server->fos->hasBufferedData() && (got.size() >= data.size()))
+        break;
+      os->flush();
+      got += received();
+      usleep(100);
+    }
+
+    return got;
+  }
+
+  Endpoint* server;
+  Endpoint* client;
+};
+
+static bool kernelTLS;
+
+static std::string makeData(size_t length)
+{
+  std::string data;
+
+  for (size_t i = 0; i < length; i++)
+    data += (char)(i * 7 + i / 251);
+
+  return data;
+}
+
+static bool testDefault()
+{
+  return !rfb::Security::TLSOffload;
+}
+
+static bool testNoSocket()
+{
+  gnutls_session_t session;
+  rdr::MemOutStream ms;
+  bool ret;
+
+  gnutls_init(&session, GNUTLS_SERVER);
+
+  {
+    rdr::TLSOutStream os(&ms, session);
+    ret = !os.offload() && !os.isOffloaded();
+  }
+
+  gnutls_deinit(session);
+
+  return ret;
+}
+
+static bool testPending()
+{
+  Connection conn(tls12);
+  std::string data;
+
+  if (!conn.handshake())
+    return false;
+
+  data = makeData(100000);
+
+  // Data that GnuTLS hasn't seen yet would be lost
+  conn.server->os->writeBytes(data.data(), 1000);
+  if (conn.server->os->offload())
+    return false;
+
+  if (conn.transfer(data.substr(1000)) != data)
+    return false;
+
+  return true;
+}
+
+static bool testTLS13()
+{
+  Connection conn(tls13);
+  std::string data;
+
+  if (!conn.handshake())
+    return false;
+  if (gnutls_protocol_get_version(conn.server->session) != GNUTLS_TLS1_3)
+    return false;
+
+  if (conn.server->os->offload() || conn.server->os->isOffloaded())
+    return false;
+
+  data = makeData(1000000);
+  if (conn.transfer(data) != data)
+    return false;
+
+  return true;
+}
+
+static bool testTLS12()
+{
+  Connection conn(tls12);
+  std::string data;
+  char buffer[16];
+
+  if (!conn.handshake())
+    return false;
+  if (gnutls_protocol_get_version(conn.server->session) != GNUTLS_TLS1_2)
+    return false;
+
+  // May or may not be possible, but either way the data must arrive
+  if (conn.server->os->offload() != kernelTLS)
+    return false;
+  if (conn.server->os->isOffloaded() != kernelTLS)
+    return false;
+
+  data = makeData(1000000);
+  if (conn.transfer(data) != data)
+    return false;
+
+  if (!kernelTLS)
+    return true;
+
+  // The client should see an orderly end of the session
+  conn.server->os->sendCloseNotify();
+  for (int i = 0; i < 10000; i++) {
+    int ret;
+
+    ret = gnutls_record_recv(conn.client->session, buffer, sizeof(buffer));
+    if (ret == 0)
+      return true;
+    if (ret != GNUTLS_E_AGAIN)
+      return false;
+
+    usleep(100);
+  }
+
+  return false;
+}
+
+struct TestEntry tests[] = {
+  {"Disabled by default", testDefault},
+  {"Not a socket", testNoSocket},
+  {"Pending data", testPending},
+  {"TLS 1.3", testTLS13},
+  {"TLS 1.2", testTLS12},
+};
+
+int main(int argc, char** argv)
+{
+  size_t i;
+  int failures;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  gnutls_global_init();
+
+  {
+    Connection conn(tls12);
+    if (!conn.handshake()) {
+      fprintf(stderr, "TLS handshake failed\n");
+      return 1;
+    }
+    kernelTLS = conn.server->os->offload();
+  }
+
+  printf("TLS Offload Test\n");
+  printf("\n");
+  printf("Kernel TLS: %s\n", kernelTLS ? "yes" : "no");
+  printf("\n");
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn()) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  gnutls_global_deinit();
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,509 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include <rdr/Exception.h>
+#include <rdr/MemOutStream.h>
+#include <rdr/WebSocketInStream.h>
+#include <rdr/WebSocketOutStream.h>
+#include <rdr/base64.h>
+#include <rdr/sha1.h>
+
+// Gives out only what has been fed to it so far, like a socket would
+class FeedInStream : public rdr::InStream {
+public:
+  FeedInStream() : offset(0) { ptr = end = NULL; }
+
+  void feed(const std::string& data) { pending += data; }
+
+  virtual size_t pos() { return offset + ptr - (const rdr::U8*)buffer.data(); }
+
+private:
+  virtual bool overrun(size_t needed) {
+    std::string left;
+
+    if (ptr != NULL) {
+      offset += ptr - (const rdr::U8*)buffer.data();
+      left.assign((const char*)ptr, end - ptr);
+    }
+    buffer = left + pending;
+    pending.clear();
+
+    ptr = (const rdr::U8*)buffer.data();
+    end = ptr + buffer.size();
+
+    return buffer.size() >= needed;
+  }
+
+  size_t offset;
+  std::string buffer;
+  std::string pending;
+};
+
+struct Connection {
+  Connection() : wsos(&out), wsis(&in, &out, &wsos) {}
+
+  FeedInStream in;
+  rdr::MemOutStream out;
+  rdr::WebSocketOutStream wsos;
+  rdr::WebSocketInStream wsis;
+
+  std::string sent() {
+    std::string data((const char*)out.data(), out.length());
+    out.clear();
+    return data;
+  }
+};
+
+static const char* request =
+  "GET /chat HTTP/1.1\r\n"
+  "Host: server.example.com\r\n"
+  "Upgrade: websocket\r\n"
+  "Connection: Upgrade\r\n"
+  "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+  "Origin: http://example.com\r\n"
+  "Sec-WebSocket-Version: 13\r\n"
+  "\r\n";
+
+// A frame as a client sends it, i.e. masked
+static std::string clientFrame(rdr::U8 first, const std::string& payload,
+                               bool masked=true)
+{
+  static const rdr::U8 mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+  std::string frame;
+
+  frame += (char)first;
+  if (payload.size() < 126) {
+    frame += (char)((masked ? 0x80 : 0) | payload.size());
+  } else if (payload.size() < 65536) {
+    frame += (char)((masked ? 0x80 : 0) | 126);
+    frame += (char)(payload.size() >> 8);
+    frame += (char)payload.size();
+  } else {
+    frame += (char)((masked ? 0x80 : 0) | 127);
+    for (int i = 7; i >= 0; i--)
+      frame += (char)((rdr::U64)payload.size() >> (i * 8));
+  }
+
+  if (masked)
+    frame.append((const char*)mask, 4);
+
+  for (size_t i = 0; i < payload.size(); i++)
+    frame += (char)(payload[i] ^ (masked ? mask[i & 3] : 0));
+
+  return frame;
+}
+
+// A frame as the server sends it, i.e. not masked
+static std::string serverFrame(rdr::U8 opcode, const std::string& payload)
+{
+  std::string frame;
+
+  frame = clientFrame(0x80 | opcode, payload, false);
+
+  return frame;
+}
+
+static std::string readAll(rdr::InStream* is)
+{
+  std::string data;
+
+  while (is->hasData(1)) {
+    size_t n = is->avail();
+    data.append((const char*)is->getptr(n), n);
+    is->setptr(n);
+  }
+
+  return data;
+}
+
+static bool testSHA1()
+{
+  static const struct {
+    const char* data;
+    const char* digest;
+  } tests[] = {
+    { "", "da39a3ee5e6b4b0d3255bfef95601890afd80709" },
+    { "abc", "a9993e364706816aba3e25717850c26c9cd0d89d" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+      "84983e441c3bd26ebaae4aa1f95129e5e54670f1" },
+  };
+
+  for (size_t i = 0; i < sizeof(tests)/sizeof(*tests); i++) {
+    rdr::U8 digest[rdr::SHA1DigestSize];
+    char hex[rdr::SHA1DigestSize * 2 + 1];
+
+    rdr::sha1((const rdr::U8*)tests[i].data, strlen(tests[i].data), digest);
+    for (size_t j = 0; j < sizeof(digest); j++)
+      sprintf(hex + j * 2, "%02x", digest[j]);
+
+    if (strcmp(hex, tests[i].digest) != 0)
+      return false;
+  }
+
+  // Long enough to need many blocks
+  std::string million(1000000, 'a');
+  rdr::U8 digest[rdr::SHA1DigestSize];
+  static const rdr::U8 expected[] = {
+    0x34, 0xaa, 0x97, 0x3c, 0xd4, 0xc4, 0xda, 0xa4, 0xf6, 0x1e,
+    0xeb, 0x2b, 0xdb, 0xad, 0x27, 0x31, 0x65, 0x34, 0x01, 0x6f,
+  };
+
+  rdr::sha1((const rdr::U8*)million.data(), million.size(), digest);
+  if (memcmp(digest, expected, sizeof(digest)) != 0)
+    return false;
+
+  return true;
+}
+
+static bool testBase64()
+{
+  static const struct {
+    const char* data;
+    const char* encoded;
+  } tests[] = {
+    { "", "" },
+    { "f", "Zg==" },
+    { "fo", "Zm8=" },
+    { "foo", "Zm9v" },
+    { "foob", "Zm9vYg==" },
+    { "fooba", "Zm9vYmE=" },
+    { "foobar", "Zm9vYmFy" },
+  };
+
+  for (size_t i = 0; i < sizeof(tests)/sizeof(*tests); i++) {
+    if (rdr::base64((const rdr::U8*)tests[i].data,
+                    strlen(tests[i].data)) != tests[i].encoded) {
+      return false;
+    }
+  }
+
+  // Make sure all bits end up in the right place
+  const rdr::U8 high[] = { 0xfb, 0xff, 0xbf };
+  if (rdr::base64(high, sizeof(high)) != "+/+/")
+    return false;
+
+  return true;
+}
+
+static bool testHandshake()
+{
+  Connection conn;
+  std::string response;
+
+  // Data sent early must be held back until the client is ready
+  conn.wsos.writeBytes("early", 5);
+  conn.wsos.flush();
+  if (!conn.sent().empty())
+    return false;
+
+  // The request might arrive in pieces
+  conn.in.feed(std::string(request, 40));
+  if (conn.wsis.hasData(1))
+    return false;
+  if (!conn.sent().empty())
+    return false;
+
+  conn.in.feed(request + 40);
+  if (conn.wsis.hasData(1))
+    return false;
+
+  response = conn.sent();
+  if (response.compare(0, 13, "HTTP/1.1 101 ") != 0)
+    return false;
+  // Example from RFC 6455
+  if (response.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") ==
+      std::string::npos) {
+    return false;
+  }
+  if (response.find("Sec-WebSocket-Protocol") != std::string::npos)
+    return false;
+
+  // Anything held back follows right after the response
+  if (response.substr(response.find("\r\n\r\n") + 4) !=
+      serverFrame(0x2, "early")) {
+    return false;
+  }
+
+  return true;
+}
+
+static bool testBadHandshake()
+{
+  Connection conn;
+  std::string bad;
+
+  bad = request;
+  bad.replace(bad.find("13\r\n"), 2, "8");
+
+  conn.in.feed(bad);
+  try {
+    conn.wsis.hasData(1);
+    return false;
+  } catch (rdr::Exception&) {
+  }
+
+  if (conn.sent().compare(0, 13, "HTTP/1.1 400 ") != 0)
+    return false;
+
+  return true;
+}
+
+static bool testOrigin()
+{
+  {
+    Connection conn;
+
+    conn.wsis.setAllowedOrigins("https://other.example.com, HTTP://EXAMPLE.COM");
+    conn.in.feed(request);
+    conn.wsis.hasData(1);
+
+    if (conn.sent().compare(0, 13, "HTTP/1.1 101 ") != 0)
+      return false;
+  }
+
+  {
+    Connection conn;
+
+    conn.wsis.setAllowedOrigins("https://other.example.com");
+    conn.in.feed(request);
+    try {
+      conn.wsis.hasData(1);
+      return false;
+    } catch (rdr::Exception&) {
+    }
+
+    if (conn.sent().compare(0, 13, "HTTP/1.1 403 ") != 0)
+      return false;
+  }
+
+  {
+    Connection conn;
+    std::string noOrigin;
+
+    noOrigin = request;
+    noOrigin.erase(noOrigin.find("Origin:"),
+                   strlen("Origin: http://example.com\r\n"));
+
+    conn.wsis.setAllowedOrigins("https://other.example.com");
+    conn.in.feed(noOrigin);
+    conn.wsis.hasData(1);
+
+    if (conn.sent().compare(0, 13, "HTTP/1.1 101 ") != 0)
+      return false;
+  }
+
+  return true;
+}
+
+static bool testFrames()
+{
+  Connection conn;
+  std::string big, data;
+
+  conn.in.feed(request);
+  conn.wsis.hasData(1);
+  conn.sent();
+
+  // Simple masked frame, fed one byte at a time
+  std::string frame = clientFrame(0x82, "hello");
+  for (size_t i = 0; i < frame.size(); i++) {
+    conn.in.feed(frame.substr(i, 1));
+    data += readAll(&conn.wsis);
+  }
+  if (data != "hello")
+    return false;
+
+  // Fragmented message, with a ping in the middle
+  conn.in.feed(clientFrame(0x02, "frag"));
+  conn.in.feed(clientFrame(0x89, "ping"));
+  conn.in.feed(clientFrame(0x00, "men"));
+  conn.in.feed(clientFrame(0x80, "ted"));
+  if (readAll(&conn.wsis) != "fragmented")
+    return false;
+  if (conn.sent() != serverFrame(0xa, "ping"))
+    return false;
+
+  // Unsolicited pongs are ignored
+  conn.in.feed(clientFrame(0x8a, "pong"));
+  conn.in.feed(clientFrame(0x82, "x"));
+  if ((readAll(&conn.wsis) != "x") || !conn.sent().empty())
+    return false;
+
+  // Both extended length forms
+  for (size_t i = 0; i < 300; i++)
+    big += (char)i;
+  conn.in.feed(clientFrame(0x82, big));
+  if (readAll(&conn.wsis) != big)
+    return false;
+
+  big.clear();
+  for (size_t i = 0; i < 100000; i++)
+    big += (char)(i * 7);
+  conn.in.feed(clientFrame(0x82, big));
+  if (readAll(&conn.wsis) != big)
+    return false;
+
+  // Close is echoed and ends the stream
+  conn.in.feed(clientFrame(0x88, std::string("\x03\xe8" "bye", 5)));
+  try {
+    readAll(&conn.wsis);
+    return false;
+  } catch (rdr::EndOfStream&) {
+  }
+  if (conn.sent() != serverFrame(0x8, std::string("\x03\xe8", 2)))
+    return false;
+
+  return true;
+}
+
+static bool rejects(const std::string& frame)
+{
+  Connection conn;
+
+  conn.in.feed(request);
+  conn.wsis.hasData(1);
+
+  conn.in.feed(frame);
+  try {
+    readAll(&conn.wsis);
+  } catch (rdr::EndOfStream&) {
+    return false;
+  } catch (rdr::Exception&) {
+    return true;
+  }
+
+  return false;
+}
+
+static bool testBadFrames()
+{
+  std::string oversized;
+
+  if (!rejects(clientFrame(0x82, "data", false)))
+    return false;
+  if (!rejects(clientFrame(0x81, "text")))
+    return false;
+  if (!rejects(clientFrame(0xc2, "data")))
+    return false;
+  if (!rejects(clientFrame(0x09, "ping")))
+    return false;
+  if (!rejects(clientFrame(0x89, std::string(126, 'x'))))
+    return false;
+  if (!rejects(clientFrame(0x8b, "ctl")))
+    return false;
+
+  // Lengths with the top bit set are invalid
+  oversized = "\x82\xff";
+  oversized += std::string("\x80\x00\x00\x00\x00\x00\x00\x01", 8);
+  oversized += std::string("\x00\x00\x00\x00", 4);
+  if (!rejects(oversized))
+    return false;
+
+  return true;
+}
+
+static bool testOutput()
+{
+  Connection conn;
+  std::string big, expected;
+
+  conn.in.feed(request);
+  conn.wsis.hasData(1);
+  conn.sent();
+
+  conn.wsos.writeBytes("data", 4);
+  conn.wsos.flush();
+  if (conn.sent() != serverFrame(0x2, "data"))
+    return false;
+
+  // Small writes are held back whilst corked
+  conn.wsos.cork(true);
+  conn.wsos.writeBytes("abc", 3);
+  conn.wsos.flush();
+  if (!conn.sent().empty() || !conn.wsos.hasBufferedData())
+    return false;
+  conn.wsos.writeBytes("def", 3);
+  conn.wsos.cork(false);
+  if ((conn.sent() != serverFrame(0x2, "abcdef")) ||
+      conn.wsos.hasBufferedData()) {
+    return false;
+  }
+
+  // Larger than the buffer, so split in to several frames
+  for (size_t i = 0; i < 40000; i++)
+    big += (char)(i * 3);
+  conn.wsos.writeBytes(big.data(), big.size());
+  conn.wsos.flush();
+  expected = serverFrame(0x2, big.substr(0, 16384)) +
+             serverFrame(0x2, big.substr(16384, 16384)) +
+             serverFrame(0x2, big.substr(32768));
+  if (conn.sent() != expected)
+    return false;
+
+  if (conn.wsos.length() != 4 + 6 + big.size())
+    return false;
+
+  return true;
+}
+
+typedef bool (*testfn) ();
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+struct TestEntry tests[] = {
+  {"SHA-1", testSHA1},
+  {"Base64", testBase64},
+  {"Handshake", testHandshake},
+  {"Bad handshake", testBadHandshake},
+  {"Origin", testOrigin},
+  {"Frames", testFrames},
+  {"Bad frames", testBadFrames},
+  {"Output", testOutput},
+};
+
+int main(int argc, char** argv)
+{
+  size_t i;
+  int failures;
+
+  printf("WebSocket Test\n");
+  printf("\n");
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn()) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  return failures ? 1 : 0;
+}
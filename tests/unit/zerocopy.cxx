@@ -0,0 +1,349 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#include <string>
+
+#include <rdr/Exception.h>
+#include <rdr/FdOutStream.h>
+#include <rdr/MemOutStream.h>
+
+typedef bool (*testfn) ();
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+// Zero copy is only supported for TCP, so talk over loopback
+struct Connection {
+  Connection() : os(NULL) {
+    struct sockaddr_in addr;
+    socklen_t addrlen;
+    int listener, fd;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0)
+      throw rdr::SystemException("socket", errno);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    addrlen = sizeof(addr);
+    if ((bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+        (getsockname(listener, (struct sockaddr*)&addr, &addrlen) < 0) ||
+        (listen(listener, 1) < 0))
+      throw rdr::SystemException("listen", errno);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+      throw rdr::SystemException("socket", errno);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+      throw rdr::SystemException("connect", errno);
+
+    peer = accept(listener, NULL, NULL);
+    if (peer < 0)
+      throw rdr::SystemException("accept", errno);
+
+    close(listener);
+
+    os = new rdr::FdOutStream(fd);
+  }
+
+  ~Connection() {
+    int fd;
+
+    fd = os->getFd();
+    delete os;
+    close(fd);
+    close(peer);
+  }
+
+  // Everything the other end has got so far
+  std::string received() {
+    std::string data;
+    char buffer[65536];
+    ssize_t len;
+
+    while ((len = recv(peer, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+      data.append(buffer, len);
+
+    return data;
+  }
+
+  // Keeps sending and reading until everything has arrived
+  std::string drain(std::string got, size_t length) {
+    while (os->hasBufferedData() || (got.size() < length)) {
+      struct pollfd pfds[2];
+
+      os->flush();
+      got += received();
+
+      if (!os->hasBufferedData() && (got.size() >= length))
+        break;
+
+      pfds[0].fd = peer;
+      pfds[0].events = POLLIN;
+      pfds[1].fd = os->getFd();
+      pfds[1].events = os->hasBufferedData() ? POLLOUT : 0;
+      if (poll(pfds, 2, 1000) <= 0)
+        break;
+    }
+
+    return got;
+  }
+
+  rdr::FdOutStream* os;
+  int peer;
+};
+
+static bool zeroCopySupported;
+
+static std::string makeData(size_t length, int seed)
+{
+  std::string data;
+
+  for (size_t i = 0; i < length; i++)
+    data += (char)(i * 7 + i / 251 + seed);
+
+  return data;
+}
+
+// Large writes are handed over from a memory stream, which is how
+// encoders get their output adopted
+static void writeLarge(rdr::OutStream* os, const std::string& data)
+{
+  rdr::MemOutStream ms;
+
+  ms.writeBytes(data.data(), data.size());
+  ms.writeTo(os);
+}
+
+static bool testUnsupported()
+{
+  int fds[2];
+  bool ret;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    throw rdr::SystemException("socketpair", errno);
+
+  {
+    rdr::FdOutStream os(fds[0]);
+    ret = !os.enableZeroCopy();
+  }
+
+  close(fds[0]);
+  close(fds[1]);
+
+  return ret;
+}
+
+static bool testIntegrity()
+{
+  Connection conn;
+  std::string expected, got, data;
+
+  if (conn.os->enableZeroCopy() != zeroCopySupported)
+    return false;
+
+  srand(1);
+
+  for (int i = 0; i < 500; i++) {
+    if (rand() % 3 == 0) {
+      data = makeData(rand() % 100000, i);
+      writeLarge(conn.os, data);
+    } else {
+      data = makeData(rand() % 50, i);
+      conn.os->writeBytes(data.data(), data.size());
+    }
+    expected += data;
+
+    if (conn.os->length() != expected.size())
+      return false;
+
+    if (rand() % 4 == 0)
+      conn.os->flush();
+    if (rand() % 8 == 0)
+      got += conn.received();
+  }
+
+  got = conn.drain(got, expected.size());
+
+  conn.os->waitZeroCopy(1000);
+
+  return got == expected;
+}
+
+static bool testSlowReader()
+{
+  Connection conn;
+  std::string expected, got, data;
+
+  conn.os->enableZeroCopy();
+
+  // Far more than the socket can hold, so the adopted buffers only
+  // go out in pieces
+  for (int i = 0; i < 20; i++) {
+    data = makeData(1000000, i);
+    writeLarge(conn.os, data);
+    expected += data;
+    conn.os->flush();
+  }
+
+  got = conn.drain(got, expected.size());
+
+  conn.os->waitZeroCopy(1000);
+
+  return got == expected;
+}
+
+static bool testWait()
+{
+  Connection conn;
+  std::string expected, got, data;
+  struct timeval start, end;
+  int elapsed;
+
+  conn.os->enableZeroCopy();
+
+  for (int i = 0; i < 10; i++) {
+    data = makeData(200000, i);
+    writeLarge(conn.os, data);
+    expected += data;
+  }
+
+  got = conn.drain(got, expected.size());
+  if (got != expected)
+    return false;
+
+  // Everything has been received, so the kernel has no reason to hold
+  // on to the buffers for long
+  gettimeofday(&start, NULL);
+  conn.os->waitZeroCopy(5000);
+  gettimeofday(&end, NULL);
+
+  elapsed = (end.tv_sec - start.tv_sec) * 1000 +
+            (end.tv_usec - start.tv_usec) / 1000;
+
+  return elapsed < 1000;
+}
+
+static bool testDisable()
+{
+  Connection conn;
+  std::string expected, got, data;
+
+  conn.os->enableZeroCopy();
+
+  data = makeData(500000, 0);
+  writeLarge(conn.os, data);
+  expected += data;
+  conn.os->flush();
+
+  // Some buffers may still be in flight when switching
+  conn.os->disableZeroCopy();
+
+  for (int i = 1; i < 5; i++) {
+    data = makeData(500000, i);
+    writeLarge(conn.os, data);
+    expected += data;
+    conn.os->flush();
+    got += conn.received();
+  }
+
+  got = conn.drain(got, expected.size());
+
+  conn.os->waitZeroCopy(1000);
+
+  return got == expected;
+}
+
+static bool testPending()
+{
+  Connection conn;
+
+  conn.os->enableZeroCopy();
+
+  writeLarge(conn.os, makeData(20000000, 0));
+  conn.os->flush();
+
+  // Let some of it through, so that the kernel is done with part of
+  // the buffer whilst the rest is still queued up with us when the
+  // stream goes away
+  for (int i = 0; i < 3; i++) {
+    conn.received();
+    conn.os->flush();
+  }
+
+  if (!conn.os->hasBufferedData())
+    return false;
+
+  return true;
+}
+
+struct TestEntry tests[] = {
+  {"Unsupported socket", testUnsupported},
+  {"Data integrity", testIntegrity},
+  {"Slow reader", testSlowReader},
+  {"Wait for completions", testWait},
+  {"Disabled midway", testDisable},
+  {"Destroyed with pending data", testPending},
+};
+
+int main(int argc, char** argv)
+{
+  size_t i;
+  int failures;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  {
+    Connection conn;
+    zeroCopySupported = conn.os->enableZeroCopy();
+  }
+
+  printf("Zero Copy Test\n");
+  printf("\n");
+  printf("Zero copy: %s\n", zeroCopySupported ? "yes" : "no");
+  printf("\n");
+
+  failures = 0;
+  for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
+    printf("    %s: ", tests[i].label);
+    fflush(stdout);
+    if (tests[i].fn()) {
+      printf("OK");
+    } else {
+      printf("FAILED");
+      failures++;
+    }
+    printf("\n");
+  }
+
+  return failures ? 1 : 0;
+}
@@ -20,6 +20,8 @@
 // FIXME: Check cases when screen width/height is not a multiply of 32.
 //        e.g. 800x600.
 
+#include <map>
+
 #include <strings.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -30,8 +32,11 @@
 #include <rfb/VNCServerST.h>
 #include <rfb/Configuration.h>
 #include <rfb/Timer.h>
+#include <network/EventLoop.h>
+#include <network/QuicSocket.h>
 #include <network/TcpSocket.h>
 #include <network/UnixSocket.h>
+#include <network/WebSocket.h>
 
 #include <signal.h>
 #include <X11/X.h>
@@ -63,6 +68,10 @@ StringParameter hostsFile("HostsFile", "File with IP access control rules", "");
 BoolParameter localhostOnly("localhost",
                             "Only allow connections from localhost",
                             false);
+BoolParameter quic("quic", "Also listen for QUIC connections on the UDP "
+                   "port with the same number as rfbport", false);
+IntParameter websocketPort("websocketPort", "TCP port to listen for RFB "
+                           "protocol wrapped in WebSockets (0 = off)", 0);
 
 //
 // Allow the main loop terminate itself gracefully on receiving a signal.
@@ -175,6 +184,112 @@ private:
 
 };
 
+
+//
+// Feeds activity from the event loop to the VNC server, and keeps the
+// loop in sync with the server's list of connections.
+//
+
+class ServerEventHandler : public EventLoop::Handler
+{
+
+public:
+
+  ServerEventHandler(EventLoop* loop_, VNCServerST* server_)
+    : loop(loop_), server(server_)
+  {
+  }
+
+  void addListener(SocketListener* listener)
+  {
+    listeners[listener->getFd()] = listener;
+    loop->addFd(listener->getFd(), EventLoop::EventRead, this);
+  }
+
+  // Drop closed connections and update which events we need for the
+  // others. Returns the number of active connections.
+  int update()
+  {
+    std::list<Socket*> sockets;
+    std::list<Socket*>::iterator i;
+    std::map<int, Socket*> active;
+    std::map<int, Socket*>::iterator j;
+
+    server->getSockets(&sockets);
+    for (i = sockets.begin(); i != sockets.end(); i++) {
+      int fd, events;
+
+      fd = (*i)->getFd();
+
+      if ((*i)->isShutdown()) {
+        loop->removeFd(fd);
+        this->sockets.erase(fd);
+        server->removeSocket(*i);
+        delete (*i);
+        continue;
+      }
+
+      events = EventLoop::EventRead;
+      if ((*i)->hasBufferedData())
+        events |= EventLoop::EventWrite;
+
+      if (this->sockets.find(fd) == this->sockets.end())
+        loop->addFd(fd, events, this);
+      else
+        loop->setEvents(fd, events);
+
+      active[fd] = *i;
+    }
+
+    // Forget about anything the server has let go of by itself
+    for (j = this->sockets.begin(); j != this->sockets.end(); j++) {
+      if (active.find(j->first) == active.end())
+        loop->removeFd(j->first);
+    }
+
+    this->sockets.swap(active);
+
+    return this->sockets.size();
+  }
+
+  virtual void handleEvent(int fd, int events)
+  {
+    std::map<int, SocketListener*>::iterator listener;
+    std::map<int, Socket*>::iterator sock;
+
+    // Accept new VNC connections
+    listener = listeners.find(fd);
+    if (listener != listeners.end()) {
+      Socket* sock = listener->second->accept();
+      if (sock) {
+        server->addSocket(sock);
+      } else {
+        vlog.status("Client connection rejected");
+      }
+      return;
+    }
+
+    // Process events on existing VNC connections
+    sock = sockets.find(fd);
+    if (sock == sockets.end())
+      return;
+
+    // Reading is what notices that the connection is gone
+    if (events & (EventLoop::EventRead | EventLoop::EventError))
+      server->processSocketReadEvent(sock->second);
+    if (events & EventLoop::EventWrite)
+      server->processSocketWriteEvent(sock->second);
+  }
+
+private:
+
+  EventLoop* loop;
+  VNCServerST* server;
+
+  std::map<int, SocketListener*> listeners;
+  std::map<int, Socket*> sockets;
+};
+
 char* programName;
 
 static void printVersion(FILE *fp)
@@ -269,6 +384,20 @@ int main(int argc, char** argv)
       else
         createTcpListeners(&listeners, 0, (int)rfbport);
       vlog.info("Listening on port %d", (int)rfbport);
+
+      if (quic) {
+        createQuicListeners(&listeners, localhostOnly ? "localhost" : 0,
+                            (int)rfbport);
+        vlog.info("Listening for QUIC on port %d", (int)rfbport);
+      }
+    }
+
+    if ((int)websocketPort != 0) {
+      if (localhostOnly)
+        createLocalWebSocketListeners(&listeners, (int)websocketPort);
+      else
+        createWebSocketListeners(&listeners, 0, (int)websocketPort);
+      vlog.info("Listening for WebSockets on port %d", (int)websocketPort);
     }
 
     const char *hostsData = hostsFile.getData();
@@ -282,40 +411,25 @@ int main(int argc, char** argv)
 
     PollingScheduler sched((int)pollingCycle, (int)maxProcessorUsage);
 
+    EventLoop loop;
+    ServerEventHandler handler(&loop, &server);
+
+    // X events are processed at the start of every iteration, so we
+    // only need to get woken up
+    loop.addFd(ConnectionNumber(dpy), EventLoop::EventRead, &handler);
+
+    for (std::list<SocketListener*>::iterator i = listeners.begin();
+         i != listeners.end();
+         i++)
+      handler.addListener(*i);
+
     while (!caughtSignal) {
       int wait_ms;
-      struct timeval tv;
-      fd_set rfds, wfds;
-      std::list<Socket*> sockets;
-      std::list<Socket*>::iterator i;
 
       // Process any incoming X events
       TXWindow::handleXEvents(dpy);
 
-      FD_ZERO(&rfds);
-      FD_ZERO(&wfds);
-
-      FD_SET(ConnectionNumber(dpy), &rfds);
-      for (std::list<SocketListener*>::iterator i = listeners.begin();
-           i != listeners.end();
-           i++)
-        FD_SET((*i)->getFd(), &rfds);
-
-      server.getSockets(&sockets);
-      int clients_connected = 0;
-      for (i = sockets.begin(); i != sockets.end(); i++) {
-        if ((*i)->isShutdown()) {
-          server.removeSocket(*i);
-          delete (*i);
-        } else {
-          FD_SET((*i)->getFd(), &rfds);
-          if ((*i)->outStream().hasBufferedData())
-            FD_SET((*i)->getFd(), &wfds);
-          clients_connected++;
-        }
-      }
-
-      if (!clients_connected)
+      if (!handler.update())
         sched.reset();
 
       wait_ms = 0;
@@ -327,57 +441,15 @@ int main(int argc, char** argv)
         }
       }
 
-      soonestTimeout(&wait_ms, Timer::checkTimeouts());
-
-      tv.tv_sec = wait_ms / 1000;
-      tv.tv_usec = (wait_ms % 1000) * 1000;
-
       // Do the wait...
       sched.sleepStarted();
-      int n = select(FD_SETSIZE, &rfds, &wfds, 0,
-                     wait_ms ? &tv : NULL);
+      loop.wait(wait_ms);
       sched.sleepFinished();
 
-      if (n < 0) {
-        if (errno == EINTR) {
-          vlog.debug("Interrupted select() system call");
-          continue;
-        } else {
-          throw rdr::SystemException("select", errno);
-        }
-      }
-
-      // Accept new VNC connections
-      for (std::list<SocketListener*>::iterator i = listeners.begin();
-           i != listeners.end();
-           i++) {
-        if (FD_ISSET((*i)->getFd(), &rfds)) {
-          Socket* sock = (*i)->accept();
-          if (sock) {
-            server.addSocket(sock);
-          } else {
-            vlog.status("Client connection rejected");
-          }
-        }
-      }
+      loop.dispatch();
 
       Timer::checkTimeouts();
 
-      // Client list could have been changed.
-      server.getSockets(&sockets);
-
-      // Nothing more to do if there are no client connections.
-      if (sockets.empty())
-        continue;
-
-      // Process events on existing VNC connections
-      for (i = sockets.begin(); i != sockets.end(); i++) {
-        if (FD_ISSET((*i)->getFd(), &rfds))
-          server.processSocketReadEvent(*i);
-        if (FD_ISSET((*i)->getFd(), &wfds))
-          server.processSocketWriteEvent(*i);
-      }
-
       if (desktop.isRunning() && sched.goodTimeToPoll()) {
         sched.newPass();
         desktop.poll();
@@ -34,6 +34,8 @@
 #include <sys/utsname.h>
 
 #include <network/Socket.h>
+#include <rdr/SendBatch.h>
+#include <rdr/SendThread.h>
 #include <rfb/Exception.h>
 #include <rfb/VNCServerST.h>
 #include <rfb/LogWriter.h>
@@ -66,6 +68,12 @@ IntParameter queryConnectTimeout("QueryConnectTimeout",
                                  "Accept Connection dialog before "
                                  "rejecting the connection",
                                  10);
+BoolParameter batchSend("BatchSend",
+                        "Send data to all clients at once, using io_uring "
+                        "if available", false);
+BoolParameter threadedSend("ThreadedSend",
+                           "Send data to clients from a separate thread",
+                           false);
 
 
 XserverDesktop::XserverDesktop(int screenIndex_,
@@ -74,7 +82,7 @@ XserverDesktop::XserverDesktop(int screenIndex_,
                                int width, int height,
                                void* fbptr, int stride)
   : screenIndex(screenIndex_),
-    server(0), listeners(listeners_),
+    server(0), listeners(listeners_), sendBatch(NULL), sendThread(NULL),
     shadowFramebuffer(NULL),
     queryConnectId(0), queryConnectTimer(this)
 {
@@ -83,6 +91,18 @@ XserverDesktop::XserverDesktop(int screenIndex_,
   server = new VNCServerST(name, this);
   setFramebuffer(width, height, fbptr, stride);
 
+  if (threadedSend) {
+    try {
+      sendThread = new rdr::SendThread();
+      vncSetNotifyFd(sendThread->getNotifyFd(), screenIndex, true, false);
+    } catch (rdr::Exception& e) {
+      vlog.error("Failed to start send thread: %s", e.str());
+    }
+  }
+
+  if (batchSend && (sendThread == NULL))
+    sendBatch = new rdr::SendBatch();
+
   for (std::list<SocketListener*>::iterator i = listeners.begin();
        i != listeners.end();
        i++) {
@@ -99,7 +119,11 @@ XserverDesktop::~XserverDesktop()
   }
   if (shadowFramebuffer)
     delete [] shadowFramebuffer;
+  if (sendThread)
+    vncRemoveNotifyFd(sendThread->getNotifyFd());
   delete server;
+  delete sendBatch;
+  delete sendThread;
 }
 
 void XserverDesktop::blockUpdates()
@@ -291,6 +315,11 @@ void XserverDesktop::add_copied(const rfb::Region &dest, const rfb::Point &delta
 void XserverDesktop::handleSocketEvent(int fd, bool read, bool write)
 {
   try {
+    if (sendThread && (fd == sendThread->getNotifyFd())) {
+      handleSendThreadEvent();
+      return;
+    }
+
     if (read) {
       if (handleListenerEvent(fd, &listeners, server))
         return;
@@ -321,6 +350,10 @@ bool XserverDesktop::handleListenerEvent(int fd,
 
   Socket* sock = (*i)->accept();
   vlog.debug("new client, sock %d", sock->getFd());
+  if (sendThread)
+    sock->outStream().setSendThread(sendThread);
+  else if (sendBatch)
+    sock->outStream().setBatch(sendBatch);
   sockserv->addSocket(sock);
   vncSetNotifyFd(sock->getFd(), screenIndex, true, false);
 
@@ -352,6 +385,20 @@ bool XserverDesktop::handleSocketEvent(int fd,
   return true;
 }
 
+// The send thread has emptied some socket, or failed to. Whichever
+// it is, the connection will deal with it when trying to flush.
+void XserverDesktop::handleSendThreadEvent()
+{
+  std::list<Socket*> sockets;
+  std::list<Socket*>::iterator i;
+
+  sendThread->clearNotify();
+
+  server->getSockets(&sockets);
+  for (i = sockets.begin(); i != sockets.end(); i++)
+    server->processSocketWriteEvent(*i);
+}
+
 void XserverDesktop::blockHandler(int* timeout)
 {
   // We don't have a good callback for when we can init input devices[1],
@@ -363,20 +410,6 @@ void XserverDesktop::blockHandler(int* timeout)
   try {
     std::list<Socket*> sockets;
     std::list<Socket*>::iterator i;
-    server->getSockets(&sockets);
-    for (i = sockets.begin(); i != sockets.end(); i++) {
-      int fd = (*i)->getFd();
-      if ((*i)->isShutdown()) {
-        vlog.debug("client gone, sock %d",fd);
-        vncRemoveNotifyFd(fd);
-        server->removeSocket(*i);
-        vncClientGone(fd);
-        delete (*i);
-      } else {
-        /* Update existing NotifyFD to listen for write (or not) */
-        vncSetNotifyFd(fd, screenIndex, true, (*i)->outStream().hasBufferedData());
-      }
-    }
 
     // We are responsible for propagating mouse movement between clients
     int cursorX, cursorY;
@@ -393,6 +426,26 @@ void XserverDesktop::blockHandler(int* timeout)
     int nextTimeout = Timer::checkTimeouts();
     if (nextTimeout > 0 && (*timeout == -1 || nextTimeout < *timeout))
       *timeout = nextTimeout;
+
+    // Send everything that was written during this round
+    if (sendBatch)
+      sendBatch->flush();
+
+    server->getSockets(&sockets);
+    for (i = sockets.begin(); i != sockets.end(); i++) {
+      int fd = (*i)->getFd();
+      if ((*i)->isShutdown()) {
+        vlog.debug("client gone, sock %d",fd);
+        vncRemoveNotifyFd(fd);
+        server->removeSocket(*i);
+        vncClientGone(fd);
+        delete (*i);
+      } else {
+        /* Update existing NotifyFD to listen for write (or not) */
+        bool write = !sendThread && (*i)->hasBufferedData();
+        vncSetNotifyFd(fd, screenIndex, true, write);
+      }
+    }
   } catch (rdr::Exception& e) {
     vlog.error("XserverDesktop::blockHandler: %s",e.str());
   }
@@ -401,6 +454,10 @@ void XserverDesktop::blockHandler(int* timeout)
 void XserverDesktop::addClient(Socket* sock, bool reverse)
 {
   vlog.debug("new client, sock %d reverse %d",sock->getFd(),reverse);
+  if (sendThread)
+    sock->outStream().setSendThread(sendThread);
+  else if (sendBatch)
+    sock->outStream().setBatch(sendBatch);
   server->addSocket(sock, reverse);
   vncSetNotifyFd(sock->getFd(), screenIndex, true, false);
 }
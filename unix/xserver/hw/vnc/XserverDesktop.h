@@ -43,6 +43,7 @@ namespace rfb {
 }
 
 namespace network { class SocketListener; class Socket; class SocketServer; }
+namespace rdr { class SendBatch; class SendThread; }
 
 class XserverDesktop : public rfb::SDesktop, public rfb::FullFramePixelBuffer,
                        public rfb::Timer::Callback {
@@ -111,6 +112,7 @@ protected:
   bool handleSocketEvent(int fd,
                          network::SocketServer* sockserv,
                          bool read, bool write);
+  void handleSendThreadEvent();
 
   virtual bool handleTimeout(rfb::Timer* t);
 
@@ -119,6 +121,8 @@ private:
   int screenIndex;
   rfb::VNCServer* server;
   std::list<network::SocketListener*> listeners;
+  rdr::SendBatch* sendBatch;
+  rdr::SendThread* sendThread;
   rdr::U8* shadowFramebuffer;
 
   uint32_t queryConnectId;
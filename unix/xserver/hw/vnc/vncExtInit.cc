@@ -35,6 +35,7 @@
 #include <rfb/ledStates.h>
 #include <network/TcpSocket.h>
 #include <network/UnixSocket.h>
+#include <network/WebSocket.h>
 
 #include "XserverDesktop.h"
 #include "vncExtInit.h"
@@ -74,6 +75,9 @@ typedef std::set<std::string, CaseInsensitiveCompare> ParamSet;
 static ParamSet allowOverrideSet;
 
 rfb::IntParameter rfbport("rfbport", "TCP port to listen for RFB protocol",0);
+rfb::IntParameter websocketPort("websocketPort", "TCP port to listen for "
+                                "RFB protocol wrapped in WebSockets (0 = off)",
+                                0);
 rfb::StringParameter rfbunixpath("rfbunixpath", "Unix socket to listen for RFB protocol", "");
 rfb::IntParameter rfbunixmode("rfbunixmode", "Unix socket access mode", 0600);
 rfb::StringParameter desktopName("desktop", "Name of VNC desktop","x11");
@@ -212,6 +216,22 @@ void vncExtensionInit(void)
                     port);
         }
 
+        if (!inetd && websocketPort != 0) {
+          const char *addr = interface;
+          int port = websocketPort;
+          port += 1000 * scr;
+          if (strcasecmp(addr, "all") == 0)
+            addr = 0;
+          if (localhostOnly)
+            network::createLocalWebSocketListeners(&listeners, port);
+          else
+            network::createWebSocketListeners(&listeners, addr, port);
+
+          vlog.info("Listening for WebSocket connections on %s interface(s), port %d",
+                    localhostOnly ? "local" : (const char*)interface,
+                    port);
+        }
+
         CharArray desktopNameStr(desktopName.getData());
         PixelFormat pf = vncGetPixelFormat(scr);
 
@@ -38,6 +38,7 @@
 #include <rfb/Timer.h>
 #include <network/TcpSocket.h>
 #ifndef WIN32
+#include <network/QuicSocket.h>
 #include <network/UnixSocket.h>
 #endif
 
@@ -97,7 +98,13 @@ CConn::CConn(const char* vncServerName, network::Socket* socket=NULL)
   if(sock == NULL) {
     try {
 #ifndef WIN32
-      if (strchr(vncServerName, '/') != NULL) {
+      if (strncmp(vncServerName, "quic://", 7) == 0) {
+        getHostAndPort(vncServerName + 7, &serverHost, &serverPort);
+
+        sock = new network::QuicSocket(serverHost, serverPort);
+        vlog.info(_("Connected to host %s port %d using QUIC"),
+                  serverHost, serverPort);
+      } else if (strchr(vncServerName, '/') != NULL) {
         sock = new network::UnixSocket(vncServerName);
         serverHost = sock->getPeerAddress();
         vlog.info(_("Connected to socket %s"), serverHost);
@@ -414,7 +421,7 @@ bool CConn::dataRect(const Rect& r, int encoding)
 {
   bool ret;
 
-  if (encoding != encodingCopyRect)
+  if ((encoding != encodingCopyRect) && (encoding != encodingTileCache))
     lastServerEncoding = encoding;
 
   ret = CConnection::dataRect(r, encoding);
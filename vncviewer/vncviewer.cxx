@@ -413,6 +413,10 @@ potentiallyLoadConfigurationFile(char *vncServerName)
 #ifndef WIN32
     struct stat sb;
 
+    // QUIC servers look like an URL
+    if (strncmp(vncServerName, "quic://", 7) == 0)
+      return;
+
     // This might be a UNIX socket, we need to check
     if (stat(vncServerName, &sb) == -1) {
       // Some access problem; let loadViewerParameters() deal with it...
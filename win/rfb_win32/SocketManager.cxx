@@ -172,7 +172,7 @@ int SocketManager::checkTimeouts() {
       shutdownSocks.push_back(j->second.sock);
     else {
       long eventMask = FD_READ | FD_CLOSE;
-      if (j->second.sock->outStream().hasBufferedData())
+      if (j->second.sock->hasBufferedData())
         eventMask |= FD_WRITE;
       if (WSAEventSelect(j->second.sock->getFd(), j->first, eventMask) == SOCKET_ERROR)
         throw rdr::SystemException("unable to adjust WSAEventSelect:%u", WSAGetLastError());
@@ -254,7 +254,7 @@ void SocketManager::processEvent(HANDLE event) {
       // Re-instate the required socket event
       // If the read event is still valid, the event object gets set here
       eventMask = FD_READ | FD_CLOSE;
-      if (ci.sock->outStream().hasBufferedData())
+      if (ci.sock->hasBufferedData())
         eventMask |= FD_WRITE;
       if (WSAEventSelect(ci.sock->getFd(), event, eventMask) == SOCKET_ERROR)
         throw rdr::SystemException("unable to re-enable WSAEventSelect:%u", WSAGetLastError());